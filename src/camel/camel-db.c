@@ -34,6 +34,8 @@
 #include "camel-debug.h"
 #include "camel-folder-search.h"
 #include "camel-object.h"
+#include "camel-operation.h"
+#include "camel-search-private.h"
 #include "camel-string-utils.h"
 
 #include "camel-db.h"
@@ -50,6 +52,7 @@ typedef struct {
 	GRecMutex sync_mutex;
 	guint timeout_id;
 	gint flags;
+	gboolean sync_immediately; /* do not defer syncs, like in the WAL mode */
 
 	/* Do know how many syncs are pending, to not close
 	   the file before the last sync is over */
@@ -317,6 +320,13 @@ camel_sqlite3_file_xSync (sqlite3_file *pFile,
 
 	g_rec_mutex_lock (&cFile->sync_mutex);
 
+	/* The WAL relies on the order of the syncs for its consistency */
+	if (cFile->sync_immediately) {
+		g_rec_mutex_unlock (&cFile->sync_mutex);
+
+		return call_old_file_Sync (cFile, flags);
+	}
+
 	/* If a sync request is already scheduled, accumulate flags. */
 	cFile->flags |= flags;
 
@@ -366,6 +376,7 @@ camel_sqlite3_vfs_xOpen (sqlite3_vfs *pVfs,
 	g_cond_init (&cFile->pending_syncs_cond);
 
 	cFile->pending_syncs = 0;
+	cFile->sync_immediately = (flags & SQLITE_OPEN_WAL) != 0;
 
 	g_rec_mutex_lock (&only_once_lock);
 
@@ -446,6 +457,22 @@ init_sqlite_vfs (void)
 	return NULL;
 }
 
+/* Makes the syncs of the main database file of the 'db' immediate */
+static void
+cdb_set_sync_immediately (sqlite3 *db)
+{
+	sqlite3_file *file = NULL;
+
+	if (sqlite3_file_control (db, "main", SQLITE_FCNTL_FILE_POINTER, &file) == SQLITE_OK &&
+	    file && file->pMethods && file->pMethods->xSync == camel_sqlite3_file_xSync) {
+		CamelSqlite3File *cFile = (CamelSqlite3File *) file;
+
+		g_rec_mutex_lock (&cFile->sync_mutex);
+		cFile->sync_immediately = TRUE;
+		g_rec_mutex_unlock (&cFile->sync_mutex);
+	}
+}
+
 #define d(x) if (camel_debug("sqlite")) x
 #define START(stmt) \
 	if (camel_debug ("dbtime")) { \
@@ -486,6 +513,13 @@ init_sqlite_vfs (void)
 			g_timer_elapsed (cdb->priv->timer, NULL)); \
 	}
 
+enum {
+	CDB_BODY_INDEX_UNKNOWN = 0,
+	CDB_BODY_INDEX_MISSING,
+	CDB_BODY_INDEX_EXISTS,
+	CDB_BODY_INDEX_UNSUPPORTED
+};
+
 struct _CamelDBPrivate {
 	sqlite3 *db;
 	GTimer *timer;
@@ -495,15 +529,66 @@ struct _CamelDBPrivate {
 	GThread *transaction_thread;
 	guint32 transaction_level;
 	gboolean is_foldersdb;
+	GHashTable *mir_stmts; /* gchar *folder_name ~> sqlite3_stmt *; guarded by the writer lock */
+	GHashTable *mif_stmts; /* gchar *folder_name ~> sqlite3_stmt *, flags-only UPDATE; guarded by the writer lock */
+	GHashTable *counted_folders; /* gchar *folder_name, with folder_counts triggers; guarded by the writer lock */
+	gint body_index_state; /* one of CDB_BODY_INDEX_...; guarded by the writer lock */
+
+	/* Read-only connections used by the readers in the WAL mode */
+	gboolean wal_enabled;
+	GMutex readers_lock;
+	GSList *idle_readers; /* CamelDBReader * */
+	guint n_readers; /* the pooled readers, not counting the temporary */
+	GHashTable *collations; /* gchar *collate ~> CamelDBCollate; guarded by the readers_lock */
+	guint collations_stamp;
 };
 
+/* The most read-only connections kept in the pool, in the WAL mode; when all
+   of them are in use, a temporary connection is opened, instead of waiting
+   for one, which could deadlock with the nested reads */
+#define CAMEL_DB_MAX_READERS 4
+
+/* The maintenance steps */
+#define CAMEL_DB_VACUUM_STEP_MSECS 50
+#define CAMEL_DB_VACUUM_MIN_PAGES 16
+#define CAMEL_DB_VACUUM_MAX_PAGES 8192
+#define CAMEL_DB_ANALYSIS_LIMIT 1000
+#define CAMEL_DB_AUTO_VACUUM_INCREMENTAL 2 /* the value of the PRAGMA auto_vacuum */
+/* Values of the maintenance, which survive the process, like the time of the last ANALYZE */
+#define CAMEL_DB_MAINTENANCE_TABLE "db_maintenance"
+
+typedef struct _CamelDBReader {
+	sqlite3 *db;
+	guint collations_stamp;
+	gboolean temporary; /* closed on release, instead of returning it to the pool */
+} CamelDBReader;
+
 G_DEFINE_TYPE_WITH_PRIVATE (CamelDB, camel_db, G_TYPE_OBJECT)
 
+static void
+cdb_reader_free (CamelDBReader *reader)
+{
+	if (reader) {
+		sqlite3_close (reader->db);
+		g_slice_free (CamelDBReader, reader);
+	}
+}
+
 static void
 camel_db_finalize (GObject *object)
 {
 	CamelDB *cdb = CAMEL_DB (object);
 
+	/* Prepared statements need to be finalized before the close */
+	g_hash_table_destroy (cdb->priv->mir_stmts);
+	g_hash_table_destroy (cdb->priv->mif_stmts);
+	g_hash_table_destroy (cdb->priv->counted_folders);
+
+	g_warn_if_fail (g_slist_length (cdb->priv->idle_readers) == cdb->priv->n_readers);
+	g_slist_free_full (cdb->priv->idle_readers, (GDestroyNotify) cdb_reader_free);
+	g_hash_table_destroy (cdb->priv->collations);
+	g_mutex_clear (&cdb->priv->readers_lock);
+
 	sqlite3_close (cdb->priv->db);
 	g_rw_lock_clear (&cdb->priv->rwlock);
 	g_mutex_clear (&cdb->priv->transaction_lock);
@@ -534,6 +619,12 @@ camel_db_init (CamelDB *cdb)
 	cdb->priv->transaction_thread = NULL;
 	cdb->priv->transaction_level = 0;
 	cdb->priv->timer = NULL;
+	cdb->priv->mir_stmts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) sqlite3_finalize);
+	cdb->priv->mif_stmts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) sqlite3_finalize);
+	cdb->priv->counted_folders = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_mutex_init (&cdb->priv->readers_lock);
+	cdb->priv->collations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 /*
@@ -591,9 +682,24 @@ cdb_sql_exec (sqlite3 *db,
 	return 0;
 }
 
-/* checks whether string 'where' contains whole word 'what',
- * case insensitively (ascii, not utf8, same as 'LIKE' in SQLite3)
-*/
+/* Whether the 'needle' is a whole word in the 'where' */
+static gboolean
+cdb_match_word (const CamelSearchNeedle *needle,
+		const gchar *where)
+{
+	const gchar *found, *found_end = NULL;
+
+	for (found = camel_search_needle_find (needle, where, &found_end);
+	     found;
+	     found = camel_search_needle_find (needle, found + 1, &found_end)) {
+		if ((found == where || found[-1] == ' ') &&
+		    (!*found_end || g_ascii_isspace (*found_end)))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 static void
 cdb_match_func (sqlite3_context *ctx,
                 gint nArgs,
@@ -612,22 +718,18 @@ cdb_match_func (sqlite3_context *ctx,
 	if (what && where && !*what) {
 		matches = TRUE;
 	} else if (what && where) {
-		gboolean word = TRUE;
-		gint i, j;
-
-		for (i = 0, j = 0; where[i] && !matches; i++) {
-			gchar c = where[i];
-
-			if (c == ' ') {
-				word = TRUE;
-				j = 0;
-			} else if (word && tolower (c) == tolower (what[j])) {
-				j++;
-				if (what[j] == 0 && (where[i + 1] == 0 || isspace (where[i + 1])))
-					matches = TRUE;
-			} else {
-				word = FALSE;
-			}
+		CamelSearchNeedle *needle;
+
+		/* The 'what' is usually the same for all the rows, thus it's folded only once */
+		needle = sqlite3_get_auxdata (ctx, 0);
+		if (needle) {
+			matches = cdb_match_word (needle, where);
+		} else {
+			needle = camel_search_needle_new (what);
+			matches = cdb_match_word (needle, where);
+
+			/* The sqlite frees the needle, when it cannot keep it */
+			sqlite3_set_auxdata (ctx, 0, needle, (void (*)(gpointer)) camel_search_needle_free);
 		}
 	}
 
@@ -743,6 +845,115 @@ cdb_is_in_transaction (CamelDB *cdb)
 	return res;
 }
 
+static void
+cdb_reader_apply_collation_cb (gpointer key,
+			       gpointer value,
+			       gpointer user_data)
+{
+	sqlite3_create_collation (user_data, key, SQLITE_UTF8, NULL, value);
+}
+
+/* Opens a new read-only connection for the WAL mode; call with the readers_lock held */
+static CamelDBReader *
+cdb_reader_new (CamelDB *cdb)
+{
+	CamelDBReader *reader;
+	sqlite3 *db = NULL;
+
+	if (sqlite3_open_v2 (cdb->priv->filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		d (g_print ("Can't open reader for %s: %s\n", cdb->priv->filename, db ? sqlite3_errmsg (db) : "Unknown error"));
+		sqlite3_close (db);
+		return NULL;
+	}
+
+	sqlite3_create_function (db, "MATCH", 2, SQLITE_UTF8, NULL, cdb_match_func, NULL, NULL);
+	sqlite3_create_function (db, "CAMELCOMPAREDATE", 2, SQLITE_UTF8, NULL, cdb_camel_compare_date_func, NULL, NULL);
+	sqlite3_busy_timeout (db, CAMEL_DB_SLEEP_INTERVAL);
+
+	/* The same as the main connection has */
+	if (sqlite3_exec (db, "ATTACH DATABASE ':memory:' AS mem", NULL, NULL, NULL) != SQLITE_OK) {
+		d (g_print ("Can't attach memory database to reader for %s: %s\n", cdb->priv->filename, sqlite3_errmsg (db)));
+		sqlite3_close (db);
+		return NULL;
+	}
+
+	reader = g_slice_new0 (CamelDBReader);
+	reader->db = db;
+	reader->collations_stamp = 0;
+
+	return reader;
+}
+
+/* Returns a connection to read from; the main connection is used in the default
+   journal mode and when the calling thread is in a transaction, thus it sees its
+   own changes. The readers in the WAL mode get their own connection, which doesn't
+   need to wait for the writer. Pair with cdb_reader_release(). */
+static sqlite3 *
+cdb_reader_acquire (CamelDB *cdb,
+		    CamelDBReader **out_reader)
+{
+	CamelDBReader *reader = NULL;
+
+	*out_reader = NULL;
+
+	if (!cdb->priv->wal_enabled || cdb_is_in_transaction (cdb)) {
+		cdb_reader_lock (cdb);
+		return cdb->priv->db;
+	}
+
+	g_mutex_lock (&cdb->priv->readers_lock);
+
+	if (cdb->priv->idle_readers) {
+		reader = cdb->priv->idle_readers->data;
+		cdb->priv->idle_readers = g_slist_remove (cdb->priv->idle_readers, reader);
+	} else {
+		reader = cdb_reader_new (cdb);
+		if (reader) {
+			/* Do not wait for a pooled reader, the caller can hold one already */
+			if (cdb->priv->n_readers >= CAMEL_DB_MAX_READERS)
+				reader->temporary = TRUE;
+			else
+				cdb->priv->n_readers++;
+		}
+	}
+
+	if (reader && reader->collations_stamp != cdb->priv->collations_stamp) {
+		g_hash_table_foreach (cdb->priv->collations, cdb_reader_apply_collation_cb, reader->db);
+		reader->collations_stamp = cdb->priv->collations_stamp;
+	}
+
+	g_mutex_unlock (&cdb->priv->readers_lock);
+
+	if (!reader) {
+		/* Fallback to the main connection */
+		cdb_reader_lock (cdb);
+		return cdb->priv->db;
+	}
+
+	*out_reader = reader;
+
+	return reader->db;
+}
+
+static void
+cdb_reader_release (CamelDB *cdb,
+		    CamelDBReader *reader)
+{
+	if (!reader) {
+		cdb_reader_unlock (cdb);
+		return;
+	}
+
+	if (reader->temporary) {
+		cdb_reader_free (reader);
+		return;
+	}
+
+	g_mutex_lock (&cdb->priv->readers_lock);
+	cdb->priv->idle_readers = g_slist_prepend (cdb->priv->idle_readers, reader);
+	g_mutex_unlock (&cdb->priv->readers_lock);
+}
+
 static gchar *
 cdb_construct_transaction_stmt (CamelDB *cdb,
 				const gchar *prefix)
@@ -781,11 +992,75 @@ camel_db_command_internal (CamelDB *cdb,
 	return ret;
 }
 
+static gint
+read_journal_mode_cb (gpointer data,
+		      gint argc,
+		      gchar **argv,
+		      gchar **azColName)
+{
+	gchar **pjournal_mode = data;
+
+	if (argc == 1 && argv[0]) {
+		g_free (*pjournal_mode);
+		*pjournal_mode = g_ascii_strdown (argv[0], -1);
+	}
+
+	return 0;
+}
+
+/* The WAL mode is persistent in the file, thus turn it off when not asked for,
+   to not run it with the deferred syncs */
+static void
+cdb_setup_journal_mode (CamelDB *cdb,
+			gboolean use_wal)
+{
+	gchar *journal_mode = NULL;
+
+	cdb_writer_lock (cdb);
+
+	cdb_sql_exec (cdb->priv->db, "PRAGMA main.journal_mode", read_journal_mode_cb, &journal_mode, NULL, NULL);
+
+	if (use_wal && g_strcmp0 (journal_mode, "wal") != 0) {
+		g_clear_pointer (&journal_mode, g_free);
+
+		/* This can fail, like on a network file system; then stay with the current mode */
+		cdb_sql_exec (cdb->priv->db, "PRAGMA main.journal_mode = WAL", read_journal_mode_cb, &journal_mode, NULL, NULL);
+	} else if (!use_wal && g_strcmp0 (journal_mode, "wal") == 0) {
+		g_clear_pointer (&journal_mode, g_free);
+
+		cdb_sql_exec (cdb->priv->db, "PRAGMA main.journal_mode = DELETE", read_journal_mode_cb, &journal_mode, NULL, NULL);
+	}
+
+	cdb->priv->wal_enabled = g_strcmp0 (journal_mode, "wal") == 0;
+
+	if (cdb->priv->wal_enabled) {
+		/* The WAL with the NORMAL synchronous mode can lose the last transactions
+		   on a power failure, but it cannot be corrupted, as long as the syncs
+		   are done in order, thus do not defer them for this database */
+		cdb_set_sync_immediately (cdb->priv->db);
+		cdb_sql_exec (cdb->priv->db, "PRAGMA main.synchronous = NORMAL", NULL, NULL, NULL, NULL);
+	}
+
+	cdb_writer_unlock (cdb);
+
+	d (g_print ("%s: journal mode of '%s' is '%s'\n", G_STRFUNC, cdb->priv->filename, journal_mode ? journal_mode : "unknown"));
+
+	g_free (journal_mode);
+}
+
 /**
  * camel_db_new:
  * @filename: A filename with the database to open/create
  * @error: return location for a #GError, or %NULL
  *
+ * Opens or creates the database file @filename.
+ *
+ * When the CAMEL_SQLITE_WAL environment variable is set, the database
+ * is switched to the write-ahead log journal mode, in which the searches
+ * and counts run on a small pool of read-only connections, thus they do
+ * not need to wait for a running write transaction. The database is
+ * switched back to the default journal mode when the variable is not set.
+ *
  * Returns: (transfer full): A new #CamelDB with @filename as its database file.
  *   Free it with g_object_unref() when no longer needed.
  *
@@ -897,6 +1172,14 @@ camel_db_new (const gchar *filename,
 
 	sqlite3_busy_timeout (cdb->priv->db, CAMEL_DB_SLEEP_INTERVAL);
 
+	/* Applies only to new databases; the existing are converted by the maintenance */
+	cdb_writer_lock (cdb);
+	cdb_sql_exec (cdb->priv->db, "PRAGMA main.auto_vacuum = INCREMENTAL;", NULL, NULL, NULL, NULL);
+	cdb_writer_unlock (cdb);
+
+	if (!g_getenv ("CAMEL_SQLITE_IN_MEMORY"))
+		cdb_setup_journal_mode (cdb, g_getenv ("CAMEL_SQLITE_WAL") != NULL);
+
 	return cdb;
 }
 
@@ -942,8 +1225,15 @@ camel_db_set_collate (CamelDB *cdb,
 
 	cdb_writer_lock (cdb);
 	d (g_print ("Creating Collation %s on %s with %p\n", collate, col, (gpointer) func));
-	if (collate && func)
+	if (collate && func) {
 		ret = sqlite3_create_collation (cdb->priv->db, collate, SQLITE_UTF8,  NULL, func);
+
+		/* The read-only connections get it when used the next time */
+		g_mutex_lock (&cdb->priv->readers_lock);
+		g_hash_table_insert (cdb->priv->collations, g_strdup (collate), func);
+		cdb->priv->collations_stamp++;
+		g_mutex_unlock (&cdb->priv->readers_lock);
+	}
 	cdb_writer_unlock (cdb);
 
 	return ret;
@@ -1055,6 +1345,10 @@ camel_db_abort_transaction (CamelDB *cdb,
 	ret = cdb_sql_exec (cdb->priv->db, stmt, NULL, NULL, NULL, error);
 	g_free (stmt);
 
+	/* The rollback can drop the just created body index tables */
+	if (cdb->priv->body_index_state == CDB_BODY_INDEX_EXISTS)
+		cdb->priv->body_index_state = CDB_BODY_INDEX_UNKNOWN;
+
 	cdb_writer_unlock (cdb);
 	camel_db_release_cache_memory ();
 
@@ -1134,6 +1428,320 @@ end:
 	return ret;
 }
 
+/* The folder_counts table holds the message counts of each folder. It is maintained
+   by triggers on the folder's message info table, thus it is always updated in the same
+   transaction as the message info rows. The conditions use '@' as the row reference
+   and they match the queries formerly used by the camel_db_count_*_message_info(). */
+#define FOLDER_COUNTS_TABLE "folder_counts"
+
+static const struct _FolderCountsColumn {
+	const gchar *name;
+	const gchar *condition;
+} folder_counts_columns[] = {
+	{ "saved_count", "@.read = 0 OR @.read = 1" },
+	{ "unread_count", "@.read = 0" },
+	{ "deleted_count", "@.deleted = 1" },
+	{ "junk_count", "@.junk = 1" },
+	{ "visible_count", "@.junk = 0 AND @.deleted = 0" },
+	{ "visible_unread_count", "@.read = 0 AND @.junk = 0 AND @.deleted = 0" },
+	{ "jnd_count", "@.junk = 1 AND @.deleted = 0" }
+};
+
+/* Trigger name suffixes, appended to the folder name */
+static const gchar *folder_counts_triggers[] = {
+	"_counts_replace",
+	"_counts_insert",
+	"_counts_delete",
+	"_counts_update"
+};
+
+static void
+cdb_append_counts_condition (GString *str,
+			     const gchar *condition,
+			     const gchar *row)
+{
+	g_string_append_c (str, '(');
+
+	for (; *condition; condition++) {
+		if (*condition == '@')
+			g_string_append (str, row);
+		else
+			g_string_append_c (str, *condition);
+	}
+
+	g_string_append_c (str, ')');
+}
+
+/* Appends "column = column <op> IFNULL (<condition on row>, 0), ..." for all the counts */
+static void
+cdb_append_counts_delta (GString *str,
+			 const gchar *op,
+			 const gchar *row)
+{
+	guint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (folder_counts_columns); ii++) {
+		if (ii)
+			g_string_append (str, ", ");
+
+		g_string_append_printf (str, "%s = %s %s IFNULL (", folder_counts_columns[ii].name, folder_counts_columns[ii].name, op);
+		cdb_append_counts_condition (str, folder_counts_columns[ii].condition, row);
+		g_string_append (str, ", 0)");
+	}
+}
+
+static gint
+cdb_create_folder_counts_table (CamelDB *cdb,
+				GError **error)
+{
+	GString *query;
+	guint ii;
+	gint ret;
+
+	query = g_string_new ("CREATE TABLE IF NOT EXISTS " FOLDER_COUNTS_TABLE " ( folder_name TEXT PRIMARY KEY");
+
+	for (ii = 0; ii < G_N_ELEMENTS (folder_counts_columns); ii++) {
+		g_string_append_printf (query, ", %s INTEGER", folder_counts_columns[ii].name);
+	}
+
+	g_string_append (query, " )");
+
+	ret = camel_db_add_to_transaction (cdb, query->str, error);
+
+	g_string_free (query, TRUE);
+
+	return ret;
+}
+
+static gint
+cdb_drop_folder_counts_triggers (CamelDB *cdb,
+				 const gchar *folder_name,
+				 GError **error)
+{
+	gint ret = 0;
+	guint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (folder_counts_triggers) && ret == 0; ii++) {
+		gchar *stmt;
+
+		stmt = sqlite3_mprintf ("DROP TRIGGER IF EXISTS '%q%q'", folder_name, folder_counts_triggers[ii]);
+		ret = camel_db_add_to_transaction (cdb, stmt, error);
+		sqlite3_free (stmt);
+	}
+
+	return ret;
+}
+
+static gint
+count_triggers_cb (gpointer data,
+		   gint argc,
+		   gchar **argv,
+		   gchar **azColName)
+{
+	guint *n_triggers = data;
+
+	if (argc == 1 && argv[0])
+		*n_triggers = strtoul (argv[0], NULL, 10);
+
+	return 0;
+}
+
+/* Creates the triggers maintaining the folder's counts and fills the folder_counts
+   row for it, unless it's all set already; call inside a transaction */
+static gint
+cdb_ensure_folder_counts (CamelDB *cdb,
+			  const gchar *folder_name,
+			  GError **error)
+{
+	GString *stmt;
+	gchar *tmp, *quoted_folder_name;
+	guint ii, n_triggers = 0;
+	gint ret;
+
+	/* Callers should hold the writer lock */
+	if (g_hash_table_contains (cdb->priv->counted_folders, folder_name))
+		return 0;
+
+	ret = cdb_create_folder_counts_table (cdb, error);
+	if (ret != 0)
+		return ret;
+
+	stmt = g_string_new ("SELECT COUNT (*) FROM sqlite_master WHERE type = 'trigger' AND name IN (");
+
+	for (ii = 0; ii < G_N_ELEMENTS (folder_counts_triggers); ii++) {
+		tmp = sqlite3_mprintf ("%s'%q%q'", ii ? ", " : "", folder_name, folder_counts_triggers[ii]);
+		g_string_append (stmt, tmp);
+		sqlite3_free (tmp);
+	}
+
+	g_string_append_c (stmt, ')');
+
+	ret = cdb_sql_exec (cdb->priv->db, stmt->str, count_triggers_cb, &n_triggers, NULL, error);
+
+	if (ret != 0 || n_triggers == G_N_ELEMENTS (folder_counts_triggers)) {
+		if (ret == 0)
+			g_hash_table_add (cdb->priv->counted_folders, g_strdup (folder_name));
+
+		g_string_free (stmt, TRUE);
+
+		return ret;
+	}
+
+	/* Some are missing, like with a newly created or migrated table; start from scratch */
+	ret = cdb_drop_folder_counts_triggers (cdb, folder_name, error);
+	if (ret != 0) {
+		g_string_free (stmt, TRUE);
+		return ret;
+	}
+
+	quoted_folder_name = sqlite3_mprintf ("%Q", folder_name);
+
+	tmp = sqlite3_mprintf ("INSERT OR REPLACE INTO " FOLDER_COUNTS_TABLE " SELECT %Q", folder_name);
+	g_string_assign (stmt, tmp);
+	sqlite3_free (tmp);
+
+	for (ii = 0; ii < G_N_ELEMENTS (folder_counts_columns); ii++) {
+		g_string_append (stmt, ", COUNT (CASE WHEN ");
+		cdb_append_counts_condition (stmt, folder_counts_columns[ii].condition, "cur");
+		g_string_append (stmt, " THEN 1 END)");
+	}
+
+	g_string_append_printf (stmt, " FROM %s AS cur", quoted_folder_name);
+
+	ret = camel_db_add_to_transaction (cdb, stmt->str, error);
+
+	/* The INSERT OR REPLACE, as used by camel_db_write_message_info_record(), does not
+	   run the DELETE trigger for the replaced row, thus subtract it before the insert */
+	if (ret == 0) {
+		tmp = sqlite3_mprintf (
+			"CREATE TRIGGER IF NOT EXISTS '%q%q' BEFORE INSERT ON %Q "
+			"WHEN EXISTS (SELECT 1 FROM %Q WHERE uid = NEW.uid) BEGIN "
+			"UPDATE " FOLDER_COUNTS_TABLE " SET ",
+			folder_name, folder_counts_triggers[0], folder_name, folder_name);
+		g_string_assign (stmt, tmp);
+		sqlite3_free (tmp);
+
+		for (ii = 0; ii < G_N_ELEMENTS (folder_counts_columns); ii++) {
+			if (ii)
+				g_string_append (stmt, ", ");
+
+			g_string_append_printf (stmt, "%s = %s - (SELECT COUNT (*) FROM %s AS cur WHERE cur.uid = NEW.uid AND ",
+				folder_counts_columns[ii].name, folder_counts_columns[ii].name, quoted_folder_name);
+			cdb_append_counts_condition (stmt, folder_counts_columns[ii].condition, "cur");
+			g_string_append_c (stmt, ')');
+		}
+
+		g_string_append_printf (stmt, " WHERE folder_name = %s; END", quoted_folder_name);
+
+		ret = camel_db_add_to_transaction (cdb, stmt->str, error);
+	}
+
+	if (ret == 0) {
+		tmp = sqlite3_mprintf (
+			"CREATE TRIGGER IF NOT EXISTS '%q%q' AFTER INSERT ON %Q BEGIN "
+			"UPDATE " FOLDER_COUNTS_TABLE " SET ",
+			folder_name, folder_counts_triggers[1], folder_name);
+		g_string_assign (stmt, tmp);
+		sqlite3_free (tmp);
+
+		cdb_append_counts_delta (stmt, "+", "NEW");
+		g_string_append_printf (stmt, " WHERE folder_name = %s; END", quoted_folder_name);
+
+		ret = camel_db_add_to_transaction (cdb, stmt->str, error);
+	}
+
+	if (ret == 0) {
+		tmp = sqlite3_mprintf (
+			"CREATE TRIGGER IF NOT EXISTS '%q%q' AFTER DELETE ON %Q BEGIN "
+			"UPDATE " FOLDER_COUNTS_TABLE " SET ",
+			folder_name, folder_counts_triggers[2], folder_name);
+		g_string_assign (stmt, tmp);
+		sqlite3_free (tmp);
+
+		cdb_append_counts_delta (stmt, "-", "OLD");
+		g_string_append_printf (stmt, " WHERE folder_name = %s; END", quoted_folder_name);
+
+		ret = camel_db_add_to_transaction (cdb, stmt->str, error);
+	}
+
+	if (ret == 0) {
+		tmp = sqlite3_mprintf (
+			"CREATE TRIGGER IF NOT EXISTS '%q%q' AFTER UPDATE OF read, deleted, junk ON %Q BEGIN "
+			"UPDATE " FOLDER_COUNTS_TABLE " SET ",
+			folder_name, folder_counts_triggers[3], folder_name);
+		g_string_assign (stmt, tmp);
+		sqlite3_free (tmp);
+
+		/* Two statements, because only the last assignment of a column is used */
+		cdb_append_counts_delta (stmt, "-", "OLD");
+		g_string_append_printf (stmt, " WHERE folder_name = %s; UPDATE " FOLDER_COUNTS_TABLE " SET ", quoted_folder_name);
+		cdb_append_counts_delta (stmt, "+", "NEW");
+		g_string_append_printf (stmt, " WHERE folder_name = %s; END", quoted_folder_name);
+
+		ret = camel_db_add_to_transaction (cdb, stmt->str, error);
+	}
+
+	g_string_free (stmt, TRUE);
+	sqlite3_free (quoted_folder_name);
+
+	return ret;
+}
+
+typedef struct _FolderCountData {
+	guint32 count;
+	gboolean found;
+} FolderCountData;
+
+static gint
+read_folder_count_cb (gpointer data,
+		      gint argc,
+		      gchar **argv,
+		      gchar **azColName)
+{
+	FolderCountData *fcd = data;
+
+	if (argc == 1 && argv[0]) {
+		fcd->count = strtoul (argv[0], NULL, 10);
+		fcd->found = TRUE;
+	}
+
+	return 0;
+}
+
+/* Reads one of the folder_counts_columns for the folder; returns FALSE,
+   when the counts are not maintained for the folder */
+static gboolean
+cdb_read_folder_count (CamelDB *cdb,
+		       const gchar *folder_name,
+		       const gchar *column,
+		       guint32 *count)
+{
+	FolderCountData fcd = { 0, FALSE };
+	CamelDBReader *reader;
+	sqlite3 *db;
+	gchar *query;
+
+	query = sqlite3_mprintf (
+		"SELECT %s FROM " FOLDER_COUNTS_TABLE " WHERE folder_name = %Q",
+		column, folder_name);
+
+	db = cdb_reader_acquire (cdb, &reader);
+
+	START (query);
+	/* Errors, like with the folder_counts table not existing yet, mean a fallback to the COUNT() */
+	cdb_sql_exec (db, query, read_folder_count_cb, &fcd, NULL, NULL);
+	END;
+
+	cdb_reader_release (cdb, reader);
+
+	sqlite3_free (query);
+
+	if (fcd.found)
+		*count = fcd.count;
+
+	return fcd.found;
+}
+
 static gint
 count_cb (gpointer data,
           gint argc,
@@ -1171,17 +1779,19 @@ camel_db_count_message_info (CamelDB *cdb,
                              guint32 *count,
                              GError **error)
 {
+	CamelDBReader *reader;
+	sqlite3 *db;
 	gint ret = -1;
 
 	g_return_val_if_fail (query != NULL, -1);
 
-	cdb_reader_lock (cdb);
+	db = cdb_reader_acquire (cdb, &reader);
 
 	START (query);
-	ret = cdb_sql_exec (cdb->priv->db, query, count_cb, count, NULL, error);
+	ret = cdb_sql_exec (db, query, count_cb, count, NULL, error);
 	END;
 
-	cdb_reader_unlock (cdb);
+	cdb_reader_release (cdb, reader);
 
 	camel_db_release_cache_memory ();
 
@@ -1213,6 +1823,9 @@ camel_db_count_junk_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "junk_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 1", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1246,6 +1859,9 @@ camel_db_count_unread_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "unread_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE read = 0", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1279,6 +1895,9 @@ camel_db_count_visible_unread_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "visible_unread_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE read = 0 AND junk = 0 AND deleted = 0", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1312,6 +1931,9 @@ camel_db_count_visible_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "visible_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 0 AND deleted = 0", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1345,6 +1967,9 @@ camel_db_count_junk_not_deleted_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "jnd_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE junk = 1 AND deleted = 0", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1378,6 +2003,9 @@ camel_db_count_deleted_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "deleted_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q WHERE deleted = 1", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1412,6 +2040,9 @@ camel_db_count_total_message_info (CamelDB *cdb,
 	if (!cdb)
 		return -1;
 
+	if (cdb_read_folder_count (cdb, table_name, "saved_count", count))
+		return 0;
+
 	query = sqlite3_mprintf ("SELECT COUNT (*) FROM %Q where read=0 or read=1", table_name);
 
 	ret = camel_db_count_message_info (cdb, query, count, error);
@@ -1441,6 +2072,8 @@ camel_db_select (CamelDB *cdb,
                  gpointer user_data,
                  GError **error)
 {
+	CamelDBReader *reader;
+	sqlite3 *db;
 	gint ret = -1;
 
 	if (!cdb)
@@ -1449,13 +2082,13 @@ camel_db_select (CamelDB *cdb,
 	g_return_val_if_fail (stmt != NULL, ret);
 
 	d (g_print ("\n%s:\n%s \n", G_STRFUNC, stmt));
-	cdb_reader_lock (cdb);
+	db = cdb_reader_acquire (cdb, &reader);
 
 	START (stmt);
-	ret = cdb_sql_exec (cdb->priv->db, stmt, callback, user_data, NULL, error);
+	ret = cdb_sql_exec (db, stmt, callback, user_data, NULL, error);
 	END;
 
-	cdb_reader_unlock (cdb);
+	cdb_reader_release (cdb, reader);
 	camel_db_release_cache_memory ();
 
 	return ret;
@@ -1800,6 +2433,9 @@ camel_db_migrate_folder_prepare (CamelDB *cdb,
 		sqlite3_free (table_creation_query);
 		g_clear_error (error);
 
+		/* The folder_counts triggers are gone with the table */
+		g_hash_table_remove (cdb->priv->counted_folders, folder_name);
+
 		ret = camel_db_create_message_info_table (cdb, folder_name, error);
 		g_clear_error (error);
 	}
@@ -2007,6 +2643,11 @@ camel_db_prepare_message_info_table (CamelDB *cdb,
 	if (err)
 		goto exit;
 
+	/* Maintain the message counts of the folder */
+	ret = cdb_ensure_folder_counts (cdb, folder_name, &err);
+	if (err)
+		goto exit;
+
 	camel_db_end_transaction (cdb, &err);
 	in_transaction = FALSE;
 
@@ -2020,6 +2661,214 @@ exit:
 	return ret;
 }
 
+static sqlite3_stmt *
+cdb_ref_mir_stmt (CamelDB *cdb,
+		  const gchar *folder_name,
+		  GError **error)
+{
+	sqlite3_stmt *stmt;
+	gchar *query;
+	gint ret;
+
+	/* Callers should hold the writer lock */
+	stmt = g_hash_table_lookup (cdb->priv->mir_stmts, folder_name);
+	if (stmt)
+		return stmt;
+
+	/* NB: UGLIEST Hack. We can't modify the schema now. We are using dirty (an unsed one to notify of FLAGGED/Dirty infos */
+	query = sqlite3_mprintf (
+		"INSERT OR REPLACE INTO %Q VALUES ("
+		"?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, "
+		"?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19, ?20, ?21, "
+		"?22, ?23, ?24, ?25, ?26, "
+		"strftime(\"%%s\", 'now'), "
+		"strftime(\"%%s\", 'now') )",
+		folder_name);
+
+	d (g_print ("Camel SQL Prepare:\n%s\n", query));
+
+	ret = sqlite3_prepare_v2 (cdb->priv->db, query, -1, &stmt, NULL);
+
+	sqlite3_free (query);
+
+	if (ret != SQLITE_OK) {
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+		sqlite3_finalize (stmt);
+		return NULL;
+	}
+
+	g_hash_table_insert (cdb->priv->mir_stmts, g_strdup (folder_name), stmt);
+
+	return stmt;
+}
+
+/* Updates only the columns derived from the message flags */
+static sqlite3_stmt *
+cdb_ref_mif_stmt (CamelDB *cdb,
+		  const gchar *folder_name,
+		  GError **error)
+{
+	sqlite3_stmt *stmt;
+	gchar *query;
+	gint ret;
+
+	/* Callers should hold the writer lock */
+	stmt = g_hash_table_lookup (cdb->priv->mif_stmts, folder_name);
+	if (stmt)
+		return stmt;
+
+	query = sqlite3_mprintf (
+		"UPDATE %Q SET flags = ?2, read = ?3, deleted = ?4, replied = ?5, important = ?6, "
+		"junk = ?7, attachment = ?8, dirty = ?9, modified = strftime(\"%%s\", 'now') "
+		"WHERE uid = ?1",
+		folder_name);
+
+	d (g_print ("Camel SQL Prepare:\n%s\n", query));
+
+	ret = sqlite3_prepare_v2 (cdb->priv->db, query, -1, &stmt, NULL);
+
+	sqlite3_free (query);
+
+	if (ret != SQLITE_OK) {
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+		sqlite3_finalize (stmt);
+		return NULL;
+	}
+
+	g_hash_table_insert (cdb->priv->mif_stmts, g_strdup (folder_name), stmt);
+
+	return stmt;
+}
+
+static void
+cdb_forget_folder_caches (CamelDB *cdb,
+		     const gchar *folder_name)
+{
+	if (!cdb)
+		return;
+
+	cdb_writer_lock (cdb);
+	g_hash_table_remove (cdb->priv->mir_stmts, folder_name);
+	g_hash_table_remove (cdb->priv->mif_stmts, folder_name);
+	g_hash_table_remove (cdb->priv->counted_folders, folder_name);
+	cdb_writer_unlock (cdb);
+}
+
+static gint
+cdb_step_stmt (sqlite3_stmt *stmt)
+{
+	gint ret, retries = 0;
+
+	ret = sqlite3_step (stmt);
+	while (ret == SQLITE_BUSY || ret == SQLITE_LOCKED) {
+		/* try for ~15 seconds, then give up, the same as cdb_sql_exec() */
+		if (retries > 150)
+			break;
+		retries++;
+
+		sqlite3_reset (stmt);
+		g_thread_yield ();
+		g_usleep (100 * 1000); /* Sleep for 100 ms */
+
+		ret = sqlite3_step (stmt);
+	}
+
+	return ret;
+}
+
+static gint
+cdb_step_mir_stmt (CamelDB *cdb,
+		   sqlite3_stmt *stmt,
+		   const CamelMIRecord *record,
+		   GError **error)
+{
+	gint ret;
+
+	/* The values are formatted the same way as the former sqlite3_mprintf() did,
+	   thus the integers are stored as signed 32-bit numbers. */
+	sqlite3_bind_text (stmt, 1, record->uid, -1, SQLITE_STATIC);
+	sqlite3_bind_int (stmt, 2, (gint) record->flags);
+	sqlite3_bind_int (stmt, 3, (gint) record->msg_type);
+	sqlite3_bind_int (stmt, 4, record->read);
+	sqlite3_bind_int (stmt, 5, record->deleted);
+	sqlite3_bind_int (stmt, 6, record->replied);
+	sqlite3_bind_int (stmt, 7, record->important);
+	sqlite3_bind_int (stmt, 8, record->junk);
+	sqlite3_bind_int (stmt, 9, record->attachment);
+	sqlite3_bind_int (stmt, 10, (gint) record->dirty);
+	sqlite3_bind_int (stmt, 11, (gint) record->size);
+	sqlite3_bind_int64 (stmt, 12, record->dsent);
+	sqlite3_bind_int64 (stmt, 13, record->dreceived);
+	sqlite3_bind_text (stmt, 14, record->subject, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 15, record->from, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 16, record->to, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 17, record->cc, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 18, record->mlist, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 19, record->followup_flag, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 20, record->followup_completed_on, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 21, record->followup_due_by, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 22, record->part, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 23, record->labels, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 24, record->usertags, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 25, record->cinfo, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt, 26, record->bdata, -1, SQLITE_STATIC);
+
+	ret = cdb_step_stmt (stmt);
+
+	if (ret != SQLITE_DONE) {
+		d (g_print ("Error in SQL step for uid '%s': %s\n", record->uid, sqlite3_errmsg (cdb->priv->db)));
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+	}
+
+	/* Strings are bound as static, thus unbind them before the caller frees them */
+	sqlite3_reset (stmt);
+	sqlite3_clear_bindings (stmt);
+
+	return ret == SQLITE_DONE ? 0 : -1;
+}
+
+static gint
+cdb_step_mif_stmt (CamelDB *cdb,
+		   sqlite3_stmt *stmt,
+		   const CamelMIRecord *record,
+		   gboolean *out_updated,
+		   GError **error)
+{
+	gint ret;
+
+	sqlite3_bind_text (stmt, 1, record->uid, -1, SQLITE_STATIC);
+	sqlite3_bind_int (stmt, 2, (gint) record->flags);
+	sqlite3_bind_int (stmt, 3, record->read);
+	sqlite3_bind_int (stmt, 4, record->deleted);
+	sqlite3_bind_int (stmt, 5, record->replied);
+	sqlite3_bind_int (stmt, 6, record->important);
+	sqlite3_bind_int (stmt, 7, record->junk);
+	sqlite3_bind_int (stmt, 8, record->attachment);
+	sqlite3_bind_int (stmt, 9, (gint) record->dirty);
+
+	ret = cdb_step_stmt (stmt);
+
+	if (ret != SQLITE_DONE) {
+		d (g_print ("Error in SQL step for uid '%s': %s\n", record->uid, sqlite3_errmsg (cdb->priv->db)));
+		g_set_error (
+			error, CAMEL_ERROR,
+			CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+	} else {
+		*out_updated = sqlite3_changes (cdb->priv->db) > 0;
+	}
+
+	sqlite3_reset (stmt);
+	sqlite3_clear_bindings (stmt);
+
+	return ret == SQLITE_DONE ? 0 : -1;
+}
+
 /**
  * camel_db_write_message_info_record:
  * @cdb: a #CamelDB
@@ -2028,6 +2877,8 @@ exit:
  * @error: return location for a #GError, or %NULL
  *
  * Write the @record to the message info table of the given folder.
+ * This should be called within a transaction. When writing many records,
+ * consider using camel_db_message_info_batch_new() instead.
  *
  * Returns: 0 on success, -1 on error
  *
@@ -2039,58 +2890,274 @@ camel_db_write_message_info_record (CamelDB *cdb,
                                     CamelMIRecord *record,
                                     GError **error)
 {
-	gint ret;
-	gchar *ins_query;
+	sqlite3_stmt *stmt;
+
+	if (!cdb)
+		return -1;
 
 	if (!record) {
 		g_warn_if_reached ();
 		return -1;
 	}
 
-	/* NB: UGLIEST Hack. We can't modify the schema now. We are using dirty (an unsed one to notify of FLAGGED/Dirty infos */
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (cdb_is_in_transaction (cdb), -1);
 
-	ins_query = sqlite3_mprintf (
-		"INSERT OR REPLACE INTO %Q VALUES ("
-		"%Q, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, "
-		"%lld, %lld, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, "
-		"%Q, %Q, %Q, %Q, %Q, "
-		"strftime(\"%%s\", 'now'), "
-		"strftime(\"%%s\", 'now') )",
-		folder_name,
-		record->uid,
-		record->flags,
-		record->msg_type,
-		record->read,
-		record->deleted,
-		record->replied,
-		record->important,
-		record->junk,
-		record->attachment,
-		record->dirty,
-		record->size,
-		record->dsent,
-		record->dreceived,
-		record->subject,
-		record->from,
-		record->to,
-		record->cc,
-		record->mlist,
-		record->followup_flag,
-		record->followup_completed_on,
-		record->followup_due_by,
-		record->part,
-		record->labels,
-		record->usertags,
-		record->cinfo,
-		record->bdata);
+	stmt = cdb_ref_mir_stmt (cdb, folder_name, error);
+	if (!stmt)
+		return -1;
 
-	ret = camel_db_add_to_transaction (cdb, ins_query, error);
+	return cdb_step_mir_stmt (cdb, stmt, record, error);
+}
 
-	sqlite3_free (ins_query);
+/**
+ * CamelDBMessageInfoBatch:
+ *
+ * An opaque structure used to write many #CamelMIRecord-s into
+ * a single folder's message info table. Create it with
+ * camel_db_message_info_batch_new().
+ *
+ * Since: 3.40
+ **/
+struct _CamelDBMessageInfoBatch {
+	CamelDB *cdb;
+	gchar *folder_name;
+	guint max_rows;
+	guint max_msecs;
+	guint n_uncommitted;
+	gint64 started; /* monotonic time, in microseconds */
+	gboolean in_transaction;
+};
+
+/**
+ * camel_db_message_info_batch_new:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @max_rows: commit after this many rows, or 0 to not limit by the row count
+ * @max_msecs: commit after this many milliseconds, or 0 to not limit by the time
+ * @error: return location for a #GError, or %NULL
+ *
+ * Begins a batch write of message info records into the table of @folder_name.
+ * Unlike camel_db_write_message_info_record() called in a loop, the batch reuses
+ * one prepared statement and binds the #CamelMIRecord values directly.
+ *
+ * The batch opens a transaction, which is committed and reopened whenever
+ * either the @max_rows or @max_msecs limit is reached, thus other threads
+ * can access the @cdb between the commits. When the caller already runs
+ * a transaction in the same thread, the intermediate commits only release
+ * the nested savepoints.
+ *
+ * Add records with camel_db_message_info_batch_add() and finish the batch
+ * with camel_db_message_info_batch_end() or camel_db_message_info_batch_abort().
+ *
+ * Returns: (transfer full) (nullable): a new #CamelDBMessageInfoBatch,
+ *    or %NULL on error
+ *
+ * Since: 3.40
+ **/
+CamelDBMessageInfoBatch *
+camel_db_message_info_batch_new (CamelDB *cdb,
+				 const gchar *folder_name,
+				 guint max_rows,
+				 guint max_msecs,
+				 GError **error)
+{
+	CamelDBMessageInfoBatch *batch;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), NULL);
+	g_return_val_if_fail (folder_name != NULL, NULL);
+
+	if (camel_db_begin_transaction (cdb, error) != 0)
+		return NULL;
+
+	batch = g_slice_new0 (CamelDBMessageInfoBatch);
+	batch->cdb = g_object_ref (cdb);
+	batch->folder_name = g_strdup (folder_name);
+	batch->max_rows = max_rows;
+	batch->max_msecs = max_msecs;
+	batch->n_uncommitted = 0;
+	batch->started = g_get_monotonic_time ();
+	batch->in_transaction = TRUE;
+
+	return batch;
+}
+
+static void
+cdb_message_info_batch_free (CamelDBMessageInfoBatch *batch)
+{
+	g_object_unref (batch->cdb);
+	g_free (batch->folder_name);
+	g_slice_free (CamelDBMessageInfoBatch, batch);
+}
+
+static gint
+cdb_message_info_batch_begin_row (CamelDBMessageInfoBatch *batch,
+				  GError **error)
+{
+	if (!batch->in_transaction) {
+		if (camel_db_begin_transaction (batch->cdb, error) != 0)
+			return -1;
+
+		batch->in_transaction = TRUE;
+		batch->started = g_get_monotonic_time ();
+	}
+
+	return 0;
+}
+
+/* Commits the transaction, when any of the limits is reached */
+static gint
+cdb_message_info_batch_end_row (CamelDBMessageInfoBatch *batch,
+				GError **error)
+{
+	gboolean commit;
+
+	batch->n_uncommitted++;
+
+	commit = (batch->max_rows && batch->n_uncommitted >= batch->max_rows) ||
+		 (batch->max_msecs && (g_get_monotonic_time () - batch->started) / 1000 >= batch->max_msecs);
+
+	if (commit) {
+		batch->in_transaction = FALSE;
+		batch->n_uncommitted = 0;
+
+		if (camel_db_end_transaction (batch->cdb, error) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * camel_db_message_info_batch_add:
+ * @batch: a #CamelDBMessageInfoBatch
+ * @record: a #CamelMIRecord to write
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the @record as part of the @batch. The @record values are not
+ * referenced after the function returns. This can commit the pending
+ * changes, when the limits given to camel_db_message_info_batch_new()
+ * are reached.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.40
+ **/
+gint
+camel_db_message_info_batch_add (CamelDBMessageInfoBatch *batch,
+				 const CamelMIRecord *record,
+				 GError **error)
+{
+	sqlite3_stmt *stmt;
+
+	g_return_val_if_fail (batch != NULL, -1);
+	g_return_val_if_fail (record != NULL, -1);
+
+	if (cdb_message_info_batch_begin_row (batch, error) != 0)
+		return -1;
+
+	/* The statement is looked up each time, because it can be forgotten
+	   by other threads between the commits; the lookup is cheap. */
+	stmt = cdb_ref_mir_stmt (batch->cdb, batch->folder_name, error);
+	if (!stmt || cdb_step_mir_stmt (batch->cdb, stmt, record, error) != 0)
+		return -1;
+
+	return cdb_message_info_batch_end_row (batch, error);
+}
+
+/**
+ * camel_db_message_info_batch_update_flags:
+ * @batch: a #CamelDBMessageInfoBatch
+ * @record: a #CamelMIRecord with the values to write
+ * @out_updated: (out): set to whether the row for the @record was found and updated
+ * @error: return location for a #GError, or %NULL
+ *
+ * Updates only the columns derived from the message flags, that is flags, read,
+ * deleted, replied, important, junk, attachment and dirty, of an existing row
+ * as part of the @batch. The other members of the @record, except of the uid,
+ * are ignored. When there is no row for the @record in the table, the @out_updated
+ * is set to %FALSE and the caller is supposed to write the whole record with
+ * camel_db_message_info_batch_add().
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.40
+ **/
+gint
+camel_db_message_info_batch_update_flags (CamelDBMessageInfoBatch *batch,
+					  const CamelMIRecord *record,
+					  gboolean *out_updated,
+					  GError **error)
+{
+	sqlite3_stmt *stmt;
+
+	g_return_val_if_fail (batch != NULL, -1);
+	g_return_val_if_fail (record != NULL, -1);
+	g_return_val_if_fail (record->uid != NULL, -1);
+	g_return_val_if_fail (out_updated != NULL, -1);
+
+	*out_updated = FALSE;
+
+	if (cdb_message_info_batch_begin_row (batch, error) != 0)
+		return -1;
+
+	stmt = cdb_ref_mif_stmt (batch->cdb, batch->folder_name, error);
+	if (!stmt || cdb_step_mif_stmt (batch->cdb, stmt, record, out_updated, error) != 0)
+		return -1;
+
+	return cdb_message_info_batch_end_row (batch, error);
+}
+
+/**
+ * camel_db_message_info_batch_end:
+ * @batch: (transfer full): a #CamelDBMessageInfoBatch
+ * @error: return location for a #GError, or %NULL
+ *
+ * Commits any pending changes of the @batch and frees it.
+ * The @batch cannot be used after this call.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.40
+ **/
+gint
+camel_db_message_info_batch_end (CamelDBMessageInfoBatch *batch,
+				 GError **error)
+{
+	gint ret = 0;
+
+	g_return_val_if_fail (batch != NULL, -1);
+
+	if (batch->in_transaction)
+		ret = camel_db_end_transaction (batch->cdb, error);
+
+	cdb_message_info_batch_free (batch);
 
 	return ret;
 }
 
+/**
+ * camel_db_message_info_batch_abort:
+ * @batch: (transfer full): a #CamelDBMessageInfoBatch
+ *
+ * Rolls back changes of the @batch, which had not been committed yet,
+ * and frees the @batch. The changes already committed due to the limits
+ * given to camel_db_message_info_batch_new() are kept.
+ * The @batch cannot be used after this call.
+ *
+ * Since: 3.40
+ **/
+void
+camel_db_message_info_batch_abort (CamelDBMessageInfoBatch *batch)
+{
+	g_return_if_fail (batch != NULL);
+
+	if (batch->in_transaction)
+		camel_db_abort_transaction (batch->cdb, NULL);
+
+	cdb_message_info_batch_free (batch);
+}
+
 /**
  * camel_db_write_folder_info_record:
  * @cdb: a #CamelDB
@@ -2316,28 +3383,350 @@ camel_db_read_message_info_records (CamelDB *cdb,
 	return (ret);
 }
 
-/**
- * camel_db_delete_uid:
- * @cdb: a #CamelDB
- * @folder_name: full name of the folder
- * @uid: a message info UID to delete
- * @error: return location for a #GError, or %NULL
- *
- * Deletes single mesage info in the given folder with
- * the given UID.
- *
- * Returns: 0 on success, -1 on error
- *
- * Since: 2.24
- **/
-gint
-camel_db_delete_uid (CamelDB *cdb,
-                     const gchar *folder_name,
-                     const gchar *uid,
-                     GError **error)
-{
-	gchar *tab;
-	gint ret;
+static gint
+get_number_cb (gpointer data,
+	       gint argc,
+	       gchar **argv,
+	       gchar **azColName)
+{
+	guint64 *pui64 = data;
+
+	if (argc == 1) {
+		*pui64 = argv[0] ? g_ascii_strtoull (argv[0], NULL, 10) : 0;
+	} else {
+		*pui64 = 0;
+	}
+
+	return 0;
+}
+
+/* The message bodies are indexed in one FTS5 table for all folders, with
+   the trigram tokenizer, thus the MATCH finds substrings the same way as
+   the in-memory body-contains search does. The rowid of the FTS table is
+   the 'id' of the uids table, which maps it to the folder and the message. */
+#define BODIES_TABLE "message_bodies"
+#define BODIES_UIDS_TABLE "message_bodies_uids"
+
+/* Call with the writer lock held */
+static gboolean
+cdb_check_body_index (CamelDB *cdb,
+		      gboolean create,
+		      GError **error)
+{
+	if (cdb->priv->body_index_state == CDB_BODY_INDEX_UNKNOWN) {
+		guint64 count = 0;
+
+		if (cdb_sql_exec (cdb->priv->db,
+			"SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name IN ('" BODIES_TABLE "', '" BODIES_UIDS_TABLE "')",
+			get_number_cb, &count, NULL, error) != SQLITE_OK)
+			return FALSE;
+
+		cdb->priv->body_index_state = count == 2 ? CDB_BODY_INDEX_EXISTS : CDB_BODY_INDEX_MISSING;
+	}
+
+	if (cdb->priv->body_index_state == CDB_BODY_INDEX_MISSING && create) {
+		/* Fails when the sqlite is built without FTS5 or it's older than 3.34.0 */
+		if (cdb_sql_exec (cdb->priv->db,
+			"CREATE VIRTUAL TABLE IF NOT EXISTS " BODIES_TABLE " USING fts5 (body, tokenize = 'trigram')",
+			NULL, NULL, NULL, NULL) != SQLITE_OK) {
+			cdb->priv->body_index_state = CDB_BODY_INDEX_UNSUPPORTED;
+		} else if (cdb_sql_exec (cdb->priv->db,
+			"CREATE TABLE IF NOT EXISTS " BODIES_UIDS_TABLE " ("
+			"id INTEGER PRIMARY KEY, "
+			"folder_name TEXT NOT NULL, "
+			"uid TEXT NOT NULL, "
+			"UNIQUE (folder_name, uid))",
+			NULL, NULL, NULL, error) != SQLITE_OK ||
+			cdb_sql_exec (cdb->priv->db,
+			"CREATE TRIGGER IF NOT EXISTS " BODIES_UIDS_TABLE "_delete AFTER DELETE ON " BODIES_UIDS_TABLE " "
+			"BEGIN DELETE FROM " BODIES_TABLE " WHERE rowid = old.id; END",
+			NULL, NULL, NULL, error) != SQLITE_OK) {
+			return FALSE;
+		} else {
+			cdb->priv->body_index_state = CDB_BODY_INDEX_EXISTS;
+		}
+	}
+
+	return cdb->priv->body_index_state == CDB_BODY_INDEX_EXISTS;
+}
+
+/* Deletes the bodies of the 'uids' or of all the messages in the folder, when 'uids' is NULL */
+static gint
+cdb_delete_message_bodies (CamelDB *cdb,
+			   const gchar *folder_name,
+			   const GList *uids,
+			   GError **error)
+{
+	sqlite3_stmt *stmt = NULL;
+	const GList *link;
+	gint ret = 0;
+
+	cdb_writer_lock (cdb);
+
+	if (!cdb_check_body_index (cdb, FALSE, error)) {
+		cdb_writer_unlock (cdb);
+		return cdb->priv->body_index_state == CDB_BODY_INDEX_UNKNOWN ? -1 : 0;
+	}
+
+	if (!uids) {
+		gchar *cmd;
+
+		cmd = sqlite3_mprintf ("DELETE FROM " BODIES_UIDS_TABLE " WHERE folder_name = %Q", folder_name);
+		ret = cdb_sql_exec (cdb->priv->db, cmd, NULL, NULL, NULL, error);
+		sqlite3_free (cmd);
+
+		cdb_writer_unlock (cdb);
+
+		return ret;
+	}
+
+	if (sqlite3_prepare_v2 (cdb->priv->db, "DELETE FROM " BODIES_UIDS_TABLE " WHERE folder_name = ?1 AND uid = ?2", -1, &stmt, NULL) != SQLITE_OK) {
+		g_set_error (error, CAMEL_ERROR, CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+		sqlite3_finalize (stmt);
+		cdb_writer_unlock (cdb);
+		return -1;
+	}
+
+	sqlite3_bind_text (stmt, 1, folder_name, -1, SQLITE_STATIC);
+
+	for (link = uids; link && ret == 0; link = g_list_next (link)) {
+		sqlite3_bind_text (stmt, 2, link->data, -1, SQLITE_STATIC);
+
+		if (cdb_step_stmt (stmt) != SQLITE_DONE) {
+			g_set_error (error, CAMEL_ERROR, CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+			ret = -1;
+		}
+
+		sqlite3_reset (stmt);
+	}
+
+	sqlite3_finalize (stmt);
+
+	cdb_writer_unlock (cdb);
+
+	return ret;
+}
+
+/**
+ * camel_db_write_message_body:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: a message UID
+ * @body: text of the message body, in UTF-8
+ * @error: return location for a #GError, or %NULL
+ *
+ * Adds the @body of the message @uid in the folder @folder_name into
+ * the full-text index, which can be used by the body-contains search.
+ * It does nothing, when the message is already in the index. The index
+ * requires sqlite 3.34.0 or later, built with the FTS5 extension.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.40
+ **/
+gint
+camel_db_write_message_body (CamelDB *cdb,
+			     const gchar *folder_name,
+			     const gchar *uid,
+			     const gchar *body,
+			     GError **error)
+{
+	sqlite3_stmt *stmt = NULL;
+	gint ret;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), -1);
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (uid != NULL, -1);
+	g_return_val_if_fail (body != NULL, -1);
+
+	if (camel_db_begin_transaction (cdb, error) != 0)
+		return -1;
+
+	if (!cdb_check_body_index (cdb, TRUE, error)) {
+		if (cdb->priv->body_index_state == CDB_BODY_INDEX_UNSUPPORTED) {
+			g_set_error_literal (error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+				_("Full-text index is not supported by the installed SQLite library"));
+		}
+
+		camel_db_abort_transaction (cdb, NULL);
+		return -1;
+	}
+
+	ret = sqlite3_prepare_v2 (cdb->priv->db, "INSERT OR IGNORE INTO " BODIES_UIDS_TABLE " (folder_name, uid) VALUES (?1, ?2)", -1, &stmt, NULL);
+	if (ret == SQLITE_OK) {
+		sqlite3_bind_text (stmt, 1, folder_name, -1, SQLITE_STATIC);
+		sqlite3_bind_text (stmt, 2, uid, -1, SQLITE_STATIC);
+
+		ret = cdb_step_stmt (stmt);
+		sqlite3_finalize (stmt);
+		stmt = NULL;
+
+		if (ret == SQLITE_DONE && sqlite3_changes (cdb->priv->db) > 0) {
+			sqlite3_int64 id = sqlite3_last_insert_rowid (cdb->priv->db);
+
+			ret = sqlite3_prepare_v2 (cdb->priv->db, "INSERT INTO " BODIES_TABLE " (rowid, body) VALUES (?1, ?2)", -1, &stmt, NULL);
+			if (ret == SQLITE_OK) {
+				sqlite3_bind_int64 (stmt, 1, id);
+				sqlite3_bind_text (stmt, 2, body, -1, SQLITE_STATIC);
+
+				ret = cdb_step_stmt (stmt);
+			}
+
+			sqlite3_finalize (stmt);
+		}
+	}
+
+	if (ret != SQLITE_OK && ret != SQLITE_DONE) {
+		g_set_error (error, CAMEL_ERROR, CAMEL_ERROR_GENERIC, "%s", sqlite3_errmsg (cdb->priv->db));
+		camel_db_abort_transaction (cdb, NULL);
+		return -1;
+	}
+
+	return camel_db_end_transaction (cdb, error);
+}
+
+/**
+ * camel_db_has_message_body:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: a message UID
+ *
+ * Checks whether the body of the message @uid in the folder @folder_name
+ * had been added into the full-text index with camel_db_write_message_body().
+ *
+ * Returns: Whether the message body is in the full-text index.
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_db_has_message_body (CamelDB *cdb,
+			   const gchar *folder_name,
+			   const gchar *uid)
+{
+	gchar *query;
+	guint64 count = 0;
+	gboolean exists;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), FALSE);
+	g_return_val_if_fail (folder_name != NULL, FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
+
+	cdb_writer_lock (cdb);
+	exists = cdb_check_body_index (cdb, FALSE, NULL);
+	cdb_writer_unlock (cdb);
+
+	if (!exists)
+		return FALSE;
+
+	query = sqlite3_mprintf ("SELECT COUNT(*) FROM " BODIES_UIDS_TABLE " WHERE folder_name = %Q AND uid = %Q", folder_name, uid);
+	camel_db_select (cdb, query, (CamelDBSelectCB) get_number_cb, &count, NULL);
+	sqlite3_free (query);
+
+	return count > 0;
+}
+
+/**
+ * camel_db_count_message_bodies:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @out_count: (out): return location for the count
+ * @error: return location for a #GError, or %NULL
+ *
+ * Counts how many message bodies of the folder @folder_name are
+ * in the full-text index.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 3.40
+ **/
+gint
+camel_db_count_message_bodies (CamelDB *cdb,
+			       const gchar *folder_name,
+			       guint32 *out_count,
+			       GError **error)
+{
+	gchar *query;
+	guint64 count = 0;
+	gboolean exists;
+	gint ret;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), -1);
+	g_return_val_if_fail (folder_name != NULL, -1);
+	g_return_val_if_fail (out_count != NULL, -1);
+
+	*out_count = 0;
+
+	cdb_writer_lock (cdb);
+	exists = cdb_check_body_index (cdb, FALSE, error);
+	cdb_writer_unlock (cdb);
+
+	if (!exists)
+		return cdb->priv->body_index_state == CDB_BODY_INDEX_UNKNOWN ? -1 : 0;
+
+	query = sqlite3_mprintf ("SELECT COUNT(*) FROM " BODIES_UIDS_TABLE " WHERE folder_name = %Q", folder_name);
+	ret = camel_db_select (cdb, query, (CamelDBSelectCB) get_number_cb, &count, error);
+	sqlite3_free (query);
+
+	*out_count = (guint32) count;
+
+	return ret;
+}
+
+/**
+ * camel_db_get_body_match_sql:
+ * @folder_name: full name of the folder
+ * @match: an FTS5 MATCH query
+ *
+ * Constructs an SQL condition for the message info table of the folder
+ * @folder_name, which is satisfied by the messages, whose indexed body
+ * matches the @match query.
+ *
+ * Returns: (transfer full): an SQL condition. Free it with g_free(),
+ *    when no longer needed.
+ *
+ * Since: 3.40
+ **/
+gchar *
+camel_db_get_body_match_sql (const gchar *folder_name,
+			     const gchar *match)
+{
+	gchar *tmp, *res;
+
+	g_return_val_if_fail (folder_name != NULL, NULL);
+	g_return_val_if_fail (match != NULL, NULL);
+
+	tmp = sqlite3_mprintf (
+		"(uid IN (SELECT uid FROM " BODIES_UIDS_TABLE " WHERE folder_name = %Q AND "
+		"id IN (SELECT rowid FROM " BODIES_TABLE " WHERE " BODIES_TABLE " MATCH %Q)))",
+		folder_name, match);
+	res = g_strdup (tmp);
+	sqlite3_free (tmp);
+
+	return res;
+}
+
+/**
+ * camel_db_delete_uid:
+ * @cdb: a #CamelDB
+ * @folder_name: full name of the folder
+ * @uid: a message info UID to delete
+ * @error: return location for a #GError, or %NULL
+ *
+ * Deletes single mesage info in the given folder with
+ * the given UID.
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Since: 2.24
+ **/
+gint
+camel_db_delete_uid (CamelDB *cdb,
+                     const gchar *folder_name,
+                     const gchar *uid,
+                     GError **error)
+{
+	gchar *tab;
+	gint ret;
 
 	camel_db_begin_transaction (cdb, error);
 
@@ -2345,6 +3734,12 @@ camel_db_delete_uid (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, tab, error);
 	sqlite3_free (tab);
 
+	if (ret == 0) {
+		GList uids = { (gpointer) uid, NULL, NULL };
+
+		ret = cdb_delete_message_bodies (cdb, folder_name, &uids, error);
+	}
+
 	ret = camel_db_end_transaction (cdb, error);
 
 	camel_db_release_cache_memory ();
@@ -2424,10 +3819,16 @@ camel_db_delete_uids (CamelDB *cdb,
                       const GList *uids,
                       GError **error)
 {
+	gint ret;
+
 	if (!uids || !uids->data)
 		return 0;
 
-	return cdb_delete_ids (cdb, folder_name, uids, "", "uid", error);
+	ret = cdb_delete_ids (cdb, folder_name, uids, "", "uid", error);
+	if (ret == 0)
+		ret = cdb_delete_message_bodies (cdb, folder_name, uids, error);
+
+	return ret;
 }
 
 /**
@@ -2459,6 +3860,7 @@ camel_db_clear_folder_summary (CamelDB *cdb,
 
 	camel_db_add_to_transaction (cdb, msginfo_del, error);
 	camel_db_add_to_transaction (cdb, folders_del, error);
+	cdb_delete_message_bodies (cdb, folder_name, NULL, error);
 
 	ret = camel_db_end_transaction (cdb, error);
 
@@ -2489,6 +3891,8 @@ camel_db_delete_folder (CamelDB *cdb,
 	gint ret;
 	gchar *del;
 
+	cdb_forget_folder_caches (cdb, folder_name);
+
 	camel_db_begin_transaction (cdb, error);
 
 	del = sqlite3_mprintf ("DELETE FROM folders WHERE folder_name = %Q", folder_name);
@@ -2499,6 +3903,16 @@ camel_db_delete_folder (CamelDB *cdb,
 	ret = camel_db_add_to_transaction (cdb, del, error);
 	sqlite3_free (del);
 
+	ret = cdb_create_folder_counts_table (cdb, error);
+	if (ret == 0) {
+		del = sqlite3_mprintf ("DELETE FROM " FOLDER_COUNTS_TABLE " WHERE folder_name = %Q", folder_name);
+		ret = camel_db_add_to_transaction (cdb, del, error);
+		sqlite3_free (del);
+	}
+
+	if (ret == 0)
+		ret = cdb_delete_message_bodies (cdb, folder_name, NULL, error);
+
 	ret = camel_db_end_transaction (cdb, error);
 
 	camel_db_release_cache_memory ();
@@ -2527,25 +3941,66 @@ camel_db_rename_folder (CamelDB *cdb,
 	gint ret;
 	gchar *cmd;
 
-	camel_db_begin_transaction (cdb, error);
+	cdb_forget_folder_caches (cdb, old_folder_name);
+	cdb_forget_folder_caches (cdb, new_folder_name);
 
-	cmd = sqlite3_mprintf ("ALTER TABLE %Q RENAME TO  %Q", old_folder_name, new_folder_name);
-	ret = camel_db_add_to_transaction (cdb, cmd, error);
-	sqlite3_free (cmd);
+	if (camel_db_begin_transaction (cdb, error) != 0)
+		return -1;
 
-	cmd = sqlite3_mprintf ("ALTER TABLE '%q_version' RENAME TO  '%q_version'", old_folder_name, new_folder_name);
-	ret = camel_db_add_to_transaction (cdb, cmd, error);
-	sqlite3_free (cmd);
+	/* The triggers reference the folder by its name, thus recreate them */
+	ret = cdb_drop_folder_counts_triggers (cdb, old_folder_name, error);
 
-	cmd = sqlite3_mprintf ("UPDATE %Q SET modified=strftime(\"%%s\", 'now'), created=strftime(\"%%s\", 'now')", new_folder_name);
-	ret = camel_db_add_to_transaction (cdb, cmd, error);
-	sqlite3_free (cmd);
+	if (ret == 0) {
+		cmd = sqlite3_mprintf ("ALTER TABLE %Q RENAME TO  %Q", old_folder_name, new_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
 
-	cmd = sqlite3_mprintf ("UPDATE folders SET folder_name = %Q WHERE folder_name = %Q", new_folder_name, old_folder_name);
-	ret = camel_db_add_to_transaction (cdb, cmd, error);
-	sqlite3_free (cmd);
+	if (ret == 0) {
+		cmd = sqlite3_mprintf ("ALTER TABLE '%q_version' RENAME TO  '%q_version'", old_folder_name, new_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
 
-	ret = camel_db_end_transaction (cdb, error);
+	if (ret == 0) {
+		cmd = sqlite3_mprintf ("UPDATE %Q SET modified=strftime(\"%%s\", 'now'), created=strftime(\"%%s\", 'now')", new_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
+
+	if (ret == 0) {
+		cmd = sqlite3_mprintf ("UPDATE folders SET folder_name = %Q WHERE folder_name = %Q", new_folder_name, old_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
+
+	if (ret == 0)
+		ret = cdb_create_folder_counts_table (cdb, error);
+
+	if (ret == 0) {
+		cmd = sqlite3_mprintf ("DELETE FROM " FOLDER_COUNTS_TABLE " WHERE folder_name = %Q", old_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
+
+	if (ret == 0)
+		ret = cdb_ensure_folder_counts (cdb, new_folder_name, error);
+
+	if (ret == 0 && cdb_check_body_index (cdb, FALSE, NULL)) {
+		cmd = sqlite3_mprintf ("UPDATE " BODIES_UIDS_TABLE " SET folder_name = %Q WHERE folder_name = %Q", new_folder_name, old_folder_name);
+		ret = camel_db_add_to_transaction (cdb, cmd, error);
+		sqlite3_free (cmd);
+	}
+
+	if (ret == 0) {
+		ret = camel_db_end_transaction (cdb, error);
+	} else {
+		camel_db_abort_transaction (cdb, NULL);
+
+		/* The counted_folders cache could be updated by the aborted transaction */
+		cdb_forget_folder_caches (cdb, old_folder_name);
+		cdb_forget_folder_caches (cdb, new_folder_name);
+	}
 
 	camel_db_release_cache_memory ();
 	return ret;
@@ -2865,41 +4320,246 @@ camel_db_get_column_ident (GHashTable **hash,
 	return GPOINTER_TO_INT (value);
 }
 
-static gint
-get_number_cb (gpointer data,
-	       gint argc,
-	       gchar **argv,
-	       gchar **azColName)
+/* Call with the writer lock held */
+static gboolean
+cdb_read_page_stats (CamelDB *cdb,
+		     guint64 *out_page_count,
+		     guint64 *out_page_size,
+		     guint64 *out_freelist_count,
+		     guint64 *out_auto_vacuum,
+		     GError **error)
 {
-	guint64 *pui64 = data;
+	*out_page_count = 0;
+	*out_page_size = 0;
+	*out_freelist_count = 0;
+	*out_auto_vacuum = 0;
+
+	return cdb_sql_exec (cdb->priv->db, "PRAGMA main.page_count;", get_number_cb, out_page_count, NULL, error) == SQLITE_OK &&
+	       cdb_sql_exec (cdb->priv->db, "PRAGMA main.page_size;", get_number_cb, out_page_size, NULL, error) == SQLITE_OK &&
+	       cdb_sql_exec (cdb->priv->db, "PRAGMA main.freelist_count;", get_number_cb, out_freelist_count, NULL, error) == SQLITE_OK &&
+	       cdb_sql_exec (cdb->priv->db, "PRAGMA main.auto_vacuum;", get_number_cb, out_auto_vacuum, NULL, error) == SQLITE_OK;
+}
 
-	if (argc == 1) {
-		*pui64 = argv[0] ? g_ascii_strtoull (argv[0], NULL, 10) : 0;
-	} else {
-		*pui64 = 0;
+static gboolean
+cdb_needs_vacuum (guint64 page_count,
+		  guint64 page_size,
+		  guint64 freelist_count)
+{
+	/* Vacuum, if there's more than 5% of the free pages, or when free pages use more than 10MB */
+	return page_count && freelist_count &&
+		(freelist_count * page_size >= 1024 * 1024 * 10 || freelist_count * 1000 / page_count > 50);
+}
+
+/* Frees the pages in small steps, each holding the writer lock for about
+   CAMEL_DB_VACUUM_STEP_MSECS, thus the other threads can access the database
+   between the steps */
+static gboolean
+cdb_incremental_vacuum (CamelDB *cdb,
+			guint64 freelist_count,
+			GCancellable *cancellable,
+			GError **error)
+{
+	guint64 left = freelist_count;
+	guint n_pages = CAMEL_DB_VACUUM_MIN_PAGES;
+
+	while (left > 0) {
+		gchar *stmt;
+		guint64 was_left = left;
+		gint64 elapsed;
+		gint ret;
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error))
+			return FALSE;
+
+		stmt = g_strdup_printf ("PRAGMA main.incremental_vacuum(%u);", n_pages);
+
+		cdb_writer_lock (cdb);
+
+		elapsed = g_get_monotonic_time ();
+		ret = cdb_sql_exec (cdb->priv->db, stmt, NULL, NULL, NULL, error);
+		elapsed = (g_get_monotonic_time () - elapsed) / 1000;
+
+		if (ret == SQLITE_OK)
+			ret = cdb_sql_exec (cdb->priv->db, "PRAGMA main.freelist_count;", get_number_cb, &left, NULL, error);
+
+		cdb_writer_unlock (cdb);
+
+		g_free (stmt);
+
+		if (ret != SQLITE_OK)
+			return FALSE;
+
+		/* Other writers can free more pages meanwhile */
+		if (left >= was_left)
+			break;
+
+		camel_operation_progress (cancellable, left < freelist_count ? (freelist_count - left) * 100 / freelist_count : 0);
+
+		if (elapsed < CAMEL_DB_VACUUM_STEP_MSECS / 2 && n_pages < CAMEL_DB_VACUUM_MAX_PAGES)
+			n_pages *= 2;
+		else if (elapsed > CAMEL_DB_VACUUM_STEP_MSECS && n_pages > CAMEL_DB_VACUUM_MIN_PAGES)
+			n_pages /= 2;
+
+		g_thread_yield ();
 	}
 
+	return TRUE;
+}
+
+static gint
+cdb_collect_names_cb (gpointer data,
+		      gint argc,
+		      gchar **argv,
+		      gchar **azColName)
+{
+	GPtrArray *names = data;
+
+	if (argc == 1 && argv[0])
+		g_ptr_array_add (names, g_strdup (argv[0]));
+
 	return 0;
 }
 
+/* Analyzes one table at a time, with limited number of rows to read, when
+   the sqlite supports it (3.32.0+), thus it doesn't block the other threads
+   for too long */
+static gboolean
+cdb_analyze (CamelDB *cdb,
+	     GCancellable *cancellable,
+	     GError **error)
+{
+	GPtrArray *names;
+	gboolean success = TRUE;
+	guint ii;
+
+	names = g_ptr_array_new_with_free_func (g_free);
+
+	if (camel_db_select (cdb, "SELECT name FROM sqlite_master WHERE type='table' AND name NOT LIKE 'sqlite\\_%' ESCAPE '\\'",
+		cdb_collect_names_cb, names, error) != 0) {
+		g_ptr_array_unref (names);
+		return FALSE;
+	}
+
+	for (ii = 0; ii < names->len && success; ii++) {
+		gchar *stmt;
+
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			success = FALSE;
+			break;
+		}
+
+		stmt = sqlite3_mprintf ("ANALYZE main.\"%w\";", (const gchar *) names->pdata[ii]);
+
+		cdb_writer_lock (cdb);
+		/* Unknown pragmas are ignored by the older sqlite versions */
+		success = cdb_sql_exec (cdb->priv->db, "PRAGMA analysis_limit = " G_STRINGIFY (CAMEL_DB_ANALYSIS_LIMIT) ";", NULL, NULL, NULL, error) == SQLITE_OK &&
+			  cdb_sql_exec (cdb->priv->db, stmt, NULL, NULL, NULL, error) == SQLITE_OK;
+		cdb_writer_unlock (cdb);
+
+		sqlite3_free (stmt);
+
+		camel_operation_progress (cancellable, (ii + 1) * 100 / names->len);
+
+		g_thread_yield ();
+	}
+
+	g_ptr_array_unref (names);
+
+	if (success) {
+		cdb_writer_lock (cdb);
+		success = cdb_sql_exec (cdb->priv->db, "CREATE TABLE IF NOT EXISTS " CAMEL_DB_MAINTENANCE_TABLE " ( name TEXT PRIMARY KEY, value INTEGER )", NULL, NULL, NULL, error) == SQLITE_OK &&
+			  cdb_sql_exec (cdb->priv->db, "INSERT OR REPLACE INTO " CAMEL_DB_MAINTENANCE_TABLE " VALUES ('last_analyze', strftime ('%s', 'now'))", NULL, NULL, NULL, error) == SQLITE_OK;
+		cdb_writer_unlock (cdb);
+	}
+
+	return success;
+}
+
 /**
- * camel_db_maybe_run_maintenance:
+ * camel_db_get_last_analyze_time:
  * @cdb: a #CamelDB
- * @error: (allow-none): a #GError or %NULL
  *
- * Runs a @cdb maintenance, which includes vacuum, if necessary.
+ * Returns when camel_db_run_maintenance_sync() gathered the statistics
+ * about the tables of the @cdb the last time. The time is stored
+ * in the @cdb itself, thus it is preserved between the sessions.
+ *
+ * Returns: the time of the last ANALYZE, as seconds since the Epoch,
+ *    or 0, when the tables had not been analyzed yet
+ *
+ * Since: 3.40
+ **/
+gint64
+camel_db_get_last_analyze_time (CamelDB *cdb)
+{
+	guint64 value = 0;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), 0);
+
+	/* Errors, like with the table not existing yet, mean it had not been analyzed */
+	camel_db_select (cdb, "SELECT value FROM " CAMEL_DB_MAINTENANCE_TABLE " WHERE name = 'last_analyze'",
+		get_number_cb, &value, NULL);
+
+	return (gint64) value;
+}
+
+/**
+ * camel_db_needs_maintenance:
+ * @cdb: a #CamelDB
+ *
+ * Checks whether there are enough unused pages in the @cdb
+ * to run camel_db_run_maintenance_sync() on it.
+ *
+ * Returns: Whether the @cdb needs maintenance.
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_db_needs_maintenance (CamelDB *cdb)
+{
+	guint64 page_count, page_size, freelist_count, auto_vacuum;
+	gboolean needs;
+
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), FALSE);
+
+	cdb_writer_lock (cdb);
+	needs = cdb_read_page_stats (cdb, &page_count, &page_size, &freelist_count, &auto_vacuum, NULL) &&
+		cdb_needs_vacuum (page_count, page_size, freelist_count);
+	cdb_writer_unlock (cdb);
+
+	return needs;
+}
+
+/**
+ * camel_db_run_maintenance_sync:
+ * @cdb: a #CamelDB
+ * @analyze: whether to also gather statistics about the tables
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Runs a @cdb maintenance, which frees the unused pages, if there are enough
+ * of them, and optionally runs ANALYZE on the tables, thus the query planner
+ * can choose better indexes.
+ *
+ * The unused pages are freed in small steps with the incremental vacuum,
+ * thus the @cdb can be used by other threads meanwhile. Databases created
+ * before the incremental vacuum had been enabled are converted with one full
+ * VACUUM, which blocks the @cdb until it's done.
+ *
+ * The progress is reported with camel_operation_progress(), when
+ * the @cancellable is a #CamelOperation.
  *
  * Returns: Whether succeeded.
  *
- * Since: 3.16
+ * Since: 3.40
  **/
 gboolean
-camel_db_maybe_run_maintenance (CamelDB *cdb,
-				GError **error)
+camel_db_run_maintenance_sync (CamelDB *cdb,
+			       gboolean analyze,
+			       GCancellable *cancellable,
+			       GError **error)
 {
-	GError *local_error = NULL;
-	guint64 page_count = 0, page_size = 0, freelist_count = 0;
-	gboolean success = FALSE;
+	guint64 page_count = 0, page_size = 0, freelist_count = 0, auto_vacuum = 0;
+	gboolean success;
 
 	g_return_val_if_fail (CAMEL_IS_DB (cdb), FALSE);
 
@@ -2909,26 +4569,53 @@ camel_db_maybe_run_maintenance (CamelDB *cdb,
 			return FALSE;
 	}
 
+	camel_operation_push_message (cancellable, _("Optimizing folder database"));
+
 	cdb_writer_lock (cdb);
+	success = cdb_read_page_stats (cdb, &page_count, &page_size, &freelist_count, &auto_vacuum, error);
 
-	if (cdb_sql_exec (cdb->priv->db, "PRAGMA page_count;", get_number_cb, &page_count, NULL, &local_error) == SQLITE_OK &&
-	    cdb_sql_exec (cdb->priv->db, "PRAGMA page_size;", get_number_cb, &page_size, NULL, &local_error) == SQLITE_OK &&
-	    cdb_sql_exec (cdb->priv->db, "PRAGMA freelist_count;", get_number_cb, &freelist_count, NULL, &local_error) == SQLITE_OK) {
-		/* Vacuum, if there's more than 5% of the free pages, or when free pages use more than 10MB */
-		success = !page_count || !freelist_count || (freelist_count * page_size < 1024 * 1024 * 10 && freelist_count * 1000 / page_count <= 50) ||
-		    cdb_sql_exec (cdb->priv->db, "vacuum;", NULL, NULL, NULL, &local_error) == SQLITE_OK;
+	if (success && cdb_needs_vacuum (page_count, page_size, freelist_count) && auto_vacuum != CAMEL_DB_AUTO_VACUUM_INCREMENTAL) {
+		/* The auto_vacuum change is applied by the VACUUM; the next runs will be incremental */
+		success = cdb_sql_exec (cdb->priv->db, "PRAGMA main.auto_vacuum = INCREMENTAL;", NULL, NULL, NULL, error) == SQLITE_OK &&
+			  cdb_sql_exec (cdb->priv->db, "VACUUM;", NULL, NULL, NULL, error) == SQLITE_OK;
+		freelist_count = 0;
 	}
 
 	cdb_writer_unlock (cdb);
 
-	if (local_error) {
-		g_propagate_error (error, local_error);
-		success = FALSE;
-	}
+	if (success && cdb_needs_vacuum (page_count, page_size, freelist_count))
+		success = cdb_incremental_vacuum (cdb, freelist_count, cancellable, error);
+
+	if (success && analyze)
+		success = cdb_analyze (cdb, cancellable, error);
+
+	camel_operation_pop_message (cancellable);
 
 	return success;
 }
 
+/**
+ * camel_db_maybe_run_maintenance:
+ * @cdb: a #CamelDB
+ * @error: (allow-none): a #GError or %NULL
+ *
+ * Runs a @cdb maintenance, which includes vacuum, if necessary.
+ * This is the same as camel_db_run_maintenance_sync() without
+ * the ANALYZE and without a cancellable.
+ *
+ * Returns: Whether succeeded.
+ *
+ * Since: 3.16
+ **/
+gboolean
+camel_db_maybe_run_maintenance (CamelDB *cdb,
+				GError **error)
+{
+	g_return_val_if_fail (CAMEL_IS_DB (cdb), FALSE);
+
+	return camel_db_run_maintenance_sync (cdb, FALSE, NULL, error);
+}
+
 /**
  * camel_db_release_cache_memory:
  *
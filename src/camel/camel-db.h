@@ -26,6 +26,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 /* Standard GObject macros */
 #define CAMEL_TYPE_DB \
@@ -51,6 +52,7 @@ G_BEGIN_DECLS
 typedef struct _CamelDB CamelDB;
 typedef struct _CamelDBClass CamelDBClass;
 typedef struct _CamelDBPrivate CamelDBPrivate;
+typedef struct _CamelDBMessageInfoBatch CamelDBMessageInfoBatch;
 
 /**
  * CamelDB:
@@ -358,6 +360,20 @@ gint		camel_db_rename_folder		(CamelDB *cdb,
 gint		camel_db_delete_folder		(CamelDB *cdb,
 						 const gchar *folder_name,
 						 GError **error);
+gint		camel_db_write_message_body	(CamelDB *cdb,
+						 const gchar *folder_name,
+						 const gchar *uid,
+						 const gchar *body,
+						 GError **error);
+gboolean	camel_db_has_message_body	(CamelDB *cdb,
+						 const gchar *folder_name,
+						 const gchar *uid);
+gint		camel_db_count_message_bodies	(CamelDB *cdb,
+						 const gchar *folder_name,
+						 guint32 *out_count,
+						 GError **error);
+gchar *		camel_db_get_body_match_sql	(const gchar *folder_name,
+						 const gchar *match);
 gint		camel_db_delete_uid		(CamelDB *cdb,
 						 const gchar *folder_name,
 						 const gchar *uid,
@@ -391,6 +407,24 @@ gint		camel_db_write_message_info_record
 						 const gchar *folder_name,
 						 CamelMIRecord *record,
 						 GError **error);
+CamelDBMessageInfoBatch *
+		camel_db_message_info_batch_new	(CamelDB *cdb,
+						 const gchar *folder_name,
+						 guint max_rows,
+						 guint max_msecs,
+						 GError **error);
+gint		camel_db_message_info_batch_add	(CamelDBMessageInfoBatch *batch,
+						 const CamelMIRecord *record,
+						 GError **error);
+gint		camel_db_message_info_batch_update_flags
+						(CamelDBMessageInfoBatch *batch,
+						 const CamelMIRecord *record,
+						 gboolean *out_updated,
+						 GError **error);
+gint		camel_db_message_info_batch_end	(CamelDBMessageInfoBatch *batch,
+						 GError **error);
+void		camel_db_message_info_batch_abort
+						(CamelDBMessageInfoBatch *batch);
 gint		camel_db_read_message_info_records
 						(CamelDB *cdb,
 						 const gchar *folder_name,
@@ -473,6 +507,12 @@ gint		camel_db_reset_folder_version	(CamelDB *cdb,
 						 GError **error);
 gboolean	camel_db_maybe_run_maintenance	(CamelDB *cdb,
 						 GError **error);
+gboolean	camel_db_needs_maintenance	(CamelDB *cdb);
+gint64		camel_db_get_last_analyze_time	(CamelDB *cdb);
+gboolean	camel_db_run_maintenance_sync	(CamelDB *cdb,
+						 gboolean analyze,
+						 GCancellable *cancellable,
+						 GError **error);
 
 void		camel_db_release_cache_memory	(void);
 
@@ -33,7 +33,7 @@
 #include <string.h>
 
 #define READ_PAD (128)		/* bytes padded before buffer */
-#define READ_SIZE (4096)
+#define READ_SIZE (32768)
 
 struct _CamelFilterInputStreamPrivate {
 	CamelMimeFilter *filter;
@@ -34,6 +34,7 @@
 #include <glib/gi18n-lib.h>
 
 #include "camel-folder-search.h"
+#include "camel-folder-summary-private.h"
 #include "camel-folder-thread.h"
 #include "camel-iconv.h"
 #include "camel-medium.h"
@@ -47,6 +48,7 @@
 #include "camel-vee-folder.h"
 #include "camel-string-utils.h"
 #include "camel-search-sql-sexp.h"
+#include "camel-search-sql-sexp-private.h"
 
 #ifdef G_OS_WIN32
 #ifdef localtime_r
@@ -59,6 +61,20 @@
 #define r(x)
 #define dd(x) if (camel_debug("search")) x
 
+/* The body search of cached messages is split between up to this many threads */
+#define MAX_BODY_SEARCH_WORKERS 8
+/* Each worker should get at least this many messages, to be worth it */
+#define MIN_BODY_SEARCH_PER_WORKER 4
+
+/* How many results of the recent searches are remembered */
+#define MAX_CACHED_SEARCHES 8
+
+typedef struct _SearchCacheEntry {
+	guint64 revision;	/* summary revision the matches correspond to */
+	GPtrArray *uids;	/* gchar *uid, camel_pstring_strdup()-ed, sorted by camel_folder_sort_uids() */
+	GHashTable *matches;	/* const gchar *uid, borrowed from the 'uids' */
+} SearchCacheEntry;
+
 struct _CamelFolderSearchPrivate {
 	CamelSExp *sexp;		/* s-exp evaluator */
 	gchar *last_search;	/* last searched expression */
@@ -89,6 +105,11 @@ struct _CamelFolderSearchPrivate {
 	GPtrArray *owned_pstrings;
 
 	gboolean only_cached_messages;
+
+	/* Results of the recent searches, valid for the result_cache_folder only */
+	GHashTable *result_cache; /* gchar *expr ~> SearchCacheEntry * */
+	GQueue result_cache_order; /* gchar *expr, the keys of the result_cache, the oldest first */
+	GWeakRef result_cache_folder;
 };
 
 typedef enum {
@@ -471,6 +492,10 @@ match_message_index (CamelIndex *idx,
 	const gchar *word, *name;
 	gint truth = FALSE;
 
+	/* most messages do not contain the word, which the name's filter can tell without a disk access */
+	if (!camel_index_may_match (idx, uid, match))
+		return FALSE;
+
 	wc = camel_index_words (idx);
 	if (wc) {
 		while (!truth && (word = camel_index_cursor_next (wc))) {
@@ -663,13 +688,138 @@ match_words_message (CamelFolderSearch *search,
 	return truth;
 }
 
+enum {
+	BODY_SEARCH_NOT_CACHED = 0,
+	BODY_SEARCH_NO_MATCH,
+	BODY_SEARCH_MATCH
+};
+
+typedef struct _BodySearchData {
+	CamelFolder *folder;
+	GPtrArray *uids;	/* const gchar *, the candidates */
+	struct _camel_search_words *words;
+	GCancellable *cancellable;
+	guint8 *results;	/* BODY_SEARCH_..., one for each of the 'uids' */
+	gint next_index;	/* atomic */
+} BodySearchData;
+
+static gpointer
+body_search_worker_thread (gpointer user_data)
+{
+	BodySearchData *bsd = user_data;
+	gint index;
+
+	/* Workers take the next candidate, thus they do not wait for each other on large messages */
+	for (;;) {
+		CamelMimeMessage *msg;
+
+		index = g_atomic_int_add (&bsd->next_index, 1);
+
+		if (index >= (gint) bsd->uids->len || g_cancellable_is_cancelled (bsd->cancellable))
+			break;
+
+		/* The cached message is parsed from the folder's data cache into a new message,
+		   independently of the other workers, thus no folder lock is involved here */
+		msg = camel_folder_get_message_cached (bsd->folder, g_ptr_array_index (bsd->uids, index), bsd->cancellable);
+		if (msg) {
+			guint32 mask = 0;
+
+			bsd->results[index] = match_words_1message ((CamelDataWrapper *) msg, bsd->words, &mask, bsd->cancellable) ?
+				BODY_SEARCH_MATCH : BODY_SEARCH_NO_MATCH;
+
+			g_object_unref (msg);
+		}
+	}
+
+	return NULL;
+}
+
+static guint
+body_search_get_n_workers (guint n_uids)
+{
+	guint n_workers;
+
+	n_workers = MIN (g_get_num_processors (), MAX_BODY_SEARCH_WORKERS);
+	n_workers = MIN (n_workers, n_uids / MIN_BODY_SEARCH_PER_WORKER);
+
+	return MAX (n_workers, 1);
+}
+
+/* Adds matching 'uids' into 'matches', in the order of the 'uids' */
+static void
+match_words_messages_uids (CamelFolderSearch *search,
+			   GPtrArray *uids,
+			   struct _camel_search_words *words,
+			   GPtrArray *matches,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	BodySearchData bsd;
+	GThread *threads[MAX_BODY_SEARCH_WORKERS];
+	guint ii, n_workers;
+
+	/* The workers read only the cached messages, which not every provider can
+	   do; the serial search would download each of the candidates otherwise */
+	if (CAMEL_FOLDER_GET_CLASS (search->priv->folder)->get_message_cached)
+		n_workers = body_search_get_n_workers (uids->len);
+	else
+		n_workers = 1;
+
+	if (n_workers <= 1) {
+		for (ii = 0; ii < uids->len && !g_cancellable_is_cancelled (cancellable); ii++) {
+			const gchar *uid = g_ptr_array_index (uids, ii);
+
+			if (match_words_message (search,
+				search->priv->folder, uid, words,
+				cancellable, error))
+				g_ptr_array_add (matches, (gchar *) uid);
+		}
+
+		return;
+	}
+
+	bsd.folder = search->priv->folder;
+	bsd.uids = uids;
+	bsd.words = words;
+	bsd.cancellable = cancellable;
+	bsd.results = g_new0 (guint8, uids->len);
+	bsd.next_index = 0;
+
+	/* The calling thread is one of the workers */
+	for (ii = 0; ii < n_workers - 1; ii++) {
+		threads[ii] = g_thread_new ("CamelFolderSearch::body", body_search_worker_thread, &bsd);
+	}
+
+	body_search_worker_thread (&bsd);
+
+	for (ii = 0; ii < n_workers - 1; ii++) {
+		g_thread_join (threads[ii]);
+	}
+
+	for (ii = 0; ii < uids->len && !g_cancellable_is_cancelled (cancellable); ii++) {
+		const gchar *uid = g_ptr_array_index (uids, ii);
+		gboolean truth;
+
+		/* Messages not in the cache are downloaded serially, as before */
+		if (bsd.results[ii] == BODY_SEARCH_NOT_CACHED)
+			truth = !camel_folder_search_get_only_cached_messages (search) &&
+				match_words_message (search, search->priv->folder, uid, words, cancellable, error);
+		else
+			truth = bsd.results[ii] == BODY_SEARCH_MATCH;
+
+		if (truth)
+			g_ptr_array_add (matches, (gchar *) uid);
+	}
+
+	g_free (bsd.results);
+}
+
 static GPtrArray *
 match_words_messages (CamelFolderSearch *search,
                       struct _camel_search_words *words,
                       GCancellable *cancellable,
                       GError **error)
 {
-	gint i;
 	GPtrArray *matches = g_ptr_array_new ();
 
 	if (g_cancellable_set_error_if_cancelled (cancellable, error))
@@ -683,27 +833,13 @@ match_words_messages (CamelFolderSearch *search,
 		indexed = match_words_index (search, simple, cancellable, error);
 		camel_search_words_free (simple);
 
-		for (i = 0; i < indexed->len && !g_cancellable_is_cancelled (cancellable); i++) {
-			const gchar *uid = g_ptr_array_index (indexed, i);
-
-			if (match_words_message (search,
-					search->priv->folder, uid, words,
-					cancellable, error))
-				g_ptr_array_add (matches, (gchar *) uid);
-		}
+		match_words_messages_uids (search, indexed, words, matches, cancellable, error);
 
 		g_ptr_array_free (indexed, TRUE);
 	} else {
 		GPtrArray *v = camel_folder_search_get_current_summary (search);
 
-		for (i = 0; i < v->len && !g_cancellable_is_cancelled (cancellable); i++) {
-			gchar *uid = g_ptr_array_index (v, i);
-
-			if (match_words_message (search,
-				search->priv->folder, uid, words,
-				cancellable, error))
-				g_ptr_array_add (matches, (gchar *) uid);
-		}
+		match_words_messages_uids (search, v, words, matches, cancellable, error);
 	}
 
 	return matches;
@@ -752,6 +888,19 @@ folder_search_header_has_words (CamelSExp *sexp,
 	return check_header (sexp, argc, argv, search, CAMEL_SEARCH_MATCH_WORD);
 }
 
+static void
+search_cache_entry_free (gpointer ptr)
+{
+	SearchCacheEntry *entry = ptr;
+
+	if (entry) {
+		g_hash_table_destroy (entry->matches);
+		g_ptr_array_foreach (entry->uids, (GFunc) camel_pstring_free, NULL);
+		g_ptr_array_free (entry->uids, TRUE);
+		g_slice_free (SearchCacheEntry, entry);
+	}
+}
+
 static void
 folder_search_dispose (GObject *object)
 {
@@ -769,6 +918,9 @@ folder_search_finalize (GObject *object)
 	CamelFolderSearch *search = CAMEL_FOLDER_SEARCH (object);
 
 	g_free (search->priv->last_search);
+	g_hash_table_destroy (search->priv->result_cache);
+	g_queue_clear (&search->priv->result_cache_order);
+	g_weak_ref_clear (&search->priv->result_cache_folder);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (camel_folder_search_parent_class)->finalize (object);
@@ -1842,6 +1994,9 @@ camel_folder_search_init (CamelFolderSearch *search)
 	search->priv = camel_folder_search_get_instance_private (search);
 	search->priv->sexp = camel_sexp_new ();
 	search->priv->only_cached_messages = FALSE;
+	search->priv->result_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, search_cache_entry_free);
+	g_queue_init (&search->priv->result_cache_order);
+	g_weak_ref_init (&search->priv->result_cache_folder, NULL);
 }
 
 /**
@@ -2106,7 +2261,6 @@ do_search_in_memory (CamelFolder *search_in_folder,
 {
 	/* if the expression contains any of these tokens, then perform a memory search, instead of the SQL one */
 	const gchar *in_memory_tokens[] = {
-		"body-contains",
 		"body-regex",
 		"match-threads",
 		"message-location",
@@ -2132,7 +2286,28 @@ do_search_in_memory (CamelFolder *search_in_folder,
 			return TRUE;
 	}
 
-	*psql_query = camel_sexp_to_sql_sexp (expr);
+	if (strstr (expr, "body-contains")) {
+		CamelStore *parent_store;
+		CamelFolderSummary *summary;
+		CamelDB *cdb;
+		const gchar *full_name;
+		guint32 n_indexed = 0;
+
+		/* the body-contains can be done by the SQL only when all the messages of the folder are indexed */
+		parent_store = search_in_folder ? camel_folder_get_parent_store (search_in_folder) : NULL;
+		cdb = parent_store ? camel_store_get_db (parent_store) : NULL;
+		summary = search_in_folder ? camel_folder_get_folder_summary (search_in_folder) : NULL;
+		full_name = search_in_folder ? camel_folder_get_full_name (search_in_folder) : NULL;
+
+		if (!cdb || !summary || !full_name ||
+		    camel_db_count_message_bodies (cdb, full_name, &n_indexed, NULL) != 0 ||
+		    n_indexed < camel_folder_summary_count (summary))
+			return TRUE;
+
+		*psql_query = camel_sexp_to_sql_sexp_with_body_index (expr, full_name);
+	} else {
+		*psql_query = camel_sexp_to_sql_sexp (expr);
+	}
 
 	/* unknown column can cause NULL sql_query, then an in-memory
 	 * search is required */
@@ -2149,6 +2324,55 @@ free_pstring_array (GPtrArray *array)
 	g_ptr_array_free (array, TRUE);
 }
 
+/* Returns uids of the messages, which can possibly match the 'expr', as preselected
+   by the SQL from the parts of the 'expr' the database can evaluate, or NULL, when
+   no such preselection can be done. Free the array with free_pstring_array(). */
+static GPtrArray *
+folder_search_prefilter_uids (CamelFolderSearch *search,
+			      const gchar *expr)
+{
+	CamelFolderSummary *summary;
+	CamelStore *parent_store;
+	CamelDB *cdb;
+	GPtrArray *uids;
+	gchar *where, *tmp, *tmp1;
+
+	summary = camel_folder_get_folder_summary (search->priv->folder);
+	parent_store = camel_folder_get_parent_store (search->priv->folder);
+	cdb = parent_store ? camel_store_get_db (parent_store) : NULL;
+
+	/* the threads need to see the whole folder */
+	if (!summary || !cdb || strstr (expr, "match-threads") ||
+	    (camel_folder_summary_get_flags (summary) & CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY) != 0)
+		return NULL;
+
+	where = _camel_sexp_to_sql_sexp_prefilter (expr, NULL);
+	if (!where)
+		return NULL;
+
+	/* Sync the db, so that the preselection covers the changes */
+	if (camel_folder_summary_save (summary, NULL)) {
+		tmp1 = camel_db_sqlize_string (camel_folder_get_full_name (search->priv->folder));
+		tmp = g_strdup_printf ("SELECT uid FROM %s WHERE %s", tmp1, where);
+		camel_db_free_sqlized_string (tmp1);
+		dd (printf ("Prefilter sql: \"%s\"\n", tmp));
+
+		uids = g_ptr_array_new ();
+		if (camel_db_select (cdb, tmp, (CamelDBSelectCB) read_uid_callback, uids, NULL) != 0) {
+			free_pstring_array (uids);
+			uids = NULL;
+		}
+
+		g_free (tmp);
+	} else {
+		uids = NULL;
+	}
+
+	g_free (where);
+
+	return uids;
+}
+
 /**
  * camel_folder_search_count:
  * @search: a #CamelFolderSearch
@@ -2311,30 +2535,15 @@ fail:
 	return count;
 }
 
-/**
- * camel_folder_search_search:
- * @search: a #CamelFolderSearch
- * @expr: a search expression to run
- * @uids: (element-type utf8): to search against, NULL for all uid's.
- * @cancellable: a #GCancellable
- * @error: return location for a #GError, or %NULL
- *
- * Run a search.  Search must have had Folder already set on it, and
- * it must implement summaries.
- *
- * Returns: (element-type utf8) (transfer full): a #GPtrArray with matching UIDs,
- *    or %NULL on error. Use camel_folder_search_free_result() to free it when
- *    no longer needed.
- **/
-GPtrArray *
-camel_folder_search_search (CamelFolderSearch *search,
-                            const gchar *expr,
-                            GPtrArray *uids,
-                            GCancellable *cancellable,
-                            GError **error)
+static GPtrArray *
+folder_search_search_internal (CamelFolderSearch *search,
+			       const gchar *expr,
+			       GPtrArray *uids,
+			       GCancellable *cancellable,
+			       GError **error)
 {
 	CamelSExpResult *r;
-	GPtrArray *matches = NULL, *summary_set;
+	GPtrArray *matches = NULL, *summary_set, *prefiltered_uids = NULL;
 	gint i;
 	CamelDB *cdb;
 	gchar *sql_query = NULL, *tmp, *tmp1;
@@ -2363,6 +2572,12 @@ camel_folder_search_search (CamelFolderSearch *search,
 
 	/* We route body-contains / thread based search and uid search through memory and not via db. */
 	if (uids || do_search_in_memory (search->priv->folder, expr, &sql_query)) {
+		/* let the database preselect the candidates, when it can evaluate part of the expression */
+		if (!uids) {
+			prefiltered_uids = folder_search_prefilter_uids (search, expr);
+			uids = prefiltered_uids;
+		}
+
 		/* setup our search list only contains those we're interested in */
 		search->priv->summary = camel_folder_get_summary (search->priv->folder);
 
@@ -2488,6 +2703,8 @@ fail:
 	search->priv->summary_set = NULL;
 	search->priv->body_index = NULL;
 
+	free_pstring_array (prefiltered_uids);
+
 	if (error && *error) {
 		camel_folder_search_free_result (search, matches);
 		matches = NULL;
@@ -2496,6 +2713,294 @@ fail:
 	return matches;
 }
 
+static gboolean
+folder_search_can_cache_result (CamelFolderSearch *search,
+				const gchar *expr)
+{
+	/* the result of these depends on more than the message infos */
+	const gchar *volatile_tokens[] = {
+		"match-threads",
+		"message-location",
+		"get-current-date",
+		"get-relative-months",
+		NULL };
+	gint ii;
+
+	for (ii = 0; volatile_tokens[ii]; ii++) {
+		if (strstr (expr, volatile_tokens[ii]))
+			return FALSE;
+	}
+
+	/* the set of the cached messages can change without the summary knowing it */
+	if (search->priv->only_cached_messages && strstr (expr, "body-"))
+		return FALSE;
+
+	return TRUE;
+}
+
+/* Returns a copy of the cached matches, in the order of the folder UIDs */
+static GPtrArray *
+folder_search_copy_cached_result (SearchCacheEntry *entry)
+{
+	GPtrArray *result;
+	guint ii;
+
+	result = g_ptr_array_sized_new (entry->uids->len);
+
+	for (ii = 0; ii < entry->uids->len; ii++) {
+		g_ptr_array_add (result, (gpointer) camel_pstring_strdup (entry->uids->pdata[ii]));
+	}
+
+	return result;
+}
+
+static SearchCacheEntry *
+folder_search_cache_result (CamelFolderSearch *search,
+			    CamelFolder *folder,
+			    const gchar *expr,
+			    guint64 revision,
+			    GPtrArray *matches)
+{
+	SearchCacheEntry *entry;
+	gchar *key;
+	guint ii;
+
+	while (g_queue_get_length (&search->priv->result_cache_order) >= MAX_CACHED_SEARCHES) {
+		/* the key is freed by the hash table */
+		key = g_queue_pop_head (&search->priv->result_cache_order);
+		g_hash_table_remove (search->priv->result_cache, key);
+	}
+
+	entry = g_slice_new0 (SearchCacheEntry);
+	entry->revision = revision;
+	entry->uids = g_ptr_array_sized_new (matches->len);
+	entry->matches = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (ii = 0; ii < matches->len; ii++) {
+		const gchar *uid = matches->pdata[ii];
+
+		if (!g_hash_table_contains (entry->matches, uid)) {
+			uid = camel_pstring_strdup (uid);
+			g_ptr_array_add (entry->uids, (gpointer) uid);
+			g_hash_table_add (entry->matches, (gpointer) uid);
+		}
+	}
+
+	/* the SQL query returns the matches in its own order */
+	camel_folder_sort_uids (folder, entry->uids);
+
+	key = g_strdup (expr);
+	g_hash_table_insert (search->priv->result_cache, key, entry);
+	g_queue_push_tail (&search->priv->result_cache_order, key);
+
+	return entry;
+}
+
+static void
+folder_search_uncache_result (CamelFolderSearch *search,
+			      const gchar *expr)
+{
+	GList *link;
+
+	link = g_queue_find_custom (&search->priv->result_cache_order, expr, (GCompareFunc) strcmp);
+	if (link) {
+		g_queue_delete_link (&search->priv->result_cache_order, link);
+		g_hash_table_remove (search->priv->result_cache, expr);
+	}
+}
+
+/* Updates the cached result of the 'expr' with the changes done in the summary
+   since it had been computed. Returns FALSE, when the entry cannot be updated
+   this way, but it needs to be recomputed. */
+static gboolean
+folder_search_update_cached_result (CamelFolderSearch *search,
+				    CamelFolder *folder,
+				    CamelFolderSummary *summary,
+				    const gchar *expr,
+				    SearchCacheEntry *entry,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	GHashTable *changed;
+	guint64 revision = 0;
+	gboolean success = TRUE;
+
+	changed = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+
+	if (!_camel_folder_summary_get_changes_since (summary, entry->revision, &revision, changed) ||
+	    g_hash_table_size (changed) > camel_folder_summary_count (summary) / 4) {
+		/* too many changes, the full search is cheaper */
+		success = FALSE;
+	} else if (g_hash_table_size (changed) > 0) {
+		GHashTableIter iter;
+		GHashTable *still_matching;
+		GPtrArray *uids, *matches;
+		GError *local_error = NULL;
+		gpointer key;
+		gboolean added = FALSE;
+		guint ii, jj;
+
+		uids = g_ptr_array_sized_new (g_hash_table_size (changed));
+
+		g_hash_table_iter_init (&iter, changed);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_ptr_array_add (uids, key);
+		}
+
+		/* the removed messages are not part of the summary, thus they do not match */
+		search->priv->folder = folder;
+		matches = folder_search_search_internal (search, expr, uids, cancellable, &local_error);
+
+		g_ptr_array_free (uids, TRUE);
+
+		if (local_error) {
+			g_propagate_error (error, local_error);
+			success = FALSE;
+		} else {
+			still_matching = g_hash_table_new (g_str_hash, g_str_equal);
+
+			for (ii = 0; matches && ii < matches->len; ii++) {
+				g_hash_table_add (still_matching, matches->pdata[ii]);
+			}
+
+			/* drop the changed messages, which do not match anymore,
+			   the others keep their place in the sorted 'uids' */
+			for (ii = 0, jj = 0; ii < entry->uids->len; ii++) {
+				gchar *uid = entry->uids->pdata[ii];
+
+				if (g_hash_table_contains (changed, uid) && !g_hash_table_contains (still_matching, uid)) {
+					g_hash_table_remove (entry->matches, uid);
+					camel_pstring_free (uid);
+				} else {
+					entry->uids->pdata[jj] = uid;
+					jj++;
+				}
+			}
+
+			g_ptr_array_set_size (entry->uids, jj);
+
+			for (ii = 0; matches && ii < matches->len; ii++) {
+				const gchar *uid = matches->pdata[ii];
+
+				if (!g_hash_table_contains (entry->matches, uid)) {
+					uid = camel_pstring_strdup (uid);
+					g_ptr_array_add (entry->uids, (gpointer) uid);
+					g_hash_table_add (entry->matches, (gpointer) uid);
+					added = TRUE;
+				}
+			}
+
+			if (added)
+				camel_folder_sort_uids (folder, entry->uids);
+
+			g_hash_table_destroy (still_matching);
+		}
+
+		camel_folder_search_free_result (search, matches);
+	}
+
+	if (success)
+		entry->revision = revision;
+
+	g_hash_table_destroy (changed);
+
+	return success;
+}
+
+/**
+ * camel_folder_search_search:
+ * @search: a #CamelFolderSearch
+ * @expr: a search expression to run
+ * @uids: (element-type utf8): to search against, NULL for all uid's.
+ * @cancellable: a #GCancellable
+ * @error: return location for a #GError, or %NULL
+ *
+ * Run a search.  Search must have had Folder already set on it, and
+ * it must implement summaries.
+ *
+ * Results of the recent searches over the whole folder are remembered
+ * and only the messages changed since the last search with the same
+ * @expr are searched again. Such results are sorted with camel_folder_sort_uids().
+ *
+ * Returns: (element-type utf8) (transfer full): a #GPtrArray with matching UIDs,
+ *    or %NULL on error. Use camel_folder_search_free_result() to free it when
+ *    no longer needed.
+ **/
+GPtrArray *
+camel_folder_search_search (CamelFolderSearch *search,
+                            const gchar *expr,
+                            GPtrArray *uids,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	CamelFolder *folder, *cache_folder;
+	CamelFolderSummary *summary;
+	SearchCacheEntry *entry;
+	GPtrArray *matches;
+	GError *local_error = NULL;
+	guint64 revision;
+
+	g_return_val_if_fail (search != NULL, NULL);
+
+	if (!expr || !*expr)
+		expr = "(match-all)";
+
+	folder = search->priv->folder;
+	summary = folder ? camel_folder_get_folder_summary (folder) : NULL;
+
+	/* the in-memory summaries, like those of the virtual folders, do not see
+	   changes of the messages they reference, thus they cannot be cached */
+	if (uids || !summary || !folder_search_can_cache_result (search, expr) ||
+	    (camel_folder_summary_get_flags (summary) & CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY) != 0 ||
+	    g_cancellable_is_cancelled (cancellable))
+		return folder_search_search_internal (search, expr, uids, cancellable, error);
+
+	cache_folder = g_weak_ref_get (&search->priv->result_cache_folder);
+	if (cache_folder != folder) {
+		g_hash_table_remove_all (search->priv->result_cache);
+		g_queue_clear (&search->priv->result_cache_order);
+		g_weak_ref_set (&search->priv->result_cache_folder, folder);
+	}
+	g_clear_object (&cache_folder);
+
+	entry = g_hash_table_lookup (search->priv->result_cache, expr);
+	if (entry) {
+		if (folder_search_update_cached_result (search, folder, summary, expr, entry, cancellable, &local_error)) {
+			matches = folder_search_copy_cached_result (entry);
+
+			search->priv->folder = NULL;
+
+			return matches;
+		}
+
+		folder_search_uncache_result (search, expr);
+
+		if (local_error) {
+			g_propagate_error (error, local_error);
+			search->priv->folder = NULL;
+
+			return NULL;
+		}
+	}
+
+	/* changes done during the search are applied with the next search */
+	revision = _camel_folder_summary_get_revision (summary);
+
+	search->priv->folder = folder;
+	matches = folder_search_search_internal (search, expr, NULL, cancellable, &local_error);
+
+	if (local_error)
+		g_propagate_error (error, local_error);
+	else if (matches && !g_cancellable_is_cancelled (cancellable)) {
+		entry = folder_search_cache_result (search, folder, expr, revision, matches);
+
+		camel_folder_search_free_result (search, matches);
+		matches = folder_search_copy_cached_result (entry);
+	}
+
+	return matches;
+}
+
 /**
  * camel_folder_search_free_result:
  * @search: a #CamelFolderSearch
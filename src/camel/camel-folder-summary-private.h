@@ -0,0 +1,32 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMEL_FOLDER_SUMMARY_PRIVATE_H
+#define CAMEL_FOLDER_SUMMARY_PRIVATE_H
+
+#include "camel-folder-summary.h"
+
+G_BEGIN_DECLS
+
+guint64		_camel_folder_summary_get_revision
+						(CamelFolderSummary *summary);
+gboolean	_camel_folder_summary_get_changes_since
+						(CamelFolderSummary *summary,
+						 guint64 since,
+						 guint64 *out_revision,
+						 GHashTable *out_uids);
+
+G_END_DECLS
+
+#endif /* CAMEL_FOLDER_SUMMARY_PRIVATE_H */
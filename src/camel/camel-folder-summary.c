@@ -35,6 +35,7 @@
 #include "camel-debug.h"
 #include "camel-file-utils.h"
 #include "camel-folder-summary.h"
+#include "camel-folder-summary-private.h"
 #include "camel-folder.h"
 #include "camel-iconv.h"
 #include "camel-message-info.h"
@@ -52,12 +53,17 @@
 #include "camel-stream-null.h"
 #include "camel-string-utils.h"
 #include "camel-store.h"
+#include "camel-store-settings.h"
 #include "camel-vee-folder.h"
 #include "camel-vtrash-folder.h"
 #include "camel-mime-part-utils.h"
 
 /* Make 5 minutes as default cache drop */
 #define SUMMARY_CACHE_DROP 300
+
+/* Commit saved message infos in chunks, to let other threads use the DB in the meantime */
+#define SAVE_BATCH_MAX_ROWS 5000
+#define SAVE_BATCH_MAX_MSECS 500
 #define dd(x) if (camel_debug("sync")) x
 
 struct _CamelFolderSummaryPrivate {
@@ -91,13 +97,45 @@ struct _CamelFolderSummaryPrivate {
 	guint32 visible_count;
 
 	GHashTable *uids; /* uids of all known message infos; the 'value' are used flags for the message info */
-	GHashTable *loaded_infos; /* uid->CamelMessageInfo *, those currently in memory */
+	GHashTable *loaded_infos; /* uid->LoadedInfo *, those currently in memory */
+	GQueue loaded_lru; /* LoadedInfo *, the most recently used at the head */
 
 	struct _CamelFolder *folder; /* parent folder, for events */
 	time_t cache_load_time;
 	guint timeout_handle;
+
+	guint cache_limit; /* how many infos to keep loaded at most, 0 for no limit */
+	CamelSettings *cache_settings; /* the parent store's settings, the 'cache_limit' is read from */
+	gulong cache_settings_handler_id;
+	time_t fetch_all_time; /* when camel_folder_summary_prepare_fetch_all() had been called */
+	guint64 cache_hits;
+	guint64 cache_misses;
+	guint64 cache_evictions;
+
+	/* The UID index, built on demand from 'uids'; either all the UIDs are numeric
+	   and they are in the 'numeric_uids', or they are borrowed in the 'sorted_uids' */
+	gboolean uid_index_valid;
+	GArray *numeric_uids; /* guint32, sorted ascending */
+	GPtrArray *sorted_uids; /* const gchar *, borrowed keys of 'uids', sorted by strcmp() */
+
+	GHashTable *dirty_uids; /* uids of the loaded infos, which had been marked dirty; saved by camel_folder_summary_save() */
+
+	/* Each change of the infos increments the 'revision'; the uids of the last changes
+	   are in the 'changes', they are those made after the 'changes_since' revision */
+	guint64 revision;
+	guint64 changes_since;
+	GQueue changes; /* gchar *uid, from camel_pstring_strdup() */
 };
 
+/* How many changed uids are remembered at most */
+#define MAX_REMEMBERED_CHANGES 4096
+
+typedef struct _LoadedInfo {
+	CamelMessageInfo *info; /* the summary's reference */
+	GList link; /* in priv->loaded_lru, its data points to this structure */
+	time_t last_used;
+} LoadedInfo;
+
 /* this should probably be conditional on it existing */
 #define USE_BSEARCH
 
@@ -113,6 +151,7 @@ struct _node {
 };
 
 static void cfs_schedule_info_release_timer (CamelFolderSummary *summary);
+static gboolean is_in_memory_summary (CamelFolderSummary *summary);
 
 static void summary_traverse_content_with_parser (CamelFolderSummary *summary, CamelMessageInfo *msginfo, CamelMimeParser *mp);
 static void summary_traverse_content_with_part (CamelFolderSummary *summary, CamelMessageInfo *msginfo, CamelMimePart *object);
@@ -148,31 +187,451 @@ static guint signals[LAST_SIGNAL];
 
 G_DEFINE_TYPE_WITH_PRIVATE (CamelFolderSummary, camel_folder_summary, G_TYPE_OBJECT)
 
-/* Private function */
+/* Private functions */
 void _camel_message_info_unset_summary (CamelMessageInfo *mi);
+gboolean _camel_message_info_get_dirty_flags_only (const CamelMessageInfo *mi);
+void _camel_message_info_save_flags (const CamelMessageInfo *mi, CamelMIRecord *record);
+void _camel_folder_summary_note_dirty_info (CamelFolderSummary *summary, CamelMessageInfo *info);
+
+/* The caller is responsible for the info's reference and the LRU link */
+static void
+loaded_info_free (LoadedInfo *loaded)
+{
+	g_slice_free (LoadedInfo, loaded);
+}
+
+/* Returns borrowed info for the uid, without touching the LRU; call with the summary lock held */
+static CamelMessageInfo *
+cfs_peek_loaded_info (CamelFolderSummary *summary,
+		      const gchar *uid)
+{
+	LoadedInfo *loaded;
+
+	loaded = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+
+	return loaded ? loaded->info : NULL;
+}
+
+/* Returns borrowed info for the uid and marks it as the most recently used;
+   call with the summary lock held */
+static CamelMessageInfo *
+cfs_use_loaded_info (CamelFolderSummary *summary,
+		     const gchar *uid)
+{
+	LoadedInfo *loaded;
+
+	loaded = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+	if (!loaded)
+		return NULL;
+
+	g_queue_unlink (&summary->priv->loaded_lru, &loaded->link);
+	g_queue_push_head_link (&summary->priv->loaded_lru, &loaded->link);
+	loaded->last_used = time (NULL);
+
+	return loaded->info;
+}
+
+/* Consumes the 'info'; there cannot be any other info loaded for its uid;
+   call with the summary lock held */
+static void
+cfs_insert_loaded_info (CamelFolderSummary *summary,
+			CamelMessageInfo *info)
+{
+	LoadedInfo *loaded;
+
+	loaded = g_slice_new0 (LoadedInfo);
+	loaded->info = info;
+	loaded->link.data = loaded;
+	loaded->last_used = time (NULL);
+
+	g_warn_if_fail (!g_hash_table_contains (summary->priv->loaded_infos, camel_message_info_get_uid (info)));
+
+	g_hash_table_insert (summary->priv->loaded_infos, (gpointer) camel_message_info_get_uid (info), loaded);
+	g_queue_push_head_link (&summary->priv->loaded_lru, &loaded->link);
+
+	if (camel_message_info_get_dirty (info))
+		g_hash_table_add (summary->priv->dirty_uids, (gpointer) camel_pstring_strdup (camel_message_info_get_uid (info)));
+}
 
+/* Removes the info from the loaded infos and returns the summary's reference on it,
+   or NULL, when not loaded; call with the summary lock held */
+static CamelMessageInfo *
+cfs_take_loaded_info (CamelFolderSummary *summary,
+		      const gchar *uid)
+{
+	CamelMessageInfo *info;
+	LoadedInfo *loaded;
+
+	loaded = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+	if (!loaded)
+		return NULL;
+
+	g_hash_table_remove (summary->priv->loaded_infos, uid);
+	g_hash_table_remove (summary->priv->dirty_uids, uid);
+	g_queue_unlink (&summary->priv->loaded_lru, &loaded->link);
+
+	info = loaded->info;
+	loaded_info_free (loaded);
+
+	return info;
+}
+
+/* Converts the 'uid' into a number, when it's a canonical decimal 32-bit number */
 static gboolean
-remove_each_item (gpointer uid,
-                  gpointer mi,
-                  gpointer user_data)
+cfs_uid_to_number (const gchar *uid,
+		   guint32 *out_number)
 {
-	GSList **to_remove_infos = user_data;
+	guint64 number = 0;
+	gint ii;
+
+	if (!uid || !*uid || (uid[0] == '0' && uid[1]))
+		return FALSE;
+
+	for (ii = 0; uid[ii]; ii++) {
+		if (uid[ii] < '0' || uid[ii] > '9' || ii >= 10)
+			return FALSE;
+
+		number = (number * 10) + (uid[ii] - '0');
+	}
+
+	if (number > G_MAXUINT32)
+		return FALSE;
 
-	*to_remove_infos = g_slist_prepend (*to_remove_infos, mi);
+	*out_number = (guint32) number;
 
 	return TRUE;
 }
 
+static gint
+cfs_compare_numbers_cb (gconstpointer ptr1,
+			gconstpointer ptr2)
+{
+	guint32 num1 = *((const guint32 *) ptr1);
+	guint32 num2 = *((const guint32 *) ptr2);
+
+	return num1 < num2 ? -1 : num1 > num2 ? 1 : 0;
+}
+
+static gint
+cfs_compare_strings_cb (gconstpointer ptr1,
+			gconstpointer ptr2)
+{
+	return strcmp (*((const gchar * const *) ptr1), *((const gchar * const *) ptr2));
+}
+
+/* Returns whether the 'uid' is in the 'numeric_uids'; the 'out_index' is set
+   to its index, or to the index where it would be inserted */
+static gboolean
+cfs_find_numeric_uid (GArray *numeric_uids,
+		      guint32 uid,
+		      guint *out_index)
+{
+	guint low = 0, high = numeric_uids->len;
+
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+		guint32 value = g_array_index (numeric_uids, guint32, middle);
+
+		if (value == uid) {
+			*out_index = middle;
+			return TRUE;
+		}
+
+		if (value < uid)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	*out_index = low;
+
+	return FALSE;
+}
+
+/* Call with the summary lock held */
+static void
+cfs_invalidate_uid_index (CamelFolderSummary *summary)
+{
+	summary->priv->uid_index_valid = FALSE;
+
+	/* The borrowed UIDs can be freed already */
+	if (summary->priv->sorted_uids)
+		g_ptr_array_set_size (summary->priv->sorted_uids, 0);
+}
+
+/* Call with the summary lock held */
+static void
+cfs_ensure_uid_index (CamelFolderSummary *summary)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gboolean all_numeric = TRUE;
+	guint n_uids;
+
+	if (summary->priv->uid_index_valid)
+		return;
+
+	n_uids = g_hash_table_size (summary->priv->uids);
+
+	if (!summary->priv->numeric_uids)
+		summary->priv->numeric_uids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), n_uids);
+
+	g_array_set_size (summary->priv->numeric_uids, 0);
+
+	g_hash_table_iter_init (&iter, summary->priv->uids);
+	while (all_numeric && g_hash_table_iter_next (&iter, &key, NULL)) {
+		guint32 number;
+
+		if (cfs_uid_to_number (key, &number))
+			g_array_append_val (summary->priv->numeric_uids, number);
+		else
+			all_numeric = FALSE;
+	}
+
+	if (all_numeric) {
+		g_array_sort (summary->priv->numeric_uids, cfs_compare_numbers_cb);
+		g_clear_pointer (&summary->priv->sorted_uids, g_ptr_array_unref);
+	} else {
+		g_clear_pointer (&summary->priv->numeric_uids, g_array_unref);
+
+		if (!summary->priv->sorted_uids)
+			summary->priv->sorted_uids = g_ptr_array_sized_new (n_uids);
+
+		g_ptr_array_set_size (summary->priv->sorted_uids, 0);
+
+		g_hash_table_iter_init (&iter, summary->priv->uids);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_ptr_array_add (summary->priv->sorted_uids, key);
+		}
+
+		g_ptr_array_sort (summary->priv->sorted_uids, cfs_compare_strings_cb);
+	}
+
+	summary->priv->uid_index_valid = TRUE;
+}
+
+/* Call with the summary lock held */
+static void
+cfs_note_change (CamelFolderSummary *summary,
+		 const gchar *uid)
+{
+	summary->priv->revision++;
+
+	g_queue_push_tail (&summary->priv->changes, (gpointer) camel_pstring_strdup (uid));
+
+	if (summary->priv->changes.length > MAX_REMEMBERED_CHANGES) {
+		camel_pstring_free (g_queue_pop_head (&summary->priv->changes));
+		summary->priv->changes_since++;
+	}
+}
+
+/* Call with the summary lock held, when the changes cannot be listed */
+static void
+cfs_forget_changes (CamelFolderSummary *summary)
+{
+	summary->priv->revision++;
+	summary->priv->changes_since = summary->priv->revision;
+
+	g_queue_foreach (&summary->priv->changes, (GFunc) camel_pstring_free, NULL);
+	g_queue_clear (&summary->priv->changes);
+}
+
+/* Call with the summary lock held, after the 'uid' had been added to the 'uids' */
+static void
+cfs_uid_index_add (CamelFolderSummary *summary,
+		   const gchar *uid)
+{
+	guint32 number;
+	guint index;
+
+	if (!summary->priv->uid_index_valid)
+		return;
+
+	if (summary->priv->numeric_uids && cfs_uid_to_number (uid, &number)) {
+		/* New messages usually have the highest UID */
+		if (!summary->priv->numeric_uids->len ||
+		    g_array_index (summary->priv->numeric_uids, guint32, summary->priv->numeric_uids->len - 1) < number) {
+			g_array_append_val (summary->priv->numeric_uids, number);
+		} else if (!cfs_find_numeric_uid (summary->priv->numeric_uids, number, &index)) {
+			g_array_insert_val (summary->priv->numeric_uids, index, number);
+		}
+	} else {
+		cfs_invalidate_uid_index (summary);
+	}
+}
+
+/* Call with the summary lock held, when the 'uid' had been removed from the 'uids' */
+static void
+cfs_uid_index_remove (CamelFolderSummary *summary,
+		      const gchar *uid)
+{
+	guint32 number;
+	guint index;
+
+	if (!summary->priv->uid_index_valid)
+		return;
+
+	if (summary->priv->numeric_uids && cfs_uid_to_number (uid, &number)) {
+		if (cfs_find_numeric_uid (summary->priv->numeric_uids, number, &index))
+			g_array_remove_index (summary->priv->numeric_uids, index);
+	} else {
+		cfs_invalidate_uid_index (summary);
+	}
+}
+
+static gboolean
+cfs_can_evict_info (CamelMessageInfo *info)
+{
+	return G_OBJECT (info)->ref_count == 1 &&
+		!camel_message_info_get_dirty (info) &&
+		(camel_message_info_get_flags (info) & CAMEL_MESSAGE_FOLDER_FLAGGED) == 0;
+}
+
+/* How many least recently used infos are checked at most on each get or add,
+   thus the eviction does not walk all the loaded infos, when most of them are in use */
+#define MAX_EVICT_SCAN 16
+
+/* Evicts the least recently used infos, until there are at most 'max_loaded'
+   infos loaded and no info unused since 'unused_since' (if not 0), checking
+   at most 'max_scan' infos. The infos which cannot be evicted, because they
+   are used or changed, are moved to the head of the LRU, thus they are not
+   scanned again on the next call. Call with the summary lock held. */
+static void
+cfs_evict_loaded_infos (CamelFolderSummary *summary,
+			guint max_loaded,
+			time_t unused_since,
+			guint max_scan)
+{
+	GSList *to_remove_infos = NULL;
+	GList *link;
+	guint to_scan;
+
+	to_scan = MIN (max_scan, g_queue_get_length (&summary->priv->loaded_lru));
+
+	while (to_scan > 0 && (link = g_queue_peek_tail_link (&summary->priv->loaded_lru)) != NULL) {
+		LoadedInfo *loaded = link->data;
+
+		if (g_hash_table_size (summary->priv->loaded_infos) <= max_loaded &&
+		    (!unused_since || loaded->last_used >= unused_since))
+			break;
+
+		to_scan--;
+
+		if (cfs_can_evict_info (loaded->info)) {
+			to_remove_infos = g_slist_prepend (to_remove_infos,
+				cfs_take_loaded_info (summary, camel_message_info_get_uid (loaded->info)));
+			summary->priv->cache_evictions++;
+		} else {
+			g_queue_unlink (&summary->priv->loaded_lru, link);
+			g_queue_push_head_link (&summary->priv->loaded_lru, link);
+		}
+	}
+
+	g_slist_free_full (to_remove_infos, g_object_unref);
+}
+
+static gboolean
+cfs_is_fetch_all_recent (CamelFolderSummary *summary)
+{
+	return time (NULL) - summary->priv->fetch_all_time < SUMMARY_CACHE_DROP;
+}
+
+/* Call with the summary lock held */
+static void
+cfs_maybe_evict_loaded_infos (CamelFolderSummary *summary)
+{
+	/* The camel_folder_summary_prepare_fetch_all() promises to keep
+	   the infos loaded for some time, thus respect it */
+	if (!summary->priv->cache_limit || is_in_memory_summary (summary) ||
+	    g_hash_table_size (summary->priv->loaded_infos) <= summary->priv->cache_limit ||
+	    cfs_is_fetch_all_recent (summary))
+		return;
+
+	cfs_evict_loaded_infos (summary, summary->priv->cache_limit, 0, MAX_EVICT_SCAN);
+}
+
+static void
+cfs_cache_limit_changed_cb (GObject *object,
+			    GParamSpec *param,
+			    gpointer user_data);
+
+static void
+cfs_disconnect_cache_settings (CamelFolderSummary *summary)
+{
+	if (summary->priv->cache_settings) {
+		g_signal_handler_disconnect (summary->priv->cache_settings, summary->priv->cache_settings_handler_id);
+		summary->priv->cache_settings_handler_id = 0;
+		g_clear_object (&summary->priv->cache_settings);
+	}
+}
+
+/* Reads the 'cache_limit' from the parent store's settings and follows
+   its changes; call with the summary lock held */
+static void
+cfs_update_cache_limit (CamelFolderSummary *summary)
+{
+	CamelStore *parent_store;
+	CamelSettings *settings = NULL;
+	gint limit = 0;
+
+	parent_store = summary->priv->folder ? camel_folder_get_parent_store (summary->priv->folder) : NULL;
+	if (parent_store)
+		settings = camel_service_ref_settings (CAMEL_SERVICE (parent_store));
+
+	if (settings && !CAMEL_IS_STORE_SETTINGS (settings))
+		g_clear_object (&settings);
+
+	if (settings != summary->priv->cache_settings) {
+		cfs_disconnect_cache_settings (summary);
+
+		if (settings) {
+			summary->priv->cache_settings = g_object_ref (settings);
+			summary->priv->cache_settings_handler_id = g_signal_connect (
+				settings, "notify::summary-cache-limit",
+				G_CALLBACK (cfs_cache_limit_changed_cb), summary);
+		}
+	}
+
+	if (settings)
+		limit = camel_store_settings_get_summary_cache_limit (CAMEL_STORE_SETTINGS (settings));
+
+	g_clear_object (&settings);
+
+	summary->priv->cache_limit = limit > 0 ? limit : 0;
+}
+
+/* Called for both the parent store's "notify::settings" and the settings' "notify::summary-cache-limit" */
+static void
+cfs_cache_limit_changed_cb (GObject *object,
+			    GParamSpec *param,
+			    gpointer user_data)
+{
+	CamelFolderSummary *summary = user_data;
+
+	camel_folder_summary_lock (summary);
+	cfs_update_cache_limit (summary);
+	camel_folder_summary_unlock (summary);
+}
+
 static void
 remove_all_loaded (CamelFolderSummary *summary)
 {
 	GSList *to_remove_infos = NULL, *link;
+	GList *lru_link;
 
 	g_return_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary));
 
 	camel_folder_summary_lock (summary);
 
-	g_hash_table_foreach_remove (summary->priv->loaded_infos, remove_each_item, &to_remove_infos);
+	while ((lru_link = g_queue_pop_head_link (&summary->priv->loaded_lru)) != NULL) {
+		LoadedInfo *loaded = lru_link->data;
+
+		to_remove_infos = g_slist_prepend (to_remove_infos, loaded->info);
+		loaded_info_free (loaded);
+	}
+
+	g_hash_table_remove_all (summary->priv->loaded_infos);
+	g_hash_table_remove_all (summary->priv->dirty_uids);
 
 	for (link = to_remove_infos; link; link = g_slist_next (link)) {
 		CamelMessageInfo *mi = link->data;
@@ -217,6 +676,8 @@ folder_summary_dispose (GObject *object)
 	g_clear_object (&summary->priv->filter_stream);
 	g_clear_object (&summary->priv->filter_index);
 
+	cfs_disconnect_cache_settings (summary);
+
 	if (summary->priv->folder) {
 		g_object_weak_unref (G_OBJECT (summary->priv->folder), (GWeakNotify) g_nullify_pointer, &summary->priv->folder);
 		summary->priv->folder = NULL;
@@ -234,6 +695,13 @@ folder_summary_finalize (GObject *object)
 	g_hash_table_destroy (summary->priv->uids);
 	remove_all_loaded (summary);
 	g_hash_table_destroy (summary->priv->loaded_infos);
+	g_hash_table_destroy (summary->priv->dirty_uids);
+
+	g_clear_pointer (&summary->priv->numeric_uids, g_array_unref);
+	g_clear_pointer (&summary->priv->sorted_uids, g_ptr_array_unref);
+
+	g_queue_foreach (&summary->priv->changes, (GFunc) camel_pstring_free, NULL);
+	g_queue_clear (&summary->priv->changes);
 
 	g_hash_table_foreach (summary->priv->filter_charset, free_o_name, NULL);
 	g_hash_table_destroy (summary->priv->filter_charset);
@@ -253,8 +721,20 @@ folder_summary_set_folder (CamelFolderSummary *summary,
 	/* folder can be NULL in certain cases, see maildir-store */
 
 	summary->priv->folder = folder;
-	if (folder)
+	if (folder) {
+		CamelStore *parent_store;
+
 		g_object_weak_ref (G_OBJECT (folder), (GWeakNotify) g_nullify_pointer, &summary->priv->folder);
+
+		parent_store = camel_folder_get_parent_store (folder);
+		if (parent_store) {
+			g_signal_connect_object (
+				parent_store, "notify::settings",
+				G_CALLBACK (cfs_cache_limit_changed_cb), summary, 0);
+		}
+
+		cfs_update_cache_limit (summary);
+	}
 }
 
 static void
@@ -785,6 +1265,9 @@ camel_folder_summary_init (CamelFolderSummary *summary)
 	summary->priv->nextuid = 1;
 	summary->priv->uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
 	summary->priv->loaded_infos = g_hash_table_new (g_str_hash, g_str_equal);
+	summary->priv->dirty_uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+	g_queue_init (&summary->priv->loaded_lru);
+	g_queue_init (&summary->priv->changes);
 
 	g_rec_mutex_init (&summary->priv->summary_lock);
 	g_rec_mutex_init (&summary->priv->filter_lock);
@@ -1301,6 +1784,312 @@ camel_folder_summary_get_hash (CamelFolderSummary *summary)
 	return uids;
 }
 
+/**
+ * camel_folder_summary_has_numeric_uids:
+ * @summary: a #CamelFolderSummary object
+ *
+ * Checks whether all the message UIDs stored in the @summary are canonical
+ * decimal numbers, which fit into 32 bits, like the UIDs of the IMAP or
+ * the NNTP messages. When they are, the functions working with numeric UIDs
+ * can be used, like camel_folder_summary_foreach_uid_range().
+ *
+ * An empty summary is considered as having numeric UIDs.
+ *
+ * Returns: whether all the message UIDs are numeric
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_has_numeric_uids (CamelFolderSummary *summary)
+{
+	gboolean res;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+	res = summary->priv->numeric_uids != NULL;
+
+	camel_folder_summary_unlock (summary);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_foreach_uid:
+ * @summary: a #CamelFolderSummary object
+ * @func: (scope call): a #CamelFolderSummaryForeachUidFunc to call
+ * @user_data: user data passed to the @func
+ *
+ * Calls the @func for each message UID stored in the @summary, without
+ * making copies of them. The UIDs are traversed in an ascending numeric
+ * order when camel_folder_summary_has_numeric_uids() returns %TRUE,
+ * otherwise they are sorted by strcmp().
+ *
+ * The @summary is locked during the call and the @func cannot
+ * add or remove any message UIDs to/from it.
+ *
+ * Returns: %TRUE, when the @func was called for all the UIDs,
+ *    %FALSE, when it stopped the traversal
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_foreach_uid (CamelFolderSummary *summary,
+				  CamelFolderSummaryForeachUidFunc func,
+				  gpointer user_data)
+{
+	gboolean res = TRUE;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+
+	if (summary->priv->numeric_uids) {
+		res = camel_folder_summary_foreach_uid_range (summary, 0, G_MAXUINT32, func, user_data);
+	} else {
+		for (ii = 0; ii < summary->priv->sorted_uids->len && res; ii++) {
+			res = func (summary, g_ptr_array_index (summary->priv->sorted_uids, ii), user_data);
+		}
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_foreach_uid_range:
+ * @summary: a #CamelFolderSummary object
+ * @first_uid: the first numeric UID of the range
+ * @last_uid: the last numeric UID of the range, inclusive
+ * @func: (scope call): a #CamelFolderSummaryForeachUidFunc to call
+ * @user_data: user data passed to the @func
+ *
+ * Calls the @func for each message UID stored in the @summary, which is
+ * between @first_uid and @last_uid, inclusive, in an ascending order.
+ * The UID passed to the @func is valid only during the call.
+ *
+ * This works only when camel_folder_summary_has_numeric_uids() returns %TRUE,
+ * otherwise the @func is not called at all.
+ *
+ * The @summary is locked during the call and the @func cannot
+ * add or remove any message UIDs to/from it.
+ *
+ * Returns: %TRUE, when the @func was called for all the UIDs in the range,
+ *    %FALSE, when it stopped the traversal or the UIDs are not numeric
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_foreach_uid_range (CamelFolderSummary *summary,
+					guint32 first_uid,
+					guint32 last_uid,
+					CamelFolderSummaryForeachUidFunc func,
+					gpointer user_data)
+{
+	gboolean res = TRUE;
+	guint ii;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+
+	if (summary->priv->numeric_uids) {
+		GArray *numeric_uids = summary->priv->numeric_uids;
+		gchar uid[16];
+
+		cfs_find_numeric_uid (numeric_uids, first_uid, &ii);
+
+		for (; ii < numeric_uids->len && res; ii++) {
+			guint32 number = g_array_index (numeric_uids, guint32, ii);
+
+			if (number > last_uid)
+				break;
+
+			g_snprintf (uid, sizeof (uid), "%u", number);
+
+			res = func (summary, uid, user_data);
+		}
+	} else {
+		res = FALSE;
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_check_numeric_uid:
+ * @summary: a #CamelFolderSummary object
+ * @uid: a numeric message UID
+ *
+ * Checks whether the message with the numeric @uid is stored in the @summary.
+ * This is like camel_folder_summary_check_uid(), only without converting
+ * the @uid into a string.
+ *
+ * Returns: whether the @uid is stored in the @summary
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_check_numeric_uid (CamelFolderSummary *summary,
+					guint32 uid)
+{
+	gboolean res;
+	guint index;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+
+	if (summary->priv->numeric_uids) {
+		res = cfs_find_numeric_uid (summary->priv->numeric_uids, uid, &index);
+	} else {
+		gchar str[16];
+
+		g_snprintf (str, sizeof (str), "%u", uid);
+
+		res = g_hash_table_contains (summary->priv->uids, str);
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_get_nth_numeric_uid:
+ * @summary: a #CamelFolderSummary object
+ * @index: an index of the UID
+ * @out_uid: (out): return location for the UID
+ *
+ * Returns the @index-th lowest numeric message UID stored in the @summary,
+ * which corresponds to the @index-th message in the UID-sorted folder,
+ * like the IMAP message sequence numbers.
+ *
+ * Returns: whether the @out_uid was set; it fails when the @index is out
+ *    of range or when not all the UIDs are numeric
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_get_nth_numeric_uid (CamelFolderSummary *summary,
+					  guint index,
+					  guint32 *out_uid)
+{
+	gboolean res = FALSE;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (out_uid != NULL, FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+
+	if (summary->priv->numeric_uids && index < summary->priv->numeric_uids->len) {
+		*out_uid = g_array_index (summary->priv->numeric_uids, guint32, index);
+		res = TRUE;
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	return res;
+}
+
+/**
+ * camel_folder_summary_diff_numeric_uids:
+ * @summary: a #CamelFolderSummary object
+ * @uids: (array length=n_uids): numeric message UIDs, sorted ascending
+ * @n_uids: how many items the @uids has
+ * @out_only_in_summary: (out) (optional) (transfer full) (element-type guint32): return location
+ *    for a #GArray of the UIDs stored in the @summary, but not in the @uids, or %NULL
+ * @out_only_in_uids: (out) (optional) (transfer full) (element-type guint32): return location
+ *    for a #GArray of the UIDs in the @uids, but not stored in the @summary, or %NULL
+ *
+ * Compares the numeric message UIDs stored in the @summary with the @uids,
+ * like those received from a server. It runs in linear time and it allocates
+ * only the two result arrays, both sorted ascending. Free them with g_array_unref(),
+ * when no longer needed.
+ *
+ * Returns: %TRUE when the arrays were set, %FALSE when not all the UIDs
+ *    stored in the @summary are numeric
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_folder_summary_diff_numeric_uids (CamelFolderSummary *summary,
+					const guint32 *uids,
+					guint n_uids,
+					GArray **out_only_in_summary,
+					GArray **out_only_in_uids)
+{
+	GArray *numeric_uids, *only_in_summary = NULL, *only_in_uids = NULL;
+	guint ii = 0, jj = 0;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (uids != NULL || n_uids == 0, FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	cfs_ensure_uid_index (summary);
+
+	numeric_uids = summary->priv->numeric_uids;
+
+	if (!numeric_uids) {
+		camel_folder_summary_unlock (summary);
+		return FALSE;
+	}
+
+	if (out_only_in_summary)
+		only_in_summary = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	if (out_only_in_uids)
+		only_in_uids = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	while (ii < numeric_uids->len || jj < n_uids) {
+		guint32 local_uid = ii < numeric_uids->len ? g_array_index (numeric_uids, guint32, ii) : 0;
+
+		if (jj >= n_uids || (ii < numeric_uids->len && local_uid < uids[jj])) {
+			if (only_in_summary)
+				g_array_append_val (only_in_summary, local_uid);
+			ii++;
+		} else if (ii >= numeric_uids->len || uids[jj] < local_uid) {
+			if (only_in_uids)
+				g_array_append_val (only_in_uids, uids[jj]);
+			jj++;
+		} else {
+			ii++;
+			jj++;
+		}
+
+		/* Skip duplicates in the given UIDs */
+		while (jj > 0 && jj < n_uids && uids[jj] == uids[jj - 1])
+			jj++;
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	if (out_only_in_summary)
+		*out_only_in_summary = only_in_summary;
+
+	if (out_only_in_uids)
+		*out_only_in_uids = only_in_uids;
+
+	return TRUE;
+}
+
 /**
  * camel_folder_summary_peek_loaded:
  * @summary: a #CamelFolderSummary
@@ -1322,7 +2111,7 @@ camel_folder_summary_peek_loaded (CamelFolderSummary *summary,
 
 	camel_folder_summary_lock (summary);
 
-	info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+	info = cfs_peek_loaded_info (summary, uid);
 
 	if (info)
 		g_object_ref (info);
@@ -1332,6 +2121,46 @@ camel_folder_summary_peek_loaded (CamelFolderSummary *summary,
 	return info;
 }
 
+/**
+ * camel_folder_summary_get_cache_stats:
+ * @summary: a #CamelFolderSummary
+ * @out_loaded: (out) (optional): return location for the count of currently loaded message infos, or %NULL
+ * @out_hits: (out) (optional): return location for the count of camel_folder_summary_get() calls
+ *    satisfied by an already loaded message info, or %NULL
+ * @out_misses: (out) (optional): return location for the count of camel_folder_summary_get() calls,
+ *    which had to load the message info from the disk, or %NULL
+ * @out_evictions: (out) (optional): return location for the count of message infos
+ *    released from the memory, or %NULL
+ *
+ * Provides statistics of the in-memory message info cache of the @summary.
+ * The limit of the loaded message infos is set by
+ * #CamelStoreSettings:summary-cache-limit of the parent store.
+ *
+ * Since: 3.40
+ **/
+void
+camel_folder_summary_get_cache_stats (CamelFolderSummary *summary,
+				      guint *out_loaded,
+				      guint64 *out_hits,
+				      guint64 *out_misses,
+				      guint64 *out_evictions)
+{
+	g_return_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary));
+
+	camel_folder_summary_lock (summary);
+
+	if (out_loaded)
+		*out_loaded = g_hash_table_size (summary->priv->loaded_infos);
+	if (out_hits)
+		*out_hits = summary->priv->cache_hits;
+	if (out_misses)
+		*out_misses = summary->priv->cache_misses;
+	if (out_evictions)
+		*out_evictions = summary->priv->cache_evictions;
+
+	camel_folder_summary_unlock (summary);
+}
+
 struct _db_pass_data {
 	GHashTable *columns_hash;
 	CamelFolderSummary *summary;
@@ -1347,9 +2176,11 @@ message_info_from_uid (CamelFolderSummary *summary,
 
 	camel_folder_summary_lock (summary);
 
-	info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+	info = cfs_use_loaded_info (summary, uid);
 
-	if (!info) {
+	if (info) {
+		summary->priv->cache_hits++;
+	} else {
 		CamelDB *cdb;
 		CamelStore *parent_store;
 		const gchar *folder_name;
@@ -1374,6 +2205,8 @@ message_info_from_uid (CamelFolderSummary *summary,
 
 		cdb = camel_store_get_db (parent_store);
 
+		summary->priv->cache_misses++;
+
 		data.columns_hash = NULL;
 		data.summary = summary;
 		data.add = FALSE;
@@ -1390,14 +2223,18 @@ message_info_from_uid (CamelFolderSummary *summary,
 		}
 
 		/* We would have double reffed at camel_read_mir_callback */
-		info = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+		info = cfs_peek_loaded_info (summary, uid);
 
 		cfs_schedule_info_release_timer (summary);
 	}
 
-	if (info)
+	if (info) {
 		g_object_ref (info);
 
+		/* Evict only after the reference is added, to not evict the just loaded info */
+		cfs_maybe_evict_loaded_infos (summary);
+	}
+
 	camel_folder_summary_unlock (summary);
 
 	return info;
@@ -1475,7 +2312,8 @@ gather_dirty_or_flagged_uids (gpointer key,
 			      gpointer user_data)
 {
 	const gchar *uid = key;
-	CamelMessageInfo *info = value;
+	LoadedInfo *loaded = value;
+	CamelMessageInfo *info = loaded->info;
 	GHashTable *hash = user_data;
 
 	if (camel_message_info_get_dirty (info) || (camel_message_info_get_flags (info) & CAMEL_MESSAGE_FOLDER_FLAGGED) != 0)
@@ -1533,38 +2371,83 @@ camel_folder_summary_get_changed (CamelFolderSummary *summary)
 	return res;
 }
 
-static void
-count_changed_uids (gchar *key,
-                    CamelMessageInfo *info,
-                    gint *count)
+/* Called by the CamelMessageInfo, when it's marked dirty */
+void
+_camel_folder_summary_note_dirty_info (CamelFolderSummary *summary,
+				       CamelMessageInfo *info)
 {
-	if (camel_message_info_get_dirty (info))
-		(*count)++;
+	const gchar *uid;
+
+	g_return_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary));
+	g_return_if_fail (CAMEL_IS_MESSAGE_INFO (info));
+
+	camel_folder_summary_lock (summary);
+
+	/* Infos not added to the summary yet are noted when added */
+	uid = camel_message_info_get_uid (info);
+	if (uid) {
+		LoadedInfo *loaded;
+
+		loaded = g_hash_table_lookup (summary->priv->loaded_infos, uid);
+		if (loaded && loaded->info == info) {
+			if (!g_hash_table_contains (summary->priv->dirty_uids, uid))
+				g_hash_table_add (summary->priv->dirty_uids, (gpointer) camel_pstring_strdup (uid));
+
+			cfs_note_change (summary, uid);
+		}
+	}
+
+	camel_folder_summary_unlock (summary);
 }
 
-static gint
-cfs_count_dirty (CamelFolderSummary *summary)
+/* Returns the current revision of the infos, which changes with any change of them */
+guint64
+_camel_folder_summary_get_revision (CamelFolderSummary *summary)
 {
-	gint count = 0;
+	guint64 revision;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), 0);
 
 	camel_folder_summary_lock (summary);
-	g_hash_table_foreach (summary->priv->loaded_infos, (GHFunc) count_changed_uids, &count);
+	revision = summary->priv->revision;
 	camel_folder_summary_unlock (summary);
 
-	return count;
+	return revision;
 }
 
-static gboolean
-remove_item (gchar *uid,
-             CamelMessageInfo *info,
-             GSList **to_remove_infos)
+/* Adds into 'out_uids' (a set of camel_pstring_strdup() strings) the uids of the infos
+   added, changed or removed after the 'since' revision, and sets the 'out_revision' to
+   the current revision. Returns FALSE, when the changes are not known that far back. */
+gboolean
+_camel_folder_summary_get_changes_since (CamelFolderSummary *summary,
+					 guint64 since,
+					 guint64 *out_revision,
+					 GHashTable *out_uids)
 {
-	if (G_OBJECT (info)->ref_count == 1 && !camel_message_info_get_dirty (info) && (camel_message_info_get_flags (info) & CAMEL_MESSAGE_FOLDER_FLAGGED) == 0) {
-		*to_remove_infos = g_slist_prepend (*to_remove_infos, info);
-		return TRUE;
+	GList *link;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), FALSE);
+	g_return_val_if_fail (out_revision != NULL, FALSE);
+	g_return_val_if_fail (out_uids != NULL, FALSE);
+
+	camel_folder_summary_lock (summary);
+
+	*out_revision = summary->priv->revision;
+
+	if (since < summary->priv->changes_since || since > summary->priv->revision) {
+		camel_folder_summary_unlock (summary);
+		return FALSE;
 	}
 
-	return FALSE;
+	for (link = g_queue_peek_nth_link (&summary->priv->changes, since - summary->priv->changes_since);
+	     link;
+	     link = g_list_next (link)) {
+		g_hash_table_add (out_uids, (gpointer) camel_pstring_strdup (link->data));
+	}
+
+	camel_folder_summary_unlock (summary);
+
+	return TRUE;
 }
 
 static void
@@ -1573,18 +2456,20 @@ remove_cache (CamelSession *session,
               CamelFolderSummary *summary,
               GError **error)
 {
-	GSList *to_remove_infos = NULL;
-
 	camel_db_release_cache_memory ();
 
-	if (time (NULL) - summary->priv->cache_load_time < SUMMARY_CACHE_DROP)
-		return;
-
 	camel_folder_summary_lock (summary);
 
-	g_hash_table_foreach_remove (summary->priv->loaded_infos, (GHRFunc) remove_item, &to_remove_infos);
+	/* Drop only those not used for the SUMMARY_CACHE_DROP seconds,
+	   and any above the limit, least recently used first */
+	cfs_evict_loaded_infos (summary,
+		(summary->priv->cache_limit && !cfs_is_fetch_all_recent (summary)) ? summary->priv->cache_limit : G_MAXUINT,
+		time (NULL) - SUMMARY_CACHE_DROP, G_MAXUINT);
 
-	g_slist_free_full (to_remove_infos, g_object_unref);
+	dd (printf ("%s: %s: loaded:%u hits:%" G_GUINT64_FORMAT " misses:%" G_GUINT64_FORMAT " evictions:%" G_GUINT64_FORMAT "\n",
+		G_STRFUNC, summary->priv->folder ? camel_folder_get_full_name (summary->priv->folder) : "[null]",
+		g_hash_table_size (summary->priv->loaded_infos), summary->priv->cache_hits,
+		summary->priv->cache_misses, summary->priv->cache_evictions));
 
 	camel_folder_summary_unlock (summary);
 
@@ -1632,11 +2517,6 @@ cfs_try_release_memory (gpointer user_data)
 		return FALSE;
 	}
 
-	if (time (NULL) - summary->priv->cache_load_time < SUMMARY_CACHE_DROP) {
-		g_object_unref (summary);
-		return TRUE;
-	}
-
 	parent_store = camel_folder_get_parent_store (summary->priv->folder);
 	if (!parent_store) {
 		summary->priv->cache_load_time = 0;
@@ -1690,7 +2570,6 @@ cfs_schedule_info_release_timer (CamelFolderSummary *summary)
 			know_can_do = TRUE;
 		}
 
-		/* FIXME[disk-summary] LRU please and not timeouts */
 		if (can_do) {
 			GWeakRef *weakref;
 
@@ -1791,6 +2670,7 @@ camel_folder_summary_prepare_fetch_all (CamelFolderSummary *summary,
 
 	/* update also cache load time, even when not loaded anything */
 	summary->priv->cache_load_time = time (NULL);
+	summary->priv->fetch_all_time = summary->priv->cache_load_time;
 }
 
 /**
@@ -1848,6 +2728,9 @@ camel_folder_summary_load (CamelFolderSummary *summary,
 		cdb, full_name, klass->sort_by, klass->collate,
 		summary->priv->uids, &local_error);
 
+	cfs_invalidate_uid_index (summary);
+	cfs_forget_changes (summary);
+
 	if (local_error != NULL && local_error->message != NULL &&
 	    strstr (local_error->message, "no such table") != NULL) {
 		g_clear_error (&local_error);
@@ -1976,7 +2859,7 @@ camel_read_mir_callback (gpointer ref,
 	mir_from_cols (&mir, summary, &data->columns_hash, ncol, cols, name);
 
 	camel_folder_summary_lock (summary);
-	if (!mir.uid || g_hash_table_lookup (summary->priv->loaded_infos, mir.uid)) {
+	if (!mir.uid || cfs_peek_loaded_info (summary, mir.uid)) {
 		/* Unlock and better return */
 		camel_folder_summary_unlock (summary);
 		return ret;
@@ -1994,7 +2877,7 @@ camel_read_mir_callback (gpointer ref,
 		} else {
 			camel_folder_summary_lock (summary);
 			/* Summary always holds a ref for the loaded infos; this consumes it */
-			g_hash_table_insert (summary->priv->loaded_infos, (gchar *) camel_message_info_get_uid (info), info);
+			cfs_insert_loaded_info (summary, info);
 			camel_folder_summary_unlock (summary);
 		}
 	} else {
@@ -2008,43 +2891,74 @@ camel_read_mir_callback (gpointer ref,
 
 typedef struct _SaveData {
 	CamelFolderSummary *summary;
-	const gchar *full_name;
-	CamelDB *cdb;
+	CamelDBMessageInfoBatch *batch;
 	GError **out_error;
 } SaveData;
 
-static void
-save_to_db_cb (gpointer key,
-               gpointer value,
-               gpointer user_data)
+/* Returns whether the 'mi' had been saved */
+static gboolean
+save_to_db (SaveData *dt,
+	    CamelMessageInfo *mi)
 {
-	CamelMessageInfo *mi = value;
 	CamelMIRecord *mir;
 	GString *bdata_str;
-	SaveData *dt = user_data;
-
-	g_return_if_fail (dt != NULL);
+	GError *local_error = NULL;
 
-	if (!camel_message_info_get_dirty (mi))
-		return;
+	g_return_val_if_fail (dt != NULL, FALSE);
 
 	mir = g_new0 (CamelMIRecord, 1);
+
+	if (_camel_message_info_get_dirty_flags_only (mi)) {
+		gboolean updated = FALSE;
+
+		/* Only the flags changed, like when marking the message as read, thus
+		   update only the related columns, instead of rewriting the whole row */
+		_camel_message_info_save_flags (mi, mir);
+
+		if (camel_db_message_info_batch_update_flags (dt->batch, mir, &updated, &local_error) != 0) {
+			/* Keep the first error only, the following are usually the same */
+			if (dt->out_error && !*dt->out_error)
+				g_propagate_error (dt->out_error, local_error);
+			else
+				g_clear_error (&local_error);
+
+			camel_db_camel_mir_free (mir);
+			return FALSE;
+		}
+
+		if (updated) {
+			camel_message_info_set_dirty (mi, FALSE);
+			camel_db_camel_mir_free (mir);
+			return TRUE;
+		}
+
+		/* Not in the table yet, thus save the whole record */
+		camel_db_camel_mir_free (mir);
+		mir = g_new0 (CamelMIRecord, 1);
+	}
+
 	bdata_str = g_string_new (NULL);
 
 	if (!camel_message_info_save (mi, mir, bdata_str)) {
 		g_warning ("Failed to save message info: %s\n", camel_message_info_get_uid (mi));
 		g_string_free (bdata_str, TRUE);
 		camel_db_camel_mir_free (mir);
-		return;
+		return FALSE;
 	}
 
 	g_warn_if_fail (mir->bdata == NULL);
 	mir->bdata = g_string_free (bdata_str, FALSE);
 	bdata_str = NULL;
 
-	if (camel_db_write_message_info_record (dt->cdb, dt->full_name, mir, dt->out_error) != 0) {
+	if (camel_db_message_info_batch_add (dt->batch, mir, &local_error) != 0) {
+		/* Keep the first error only, the following are usually the same */
+		if (dt->out_error && !*dt->out_error)
+			g_propagate_error (dt->out_error, local_error);
+		else
+			g_clear_error (&local_error);
+
 		camel_db_camel_mir_free (mir);
-		return;
+		return FALSE;
 	}
 
 	/* Reset the dirty flag which decides if the changes are synced to the DB or not.
@@ -2053,6 +2967,8 @@ save_to_db_cb (gpointer key,
 	camel_message_info_set_dirty (mi, FALSE);
 
 	camel_db_camel_mir_free (mir);
+
+	return TRUE;
 }
 
 static gint
@@ -2061,8 +2977,14 @@ save_message_infos_to_db (CamelFolderSummary *summary,
 {
 	CamelStore *parent_store;
 	CamelDB *cdb;
+	GHashTable *dirty_uids;
+	GHashTableIter iter;
+	GPtrArray *saved_infos;
+	gpointer key;
 	const gchar *full_name;
 	SaveData dt;
+	gint ret = 0;
+	guint ii;
 
 	if (is_in_memory_summary (summary))
 		return 0;
@@ -2080,19 +3002,56 @@ save_message_infos_to_db (CamelFolderSummary *summary,
 	camel_folder_summary_lock (summary);
 
 	dt.summary = summary;
-	dt.full_name = full_name;
-	dt.cdb = cdb;
+	dt.batch = camel_db_message_info_batch_new (cdb, full_name, SAVE_BATCH_MAX_ROWS, SAVE_BATCH_MAX_MSECS, error);
 	dt.out_error = error;
 
-	/* Push MessageInfo-es */
-	camel_db_begin_transaction (cdb, NULL);
-	g_hash_table_foreach (summary->priv->loaded_infos, save_to_db_cb, &dt);
-	camel_db_end_transaction (cdb, NULL);
+	if (!dt.batch) {
+		camel_folder_summary_unlock (summary);
+		return -1;
+	}
+
+	/* Push only the changed MessageInfo-es; take the set, because
+	   the infos can be marked dirty again from the notifications */
+	dirty_uids = summary->priv->dirty_uids;
+	summary->priv->dirty_uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+
+	saved_infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+	g_hash_table_iter_init (&iter, dirty_uids);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		LoadedInfo *loaded;
+
+		loaded = g_hash_table_lookup (summary->priv->loaded_infos, key);
+		if (!loaded || !camel_message_info_get_dirty (loaded->info))
+			continue;
+
+		/* Keep the failed for the next save */
+		if (save_to_db (&dt, loaded->info)) {
+			g_ptr_array_add (saved_infos, g_object_ref (loaded->info));
+		} else {
+			g_hash_table_iter_steal (&iter);
+			g_hash_table_add (summary->priv->dirty_uids, key);
+		}
+	}
+
+	g_hash_table_destroy (dirty_uids);
+
+	if (camel_db_message_info_batch_end (dt.batch, (error && !*error) ? error : NULL) != 0) {
+		/* The last rows were not committed; the rows committed by the batch
+		   before are written again on the next save, which does no harm */
+		for (ii = 0; ii < saved_infos->len; ii++) {
+			camel_message_info_set_dirty (g_ptr_array_index (saved_infos, ii), TRUE);
+		}
+
+		ret = -1;
+	}
+
+	g_ptr_array_unref (saved_infos);
 
 	camel_folder_summary_unlock (summary);
 	cfs_schedule_info_release_timer (summary);
 
-	return 0;
+	return ret;
 }
 
 /**
@@ -2140,7 +3099,7 @@ camel_folder_summary_save (CamelFolderSummary *summary,
 
 	summary->priv->flags &= ~CAMEL_FOLDER_SUMMARY_DIRTY;
 
-	count = cfs_count_dirty (summary);
+	count = g_hash_table_size (summary->priv->dirty_uids);
 	if (!count) {
 		gboolean res = camel_folder_summary_header_save (summary, error);
 		camel_folder_summary_unlock (summary);
@@ -2346,7 +3305,7 @@ summary_assign_uid (CamelFolderSummary *summary,
 
 	camel_folder_summary_lock (summary);
 
-	while ((mi = g_hash_table_lookup (summary->priv->loaded_infos, new_uid))) {
+	while ((mi = cfs_peek_loaded_info (summary, new_uid))) {
 		camel_folder_summary_unlock (summary);
 
 		g_free (new_uid);
@@ -2395,6 +3354,7 @@ camel_folder_summary_add (CamelFolderSummary *summary,
 			  gboolean force_keep_uid)
 {
 	CamelMessageInfo *loaded_info;
+	gboolean is_new_uid;
 
 	g_return_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary));
 
@@ -2424,15 +3384,20 @@ camel_folder_summary_add (CamelFolderSummary *summary,
 	camel_message_info_set_folder_flagged (info, TRUE);
 	camel_message_info_set_dirty (info, TRUE);
 
+	is_new_uid = !g_hash_table_contains (summary->priv->uids, camel_message_info_get_uid (info));
+
 	g_hash_table_insert (
 		summary->priv->uids,
 		(gpointer) camel_pstring_strdup (camel_message_info_get_uid (info)),
 		GUINT_TO_POINTER (camel_message_info_get_flags (info)));
 
+	if (is_new_uid)
+		cfs_uid_index_add (summary, camel_message_info_get_uid (info));
+
 	/* Summary always holds a ref for the loaded infos */
 	g_object_ref (info);
 
-	loaded_info = g_hash_table_lookup (summary->priv->loaded_infos, camel_message_info_get_uid (info));
+	loaded_info = cfs_take_loaded_info (summary, camel_message_info_get_uid (info));
 	if (loaded_info) {
 		/* Dirty hack, to have CamelWeakRefGroup properly cleared,
 		   when the message info leaks due to ref/unref imbalance. */
@@ -2441,7 +3406,10 @@ camel_folder_summary_add (CamelFolderSummary *summary,
 		g_clear_object (&loaded_info);
 	}
 
-	g_hash_table_insert (summary->priv->loaded_infos, (gpointer) camel_message_info_get_uid (info), info);
+	cfs_insert_loaded_info (summary, info);
+	cfs_maybe_evict_loaded_infos (summary);
+
+	cfs_note_change (summary, camel_message_info_get_uid (info));
 
 	camel_folder_summary_touch (summary);
 
@@ -2537,9 +3505,16 @@ camel_folder_summary_info_new_from_parser (CamelFolderSummary *summary,
 			camel_mime_filter_index_set_name (CAMEL_MIME_FILTER_INDEX (summary->priv->filter_index), name);
 		}
 
-		/* always scan the content info, even if we dont save it */
+		/* always scan the content info, even if we dont save it; without
+		 * the index only the part headers matter, thus skip the bodies */
+		if (!summary->priv->index)
+			camel_mime_parser_skim_content (mp, TRUE);
+
 		summary_traverse_content_with_parser (summary, info, mp);
 
+		if (!summary->priv->index)
+			camel_mime_parser_skim_content (mp, FALSE);
+
 		if (name && summary->priv->index) {
 			camel_index_write_name (summary->priv->index, name);
 			g_object_unref (name);
@@ -2660,7 +3635,8 @@ camel_folder_summary_clear (CamelFolderSummary *summary,
 
 	g_hash_table_remove_all (summary->priv->uids);
 	remove_all_loaded (summary);
-	g_hash_table_remove_all (summary->priv->loaded_infos);
+	cfs_invalidate_uid_index (summary);
+	cfs_forget_changes (summary);
 
 	summary->priv->saved_count = 0;
 	summary->priv->unread_count = 0;
@@ -2752,9 +3728,10 @@ camel_folder_summary_remove_uid (CamelFolderSummary *summary,
 
 	uid_copy = camel_pstring_strdup (uid);
 	g_hash_table_remove (summary->priv->uids, uid_copy);
+	cfs_uid_index_remove (summary, uid_copy);
+	cfs_note_change (summary, uid_copy);
 
-	mi = g_hash_table_lookup (summary->priv->loaded_infos, uid_copy);
-	g_hash_table_remove (summary->priv->loaded_infos, uid_copy);
+	mi = cfs_take_loaded_info (summary, uid_copy);
 
 	if (mi) {
 		/* Dirty hack, to have CamelWeakRefGroup properly cleared,
@@ -2813,9 +3790,10 @@ camel_folder_summary_remove_uids (CamelFolderSummary *summary,
 
 			folder_summary_update_counts_by_flags (summary, GPOINTER_TO_UINT (ptr_flags), UPDATE_COUNTS_SUB);
 			g_hash_table_remove (summary->priv->uids, uid_copy);
+			cfs_uid_index_remove (summary, uid_copy);
+			cfs_note_change (summary, uid_copy);
 
-			mi = g_hash_table_lookup (summary->priv->loaded_infos, uid_copy);
-			g_hash_table_remove (summary->priv->loaded_infos, uid_copy);
+			mi = cfs_take_loaded_info (summary, uid_copy);
 
 			if (mi) {
 				/* Dirty hack, to have CamelWeakRefGroup properly cleared,
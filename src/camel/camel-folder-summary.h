@@ -81,6 +81,24 @@ struct _CamelFolderSummary {
 struct _CamelMIRecord;
 struct _CamelFIRecord;
 
+/**
+ * CamelFolderSummaryForeachUidFunc:
+ * @summary: a #CamelFolderSummary
+ * @uid: a message UID, valid only during the call
+ * @user_data: user data passed to the function
+ *
+ * A callback used by camel_folder_summary_foreach_uid()
+ * and camel_folder_summary_foreach_uid_range().
+ *
+ * Returns: %TRUE to continue, %FALSE to stop the traversal
+ *
+ * Since: 3.40
+ **/
+typedef gboolean (* CamelFolderSummaryForeachUidFunc)
+						(CamelFolderSummary *summary,
+						 const gchar *uid,
+						 gpointer user_data);
+
 struct _CamelFolderSummaryClass {
 	GObjectClass parent_class;
 
@@ -237,6 +255,31 @@ GPtrArray *	camel_folder_summary_get_array	(CamelFolderSummary *summary);
 void		camel_folder_summary_free_array	(GPtrArray *array);
 
 GHashTable *	camel_folder_summary_get_hash	(CamelFolderSummary *summary);
+gboolean	camel_folder_summary_has_numeric_uids
+						(CamelFolderSummary *summary);
+gboolean	camel_folder_summary_foreach_uid
+						(CamelFolderSummary *summary,
+						 CamelFolderSummaryForeachUidFunc func,
+						 gpointer user_data);
+gboolean	camel_folder_summary_foreach_uid_range
+						(CamelFolderSummary *summary,
+						 guint32 first_uid,
+						 guint32 last_uid,
+						 CamelFolderSummaryForeachUidFunc func,
+						 gpointer user_data);
+gboolean	camel_folder_summary_check_numeric_uid
+						(CamelFolderSummary *summary,
+						 guint32 uid);
+gboolean	camel_folder_summary_get_nth_numeric_uid
+						(CamelFolderSummary *summary,
+						 guint index,
+						 guint32 *out_uid);
+gboolean	camel_folder_summary_diff_numeric_uids
+						(CamelFolderSummary *summary,
+						 const guint32 *uids,
+						 guint n_uids,
+						 GArray **out_only_in_summary,
+						 GArray **out_only_in_uids);
 
 gboolean	camel_folder_summary_replace_flags
 						(CamelFolderSummary *summary,
@@ -257,6 +300,13 @@ void		camel_folder_summary_prepare_fetch_all
 						(CamelFolderSummary *summary,
 						 GError **error);
 
+void		camel_folder_summary_get_cache_stats
+						(CamelFolderSummary *summary,
+						 guint *out_loaded,
+						 guint64 *out_hits,
+						 guint64 *out_misses,
+						 guint64 *out_evictions);
+
 /* summary locking */
 void		camel_folder_summary_lock	(CamelFolderSummary *summary);
 void		camel_folder_summary_unlock	(CamelFolderSummary *summary);
@@ -34,6 +34,7 @@
 #include "camel-network-service.h"
 #include "camel-offline-store.h"
 #include "camel-operation.h"
+#include "camel-search-private.h"
 #include "camel-session.h"
 #include "camel-store.h"
 #include "camel-store-settings.h"
@@ -75,6 +76,11 @@ struct _CamelFolderPrivate {
 	GMutex store_changes_lock;
 	guint store_changes_id;
 	gboolean store_changes_after_frozen;
+
+	/* Messages waiting for the full-text index of their bodies */
+	GMutex body_index_lock;
+	GHashTable *body_index_pending; /* gchar *uid ~> CamelMimeMessage * */
+	gboolean body_index_job_scheduled;
 };
 
 struct _AsyncContext {
@@ -673,6 +679,157 @@ folder_maybe_connect_sync (CamelFolder *folder,
 	return success;
 }
 
+/* Returns the store's CamelDB, when it has enabled the full-text
+   index of the message bodies and the folder's messages can be
+   indexed; NULL otherwise. */
+static CamelDB *
+folder_get_body_index_db (CamelFolder *folder)
+{
+	CamelStore *parent_store;
+	CamelFolderSummary *summary;
+	CamelSettings *settings;
+	gboolean index_bodies = FALSE;
+
+	parent_store = camel_folder_get_parent_store (folder);
+	if (!parent_store || !camel_store_get_db (parent_store))
+		return NULL;
+
+	/* Virtual folders do not have their own messages */
+	summary = camel_folder_get_folder_summary (folder);
+	if (!summary || (camel_folder_summary_get_flags (summary) & CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY) != 0)
+		return NULL;
+
+	settings = camel_service_ref_settings (CAMEL_SERVICE (parent_store));
+	if (settings && CAMEL_IS_STORE_SETTINGS (settings))
+		index_bodies = camel_store_settings_get_index_message_bodies (CAMEL_STORE_SETTINGS (settings));
+	g_clear_object (&settings);
+
+	return index_bodies ? camel_store_get_db (parent_store) : NULL;
+}
+
+/* Do not keep more than this many messages in memory,
+   while they are waiting for their bodies to be indexed */
+#define MAX_BODY_INDEX_PENDING 64
+
+static void
+folder_index_message_bodies_job_cb (CamelSession *session,
+				    GCancellable *cancellable,
+				    gpointer user_data,
+				    GError **error)
+{
+	CamelFolder *folder = user_data;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+
+	while (!g_cancellable_is_cancelled (cancellable)) {
+		CamelMimeMessage *message = NULL;
+		CamelDB *cdb;
+		GHashTableIter iter;
+		gpointer key = NULL, value = NULL;
+		const gchar *full_name;
+		gchar *uid = NULL, *text;
+
+		g_mutex_lock (&folder->priv->body_index_lock);
+
+		g_hash_table_iter_init (&iter, folder->priv->body_index_pending);
+		if (g_hash_table_iter_next (&iter, &key, &value)) {
+			uid = key;
+			message = value;
+			g_hash_table_iter_steal (&iter);
+		} else {
+			folder->priv->body_index_job_scheduled = FALSE;
+		}
+
+		g_mutex_unlock (&folder->priv->body_index_lock);
+
+		if (!uid)
+			return;
+
+		cdb = folder_get_body_index_db (folder);
+		full_name = camel_folder_get_full_name (folder);
+
+		if (cdb && !camel_db_has_message_body (cdb, full_name, uid)) {
+			text = camel_search_get_message_body_text (message, cancellable);
+			if (text) {
+				GError *local_error = NULL;
+
+				if (camel_db_write_message_body (cdb, full_name, uid, text, &local_error) != 0) {
+					if (camel_debug ("folder"))
+						printf ("%s: Failed to index body of message '%s' in '%s': %s\n", G_STRFUNC,
+							uid, full_name, local_error ? local_error->message : "Unknown error");
+					g_clear_error (&local_error);
+				}
+
+				g_free (text);
+			}
+		}
+
+		g_object_unref (message);
+		g_free (uid);
+	}
+
+	/* Cancelled; drop what is left, it'll be indexed when read again */
+	g_mutex_lock (&folder->priv->body_index_lock);
+	g_hash_table_remove_all (folder->priv->body_index_pending);
+	folder->priv->body_index_job_scheduled = FALSE;
+	g_mutex_unlock (&folder->priv->body_index_lock);
+}
+
+/* Queues the @message for the full-text index of the message bodies; the index
+   itself is written in a session job, to not delay the caller with it. */
+static void
+folder_maybe_index_message_body (CamelFolder *folder,
+				 const gchar *message_uid,
+				 CamelMimeMessage *message)
+{
+	CamelStore *parent_store;
+	CamelSession *session;
+	gboolean schedule = FALSE;
+
+	if (!folder_get_body_index_db (folder))
+		return;
+
+	g_mutex_lock (&folder->priv->body_index_lock);
+
+	if (g_hash_table_size (folder->priv->body_index_pending) < MAX_BODY_INDEX_PENDING &&
+	    !g_hash_table_contains (folder->priv->body_index_pending, message_uid)) {
+		g_hash_table_insert (folder->priv->body_index_pending, g_strdup (message_uid), g_object_ref (message));
+
+		schedule = !folder->priv->body_index_job_scheduled;
+		folder->priv->body_index_job_scheduled = TRUE;
+	}
+
+	g_mutex_unlock (&folder->priv->body_index_lock);
+
+	if (!schedule)
+		return;
+
+	parent_store = camel_folder_get_parent_store (folder);
+	session = parent_store ? camel_service_ref_session (CAMEL_SERVICE (parent_store)) : NULL;
+	if (session) {
+		gchar *description;
+
+		/* Translators: The first “%s” is replaced with an account name and the second “%s”
+		   is replaced with a full path name. The spaces around “:” are intentional, as
+		   the whole “%s : %s” is meant as an absolute identification of the folder. */
+		description = g_strdup_printf (_("Indexing messages in folder “%s : %s”"),
+			camel_service_get_display_name (CAMEL_SERVICE (parent_store)),
+			camel_folder_get_full_name (folder));
+
+		camel_session_submit_job (session, description,
+			folder_index_message_bodies_job_cb,
+			g_object_ref (folder), g_object_unref);
+
+		g_free (description);
+		g_object_unref (session);
+	} else {
+		g_mutex_lock (&folder->priv->body_index_lock);
+		g_hash_table_remove_all (folder->priv->body_index_pending);
+		folder->priv->body_index_job_scheduled = FALSE;
+		g_mutex_unlock (&folder->priv->body_index_lock);
+	}
+}
+
 static void
 folder_set_parent_store (CamelFolder *folder,
                          CamelStore *parent_store)
@@ -805,6 +962,10 @@ folder_dispose (GObject *object)
 	folder->priv->store_changes_id = 0;
 	g_mutex_unlock (&folder->priv->store_changes_lock);
 
+	g_mutex_lock (&folder->priv->body_index_lock);
+	g_hash_table_remove_all (folder->priv->body_index_pending);
+	g_mutex_unlock (&folder->priv->body_index_lock);
+
 	/* Chain up to parent's dispose () method. */
 	G_OBJECT_CLASS (camel_folder_parent_class)->dispose (object);
 }
@@ -831,6 +992,9 @@ folder_finalize (GObject *object)
 	g_mutex_clear (&priv->change_lock);
 	g_mutex_clear (&priv->store_changes_lock);
 
+	g_hash_table_destroy (priv->body_index_pending);
+	g_mutex_clear (&priv->body_index_lock);
+
 	/* Chain up to parent's finalize () method. */
 	G_OBJECT_CLASS (camel_folder_parent_class)->finalize (object);
 }
@@ -1559,6 +1723,9 @@ camel_folder_init (CamelFolder *folder)
 	g_mutex_init (&folder->priv->change_lock);
 	g_mutex_init (&folder->priv->property_lock);
 	g_mutex_init (&folder->priv->store_changes_lock);
+	g_mutex_init (&folder->priv->body_index_lock);
+
+	folder->priv->body_index_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 }
 
 G_DEFINE_QUARK (camel-folder-error-quark, camel_folder_error)
@@ -3444,6 +3611,7 @@ camel_folder_get_message_sync (CamelFolder *folder,
 		message_uid, camel_service_get_display_name (CAMEL_SERVICE (camel_folder_get_parent_store (folder))),
 		camel_folder_get_full_name (folder));
 
+	/* The cached message is queued for the body index by the called function */
 	message = camel_folder_get_message_cached (folder, message_uid, cancellable);
 
 	if (message == NULL) {
@@ -3468,6 +3636,9 @@ camel_folder_get_message_sync (CamelFolder *folder,
 			folder, get_message_sync, message != NULL, error);
 
 		camel_folder_unlock (folder);
+
+		if (message)
+			folder_maybe_index_message_body (folder, message_uid, message);
 	}
 
 	if (message && camel_mime_message_get_source (message) == NULL) {
@@ -3518,6 +3689,7 @@ camel_folder_get_message_cached (CamelFolder *folder,
 				 GCancellable *cancellable)
 {
 	CamelFolderClass *class;
+	CamelMimeMessage *message;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
 	g_return_val_if_fail (message_uid != NULL, NULL);
@@ -3528,7 +3700,11 @@ camel_folder_get_message_cached (CamelFolder *folder,
 	if (!class->get_message_cached)
 		return NULL;
 
-	return class->get_message_cached (folder, message_uid, cancellable);
+	message = class->get_message_cached (folder, message_uid, cancellable);
+	if (message)
+		folder_maybe_index_message_body (folder, message_uid, message);
+
+	return message;
 }
 
 /* Helper for camel_folder_get_message() */
@@ -4270,6 +4446,7 @@ camel_folder_synchronize_message_sync (CamelFolder *folder,
 			folder, get_message_sync, message != NULL, error);
 
 		if (message != NULL) {
+			folder_maybe_index_message_body (folder, message_uid, message);
 			g_object_unref (message);
 			success = TRUE;
 		}
@@ -37,26 +37,43 @@
 
 #define cd(x)
 
+/* guards the iconv_cache_open and the parent of the cache nodes */
 G_LOCK_DEFINE_STATIC (iconv);
 
+/* the charsets, which can be converted without the iconv */
+enum {
+	ICONV_CHARSET_OTHER,
+	ICONV_CHARSET_ASCII,	/* any stateless superset of the US-ASCII */
+	ICONV_CHARSET_LATIN1,
+	ICONV_CHARSET_CP1252,
+	ICONV_CHARSET_UTF8
+};
+
 struct _iconv_cache_node {
-	struct _iconv_cache *parent;
+	struct _iconv_cache *parent;	/* NULL, when the owner thread ended */
 
-	gint busy;
+	gint busy;	/* atomic, another thread can close the converter */
+	gchar *to;
+	gchar *from;
+	gint to_kind;
+	gint from_kind;
 	GIConv ip;
 };
 
+/* every thread has its own cache of the converters, thus opening and closing
+ * them does not need any lock, unless a converter is closed by another thread */
 struct _iconv_cache {
-	gchar *conv;
-	GQueue open;	/* stores iconv_cache_nodes, busy ones up front */
+	GQueue open;	/* stores iconv_cache_nodes, the recently used ones up front */
 };
 
 #define E_ICONV_CACHE_SIZE (16)
 
-static GQueue iconv_cache_list = G_QUEUE_INIT;
-static GHashTable *iconv_cache;
+static void iconv_cache_free (gpointer data);
+
+static GPrivate iconv_cache_private = G_PRIVATE_INIT (iconv_cache_free);
 static GHashTable *iconv_cache_open;
 
+static GRWLock iconv_charsets_lock;
 static GHashTable *iconv_charsets = NULL;
 static gchar *locale_charset = NULL;
 static gchar *locale_lang = NULL;
@@ -187,20 +204,15 @@ locale_parse_lang (const gchar *locale)
 	}
 }
 
-/* NOTE: Owns the lock on return if keep is TRUE !*/
 static void
-iconv_init (gint keep)
+iconv_init (void)
 {
+	static gsize initialized = 0;
 	gchar *from, *to, *locale;
 	gint i;
 
-	G_LOCK (iconv);
-
-	if (iconv_charsets != NULL) {
-		if (!keep)
-			G_UNLOCK (iconv);
+	if (!g_once_init_enter (&initialized))
 		return;
-	}
 
 	iconv_charsets = g_hash_table_new (g_str_hash, g_str_equal);
 
@@ -211,7 +223,6 @@ iconv_init (gint keep)
 		g_hash_table_insert (iconv_charsets, from, to);
 	}
 
-	iconv_cache = g_hash_table_new (g_str_hash, g_str_equal);
 	iconv_cache_open = g_hash_table_new (NULL, NULL);
 
 #ifndef G_OS_WIN32
@@ -269,14 +280,14 @@ iconv_init (gint keep)
 #ifdef G_OS_WIN32
 	g_free (locale);
 #endif
-	if (!keep)
-		G_UNLOCK (iconv);
+
+	g_once_init_leave (&initialized, 1);
 }
 
 const gchar *
 camel_iconv_charset_name (const gchar *charset)
 {
-	gchar *name, *ret, *tmp;
+	gchar *name, *ret, *tmp, *known;
 	gsize name_len;
 
 	if (charset == NULL)
@@ -287,12 +298,14 @@ camel_iconv_charset_name (const gchar *charset)
 	g_strlcpy (name, charset, name_len);
 	e_strdown (name);
 
-	iconv_init (TRUE);
+	iconv_init ();
+
+	g_rw_lock_reader_lock (&iconv_charsets_lock);
 	ret = g_hash_table_lookup (iconv_charsets, name);
-	if (ret != NULL) {
-		G_UNLOCK (iconv);
+	g_rw_lock_reader_unlock (&iconv_charsets_lock);
+
+	if (ret != NULL)
 		return ret;
-	}
 
 	/* Unknown, try canonicalise some basic charset types to something that should work */
 	if (strncmp (name, "iso", 3) == 0) {
@@ -346,29 +359,305 @@ camel_iconv_charset_name (const gchar *charset)
 		ret = g_strdup (charset);
 	}
 
-	g_hash_table_insert (iconv_charsets, g_strdup (name), ret);
-	G_UNLOCK (iconv);
+	g_rw_lock_writer_lock (&iconv_charsets_lock);
+
+	/* another thread could add it in the meantime */
+	known = g_hash_table_lookup (iconv_charsets, name);
+	if (known) {
+		g_free (ret);
+		ret = known;
+	} else {
+		g_hash_table_insert (iconv_charsets, g_strdup (name), ret);
+	}
+
+	g_rw_lock_writer_unlock (&iconv_charsets_lock);
 
 	return ret;
 }
 
+static gint
+iconv_charset_kind (const gchar *charset)
+{
+	const gchar *p;
+	gchar *end;
+	gulong part;
+
+	/* the //TRANSLIT and similar suffixes */
+	if (strchr (charset, '/'))
+		return ICONV_CHARSET_OTHER;
+
+	if (!g_ascii_strcasecmp (charset, "UTF-8") || !g_ascii_strcasecmp (charset, "UTF8"))
+		return ICONV_CHARSET_UTF8;
+
+	if (!g_ascii_strcasecmp (charset, "CP1252"))
+		return ICONV_CHARSET_CP1252;
+
+	if (!g_ascii_strcasecmp (charset, "latin1"))
+		return ICONV_CHARSET_LATIN1;
+
+	if (!g_ascii_strcasecmp (charset, "us-ascii") || !g_ascii_strcasecmp (charset, "ascii") ||
+	    !g_ascii_strcasecmp (charset, "ANSI_X3.4-1968") || !g_ascii_strcasecmp (charset, "koi8-r") ||
+	    !g_ascii_strcasecmp (charset, "koi8-u"))
+		return ICONV_CHARSET_ASCII;
+
+	if (!g_ascii_strncasecmp (charset, "CP125", 5) && charset[5] >= '0' && charset[5] <= '8' && !charset[6])
+		return ICONV_CHARSET_ASCII;
+
+	/* any of the ICONV_ISO_D_FORMAT variants of the iso-8859-n */
+	p = charset;
+	if (!g_ascii_strncasecmp (p, "iso", 3)) {
+		p += 3;
+		if (*p == '-' || *p == '_')
+			p++;
+	}
+
+	if (strncmp (p, "8859", 4) == 0) {
+		p += 4;
+		if (*p == '-' || *p == '_')
+			p++;
+
+		part = strtoul (p, &end, 10);
+		if (end > p && !*end && part >= 1 && part <= 16)
+			return part == 1 ? ICONV_CHARSET_LATIN1 : ICONV_CHARSET_ASCII;
+	}
+
+	return ICONV_CHARSET_OTHER;
+}
+
+/* Windows-1252 characters 0x80 - 0x9f, zero for those not defined */
+static const gunichar cp1252_to_ucs[32] = {
+	0x20ac, 0x0000, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017d, 0x0000,
+	0x0000, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x0000, 0x017e, 0x0178
+};
+
+/* Returns the character at the 'inptr' and its length in the 'len', or zero,
+ * when it is not one of those converted by the iconv_fast() */
+static gunichar
+iconv_fast_getc (gint kind,
+                 const guchar *inptr,
+                 const guchar *inend,
+                 gint *len)
+{
+	guchar c = inptr[0];
+
+	*len = 1;
+
+	switch (kind) {
+	case ICONV_CHARSET_LATIN1:
+		return c;
+	case ICONV_CHARSET_CP1252:
+		return c < 0xa0 ? cp1252_to_ucs[c - 0x80] : c;
+	case ICONV_CHARSET_UTF8:
+		/* only the valid sequences of U+0080 - U+07FF and U+2000 - U+2FFF */
+		if (c >= 0xc2 && c <= 0xdf && inend - inptr >= 2 && (inptr[1] & 0xc0) == 0x80) {
+			*len = 2;
+			return ((c & 0x1f) << 6) | (inptr[1] & 0x3f);
+		}
+
+		if (c == 0xe2 && inend - inptr >= 3 && (inptr[1] & 0xc0) == 0x80 && (inptr[2] & 0xc0) == 0x80) {
+			*len = 3;
+			return 0x2000 | ((inptr[1] & 0x3f) << 6) | (inptr[2] & 0x3f);
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* Writes the 'ch' at the 'outptr' and returns its length, or zero, when it
+ * is not one of those converted by the iconv_fast() or it does not fit */
+static gint
+iconv_fast_putc (gint kind,
+                 gunichar ch,
+                 guchar *outptr,
+                 guchar *outend)
+{
+	gint ii;
+
+	switch (kind) {
+	case ICONV_CHARSET_LATIN1:
+		if (ch > 0xff || outptr >= outend)
+			return 0;
+
+		*outptr = ch;
+		return 1;
+	case ICONV_CHARSET_CP1252:
+		if (outptr >= outend)
+			return 0;
+
+		if (ch >= 0xa0 && ch <= 0xff) {
+			*outptr = ch;
+			return 1;
+		}
+
+		for (ii = 0; ii < G_N_ELEMENTS (cp1252_to_ucs); ii++) {
+			if (cp1252_to_ucs[ii] == ch) {
+				*outptr = 0x80 + ii;
+				return 1;
+			}
+		}
+		break;
+	case ICONV_CHARSET_UTF8:
+		if (ch < 0x800) {
+			if (outend - outptr < 2)
+				return 0;
+
+			outptr[0] = 0xc0 | (ch >> 6);
+			outptr[1] = 0x80 | (ch & 0x3f);
+			return 2;
+		}
+
+		if (outend - outptr < 3)
+			return 0;
+
+		outptr[0] = 0xe0 | (ch >> 12);
+		outptr[1] = 0x80 | ((ch >> 6) & 0x3f);
+		outptr[2] = 0x80 | (ch & 0x3f);
+		return 3;
+	}
+
+	return 0;
+}
+
+/* Converts the ASCII and the common Latin characters without the iconv, which
+ * is used for the rest of the input, thus the result and the errors are the same */
+static gsize
+iconv_fast (struct _iconv_cache_node *in,
+            const gchar **inbuf,
+            gsize *inbytesleft,
+            gchar **outbuf,
+            gsize *outbytesleft)
+{
+	const guchar *inptr = (const guchar *) *inbuf, *inend = inptr + *inbytesleft, *run;
+	guchar *outptr = (guchar *) *outbuf, *outend = outptr + *outbytesleft;
+	gsize converted = 0, rc;
+	gunichar ch;
+	gint inlen, outlen;
+
+	while (inptr < inend) {
+		while (inptr < inend && outptr < outend && *inptr < 0x80)
+			*outptr++ = *inptr++;
+
+		if (inptr == inend)
+			break;
+
+		/* let the iconv report the E2BIG */
+		if (outptr == outend)
+			goto slow;
+
+		ch = iconv_fast_getc (in->from_kind, inptr, inend, &inlen);
+		if (ch != 0 && (outlen = iconv_fast_putc (in->to_kind, ch, outptr, outend)) != 0) {
+			inptr += inlen;
+			outptr += outlen;
+			continue;
+		}
+
+		/* convert the non-ASCII run by the iconv, the ASCII is always
+		 * on a character boundary in the stateless charsets */
+		for (run = inptr; run < inend && *run >= 0x80; run++)
+			;
+
+		*inbuf = (const gchar *) inptr;
+		*inbytesleft = run - inptr;
+		*outbuf = (gchar *) outptr;
+		*outbytesleft = outend - outptr;
+
+		rc = g_iconv (in->ip, (gchar **) inbuf, inbytesleft, outbuf, outbytesleft);
+
+		inptr = (const guchar *) *inbuf;
+		outptr = (guchar *) *outbuf;
+
+		if (rc == (gsize) -1) {
+			/* an incomplete sequence followed by the ASCII is an invalid one */
+			if (errno == EINVAL && run < inend)
+				goto slow;
+
+			*inbytesleft = inend - inptr;
+
+			return rc;
+		}
+
+		converted += rc;
+	}
+
+	*inbuf = (const gchar *) inptr;
+	*inbytesleft = 0;
+	*outbuf = (gchar *) outptr;
+	*outbytesleft = outend - outptr;
+
+	return converted;
+
+ slow:
+	*inbuf = (const gchar *) inptr;
+	*inbytesleft = inend - inptr;
+	*outbuf = (gchar *) outptr;
+	*outbytesleft = outend - outptr;
+
+	rc = g_iconv (in->ip, (gchar **) inbuf, inbytesleft, outbuf, outbytesleft);
+
+	return rc == (gsize) -1 ? rc : converted + rc;
+}
+
+/* the lock should be held, when the converter is open */
 static void
-flush_entry (struct _iconv_cache *ic)
+iconv_cache_node_free (struct _iconv_cache_node *in)
 {
+	if (in->ip != (GIConv) -1) {
+		g_hash_table_remove (iconv_cache_open, in->ip);
+		g_iconv_close (in->ip);
+	}
+
+	g_free (in->to);
+	g_free (in->from);
+	g_free (in);
+}
+
+static void
+iconv_cache_free (gpointer data)
+{
+	struct _iconv_cache *ic = data;
 	struct _iconv_cache_node *in;
 
+	G_LOCK (iconv);
+
 	while ((in = g_queue_pop_head (&ic->open)) != NULL) {
-		if (in->ip != (GIConv) -1) {
-			g_hash_table_remove (iconv_cache_open, in->ip);
-			g_iconv_close (in->ip);
+		in->parent = NULL;
+
+		/* the busy ones are freed by the camel_iconv_close() in another thread */
+		if (!g_atomic_int_get (&in->busy)) {
+			cd (printf ("Flushing iconv converter '%s' to '%s'\n", in->from, in->to));
+			iconv_cache_node_free (in);
 		}
-		g_free (in);
 	}
 
-	g_free (ic->conv);
+	G_UNLOCK (iconv);
+
 	g_free (ic);
 }
 
+/* Finds the open converter in the cache of the current thread */
+static struct _iconv_cache_node *
+iconv_cache_lookup (GIConv ip)
+{
+	struct _iconv_cache *ic;
+	GList *link;
+
+	ic = g_private_get (&iconv_cache_private);
+	if (ic == NULL || ip == (GIConv) -1)
+		return NULL;
+
+	for (link = g_queue_peek_head_link (&ic->open); link != NULL; link = g_list_next (link)) {
+		struct _iconv_cache_node *in = link->data;
+
+		if (in->ip == ip)
+			return in;
+	}
+
+	return NULL;
+}
+
 /**
  * camel_iconv_open: (skip)
  * @to: charset to convert to
@@ -381,10 +670,9 @@ camel_iconv_open (const gchar *to,
                   const gchar *from)
 {
 	const gchar *nto, *nfrom;
-	gchar *tofrom;
-	gsize tofrom_len;
 	struct _iconv_cache *ic;
 	struct _iconv_cache_node *in;
+	GList *link;
 	gint errnosav;
 	GIConv ip;
 
@@ -393,52 +681,25 @@ camel_iconv_open (const gchar *to,
 		return (GIConv) -1;
 	}
 
-	nto = camel_iconv_charset_name (to);
-	nfrom = camel_iconv_charset_name (from);
-	tofrom_len = strlen (nto) + strlen (nfrom) + 2;
-	tofrom = g_alloca (tofrom_len);
-	g_snprintf (tofrom, tofrom_len, "%s%%%s", nto, nfrom);
-
-	G_LOCK (iconv);
-
-	ic = g_hash_table_lookup (iconv_cache, tofrom);
-	if (ic) {
-		g_queue_remove (&iconv_cache_list, ic);
-	} else {
-		GList *link;
-
-		link = g_queue_peek_tail_link (&iconv_cache_list);
-
-		while (link != NULL && iconv_cache_list.length > E_ICONV_CACHE_SIZE) {
-			GList *prev = g_list_previous (link);
-
-			ic = (struct _iconv_cache *) link->data;
-			in = g_queue_peek_head (&ic->open);
-
-			if (in != NULL && !in->busy) {
-				cd (printf ("Flushing iconv converter '%s'\n", ic->conv));
-				g_queue_delete_link (&iconv_cache_list, link);
-				g_hash_table_remove (iconv_cache, ic->conv);
-				flush_entry (ic);
-			}
-
-			link = prev;
-		}
-
-		ic = g_malloc (sizeof (*ic));
+	ic = g_private_get (&iconv_cache_private);
+	if (ic == NULL) {
+		ic = g_new0 (struct _iconv_cache, 1);
 		g_queue_init (&ic->open);
-		ic->conv = g_strdup (tofrom);
-		g_hash_table_insert (iconv_cache, ic->conv, ic);
-
-		cd (printf ("Creating iconv converter '%s'\n", ic->conv));
+		g_private_set (&iconv_cache_private, ic);
 	}
 
-	g_queue_push_head (&iconv_cache_list, ic);
-
 	/* If we have a free iconv, use it */
-	in = g_queue_peek_tail (&ic->open);
-	if (in != NULL && !in->busy) {
-		cd (printf ("using existing iconv converter '%s'\n", ic->conv));
+	for (link = g_queue_peek_head_link (&ic->open); link != NULL; link = g_list_next (link)) {
+		in = link->data;
+
+		if (g_atomic_int_get (&in->busy) ||
+		    g_ascii_strcasecmp (in->to, to) != 0 ||
+		    g_ascii_strcasecmp (in->from, from) != 0)
+			continue;
+
+		g_queue_unlink (&ic->open, link);
+		g_queue_push_head_link (&ic->open, link);
+
 		ip = in->ip;
 		if (ip != (GIConv) -1) {
 			/* work around some broken iconv implementations
@@ -447,31 +708,68 @@ camel_iconv_open (const gchar *to,
 			gsize buggy_iconv_len = 0;
 			gchar *buggy_iconv_buf = NULL;
 
+			cd (printf ("using existing iconv converter '%s' to '%s'\n", from, to));
+
 			/* resets the converter */
 			g_iconv (ip, &buggy_iconv_buf, &buggy_iconv_len, &buggy_iconv_buf, &buggy_iconv_len);
-			in->busy = TRUE;
-			g_queue_remove (&ic->open, in);
-			g_queue_push_head (&ic->open, in);
+			g_atomic_int_set (&in->busy, TRUE);
+		} else {
+			errno = EINVAL;
 		}
+
+		return ip;
+	}
+
+	nto = camel_iconv_charset_name (to);
+	nfrom = camel_iconv_charset_name (from);
+
+	cd (printf ("creating new iconv converter '%s' to '%s'\n", nfrom, nto));
+
+	ip = g_iconv_open (nto, nfrom);
+	errnosav = errno;
+
+	in = g_new0 (struct _iconv_cache_node, 1);
+	in->parent = ic;
+	in->to = g_strdup (to);
+	in->from = g_strdup (from);
+	in->ip = ip;
+
+	if (ip != (GIConv) -1) {
+		in->to_kind = iconv_charset_kind (nto);
+		in->from_kind = iconv_charset_kind (nfrom);
+		in->busy = TRUE;
+
+		G_LOCK (iconv);
+		g_hash_table_insert (iconv_cache_open, ip, in);
+		G_UNLOCK (iconv);
 	} else {
-		cd (printf ("creating new iconv converter '%s'\n", ic->conv));
-		ip = g_iconv_open (nto, nfrom);
-		in = g_malloc (sizeof (*in));
-		in->ip = ip;
-		in->parent = ic;
-		g_queue_push_head (&ic->open, in);
-		if (ip != (GIConv) -1) {
-			g_hash_table_insert (iconv_cache_open, ip, in);
-			in->busy = TRUE;
-		} else {
-			errnosav = errno;
-			g_warning ("Could not open converter for '%s' to '%s' charset", nfrom, nto);
-			in->busy = FALSE;
-			errno = errnosav;
+		/* remember the failure, to not try it again */
+		g_warning ("Could not open converter for '%s' to '%s' charset", nfrom, nto);
+	}
+
+	g_queue_push_head (&ic->open, in);
+
+	/* flush the least recently used converters, which are not used */
+	link = g_queue_peek_tail_link (&ic->open);
+
+	while (link != NULL && ic->open.length > E_ICONV_CACHE_SIZE) {
+		GList *prev = g_list_previous (link);
+
+		in = link->data;
+
+		if (!g_atomic_int_get (&in->busy)) {
+			cd (printf ("Flushing iconv converter '%s' to '%s'\n", in->from, in->to));
+			g_queue_delete_link (&ic->open, link);
+
+			G_LOCK (iconv);
+			iconv_cache_node_free (in);
+			G_UNLOCK (iconv);
 		}
+
+		link = prev;
 	}
 
-	G_UNLOCK (iconv);
+	errno = errnosav;
 
 	return ip;
 }
@@ -483,6 +781,14 @@ camel_iconv (GIConv cd,
              gchar **outbuf,
              gsize *outbytesleft)
 {
+	struct _iconv_cache_node *in;
+
+	if (inbuf && *inbuf && outbuf && *outbuf &&
+	    (in = iconv_cache_lookup (cd)) != NULL &&
+	    in->to_kind != ICONV_CHARSET_OTHER &&
+	    in->from_kind != ICONV_CHARSET_OTHER)
+		return iconv_fast (in, inbuf, inbytesleft, outbuf, outbytesleft);
+
 	return g_iconv (cd, (gchar **) inbuf, inbytesleft, outbuf, outbytesleft);
 }
 
@@ -494,13 +800,24 @@ camel_iconv_close (GIConv ip)
 	if (ip == (GIConv) -1)
 		return;
 
+	in = iconv_cache_lookup (ip);
+	if (in) {
+		cd (printf ("closing iconv converter '%s' to '%s'\n", in->from, in->to));
+		g_atomic_int_set (&in->busy, FALSE);
+		return;
+	}
+
+	/* opened by another thread */
+	iconv_init ();
+
 	G_LOCK (iconv);
 	in = g_hash_table_lookup (iconv_cache_open, ip);
 	if (in) {
-		cd (printf ("closing iconv converter '%s'\n", in->parent->conv));
-		g_queue_remove (&in->parent->open, in);
-		in->busy = FALSE;
-		g_queue_push_tail (&in->parent->open, in);
+		cd (printf ("closing iconv converter '%s' to '%s' of another thread\n", in->from, in->to));
+		if (in->parent)
+			g_atomic_int_set (&in->busy, FALSE);
+		else
+			iconv_cache_node_free (in);
 	} else {
 		g_warning ("trying to close iconv i dont know about: %p", ip);
 		g_iconv_close (ip);
@@ -511,7 +828,7 @@ camel_iconv_close (GIConv ip)
 const gchar *
 camel_iconv_locale_charset (void)
 {
-	iconv_init (FALSE);
+	iconv_init ();
 
 	return locale_charset;
 }
@@ -519,7 +836,7 @@ camel_iconv_locale_charset (void)
 const gchar *
 camel_iconv_locale_language (void)
 {
-	iconv_init (FALSE);
+	iconv_init ();
 
 	return locale_lang;
 }
@@ -21,11 +21,15 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
+#include <glib/gstdio.h>
+
+#include "camel-file-utils.h"
 #include "camel-index.h"
 #include "camel-object.h"
 
@@ -35,8 +39,49 @@
 
 #define CAMEL_INDEX_VERSION (0x01)
 
+/* Each name has a Bloom filter of the character trigrams of its words, which can
+   tell without touching the index files that no word of the name contains a string.
+   A name without a filter can contain anything.
+
+   The filters are stored in "<path>.index.bloom", as a header followed by records
+   of the state, the name length and the filter size (all 32-bit little-endian),
+   the name and the filter. Only the names changed since the last sync are written,
+   as new records appended before the index is synced, thus a filter is never older
+   than the index data of its name. The replaced records are marked as deleted
+   afterwards; a later record of the same name wins over an earlier one, thus
+   an interrupted sync leaves the file consistent. The file is rewritten only
+   when the deleted records take more space than the live ones. Only the record
+   locations are kept in memory, the filters are read on demand. */
+#define BLOOM_MAGIC "CBLM"
+#define BLOOM_VERSION (2)
+#define BLOOM_HEADER_SIZE (8)
+#define BLOOM_RECORD_HEADER_SIZE (12)
+#define BLOOM_RECORD_DELETED (0)
+#define BLOOM_RECORD_LIVE (1)
+#define BLOOM_HASHES (4)
+#define BLOOM_BITS_PER_GRAM (8)
+#define BLOOM_MIN_SIZE (8)
+#define BLOOM_MAX_SIZE (4096)
+#define BLOOM_MAX_NAME_LEN (1024)
+/* Do not bother rewriting the file for less dead space than this */
+#define BLOOM_MIN_COMPACT_SIZE (64 * 1024)
+
+typedef struct _FilterRecord {
+	goffset offset;	/* of the record in the file */
+	guint32 name_len;
+	guint32 size;	/* of the filter */
+} FilterRecord;
+
+#define FILTER_RECORD_LENGTH(rec) (BLOOM_RECORD_HEADER_SIZE + (rec)->name_len + (rec)->size)
+
 struct _CamelIndexPrivate {
-	gpointer dummy;
+	GMutex filters_lock;
+	gint filters_fd; /* -1 when not opened */
+	GHashTable *filters; /* gchar *name ~> FilterRecord *, the saved filters */
+	GHashTable *dirty_filters; /* gchar *name ~> GBytes *filter, NULL when deleted */
+	goffset filters_end; /* where the next record is appended */
+	goffset filters_dead; /* size of the deleted records */
+	gboolean filters_loaded;
 };
 
 /* ********************************************************************** */
@@ -45,11 +90,593 @@ struct _CamelIndexPrivate {
 
 G_DEFINE_TYPE_WITH_PRIVATE (CamelIndex, camel_index, G_TYPE_OBJECT)
 
+static gchar *
+index_filters_filename (const gchar *index_path)
+{
+	return g_strconcat (index_path, ".bloom", NULL);
+}
+
+static guint64
+index_filters_hash (const gchar *gram,
+		    gsize len)
+{
+	guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+	gsize ii;
+
+	/* FNV-1a */
+	for (ii = 0; ii < len; ii++) {
+		hash ^= (guchar) gram[ii];
+		hash *= G_GUINT64_CONSTANT (0x100000001b3);
+	}
+
+	return hash;
+}
+
+/* Calls 'func' for each trigram of the 'word', or for the whole word, when it is shorter */
+static void
+index_filters_foreach_gram (const gchar *word,
+			    void (*func) (const gchar *gram, gsize len, gpointer user_data),
+			    gpointer user_data)
+{
+	const gchar *p1, *p2, *p3;
+
+	p1 = word;
+	p2 = *p1 ? g_utf8_next_char (p1) : p1;
+	p3 = *p2 ? g_utf8_next_char (p2) : p2;
+
+	if (!*p3) {
+		if (*word)
+			func (word, p3 - word, user_data);
+		return;
+	}
+
+	while (*p3) {
+		const gchar *end = g_utf8_next_char (p3);
+
+		func (p1, end - p1, user_data);
+
+		p1 = p2;
+		p2 = p3;
+		p3 = end;
+	}
+}
+
+static void
+index_filters_count_gram_cb (const gchar *gram,
+			     gsize len,
+			     gpointer user_data)
+{
+	guint *pcount = user_data;
+
+	(*pcount)++;
+}
+
+typedef struct _FilterData {
+	guchar *bits;
+	guint32 mask;
+	gboolean all_set;
+} FilterData;
+
+static void
+index_filters_set_gram_cb (const gchar *gram,
+			   gsize len,
+			   gpointer user_data)
+{
+	FilterData *fd = user_data;
+	guint64 hash = index_filters_hash (gram, len);
+	guint32 h1 = (guint32) hash, h2 = (guint32) (hash >> 32) | 1;
+	gint ii;
+
+	for (ii = 0; ii < BLOOM_HASHES; ii++) {
+		guint32 bit = (h1 + ii * h2) & fd->mask;
+
+		fd->bits[bit / 8] |= 1 << (bit % 8);
+	}
+}
+
+static void
+index_filters_test_gram_cb (const gchar *gram,
+			    gsize len,
+			    gpointer user_data)
+{
+	FilterData *fd = user_data;
+	guint64 hash;
+	guint32 h1, h2;
+	gint ii;
+
+	if (!fd->all_set)
+		return;
+
+	hash = index_filters_hash (gram, len);
+	h1 = (guint32) hash;
+	h2 = (guint32) (hash >> 32) | 1;
+
+	for (ii = 0; ii < BLOOM_HASHES && fd->all_set; ii++) {
+		guint32 bit = (h1 + ii * h2) & fd->mask;
+
+		fd->all_set = (fd->bits[bit / 8] & (1 << (bit % 8))) != 0;
+	}
+}
+
+/* Builds the filter from the words of the 'idn' */
+static GBytes *
+index_filters_build (CamelIndexName *idn)
+{
+	FilterData fd;
+	GHashTableIter iter;
+	gpointer key;
+	guint n_grams = 0;
+	gsize size;
+
+	if (!idn->words)
+		return NULL;
+
+	g_hash_table_iter_init (&iter, idn->words);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		index_filters_foreach_gram (key, index_filters_count_gram_cb, &n_grams);
+	}
+
+	/* power of two, to replace the modulo with a mask */
+	for (size = BLOOM_MIN_SIZE; size < BLOOM_MAX_SIZE && size * 8 < ((gsize) n_grams) * BLOOM_BITS_PER_GRAM; size <<= 1) {
+		/* just count */
+	}
+
+	fd.bits = g_malloc0 (size);
+	fd.mask = size * 8 - 1;
+
+	g_hash_table_iter_init (&iter, idn->words);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		index_filters_foreach_gram (key, index_filters_set_gram_cb, &fd);
+	}
+
+	return g_bytes_new_take (fd.bits, size);
+}
+
+static void
+index_filters_encode_uint32 (guchar *bytes,
+			     guint32 value)
+{
+	bytes[0] = value & 0xff;
+	bytes[1] = (value >> 8) & 0xff;
+	bytes[2] = (value >> 16) & 0xff;
+	bytes[3] = (value >> 24) & 0xff;
+}
+
+static guint32
+index_filters_decode_uint32 (const guchar *bytes)
+{
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (((guint32) bytes[3]) << 24);
+}
+
+static gboolean
+index_filters_pread (gint fd,
+		     goffset offset,
+		     gpointer buffer,
+		     gsize len)
+{
+	gchar *ptr = buffer;
+
+	if (lseek (fd, offset, SEEK_SET) != offset)
+		return FALSE;
+
+	while (len > 0) {
+		gssize n_read;
+
+		n_read = camel_read (fd, ptr, len, NULL, NULL);
+		if (n_read <= 0)
+			return FALSE;
+
+		ptr += n_read;
+		len -= n_read;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+index_filters_pwrite (gint fd,
+		      goffset offset,
+		      gconstpointer buffer,
+		      gsize len)
+{
+	gssize n_written;
+
+	if (lseek (fd, offset, SEEK_SET) != offset)
+		return FALSE;
+
+	n_written = camel_write (fd, (const gchar *) buffer, len, NULL, NULL);
+
+	return n_written == len;
+}
+
+/* Call with the filters_lock held; keeps the unsaved filters */
+static void
+index_filters_close_locked (CamelIndex *index)
+{
+	if (index->priv->filters_fd != -1) {
+		close (index->priv->filters_fd);
+		index->priv->filters_fd = -1;
+	}
+
+	g_hash_table_remove_all (index->priv->filters);
+	index->priv->filters_end = 0;
+	index->priv->filters_dead = 0;
+	index->priv->filters_loaded = FALSE;
+}
+
+/* Call with the filters_lock held */
+static gboolean
+index_filters_reset_file_locked (CamelIndex *index)
+{
+	guchar header[BLOOM_HEADER_SIZE];
+
+	memcpy (header, BLOOM_MAGIC, 4);
+	index_filters_encode_uint32 (header + 4, BLOOM_VERSION);
+
+	if (ftruncate (index->priv->filters_fd, 0) == -1 ||
+	    !index_filters_pwrite (index->priv->filters_fd, 0, header, BLOOM_HEADER_SIZE))
+		return FALSE;
+
+	index->priv->filters_end = BLOOM_HEADER_SIZE;
+	index->priv->filters_dead = 0;
+
+	return TRUE;
+}
+
+/* Call with the filters_lock held; reads only the record headers and names,
+   into the locations of the saved filters */
+static void
+index_filters_load_locked (CamelIndex *index)
+{
+	GFile *file;
+	GFileInputStream *file_stream;
+	GInputStream *stream;
+	struct stat st;
+	guchar header[BLOOM_RECORD_HEADER_SIZE];
+	gchar *filename;
+	goffset offset;
+	gsize n_read = 0;
+
+	if (index->priv->filters_loaded)
+		return;
+
+	index->priv->filters_loaded = TRUE;
+
+	filename = index_filters_filename (index->path);
+
+	index->priv->filters_fd = g_open (filename, O_RDWR | O_CREAT | O_BINARY, 0600);
+	if (index->priv->filters_fd == -1) {
+		w (g_warning ("%s: Failed to open '%s': %s", G_STRFUNC, filename, g_strerror (errno)));
+		g_free (filename);
+		return;
+	}
+
+	file = g_file_new_for_path (filename);
+	file_stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+
+	/* skipping does not stop at the end of the file */
+	if (fstat (index->priv->filters_fd, &st) == -1)
+		st.st_size = 0;
+
+	stream = file_stream ? g_buffered_input_stream_new_sized (G_INPUT_STREAM (file_stream), 65536) : NULL;
+	g_clear_object (&file_stream);
+
+	if (!stream ||
+	    !g_input_stream_read_all (stream, header, BLOOM_HEADER_SIZE, &n_read, NULL, NULL) || n_read != BLOOM_HEADER_SIZE ||
+	    memcmp (header, BLOOM_MAGIC, 4) != 0 || index_filters_decode_uint32 (header + 4) != BLOOM_VERSION) {
+		/* a new file, or a file of an older version, which is not worth converting */
+		if (!index_filters_reset_file_locked (index))
+			index_filters_close_locked (index);
+
+		/* do not try to open it again */
+		index->priv->filters_loaded = TRUE;
+
+		g_clear_object (&stream);
+		g_free (filename);
+
+		return;
+	}
+
+	offset = BLOOM_HEADER_SIZE;
+
+	while (g_input_stream_read_all (stream, header, BLOOM_RECORD_HEADER_SIZE, &n_read, NULL, NULL) &&
+	       n_read == BLOOM_RECORD_HEADER_SIZE) {
+		FilterRecord rec, *existing;
+		guint32 state;
+		gchar *name;
+
+		state = index_filters_decode_uint32 (header);
+		rec.offset = offset;
+		rec.name_len = index_filters_decode_uint32 (header + 4);
+		rec.size = index_filters_decode_uint32 (header + 8);
+
+		/* the size is always a power of two */
+		if ((state != BLOOM_RECORD_LIVE && state != BLOOM_RECORD_DELETED) ||
+		    rec.name_len > BLOOM_MAX_NAME_LEN || rec.size < BLOOM_MIN_SIZE ||
+		    rec.size > BLOOM_MAX_SIZE || (rec.size & (rec.size - 1)) != 0 ||
+		    offset + FILTER_RECORD_LENGTH (&rec) > st.st_size)
+			break;
+
+		name = g_malloc (rec.name_len + 1);
+
+		if (!g_input_stream_read_all (stream, name, rec.name_len, &n_read, NULL, NULL) || n_read != rec.name_len ||
+		    g_input_stream_skip (stream, rec.size, NULL, NULL) != rec.size) {
+			g_free (name);
+			break;
+		}
+
+		name[rec.name_len] = '\0';
+		offset += FILTER_RECORD_LENGTH (&rec);
+
+		if (state == BLOOM_RECORD_LIVE) {
+			existing = g_hash_table_lookup (index->priv->filters, name);
+			if (existing)
+				index->priv->filters_dead += FILTER_RECORD_LENGTH (existing);
+
+			g_hash_table_insert (index->priv->filters, name, g_slice_dup (FilterRecord, &rec));
+		} else {
+			index->priv->filters_dead += FILTER_RECORD_LENGTH (&rec);
+			g_free (name);
+		}
+	}
+
+	g_object_unref (stream);
+
+	/* drop any incomplete record, left by an interrupted write */
+	if (ftruncate (index->priv->filters_fd, offset) == -1) {
+		w (g_warning ("%s: Failed to truncate '%s': %s", G_STRFUNC, filename, g_strerror (errno)));
+		index_filters_close_locked (index);
+		index->priv->filters_loaded = TRUE;
+	} else {
+		index->priv->filters_end = offset;
+	}
+
+	g_free (filename);
+}
+
+/* Call with the filters_lock held; returns a new reference of the filter of the 'name', or NULL */
+static GBytes *
+index_filters_ref_filter_locked (CamelIndex *index,
+				 const gchar *name)
+{
+	FilterRecord *rec;
+	gpointer value = NULL;
+	guchar *bits;
+
+	if (g_hash_table_lookup_extended (index->priv->dirty_filters, name, NULL, &value))
+		return value ? g_bytes_ref (value) : NULL;
+
+	index_filters_load_locked (index);
+
+	rec = g_hash_table_lookup (index->priv->filters, name);
+	if (!rec || index->priv->filters_fd == -1)
+		return NULL;
+
+	bits = g_malloc (rec->size);
+
+	if (!index_filters_pread (index->priv->filters_fd, rec->offset + BLOOM_RECORD_HEADER_SIZE + rec->name_len, bits, rec->size)) {
+		g_free (bits);
+		return NULL;
+	}
+
+	return g_bytes_new_take (bits, rec->size);
+}
+
+/* Call with the filters_lock held; appends a record of the 'filter' of the 'name' */
+static gboolean
+index_filters_append_locked (CamelIndex *index,
+			     gint fd,
+			     goffset *inout_end,
+			     const gchar *name,
+			     GBytes *filter,
+			     FilterRecord *out_rec)
+{
+	GByteArray *data;
+	guchar header[BLOOM_RECORD_HEADER_SIZE];
+	gconstpointer bits;
+	gsize size = 0;
+	gboolean success;
+
+	bits = g_bytes_get_data (filter, &size);
+
+	out_rec->offset = *inout_end;
+	out_rec->name_len = strlen (name);
+	out_rec->size = size;
+
+	index_filters_encode_uint32 (header, BLOOM_RECORD_LIVE);
+	index_filters_encode_uint32 (header + 4, out_rec->name_len);
+	index_filters_encode_uint32 (header + 8, out_rec->size);
+
+	data = g_byte_array_sized_new (FILTER_RECORD_LENGTH (out_rec));
+	g_byte_array_append (data, header, BLOOM_RECORD_HEADER_SIZE);
+	g_byte_array_append (data, (const guint8 *) name, out_rec->name_len);
+	g_byte_array_append (data, bits, size);
+
+	success = index_filters_pwrite (fd, out_rec->offset, data->data, data->len);
+	if (success)
+		*inout_end += data->len;
+
+	g_byte_array_free (data, TRUE);
+
+	return success;
+}
+
+/* Call with the filters_lock held; rewrites the file with only the live records */
+static gboolean
+index_filters_compact_locked (CamelIndex *index)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gchar *filename, *tmp_filename;
+	guchar header[BLOOM_HEADER_SIZE];
+	goffset end = BLOOM_HEADER_SIZE;
+	gboolean success = TRUE;
+	gint fd;
+
+	filename = index_filters_filename (index->path);
+	tmp_filename = g_strconcat (filename, "~", NULL);
+
+	fd = g_open (tmp_filename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0600);
+	if (fd == -1) {
+		g_free (tmp_filename);
+		g_free (filename);
+		return FALSE;
+	}
+
+	memcpy (header, BLOOM_MAGIC, 4);
+	index_filters_encode_uint32 (header + 4, BLOOM_VERSION);
+	success = index_filters_pwrite (fd, 0, header, BLOOM_HEADER_SIZE);
+
+	g_hash_table_iter_init (&iter, index->priv->filters);
+	while (success && g_hash_table_iter_next (&iter, &key, &value)) {
+		FilterRecord *rec = value, new_rec;
+		GBytes *filter;
+
+		filter = index_filters_ref_filter_locked (index, key);
+		if (!filter) {
+			/* the name is left without a filter */
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		success = index_filters_append_locked (index, fd, &end, key, filter, &new_rec);
+		if (success)
+			*rec = new_rec;
+
+		g_bytes_unref (filter);
+	}
+
+	if (success && g_rename (tmp_filename, filename) == -1)
+		success = FALSE;
+
+	if (success) {
+		close (index->priv->filters_fd);
+		index->priv->filters_fd = fd;
+		index->priv->filters_end = end;
+		index->priv->filters_dead = 0;
+	} else {
+		close (fd);
+		g_unlink (tmp_filename);
+
+		/* the locations can be partly updated, read them again */
+		index_filters_close_locked (index);
+	}
+
+	g_free (tmp_filename);
+	g_free (filename);
+
+	return success;
+}
+
+static gint
+index_filters_save (CamelIndex *index)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean success = TRUE;
+
+	g_mutex_lock (&index->priv->filters_lock);
+
+	if (!g_hash_table_size (index->priv->dirty_filters)) {
+		g_mutex_unlock (&index->priv->filters_lock);
+		return 0;
+	}
+
+	index_filters_load_locked (index);
+
+	/* the file cannot be used, thus the names are left without filters */
+	if (index->priv->filters_fd == -1) {
+		gchar *filename = index_filters_filename (index->path);
+
+		g_hash_table_remove_all (index->priv->dirty_filters);
+		g_unlink (filename);
+		g_free (filename);
+
+		g_mutex_unlock (&index->priv->filters_lock);
+
+		return 0;
+	}
+
+	/* first append the new filters, the deleted records are marked afterwards */
+	g_hash_table_iter_init (&iter, index->priv->dirty_filters);
+	while (success && g_hash_table_iter_next (&iter, &key, &value)) {
+		FilterRecord rec, *old_rec;
+		guchar deleted[4];
+
+		if (value) {
+			success = index_filters_append_locked (index, index->priv->filters_fd, &index->priv->filters_end, key, value, &rec);
+			if (!success)
+				break;
+		}
+
+		old_rec = g_hash_table_lookup (index->priv->filters, key);
+		if (old_rec) {
+			index_filters_encode_uint32 (deleted, BLOOM_RECORD_DELETED);
+
+			/* when this fails, the new record wins anyway */
+			if (!index_filters_pwrite (index->priv->filters_fd, old_rec->offset, deleted, 4) && !value)
+				success = FALSE;
+
+			index->priv->filters_dead += FILTER_RECORD_LENGTH (old_rec);
+		}
+
+		if (value)
+			g_hash_table_insert (index->priv->filters, g_strdup (key), g_slice_dup (FilterRecord, &rec));
+		else if (success)
+			g_hash_table_remove (index->priv->filters, key);
+
+		g_hash_table_iter_remove (&iter);
+	}
+
+	if (success &&
+	    index->priv->filters_dead > BLOOM_MIN_COMPACT_SIZE &&
+	    index->priv->filters_dead > index->priv->filters_end / 2 &&
+	    !index_filters_compact_locked (index)) {
+		w (g_warning ("%s: Failed to compact the filters of '%s'", G_STRFUNC, index->path));
+	}
+
+	if (!success) {
+		gchar *filename = index_filters_filename (index->path);
+
+		g_warning ("%s: Failed to write '%s': %s", G_STRFUNC, filename, g_strerror (errno));
+
+		/* better no filters than outdated filters */
+		index_filters_close_locked (index);
+		g_hash_table_remove_all (index->priv->dirty_filters);
+		g_unlink (filename);
+		g_free (filename);
+	}
+
+	g_mutex_unlock (&index->priv->filters_lock);
+
+	if (!success) {
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+filter_record_free (gpointer ptr)
+{
+	FilterRecord *rec = ptr;
+
+	if (rec)
+		g_slice_free (FilterRecord, rec);
+}
+
 static void
 index_finalize (GObject *object)
 {
 	CamelIndex *index = CAMEL_INDEX (object);
 
+	if (index->priv->filters_fd != -1)
+		close (index->priv->filters_fd);
+	g_hash_table_destroy (index->priv->filters);
+	g_hash_table_destroy (index->priv->dirty_filters);
+	g_mutex_clear (&index->priv->filters_lock);
 	g_free (index->path);
 
 	/* Chain up to parent's finalize () method. */
@@ -70,6 +697,11 @@ camel_index_init (CamelIndex *index)
 {
 	index->priv = camel_index_get_instance_private (index);
 	index->version = CAMEL_INDEX_VERSION;
+
+	g_mutex_init (&index->priv->filters_lock);
+	index->priv->filters_fd = -1;
+	index->priv->filters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, filter_record_free);
+	index->priv->dirty_filters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
 }
 
 void
@@ -80,6 +712,17 @@ camel_index_construct (CamelIndex *idx,
 	g_free (idx->path);
 	idx->path = g_strdup_printf ("%s.index", path);
 	idx->flags = flags;
+
+	g_mutex_lock (&idx->priv->filters_lock);
+	index_filters_close_locked (idx);
+	g_mutex_unlock (&idx->priv->filters_lock);
+
+	if ((flags & O_TRUNC) != 0) {
+		gchar *filename = index_filters_filename (idx->path);
+
+		g_unlink (filename);
+		g_free (filename);
+	}
 }
 
 gint
@@ -94,9 +737,30 @@ camel_index_rename (CamelIndex *idx,
 	g_return_val_if_fail (class != NULL, -1);
 	g_return_val_if_fail (class->rename != NULL, -1);
 
-	if ((idx->state & CAMEL_INDEX_DELETED) == 0)
-		return class->rename (idx, path);
-	else {
+	if ((idx->state & CAMEL_INDEX_DELETED) == 0) {
+		gchar *old_filename;
+		gint ret;
+
+		old_filename = index_filters_filename (idx->path);
+
+		ret = class->rename (idx, path);
+		if (ret == 0) {
+			gchar *new_filename = index_filters_filename (idx->path);
+
+			/* the unsaved filters are kept; when the file cannot be renamed,
+			   the names saved before are left without a filter */
+			g_mutex_lock (&idx->priv->filters_lock);
+			index_filters_close_locked (idx);
+			g_rename (old_filename, new_filename);
+			g_mutex_unlock (&idx->priv->filters_lock);
+
+			g_free (new_filename);
+		}
+
+		g_free (old_filename);
+
+		return ret;
+	} else {
 		errno = ENOENT;
 		return -1;
 	}
@@ -132,9 +796,13 @@ camel_index_sync (CamelIndex *idx)
 	g_return_val_if_fail (class != NULL, -1);
 	g_return_val_if_fail (class->sync != NULL, -1);
 
-	if ((idx->state & CAMEL_INDEX_DELETED) == 0)
+	if ((idx->state & CAMEL_INDEX_DELETED) == 0) {
+		/* the filters first, they can be newer than the index, but not older */
+		if (index_filters_save (idx) == -1)
+			return -1;
+
 		return class->sync (idx);
-	else {
+	} else {
 		errno = ENOENT;
 		return -1;
 	}
@@ -172,8 +840,19 @@ camel_index_delete (CamelIndex *idx)
 	g_return_val_if_fail (class->delete_ != NULL, -1);
 
 	if ((idx->state & CAMEL_INDEX_DELETED) == 0) {
+		gchar *filename;
+
 		ret = class->delete_ (idx);
 		idx->state |= CAMEL_INDEX_DELETED;
+
+		g_mutex_lock (&idx->priv->filters_lock);
+		index_filters_close_locked (idx);
+		g_hash_table_remove_all (idx->priv->dirty_filters);
+		g_mutex_unlock (&idx->priv->filters_lock);
+
+		filename = index_filters_filename (idx->path);
+		g_unlink (filename);
+		g_free (filename);
 	} else {
 		errno = ENOENT;
 		ret = -1;
@@ -239,9 +918,22 @@ camel_index_write_name (CamelIndex *idx,
 	g_return_val_if_fail (class != NULL, -1);
 	g_return_val_if_fail (class->write_name != NULL, -1);
 
-	if ((idx->state & CAMEL_INDEX_DELETED) == 0)
+	if ((idx->state & CAMEL_INDEX_DELETED) == 0) {
+		GBytes *filter = NULL;
+
+		/* force 'flush' of any outstanding data, to have all the words */
+		camel_index_name_add_buffer (idn, NULL, 0);
+
+		/* longer names would not be read back */
+		if (strlen (idn->name) <= BLOOM_MAX_NAME_LEN)
+			filter = index_filters_build (idn);
+
+		g_mutex_lock (&idx->priv->filters_lock);
+		g_hash_table_insert (idx->priv->dirty_filters, g_strdup (idn->name), filter);
+		g_mutex_unlock (&idx->priv->filters_lock);
+
 		return class->write_name (idx, idn);
-	else {
+	} else {
 		errno = ENOENT;
 		return -1;
 	}
@@ -292,8 +984,13 @@ camel_index_delete_name (CamelIndex *index,
 	g_return_if_fail (class != NULL);
 	g_return_if_fail (class->delete_name != NULL);
 
-	if ((index->state & CAMEL_INDEX_DELETED) == 0)
+	if ((index->state & CAMEL_INDEX_DELETED) == 0) {
+		g_mutex_lock (&index->priv->filters_lock);
+		g_hash_table_insert (index->priv->dirty_filters, g_strdup (name), NULL);
+		g_mutex_unlock (&index->priv->filters_lock);
+
 		class->delete_name (index, name);
+	}
 }
 
 /**
@@ -332,6 +1029,67 @@ camel_index_find (CamelIndex *index,
 	return ret;
 }
 
+/**
+ * camel_index_may_match:
+ * @index: a #CamelIndex
+ * @name: an indexed name
+ * @substring: a string to look for in the words of the @name
+ *
+ * Quickly checks whether any word of the @name can contain the @substring,
+ * the same way as camel_index_words() combined with camel_index_find()
+ * would find, without reading the index files. The test is case insensitive.
+ *
+ * Returns: %FALSE when it is certain that no word of the @name contains
+ *    the @substring, %TRUE when it can
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_index_may_match (CamelIndex *index,
+		       const gchar *name,
+		       const gchar *substring)
+{
+	FilterData fd;
+	GBytes *filter = NULL;
+	GString *lower;
+	const gchar *ptr;
+	gsize size = 0;
+
+	g_return_val_if_fail (CAMEL_IS_INDEX (index), TRUE);
+	g_return_val_if_fail (name != NULL, TRUE);
+	g_return_val_if_fail (substring != NULL, TRUE);
+
+	if ((index->state & CAMEL_INDEX_DELETED) != 0 ||
+	    !*substring || !g_utf8_validate (substring, -1, NULL))
+		return TRUE;
+
+	g_mutex_lock (&index->priv->filters_lock);
+	filter = index_filters_ref_filter_locked (index, name);
+	g_mutex_unlock (&index->priv->filters_lock);
+
+	if (!filter)
+		return TRUE;
+
+	/* the same way as camel_ustrstrcase() compares */
+	lower = g_string_sized_new (strlen (substring));
+	for (ptr = substring; *ptr; ptr = g_utf8_next_char (ptr)) {
+		g_string_append_unichar (lower, g_unichar_tolower (g_utf8_get_char (ptr)));
+	}
+
+	fd.bits = (guchar *) g_bytes_get_data (filter, &size);
+	fd.mask = size * 8 - 1;
+	fd.all_set = TRUE;
+
+	/* a shorter substring can be in a longer word, which has only its trigrams in the filter */
+	if (g_utf8_strlen (lower->str, -1) >= 3)
+		index_filters_foreach_gram (lower->str, index_filters_test_gram_cb, &fd);
+
+	g_string_free (lower, TRUE);
+	g_bytes_unref (filter);
+
+	return fd.all_set;
+}
+
 /**
  * camel_index_words:
  * @index: a #CamelIndex
@@ -212,6 +212,9 @@ void		camel_index_delete_name		(CamelIndex *index,
 CamelIndexCursor *
 		camel_index_find		(CamelIndex *index,
 						 const gchar *word);
+gboolean	camel_index_may_match		(CamelIndex *index,
+						 const gchar *name,
+						 const gchar *substring);
 CamelIndexCursor *
 		camel_index_words		(CamelIndex *index);
 
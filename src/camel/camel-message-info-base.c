@@ -40,10 +40,97 @@ struct _CamelMessageInfoBasePrivate {
 	guint64 message_id;
 	GArray *references;	/* guint64, aka CamelSummaryMessageID */
 	CamelNameValueArray *headers;
+
+	/* The raw record values, decoded on the first use; see message_info_base_load() */
+	gchar *lazy_part;
+	gchar *lazy_labels;
+	gchar *lazy_usertags;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (CamelMessageInfoBase, camel_message_info_base, CAMEL_TYPE_MESSAGE_INFO)
 
+/* Private functions */
+void _camel_message_info_parse_part (/* const */ gchar *part, guint64 *out_message_id, GArray **out_references);
+CamelNamedFlags *_camel_message_info_parse_labels (gchar *labels);
+CamelNameValueArray *_camel_message_info_parse_usertags (/* const */ gchar *usertags);
+
+/* Call with the property lock held */
+static void
+message_info_base_decode_lazy (CamelMessageInfoBase *bmi)
+{
+	if (G_LIKELY (!bmi->priv->lazy_part && !bmi->priv->lazy_labels && !bmi->priv->lazy_usertags))
+		return;
+
+	if (bmi->priv->lazy_part) {
+		GArray *references = NULL;
+
+		_camel_message_info_parse_part (bmi->priv->lazy_part, &bmi->priv->message_id, &references);
+
+		if (references) {
+			if (bmi->priv->references)
+				g_array_unref (bmi->priv->references);
+			bmi->priv->references = references;
+		}
+
+		g_clear_pointer (&bmi->priv->lazy_part, g_free);
+	}
+
+	if (bmi->priv->lazy_labels) {
+		camel_named_flags_free (bmi->priv->user_flags);
+		bmi->priv->user_flags = _camel_message_info_parse_labels (bmi->priv->lazy_labels);
+
+		g_clear_pointer (&bmi->priv->lazy_labels, g_free);
+	}
+
+	if (bmi->priv->lazy_usertags) {
+		camel_name_value_array_free (bmi->priv->user_tags);
+		bmi->priv->user_tags = _camel_message_info_parse_usertags (bmi->priv->lazy_usertags);
+
+		g_clear_pointer (&bmi->priv->lazy_usertags, g_free);
+	}
+}
+
+static gboolean
+message_info_base_load (CamelMessageInfo *mi,
+			const CamelMIRecord *record,
+			/* const */ gchar **bdata_ptr)
+{
+	CamelMessageInfoBase *bmi;
+	CamelMIRecord parent_record;
+
+	g_return_val_if_fail (CAMEL_IS_MESSAGE_INFO_BASE (mi), FALSE);
+	g_return_val_if_fail (record != NULL, FALSE);
+	g_return_val_if_fail (bdata_ptr != NULL, FALSE);
+
+	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
+
+	/* The parent loads all but the values decoded later below */
+	parent_record = *record;
+	parent_record.part = NULL;
+	parent_record.labels = NULL;
+	parent_record.usertags = NULL;
+
+	if (!CAMEL_MESSAGE_INFO_CLASS (camel_message_info_base_parent_class)->load (mi, &parent_record, bdata_ptr))
+		return FALSE;
+
+	/* Many infos are loaded only for their flags, like when counting or filtering
+	   by them, thus postpone decoding of the message ID, references, user flags
+	   and user tags until any of them is used. */
+	camel_message_info_property_lock (mi);
+
+	g_free (bmi->priv->lazy_part);
+	g_free (bmi->priv->lazy_labels);
+	g_free (bmi->priv->lazy_usertags);
+
+	bmi->priv->lazy_part = g_strdup (record->part);
+	bmi->priv->lazy_labels = g_strdup (record->labels);
+	bmi->priv->lazy_usertags = g_strdup (record->usertags);
+
+	camel_message_info_property_unlock (mi);
+
+	return TRUE;
+}
+
 static guint32
 message_info_base_get_flags (const CamelMessageInfo *mi)
 {
@@ -95,6 +182,7 @@ message_info_base_get_user_flag (const CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	if (bmi->priv->user_flags)
 		result = camel_named_flags_contains (bmi->priv->user_flags, name);
 	else
@@ -118,6 +206,7 @@ message_info_base_set_user_flag (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	if (!bmi->priv->user_flags)
 		bmi->priv->user_flags = camel_named_flags_new ();
 
@@ -141,6 +230,7 @@ message_info_base_get_user_flags (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	result = bmi->priv->user_flags;
 	camel_message_info_property_unlock (mi);
 
@@ -158,6 +248,7 @@ message_info_base_dup_user_flags (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	if (bmi->priv->user_flags)
 		result = camel_named_flags_copy (bmi->priv->user_flags);
 	else
@@ -179,6 +270,7 @@ message_info_base_take_user_flags (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 
 	changed = !camel_named_flags_equal (bmi->priv->user_flags, user_flags);
 
@@ -207,6 +299,7 @@ message_info_base_get_user_tag (const CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	if (bmi->priv->user_tags)
 		result = camel_name_value_array_get_named (bmi->priv->user_tags, CAMEL_COMPARE_CASE_SENSITIVE, name);
 	else
@@ -230,6 +323,7 @@ message_info_base_set_user_tag (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	if (!bmi->priv->user_tags)
 		bmi->priv->user_tags = camel_name_value_array_new ();
 
@@ -253,6 +347,7 @@ message_info_base_get_user_tags (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	result = bmi->priv->user_tags;
 	camel_message_info_property_unlock (mi);
 
@@ -270,6 +365,7 @@ message_info_base_dup_user_tags (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	result = camel_name_value_array_copy (bmi->priv->user_tags);
 	camel_message_info_property_unlock (mi);
 
@@ -288,6 +384,7 @@ message_info_base_take_user_tags (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 
 	changed = !camel_name_value_array_equal (bmi->priv->user_tags, user_tags, CAMEL_COMPARE_CASE_SENSITIVE);
 
@@ -644,6 +741,7 @@ message_info_base_get_message_id (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	result = bmi->priv->message_id;
 	camel_message_info_property_unlock (mi);
 
@@ -662,6 +760,7 @@ message_info_base_set_message_id (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 
 	changed = bmi->priv->message_id != message_id;
 
@@ -684,6 +783,7 @@ message_info_base_get_references (const CamelMessageInfo *mi)
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 	result = bmi->priv->references;
 	camel_message_info_property_unlock (mi);
 
@@ -728,6 +828,7 @@ message_info_base_take_references (CamelMessageInfo *mi,
 	bmi = CAMEL_MESSAGE_INFO_BASE (mi);
 
 	camel_message_info_property_lock (mi);
+	message_info_base_decode_lazy (bmi);
 
 	changed = !message_info_base_references_equal (bmi->priv->references, references);
 
@@ -810,6 +911,10 @@ message_info_base_dispose (GObject *object)
 	camel_name_value_array_free (bmi->priv->headers);
 	bmi->priv->headers = NULL;
 
+	g_clear_pointer (&bmi->priv->lazy_part, g_free);
+	g_clear_pointer (&bmi->priv->lazy_labels, g_free);
+	g_clear_pointer (&bmi->priv->lazy_usertags, g_free);
+
 	/* Chain up to parent's method. */
 	G_OBJECT_CLASS (camel_message_info_base_parent_class)->dispose (object);
 }
@@ -821,6 +926,7 @@ camel_message_info_base_class_init (CamelMessageInfoBaseClass *class)
 	GObjectClass *object_class;
 
 	mi_class = CAMEL_MESSAGE_INFO_CLASS (class);
+	mi_class->load = message_info_base_load;
 	mi_class->get_flags = message_info_base_get_flags;
 	mi_class->set_flags = message_info_base_set_flags;
 	mi_class->get_user_flag = message_info_base_get_user_flag;
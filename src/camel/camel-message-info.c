@@ -34,6 +34,7 @@ struct _CamelMessageInfoPrivate {
 
 	CamelWeakRefGroup *summary_wrg;	/* CamelFolderSummary * */
 	gboolean dirty;			/* whether requires save to local disk/summary */
+	gboolean dirty_flags_only;	/* whether only the flags changed since the last save */
 	const gchar *uid;		/* allocated in the string pool */
 	gboolean abort_notifications;
 	gboolean thaw_notify_folder;
@@ -150,14 +151,109 @@ message_info_clone (const CamelMessageInfo *mi,
 	return result;
 }
 
+/* Private functions, used also by the CamelMessageInfoBase */
+void _camel_message_info_parse_part (/* const */ gchar *part, guint64 *out_message_id, GArray **out_references);
+CamelNamedFlags *_camel_message_info_parse_labels (gchar *labels);
+CamelNameValueArray *_camel_message_info_parse_usertags (/* const */ gchar *usertags);
+
+/* Extracts Message id & References from the record->part value */
+void
+_camel_message_info_parse_part (/* const */ gchar *part,
+				guint64 *out_message_id,
+				GArray **out_references)
+{
+	CamelSummaryMessageID message_id;
+	gint ii, count;
+
+	g_return_if_fail (part != NULL);
+	g_return_if_fail (out_message_id != NULL);
+	g_return_if_fail (out_references != NULL);
+
+	message_id.id.part.hi = camel_util_bdata_get_number (&part, 0);
+	message_id.id.part.lo = camel_util_bdata_get_number (&part, 0);
+
+	*out_message_id = message_id.id.id;
+	*out_references = NULL;
+
+	count = camel_util_bdata_get_number (&part, 0);
+
+	if (count > 0) {
+		GArray *references = g_array_sized_new (FALSE, FALSE, sizeof (guint64), count);
+
+		for (ii = 0; ii < count; ii++) {
+			message_id.id.part.hi = camel_util_bdata_get_number (&part, 0);
+			message_id.id.part.lo = camel_util_bdata_get_number (&part, 0);
+
+			g_array_append_val (references, message_id.id.id);
+		}
+
+		*out_references = references;
+	}
+}
+
+/* Extracts User flags/labels from the record->labels value; the 'labels'
+   is modified during the call, but it's restored before the return */
+CamelNamedFlags *
+_camel_message_info_parse_labels (gchar *labels)
+{
+	CamelNamedFlags *user_flags;
+	gchar *label;
+	gint ii;
+
+	g_return_val_if_fail (labels != NULL, NULL);
+
+	user_flags = camel_named_flags_new ();
+
+	label = labels;
+	for (ii = 0; labels[ii]; ii++) {
+		if (labels[ii] == ' ') {
+			labels[ii] = 0;
+			if (label && *label)
+				camel_named_flags_insert (user_flags, label);
+			label = &(labels[ii + 1]);
+			labels[ii] = ' ';
+		}
+	}
+	if (label && *label)
+		camel_named_flags_insert (user_flags, label);
+
+	return user_flags;
+}
+
+/* Extracts User tags from the record->usertags value */
+CamelNameValueArray *
+_camel_message_info_parse_usertags (/* const */ gchar *usertags)
+{
+	CamelNameValueArray *user_tags;
+	gint ii, count;
+
+	g_return_val_if_fail (usertags != NULL, NULL);
+
+	count = camel_util_bdata_get_number (&usertags, 0);
+
+	user_tags = camel_name_value_array_new_sized (count);
+
+	for (ii = 0; ii < count; ii++) {
+		gchar *name, *value;
+
+		name = camel_util_bdata_get_string (&usertags, NULL);
+		value = camel_util_bdata_get_string (&usertags, NULL);
+
+		if (name)
+			camel_name_value_array_set_named (user_tags, CAMEL_COMPARE_CASE_SENSITIVE, name, value ? value : "");
+
+		g_free (name);
+		g_free (value);
+	}
+
+	return user_tags;
+}
+
 static gboolean
 message_info_load (CamelMessageInfo *mi,
 		   const CamelMIRecord *record,
 		   /* const */ gchar **bdata_ptr)
 {
-	gint ii, count;
-	gchar *part, *label;
-
 	g_return_val_if_fail (CAMEL_IS_MESSAGE_INFO (mi), FALSE);
 	g_return_val_if_fail (record != NULL, FALSE);
 	g_return_val_if_fail (bdata_ptr != NULL, FALSE);
@@ -174,99 +270,37 @@ message_info_load (CamelMessageInfo *mi,
 	camel_message_info_set_cc (mi, record->cc);
 	camel_message_info_set_mlist (mi, record->mlist);
 
-	/* Extract Message id & References */
-	part = record->part;
-	if (part) {
-		CamelSummaryMessageID message_id;
-
-		message_id.id.part.hi = camel_util_bdata_get_number (&part, 0);
-		message_id.id.part.lo = camel_util_bdata_get_number (&part, 0);
-
-		camel_message_info_set_message_id (mi, message_id.id.id);
+	if (record->part) {
+		GArray *references = NULL;
+		guint64 message_id = 0;
 
-		count = camel_util_bdata_get_number (&part, 0);
+		_camel_message_info_parse_part (record->part, &message_id, &references);
 
-		if (count > 0) {
-			GArray *references = g_array_sized_new (FALSE, FALSE, sizeof (guint64), count);
-
-			for (ii = 0; ii < count; ii++) {
-				message_id.id.part.hi = camel_util_bdata_get_number (&part, 0);
-				message_id.id.part.lo = camel_util_bdata_get_number (&part, 0);
-
-				g_array_append_val (references, message_id.id.id);
-			}
+		camel_message_info_set_message_id (mi, message_id);
 
+		if (references)
 			camel_message_info_take_references (mi, references);
-		}
 	}
 
-	/* Extract User flags/labels */
-	part = record->labels;
-	if (part) {
-		CamelNamedFlags *user_flags;
-
-		user_flags = camel_named_flags_new ();
-
-		label = part;
-		for (ii = 0; part[ii]; ii++) {
-			if (part[ii] == ' ') {
-				part[ii] = 0;
-				if (label && *label)
-					camel_named_flags_insert (user_flags, label);
-				label = &(part[ii + 1]);
-				part[ii] = ' ';
-			}
-		}
-		if (label && *label)
-			camel_named_flags_insert (user_flags, label);
+	if (record->labels)
+		camel_message_info_take_user_flags (mi, _camel_message_info_parse_labels (record->labels));
 
-		camel_message_info_take_user_flags (mi, user_flags);
-	}
-
-	/* Extract User tags */
-	part = record->usertags;
-	if (part) {
-		CamelNameValueArray *user_tags;
-
-		count = camel_util_bdata_get_number (&part, 0);
-
-		user_tags = camel_name_value_array_new_sized (count);
-
-		for (ii = 0; ii < count; ii++) {
-			gchar *name, *value;
-
-			name = camel_util_bdata_get_string (&part, NULL);
-			value = camel_util_bdata_get_string (&part, NULL);
-
-			if (name)
-				camel_name_value_array_set_named (user_tags, CAMEL_COMPARE_CASE_SENSITIVE, name, value ? value : "");
-
-			g_free (name);
-			g_free (value);
-		}
-
-		camel_message_info_take_user_tags (mi, user_tags);
-	}
+	if (record->usertags)
+		camel_message_info_take_user_tags (mi, _camel_message_info_parse_usertags (record->usertags));
 
 	return TRUE;
 }
 
-static gboolean
-message_info_save (const CamelMessageInfo *mi,
-		   CamelMIRecord *record,
-		   GString *bdata_str)
+/* Private function, used also by the CamelFolderSummary; fills the uid
+   and the columns derived from the message flags only */
+void _camel_message_info_save_flags (const CamelMessageInfo *mi, CamelMIRecord *record);
+
+void
+_camel_message_info_save_flags (const CamelMessageInfo *mi,
+				CamelMIRecord *record)
 {
-	GString *tmp;
-	CamelSummaryMessageID message_id;
-	const CamelNamedFlags *user_flags;
-	const CamelNameValueArray *user_tags;
-	const GArray *references;
 	guint32 read_or_flags = CAMEL_MESSAGE_DELETED | CAMEL_MESSAGE_JUNK;
 
-	g_return_val_if_fail (CAMEL_IS_MESSAGE_INFO (mi), FALSE);
-	g_return_val_if_fail (record != NULL, FALSE);
-	g_return_val_if_fail (bdata_str != NULL, FALSE);
-
 	record->uid = camel_pstring_strdup (camel_message_info_get_uid (mi));
 	record->flags = camel_message_info_get_flags (mi);
 
@@ -297,6 +331,24 @@ message_info_save (const CamelMessageInfo *mi,
 	record->junk = (record->flags & CAMEL_MESSAGE_JUNK) != 0 ? 1 : 0;
 	record->dirty = (record->flags & CAMEL_MESSAGE_FOLDER_FLAGGED) != 0 ? 1 : 0;
 	record->attachment = (record->flags & CAMEL_MESSAGE_ATTACHMENTS) != 0 ? 1 : 0;
+}
+
+static gboolean
+message_info_save (const CamelMessageInfo *mi,
+		   CamelMIRecord *record,
+		   GString *bdata_str)
+{
+	GString *tmp;
+	CamelSummaryMessageID message_id;
+	const CamelNamedFlags *user_flags;
+	const CamelNameValueArray *user_tags;
+	const GArray *references;
+
+	g_return_val_if_fail (CAMEL_IS_MESSAGE_INFO (mi), FALSE);
+	g_return_val_if_fail (record != NULL, FALSE);
+	g_return_val_if_fail (bdata_str != NULL, FALSE);
+
+	_camel_message_info_save_flags (mi, record);
 
 	record->size = camel_message_info_get_size (mi);
 	record->dsent = camel_message_info_get_date_sent (mi);
@@ -1299,48 +1351,88 @@ camel_message_info_get_dirty (const CamelMessageInfo *mi)
 	return result;
 }
 
-/**
- * camel_message_info_set_dirty:
- * @mi: a #CamelMessageInfo
- * @dirty: a dirty state to set
- *
- * Marks the @mi as dirty, which means a save to the local summary
- * is required.
- *
- * Since: 3.24
- **/
-void
-camel_message_info_set_dirty (CamelMessageInfo *mi,
-			      gboolean dirty)
+/* Private function, used also by the CamelFolderSummary */
+void _camel_folder_summary_note_dirty_info (CamelFolderSummary *summary, CamelMessageInfo *info);
+
+/* The 'flags_only' is used to let the summary save only the columns
+   derived from the flags, when nothing else changed since the last save */
+static void
+message_info_set_dirty_internal (CamelMessageInfo *mi,
+				 gboolean dirty,
+				 gboolean flags_only)
 {
 	gboolean changed, abort_notifications;
 
-	g_return_if_fail (CAMEL_IS_MESSAGE_INFO (mi));
-
 	camel_message_info_property_lock (mi);
 
 	changed = (!mi->priv->dirty) != (!dirty);
 	if (changed)
 		mi->priv->dirty = dirty;
+	if (!dirty)
+		mi->priv->dirty_flags_only = FALSE;
+	else if (changed)
+		mi->priv->dirty_flags_only = flags_only;
+	else if (!flags_only)
+		mi->priv->dirty_flags_only = FALSE;
 	abort_notifications = mi->priv->abort_notifications;
 
 	camel_message_info_property_unlock (mi);
 
-	if (changed && !abort_notifications) {
+	if (changed && !abort_notifications)
 		g_object_notify (G_OBJECT (mi), "dirty");
 
-		if (dirty) {
-			CamelFolderSummary *summary;
+	if (dirty) {
+		CamelFolderSummary *summary;
 
-			summary = camel_message_info_ref_summary (mi);
-			if (summary)
-				camel_folder_summary_touch (summary);
+		summary = camel_message_info_ref_summary (mi);
+		if (summary) {
+			/* Also when not changed, the UID could change meanwhile */
+			_camel_folder_summary_note_dirty_info (summary, mi);
 
-			g_clear_object (&summary);
+			if (changed && !abort_notifications)
+				camel_folder_summary_touch (summary);
 		}
+
+		g_clear_object (&summary);
 	}
 }
 
+/* Private function, used also by the CamelFolderSummary */
+gboolean _camel_message_info_get_dirty_flags_only (const CamelMessageInfo *mi);
+
+gboolean
+_camel_message_info_get_dirty_flags_only (const CamelMessageInfo *mi)
+{
+	gboolean result;
+
+	g_return_val_if_fail (CAMEL_IS_MESSAGE_INFO (mi), FALSE);
+
+	camel_message_info_property_lock (mi);
+	result = mi->priv->dirty && mi->priv->dirty_flags_only;
+	camel_message_info_property_unlock (mi);
+
+	return result;
+}
+
+/**
+ * camel_message_info_set_dirty:
+ * @mi: a #CamelMessageInfo
+ * @dirty: a dirty state to set
+ *
+ * Marks the @mi as dirty, which means a save to the local summary
+ * is required.
+ *
+ * Since: 3.24
+ **/
+void
+camel_message_info_set_dirty (CamelMessageInfo *mi,
+			      gboolean dirty)
+{
+	g_return_if_fail (CAMEL_IS_MESSAGE_INFO (mi));
+
+	message_info_set_dirty_internal (mi, dirty, FALSE);
+}
+
 /**
  * camel_message_info_get_folder_flagged:
  * @mi: a #CamelMessageInfo
@@ -1726,7 +1818,7 @@ camel_message_info_set_flags (CamelMessageInfo *mi,
 
 	if (changed && !abort_notifications) {
 		g_object_notify (G_OBJECT (mi), "flags");
-		camel_message_info_set_dirty (mi, TRUE);
+		message_info_set_dirty_internal (mi, TRUE, TRUE);
 
 		/* Only if the folder-flagged was not part of the change */
 		if (!(mask & CAMEL_MESSAGE_FOLDER_FLAGGED))
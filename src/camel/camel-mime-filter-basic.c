@@ -19,6 +19,11 @@
 
 #include <string.h>
 
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define BASE64_SIMD 1
+#include <immintrin.h>
+#endif
+
 #include "camel-mime-filter-basic.h"
 #include "camel-mime-utils.h"
 
@@ -31,6 +36,496 @@ struct _CamelMimeFilterBasicPrivate {
 
 G_DEFINE_TYPE_WITH_PRIVATE (CamelMimeFilterBasic, camel_mime_filter_basic, CAMEL_TYPE_MIME_FILTER)
 
+/* The base64 codec does the same as g_base64_encode_step() and g_base64_decode_step(),
+   with the same state and save values, thus the output is bit-identical, only the runs
+   of whole groups are converted at once, by the SIMD kernels when the CPU has them. */
+
+#define BASE64_LINE_GROUPS 19
+
+static const gchar base64_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* 0 - 63 for the alphabet, 64 for the '=' padding and 255 for the skipped characters */
+static const guchar base64_rank[256] = {
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+	 52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255,  64, 255, 255,
+	255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+	255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	 41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+};
+
+/* Encodes as many as 'max_groups' whole 3-byte groups of the 'in', returns how many it did.
+   It can write up to 12 characters past the encoded groups, when it stops at the line end,
+   which the following output of the base64_encode_step() overwrites. */
+typedef gsize (* Base64EncodeBlocksFunc) (const guchar *in,
+					  gsize inlen,
+					  gchar *out,
+					  gsize max_groups);
+/* Decodes the blocks of the 'in' up to the first character, which is not from the alphabet,
+   returns how many characters it decoded, which is always a multiple of 4. It can write past
+   the decoded bytes, but not past the 'inlen' bytes of the 'out'. */
+typedef gsize (* Base64DecodeBlocksFunc) (const guchar *in,
+					  gsize inlen,
+					  guchar *out);
+
+static Base64EncodeBlocksFunc base64_encode_blocks = NULL;
+static Base64DecodeBlocksFunc base64_decode_blocks = NULL;
+
+#ifdef BASE64_SIMD
+
+/* The SIMD kernels follow Wojciech Muła's and Daniel Lemire's
+   "Faster Base64 Encoding and Decoding Using AVX2 Instructions" */
+
+__attribute__ ((target ("ssse3")))
+static inline __m128i
+base64_encode_sse_block (__m128i in)
+{
+	__m128i t0, t1, t2, t3, indices, result, less;
+
+	/* the 12 input bytes as 4 32-bit words of the 3 bytes [b1 b0 b2 b1] */
+	in = _mm_shuffle_epi8 (in, _mm_setr_epi8 (1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+	/* split each word into the four 6-bit indices */
+	t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+	t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+	t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+	t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+	indices = _mm_or_si128 (t1, t3);
+
+	/* translate the indices into the alphabet by the offset of its range */
+	result = _mm_subs_epu8 (indices, _mm_set1_epi8 (51));
+	less = _mm_cmpgt_epi8 (_mm_set1_epi8 (26), indices);
+	result = _mm_or_si128 (result, _mm_and_si128 (less, _mm_set1_epi8 (13)));
+	result = _mm_shuffle_epi8 (_mm_setr_epi8 (
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0), result);
+
+	return _mm_add_epi8 (result, indices);
+}
+
+/* Writes 12 bytes and returns how many of the 16 characters were valid, rounded down to whole groups */
+__attribute__ ((target ("ssse3")))
+static inline guint
+base64_decode_sse_block (__m128i in,
+			 guchar *out)
+{
+	__m128i hi_nibbles, lo_nibbles, mask, bit, roll;
+	guint32 invalid;
+	gint32 tail;
+
+	hi_nibbles = _mm_and_si128 (_mm_srli_epi32 (in, 4), _mm_set1_epi8 (0x0f));
+	lo_nibbles = _mm_and_si128 (in, _mm_set1_epi8 (0x0f));
+
+	/* for each low nibble a bit mask of the valid high nibbles */
+	mask = _mm_shuffle_epi8 (_mm_setr_epi8 (
+		(gchar) 0xa8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8,
+		(gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54), lo_nibbles);
+	bit = _mm_shuffle_epi8 (_mm_setr_epi8 (
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (gchar) 0x80,
+		0, 0, 0, 0, 0, 0, 0, 0), hi_nibbles);
+	invalid = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_and_si128 (mask, bit), _mm_setzero_si128 ()));
+
+	/* the offset of the range by the high nibble, the '/' shares it with the '+' */
+	roll = _mm_shuffle_epi8 (_mm_setr_epi8 (
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+		_mm_add_epi8 (_mm_cmpeq_epi8 (in, _mm_set1_epi8 ('/')), hi_nibbles));
+	in = _mm_add_epi8 (in, roll);
+
+	/* pack the 6-bit values into 12 bytes; each group is packed on its own,
+	   thus the invalid characters do not break the groups before them */
+	in = _mm_maddubs_epi16 (in, _mm_set1_epi32 (0x01400140));
+	in = _mm_madd_epi16 (in, _mm_set1_epi32 (0x00011000));
+	in = _mm_shuffle_epi8 (in, _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+	tail = _mm_cvtsi128_si32 (_mm_srli_si128 (in, 8));
+
+	_mm_storel_epi64 ((__m128i *) out, in);
+	memcpy (out + 8, &tail, 4);
+
+	return invalid ? (__builtin_ctz (invalid) & ~3) : 16;
+}
+
+__attribute__ ((target ("ssse3")))
+static gsize
+base64_encode_blocks_ssse3 (const guchar *in,
+			    gsize inlen,
+			    gchar *out,
+			    gsize max_groups)
+{
+	gsize groups = 0;
+
+	/* reads 16 bytes for the 12 it encodes */
+	while (groups < max_groups && inlen >= 16) {
+		gsize n = MIN (max_groups - groups, 4);
+
+		_mm_storeu_si128 ((__m128i *) out, base64_encode_sse_block (_mm_loadu_si128 ((const __m128i *) in)));
+
+		in += n * 3;
+		inlen -= n * 3;
+		out += n * 4;
+		groups += n;
+	}
+
+	return groups;
+}
+
+__attribute__ ((target ("ssse3")))
+static gsize
+base64_decode_blocks_ssse3 (const guchar *in,
+			    gsize inlen,
+			    guchar *out)
+{
+	gsize done = 0;
+
+	while (inlen - done >= 16) {
+		guint valid;
+
+		valid = base64_decode_sse_block (_mm_loadu_si128 ((const __m128i *) (in + done)), out);
+		done += valid;
+		out += valid / 4 * 3;
+
+		if (valid < 16)
+			break;
+	}
+
+	return done;
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+base64_encode_blocks_avx2 (const guchar *in,
+			   gsize inlen,
+			   gchar *out,
+			   gsize max_groups)
+{
+	gsize groups = 0;
+
+	/* reads 28 bytes for the 24 it encodes, 12 of them in each lane */
+	while (groups + 8 <= max_groups && inlen >= 28) {
+		__m256i block, t0, t1, t2, t3, indices, result, less;
+
+		block = _mm256_inserti128_si256 (
+			_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) in)),
+			_mm_loadu_si128 ((const __m128i *) (in + 12)), 1);
+
+		block = _mm256_shuffle_epi8 (block, _mm256_setr_epi8 (
+			1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+			1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+		t0 = _mm256_and_si256 (block, _mm256_set1_epi32 (0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+		t2 = _mm256_and_si256 (block, _mm256_set1_epi32 (0x003f03f0));
+		t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+		indices = _mm256_or_si256 (t1, t3);
+
+		result = _mm256_subs_epu8 (indices, _mm256_set1_epi8 (51));
+		less = _mm256_cmpgt_epi8 (_mm256_set1_epi8 (26), indices);
+		result = _mm256_or_si256 (result, _mm256_and_si256 (less, _mm256_set1_epi8 (13)));
+		result = _mm256_shuffle_epi8 (_mm256_setr_epi8 (
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0), result);
+
+		_mm256_storeu_si256 ((__m256i *) out, _mm256_add_epi8 (result, indices));
+
+		in += 24;
+		inlen -= 24;
+		out += 32;
+		groups += 8;
+	}
+
+	/* the rest of the line by the 128-bit block, inlined here,
+	   to not mix the VEX and the legacy SSE encoding */
+	while (groups < max_groups && inlen >= 16) {
+		gsize n = MIN (max_groups - groups, 4);
+
+		_mm_storeu_si128 ((__m128i *) out, base64_encode_sse_block (_mm_loadu_si128 ((const __m128i *) in)));
+
+		in += n * 3;
+		inlen -= n * 3;
+		out += n * 4;
+		groups += n;
+	}
+
+	return groups;
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+base64_decode_blocks_avx2 (const guchar *in,
+			   gsize inlen,
+			   guchar *out)
+{
+	gsize done = 0;
+
+	while (inlen - done >= 32) {
+		__m256i block, hi_nibbles, lo_nibbles, mask, bit, roll;
+		guint32 invalid;
+		guint valid;
+
+		block = _mm256_loadu_si256 ((const __m256i *) (in + done));
+
+		hi_nibbles = _mm256_and_si256 (_mm256_srli_epi32 (block, 4), _mm256_set1_epi8 (0x0f));
+		lo_nibbles = _mm256_and_si256 (block, _mm256_set1_epi8 (0x0f));
+
+		mask = _mm256_shuffle_epi8 (_mm256_setr_epi8 (
+			(gchar) 0xa8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8,
+			(gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+			(gchar) 0xa8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf8,
+			(gchar) 0xf8, (gchar) 0xf8, (gchar) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54), lo_nibbles);
+		bit = _mm256_shuffle_epi8 (_mm256_setr_epi8 (
+			0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (gchar) 0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+			0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (gchar) 0x80, 0, 0, 0, 0, 0, 0, 0, 0), hi_nibbles);
+		invalid = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_and_si256 (mask, bit), _mm256_setzero_si256 ()));
+
+		roll = _mm256_shuffle_epi8 (_mm256_setr_epi8 (
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+			_mm256_add_epi8 (_mm256_cmpeq_epi8 (block, _mm256_set1_epi8 ('/')), hi_nibbles));
+		block = _mm256_add_epi8 (block, roll);
+
+		block = _mm256_maddubs_epi16 (block, _mm256_set1_epi32 (0x01400140));
+		block = _mm256_madd_epi16 (block, _mm256_set1_epi32 (0x00011000));
+		block = _mm256_shuffle_epi8 (block, _mm256_setr_epi8 (
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		block = _mm256_permutevar8x32_epi32 (block, _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 3, 7));
+
+		/* only 24 of the 32 bytes are used */
+		_mm_storeu_si128 ((__m128i *) out, _mm256_castsi256_si128 (block));
+		_mm_storel_epi64 ((__m128i *) (out + 16), _mm256_extracti128_si256 (block, 1));
+
+		/* usually a line end, the groups before it are decoded */
+		valid = invalid ? (__builtin_ctz (invalid) & ~3) : 32;
+		done += valid;
+		out += valid / 4 * 3;
+
+		if (valid < 32)
+			return done;
+	}
+
+	if (inlen - done >= 16)
+		done += base64_decode_sse_block (_mm_loadu_si128 ((const __m128i *) (in + done)), out);
+
+	return done;
+}
+
+#endif /* BASE64_SIMD */
+
+static gsize
+base64_encode_step (const guchar *in,
+		    gsize len,
+		    gboolean break_lines,
+		    gchar *out,
+		    gint *state,
+		    gint *save)
+{
+	Base64EncodeBlocksFunc encode_blocks = base64_encode_blocks;
+	const guchar *inptr;
+	gchar *outptr;
+
+	if (len == 0)
+		return 0;
+
+	inptr = in;
+	outptr = out;
+
+	if (len + ((gchar *) save)[0] > 2) {
+		const guchar *inend = in + len - 2;
+		gint c1, c2, c3;
+		gint already;
+
+		already = *state;
+
+		switch (((gchar *) save)[0]) {
+		case 1:
+			c1 = ((guchar *) save)[1];
+			goto skip1;
+		case 2:
+			c1 = ((guchar *) save)[1];
+			c2 = ((guchar *) save)[2];
+			goto skip2;
+		}
+
+		while (inptr < inend) {
+			if (encode_blocks) {
+				gsize groups;
+
+				groups = encode_blocks (inptr, inend + 2 - inptr, outptr,
+					break_lines ? BASE64_LINE_GROUPS - already : G_MAXSIZE);
+
+				if (groups > 0) {
+					inptr += groups * 3;
+					outptr += groups * 4;
+
+					if (break_lines && (already += groups) >= BASE64_LINE_GROUPS) {
+						*outptr++ = '\n';
+						already = 0;
+					}
+
+					continue;
+				}
+			}
+
+			c1 = *inptr++;
+		skip1:
+			c2 = *inptr++;
+		skip2:
+			c3 = *inptr++;
+			*outptr++ = base64_alphabet[c1 >> 2];
+			*outptr++ = base64_alphabet[c2 >> 4 | ((c1 & 0x3) << 4)];
+			*outptr++ = base64_alphabet[((c2 & 0x0f) << 2) | (c3 >> 6)];
+			*outptr++ = base64_alphabet[c3 & 0x3f];
+
+			if (break_lines && (++already) >= BASE64_LINE_GROUPS) {
+				*outptr++ = '\n';
+				already = 0;
+			}
+		}
+
+		((gchar *) save)[0] = 0;
+		len = 2 - (inptr - inend);
+		*state = already;
+	}
+
+	if (len > 0) {
+		gchar *saveout;
+
+		/* points to the slot for the next char to save */
+		saveout = &(((gchar *) save)[1]) + ((gchar *) save)[0];
+
+		/* len can only be 1 or 2 */
+		switch (len) {
+		case 2:
+			*saveout++ = *inptr++;
+			/* falls through */
+		case 1:
+			*saveout++ = *inptr++;
+		}
+
+		((gchar *) save)[0] += len;
+	}
+
+	return outptr - out;
+}
+
+/* Unlike with the g_base64_decode_step(), the 'out' has to have room for 'len' + 3 bytes */
+static gsize
+base64_decode_step (const guchar *in,
+		    gsize len,
+		    guchar *out,
+		    gint *state,
+		    guint *save)
+{
+	Base64DecodeBlocksFunc decode_blocks = base64_decode_blocks;
+	const guchar *inptr, *inend;
+	guchar *outptr;
+	guchar c, rank;
+	guchar last[2];
+	guint v;
+	gint i;
+
+	if (len == 0)
+		return 0;
+
+	inptr = in;
+	inend = in + len;
+	outptr = out;
+
+	v = *save;
+	i = *state;
+
+	last[0] = last[1] = 0;
+
+	/* the sign of the state tells whether the previous group ended with a padding */
+	if (i < 0) {
+		i = -i;
+		last[0] = '=';
+	}
+
+	while (inptr < inend) {
+		if (i == 0) {
+			const guchar *start = inptr, *ptr;
+
+			if (decode_blocks) {
+				gsize done;
+
+				done = decode_blocks (inptr, inend - inptr, outptr);
+				inptr += done;
+				outptr += done / 4 * 3;
+			}
+
+			while (inend - inptr >= 4) {
+				guchar r0, r1, r2, r3;
+
+				r0 = base64_rank[inptr[0]];
+				r1 = base64_rank[inptr[1]];
+				r2 = base64_rank[inptr[2]];
+				r3 = base64_rank[inptr[3]];
+
+				if ((r0 | r1 | r2 | r3) & 0xc0)
+					break;
+
+				*outptr++ = (r0 << 2) | (r1 >> 4);
+				*outptr++ = (r1 << 4) | (r2 >> 2);
+				*outptr++ = (r2 << 6) | r3;
+
+				inptr += 4;
+			}
+
+			if (inptr != start) {
+				/* the save and the state as if the characters were decoded one by one;
+				   only the last 6 characters matter for the 32-bit save */
+				for (ptr = MAX (start, inptr - 8); ptr < inptr; ptr++) {
+					v = (v << 6) | base64_rank[*ptr];
+				}
+
+				last[1] = inptr[-2];
+				last[0] = inptr[-1];
+
+				if (inptr >= inend)
+					break;
+			}
+		}
+
+		c = *inptr++;
+		rank = base64_rank[c];
+
+		if (rank != 0xff) {
+			last[1] = last[0];
+			last[0] = c;
+			v = (v << 6) | (rank & 0x3f);
+			i++;
+
+			if (i == 4) {
+				*outptr++ = v >> 16;
+				if (last[1] != '=')
+					*outptr++ = v >> 8;
+				if (last[0] != '=')
+					*outptr++ = v;
+				i = 0;
+			}
+		}
+	}
+
+	*save = v;
+	*state = last[0] == '=' ? -i : i;
+
+	return outptr - out;
+}
+
 /* here we do all of the basic mime filtering */
 static void
 mime_filter_basic_filter (CamelMimeFilter *mime_filter,
@@ -51,7 +546,7 @@ mime_filter_basic_filter (CamelMimeFilter *mime_filter,
 		/* wont go to more than 2x size (overly conservative) */
 		camel_mime_filter_set_size (
 			mime_filter, len * 2 + 6, FALSE);
-		newlen = g_base64_encode_step (
+		newlen = base64_encode_step (
 			(const guchar *) in, len,
 			TRUE,
 			mime_filter->outbuf,
@@ -85,8 +580,8 @@ mime_filter_basic_filter (CamelMimeFilter *mime_filter,
 	case CAMEL_MIME_FILTER_BASIC_BASE64_DEC:
 		/* output can't possibly exceed the input size */
 		camel_mime_filter_set_size (mime_filter, len + 3, FALSE);
-		newlen = g_base64_decode_step (
-			in, len,
+		newlen = base64_decode_step (
+			(const guchar *) in, len,
 			(guchar *) mime_filter->outbuf,
 			&priv->state,
 			(guint *) &priv->save);
@@ -188,7 +683,7 @@ mime_filter_basic_complete (CamelMimeFilter *mime_filter,
 		camel_mime_filter_set_size (
 			mime_filter, len * 2 + 6, FALSE);
 		if (len > 0)
-			newlen += g_base64_encode_step (
+			newlen += base64_encode_step (
 				(const guchar *) in, len,
 				TRUE,
 				mime_filter->outbuf,
@@ -225,16 +720,16 @@ mime_filter_basic_complete (CamelMimeFilter *mime_filter,
 		g_return_if_fail (newlen <= (len + 2) * 2 + 62);
 		break;
 	case CAMEL_MIME_FILTER_BASIC_BASE64_DEC:
-		/* Output can't possibly exceed the input size, but add 1,
-		   to make sure the mime_filter->outbuf will not be NULL,
-		   in case the input stream is empty. */
-		camel_mime_filter_set_size (mime_filter, len + 1, FALSE);
-		newlen = g_base64_decode_step (
-			in, len,
+		/* Output can't possibly exceed the input size and the saved
+		   group; this also makes sure the mime_filter->outbuf will
+		   not be NULL, in case the input stream is empty. */
+		camel_mime_filter_set_size (mime_filter, len + 3, FALSE);
+		newlen = base64_decode_step (
+			(const guchar *) in, len,
 			(guchar *) mime_filter->outbuf,
 			&priv->state,
 			(guint *) &priv->save);
-		g_return_if_fail (newlen <= len);
+		g_return_if_fail (newlen <= len + 3);
 		break;
 	case CAMEL_MIME_FILTER_BASIC_QP_DEC:
 		/* output can't possibly exceed the input size,
@@ -305,6 +800,18 @@ camel_mime_filter_basic_class_init (CamelMimeFilterBasicClass *class)
 	mime_filter_class->filter = mime_filter_basic_filter;
 	mime_filter_class->complete = mime_filter_basic_complete;
 	mime_filter_class->reset = mime_filter_basic_reset;
+
+#ifdef BASE64_SIMD
+	__builtin_cpu_init ();
+
+	if (__builtin_cpu_supports ("avx2")) {
+		base64_encode_blocks = base64_encode_blocks_avx2;
+		base64_decode_blocks = base64_decode_blocks_avx2;
+	} else if (__builtin_cpu_supports ("ssse3")) {
+		base64_encode_blocks = base64_encode_blocks_ssse3;
+		base64_decode_blocks = base64_decode_blocks_ssse3;
+	}
+#endif
 }
 
 static void
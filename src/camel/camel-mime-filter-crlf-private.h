@@ -0,0 +1,30 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMEL_MIME_FILTER_CRLF_PRIVATE_H
+#define CAMEL_MIME_FILTER_CRLF_PRIVATE_H
+
+#include "camel-mime-filter-crlf.h"
+
+G_BEGIN_DECLS
+
+gboolean	_camel_mime_filter_crlf_filter_inplace
+						(CamelMimeFilter *mime_filter,
+						 gchar **buffer,
+						 gsize *len,
+						 gsize *prespace);
+
+G_END_DECLS
+
+#endif /* CAMEL_MIME_FILTER_CRLF_PRIVATE_H */
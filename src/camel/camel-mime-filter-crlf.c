@@ -19,6 +19,7 @@
  */
 
 #include "camel-mime-filter-crlf.h"
+#include "camel-mime-filter-crlf-private.h"
 
 struct _CamelMimeFilterCRLFPrivate {
 	CamelMimeFilterCRLFDirection direction;
@@ -30,6 +31,55 @@ struct _CamelMimeFilterCRLFPrivate {
 
 G_DEFINE_TYPE_WITH_PRIVATE (CamelMimeFilterCRLF, camel_mime_filter_crlf, CAMEL_TYPE_MIME_FILTER)
 
+/* Writes at most one byte more than it reads, the '\r' left from the previous
+   call, thus it can decode in place, when the 'outptr' is one byte before 'in' */
+static gchar *
+crlf_decode (CamelMimeFilterCRLFPrivate *priv,
+	     const gchar *in,
+	     const gchar *inend,
+	     gchar *outptr)
+{
+	register const gchar *inptr = in;
+	gboolean do_dots;
+
+	do_dots = priv->mode == CAMEL_MIME_FILTER_CRLF_MODE_CRLF_DOTS;
+
+	while (inptr < inend) {
+		if (*inptr == '\r') {
+			priv->saw_cr = TRUE;
+		} else {
+			if (priv->saw_cr) {
+				priv->saw_cr = FALSE;
+
+				if (*inptr == '\n') {
+					priv->saw_lf = TRUE;
+					*outptr++ = *inptr++;
+					continue;
+				} else
+					*outptr++ = '\r';
+			}
+
+			*outptr++ = *inptr;
+		}
+
+		if (do_dots && *inptr == '.') {
+			if (priv->saw_lf) {
+				priv->saw_dot = TRUE;
+				priv->saw_lf = FALSE;
+				inptr++;
+			} else if (priv->saw_dot) {
+				priv->saw_dot = FALSE;
+			}
+		}
+
+		priv->saw_lf = FALSE;
+
+		inptr++;
+	}
+
+	return outptr;
+}
+
 static void
 mime_filter_crlf_filter (CamelMimeFilter *mime_filter,
                          const gchar *in,
@@ -81,39 +131,7 @@ mime_filter_crlf_filter (CamelMimeFilter *mime_filter,
 		 * blocks. */
 		camel_mime_filter_set_size (mime_filter, len + 1, FALSE);
 
-		outptr = mime_filter->outbuf;
-		while (inptr < inend) {
-			if (*inptr == '\r') {
-				priv->saw_cr = TRUE;
-			} else {
-				if (priv->saw_cr) {
-					priv->saw_cr = FALSE;
-
-					if (*inptr == '\n') {
-						priv->saw_lf = TRUE;
-						*outptr++ = *inptr++;
-						continue;
-					} else
-						*outptr++ = '\r';
-				}
-
-				*outptr++ = *inptr;
-			}
-
-			if (do_dots && *inptr == '.') {
-				if (priv->saw_lf) {
-					priv->saw_dot = TRUE;
-					priv->saw_lf = FALSE;
-					inptr++;
-				} else if (priv->saw_dot) {
-					priv->saw_dot = FALSE;
-				}
-			}
-
-			priv->saw_lf = FALSE;
-
-			inptr++;
-		}
+		outptr = crlf_decode (priv, in, inend, mime_filter->outbuf);
 	}
 
 	*out = mime_filter->outbuf;
@@ -136,6 +154,44 @@ mime_filter_crlf_complete (CamelMimeFilter *mime_filter,
 			out, outlen, outprespace);
 }
 
+/* Decodes the '*buffer' in place, when it is writable, instead of copying
+   it into the filter's own output buffer. Returns FALSE when the filter
+   encodes, or when there is no prespace for the left '\r'. */
+gboolean
+_camel_mime_filter_crlf_filter_inplace (CamelMimeFilter *mime_filter,
+					gchar **buffer,
+					gsize *len,
+					gsize *prespace)
+{
+	CamelMimeFilterCRLFPrivate *priv;
+	gchar *outptr;
+
+	g_return_val_if_fail (CAMEL_IS_MIME_FILTER_CRLF (mime_filter), FALSE);
+
+	priv = CAMEL_MIME_FILTER_CRLF (mime_filter)->priv;
+
+	if (priv->direction != CAMEL_MIME_FILTER_CRLF_DECODE ||
+	    mime_filter->backlen > 0 ||
+	    (priv->saw_cr && *prespace < 1))
+		return FALSE;
+
+	/* the same as the complete() does, keep the '\r' */
+	if (!*len)
+		return TRUE;
+
+	if (priv->saw_cr) {
+		outptr = crlf_decode (priv, *buffer, *buffer + *len, *buffer - 1);
+		*buffer = *buffer - 1;
+		*prespace = *prespace - 1;
+	} else {
+		outptr = crlf_decode (priv, *buffer, *buffer + *len, *buffer);
+	}
+
+	*len = outptr - *buffer;
+
+	return TRUE;
+}
+
 static void
 mime_filter_crlf_reset (CamelMimeFilter *mime_filter)
 {
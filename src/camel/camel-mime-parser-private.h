@@ -0,0 +1,32 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMEL_MIME_PARSER_PRIVATE_H
+#define CAMEL_MIME_PARSER_PRIVATE_H
+
+#include "camel-mime-parser.h"
+#include "camel-name-value-array-private.h"
+
+G_BEGIN_DECLS
+
+void		_camel_mime_parser_set_header_arena
+						(CamelMimeParser *parser,
+						 CamelNameValueArena *arena);
+CamelNameValueArena *
+		_camel_mime_parser_get_header_arena
+						(CamelMimeParser *parser);
+
+G_END_DECLS
+
+#endif /* CAMEL_MIME_PARSER_PRIVATE_H */
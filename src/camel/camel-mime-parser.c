@@ -31,9 +31,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "camel-mempool.h"
 #include "camel-mime-filter.h"
 #include "camel-mime-parser.h"
+#include "camel-mime-parser-private.h"
 #include "camel-mime-utils.h"
 #include "camel-stream.h"
 
@@ -53,7 +58,9 @@ gint inend_id = -1,
   inbuffer_id = -1;
 #endif
 
-#define SCAN_BUF 4096		/* size of read buffer */
+#define SCAN_BUF 4096		/* initial size of read buffer */
+#define SCAN_BUF_FD 65536	/* initial size of read buffer for a fd input, which is usually a whole mbox file */
+#define SCAN_BUF_MAX 1048576	/* the read buffer grows up to this size, while the input fills it */
 #define SCAN_HEAD 128		/* headroom guaranteed to be before each read buffer */
 
 /* a little hacky, but i couldn't be bothered renaming everything */
@@ -87,10 +94,15 @@ struct _header_scan_state {
 	gint ioerrno;		/* io error state */
 
 	/* for scanning input buffers */
-	gchar *realbuf;		/* the real buffer, SCAN_HEAD *2 + SCAN_BUF bytes */
+	gchar *realbuf;		/* the real buffer, SCAN_HEAD *2 + bufsize bytes */
 	gchar *inbuf;		/* points to a subset of the allocated memory, the underflow */
 	gchar *inptr;		/* (upto SCAN_HEAD) is for use by filters so they dont copy all data */
 	gchar *inend;
+	gsize bufsize;		/* allocated size of the inbuf */
+	gsize window;		/* how much to read at once, the buffer grows to it on the next read */
+	gsize window_min;	/* the window after init or seek */
+	gsize window_max;	/* the window doubles up to this, while the reads fill it */
+	gboolean window_filled;	/* the last read filled the whole window */
 
 	gint atleast;
 
@@ -101,6 +113,7 @@ struct _header_scan_state {
 	guint check_header_folded:1;	/* check whether header is folded first? */
 	guint scan_from:1;	/* do we care about From lines? */
 	guint scan_pre_from:1;	/* do we return pre-from data? */
+	guint skim_content:1;	/* only look for the boundaries in the body content? */
 	guint eof:1;		/* reached eof? */
 
 	goffset start_of_from;	/* where from started */
@@ -109,6 +122,9 @@ struct _header_scan_state {
 
 	goffset header_start;	/* start of last header, or -1 */
 
+	/* where the headers of the constructed parts are stored, or NULL */
+	CamelNameValueArena *header_arena;
+
 	/* filters to apply to all content before output */
 	gint filterid;		/* id of next filter */
 	struct _header_scan_filter *filters;
@@ -360,7 +376,10 @@ camel_mime_parser_dup_headers (CamelMimeParser *m)
 		CamelHeaderRaw *header = s->parts->headers;
 		CamelNameValueArray *header_copy = camel_name_value_array_new ();
 		while (header) {
-			camel_name_value_array_append (header_copy, header->name, header->value);
+			if (s->header_arena)
+				_camel_name_value_array_append_arena (header_copy, s->header_arena, header->name, header->value);
+			else
+				camel_name_value_array_append (header_copy, header->name, header->value);
 			header = header->next;
 		}
 
@@ -369,6 +388,33 @@ camel_mime_parser_dup_headers (CamelMimeParser *m)
 	return NULL;
 }
 
+/* While set, the headers returned by the camel_mime_parser_dup_headers() are
+   stored in the 'arena'. The CamelMimePart sets it for the whole message tree. */
+void
+_camel_mime_parser_set_header_arena (CamelMimeParser *parser,
+				     CamelNameValueArena *arena)
+{
+	struct _header_scan_state *s;
+
+	g_return_if_fail (CAMEL_IS_MIME_PARSER (parser));
+
+	s = _PRIVATE (parser);
+
+	if (arena)
+		_camel_name_value_arena_ref (arena);
+
+	_camel_name_value_arena_unref (s->header_arena);
+	s->header_arena = arena;
+}
+
+CamelNameValueArena *
+_camel_mime_parser_get_header_arena (CamelMimeParser *parser)
+{
+	g_return_val_if_fail (CAMEL_IS_MIME_PARSER (parser), NULL);
+
+	return _PRIVATE (parser)->header_arena;
+}
+
 static const gchar *
 byte_array_to_string (GByteArray *array)
 {
@@ -584,6 +630,66 @@ camel_mime_parser_scan_pre_from (CamelMimeParser *parser,
 	s->scan_pre_from = scan_pre_from;
 }
 
+/**
+ * camel_mime_parser_skim_content:
+ * @parser: MIME parser object
+ * @skim_content: %TRUE to skip the body content
+ *
+ * Tell the scanner whether it should skip the body content of the parts,
+ * only looking for the boundaries in it. If it does, then the
+ * CAMEL_MIME_PARSER_STATE_HEADER state is followed directly by
+ * the CAMEL_MIME_PARSER_STATE_BODY_END state, without any
+ * CAMEL_MIME_PARSER_STATE_BODY state, the content filters are not
+ * used and the multipart preface and postface are not saved. The structure
+ * of the message, its headers and the offsets are the same as without it.
+ *
+ * Since: 3.40
+ **/
+void
+camel_mime_parser_skim_content (CamelMimeParser *parser,
+				gboolean skim_content)
+{
+	struct _header_scan_state *s;
+
+	g_return_if_fail (CAMEL_IS_MIME_PARSER (parser));
+
+	s = _PRIVATE (parser);
+
+	s->skim_content = skim_content;
+}
+
+/**
+ * camel_mime_parser_set_read_window:
+ * @parser: MIME parser object
+ * @min_size: how many bytes to read at once after init or seek, or 0 for the default
+ * @max_size: up to how many bytes to read at once, or 0 for the default
+ *
+ * Sets how much the scanner reads from its input at once. It starts with
+ * the @min_size and, while the input fills the whole window, doubles it up
+ * to the @max_size, thus parsing large files, like an mbox, needs fewer reads.
+ * Input from a file descriptor starts with a 64 KB window, when allowed.
+ *
+ * The defaults are 4 KB and 1 MB. It's not possible to set the window
+ * smaller than 4 KB.
+ *
+ * Since: 3.40
+ **/
+void
+camel_mime_parser_set_read_window (CamelMimeParser *parser,
+				   gsize min_size,
+				   gsize max_size)
+{
+	struct _header_scan_state *s;
+
+	g_return_if_fail (CAMEL_IS_MIME_PARSER (parser));
+
+	s = _PRIVATE (parser);
+
+	s->window_min = MAX (min_size ? min_size : SCAN_BUF, SCAN_BUF);
+	s->window_max = MAX (max_size ? max_size : SCAN_BUF_MAX, s->window_min);
+	s->window = CLAMP (s->window, s->window_min, s->window_max);
+}
+
 /**
  * camel_mime_parser_content_type:
  * @parser: MIME parser object
@@ -962,8 +1068,8 @@ camel_mime_parser_errno (CamelMimeParser *parser)
 static gint
 folder_read (struct _header_scan_state *s)
 {
-	gint len;
-	gint inoffset;
+	gssize len;
+	gsize inoffset, toread;
 
 	if (s->inptr < s->inend - s->atleast || s->eof)
 		return s->inend - s->inptr;
@@ -973,18 +1079,43 @@ folder_read (struct _header_scan_state *s)
 #endif
 	/* check for any remaning bytes (under the atleast limit( */
 	inoffset = s->inend - s->inptr;
-	if (inoffset > 0) {
+
+	/* there is more data than fits in the window, thus read more at once,
+	 * to save on the system calls for large files */
+	if (s->window_filled && s->window < s->window_max)
+		s->window = MIN (s->window * 2, s->window_max);
+
+	if (s->window > s->bufsize) {
+		gchar *realbuf;
+
+		realbuf = g_malloc (s->window + SCAN_HEAD * 2);
+		if (inoffset > 0)
+			memcpy (realbuf + SCAN_HEAD, s->inptr, inoffset);
+
+		/* add on the consumed part of the old buffer */
+		s->seek += s->inptr - s->inbuf;
+
+		g_free (s->realbuf);
+		s->realbuf = realbuf;
+		s->bufsize = s->window;
+		s->inbuf = s->realbuf + SCAN_HEAD;
+		s->inptr = s->inbuf;
+		s->inend = s->inbuf + inoffset;
+	} else if (inoffset > 0) {
 		memmove (s->inbuf, s->inptr, inoffset);
 	}
+
+	toread = s->window - inoffset;
+
 	if (s->stream) {
 		len = camel_stream_read (
-			s->stream, s->inbuf + inoffset, SCAN_BUF - inoffset, NULL, NULL);
+			s->stream, s->inbuf + inoffset, toread, NULL, NULL);
 	} else if (s->input_stream != NULL) {
 		len = g_input_stream_read (
 			s->input_stream, s->inbuf + inoffset,
-			SCAN_BUF - inoffset, NULL, NULL);
+			toread, NULL, NULL);
 	} else {
-		len = read (s->fd, s->inbuf + inoffset, SCAN_BUF - inoffset);
+		len = read (s->fd, s->inbuf + inoffset, toread);
 	}
 	r (printf ("read %d bytes, offset = %d\n", len, inoffset));
 	if (len >= 0) {
@@ -993,6 +1124,7 @@ folder_read (struct _header_scan_state *s)
 		s->inptr = s->inbuf;
 		s->inend = s->inbuf + len + inoffset;
 		s->eof = (len == 0);
+		s->window_filled = len == toread;
 		r (printf ("content = %d '%.*s'\n",s->inend - s->inptr,  s->inend - s->inptr, s->inptr));
 	} else {
 		s->ioerrno = errno ? errno : EIO;
@@ -1063,6 +1195,9 @@ folder_seek (struct _header_scan_state *s,
 		s->inptr = s->inbuf;
 		s->inend = s->inbuf;
 		s->eof = FALSE;
+		/* usually seeks to read a single message */
+		s->window = s->window_min;
+		s->window_filled = FALSE;
 	} else {
 		s->ioerrno = errno ? errno : EIO;
 	}
@@ -1344,8 +1479,7 @@ folder_scan_header (struct _header_scan_state *s,
 				}
 
 				/* goto next line/sentinal */
-				while ((*inptr++) != '\n')
-					;
+				inptr = (gchar *) memchr (inptr, '\n', s->inend - inptr + 1) + 1;
 
 				if (inptr > s->inend + 1) {
 					g_warn_if_fail (inptr <= s->inend + 1);
@@ -1450,6 +1584,63 @@ header_done:
 	return h;
 }
 
+#define MAX_MARKS 4
+
+/* Finds the start of the next line after the 'inptr', which begins with one of
+   the 'marks', the first characters of the boundaries. When there is none before
+   the 'inend', returns the 'inend' and whether it is in the middle of a line. */
+static gchar *
+folder_scan_next_mark (gchar *inptr,
+                       gchar *inend,
+                       const gchar *marks,
+                       gint n_marks,
+                       gboolean *midline)
+{
+	gchar *nl;
+
+#ifdef __SSE2__
+	if (n_marks > 0) {
+		const __m128i eol = _mm_set1_epi8 ('\n');
+		const __m128i mark0 = _mm_set1_epi8 (marks[0]);
+		const __m128i mark1 = _mm_set1_epi8 (marks[n_marks > 1 ? 1 : 0]);
+		const __m128i mark2 = _mm_set1_epi8 (marks[n_marks > 2 ? 2 : 0]);
+		const __m128i mark3 = _mm_set1_epi8 (marks[n_marks > 3 ? 3 : 0]);
+
+		/* the line starts are after the 16 bytes, thus before the 'inend' */
+		while (inend - inptr > 16) {
+			__m128i next = _mm_loadu_si128 ((const __m128i *) (inptr + 1));
+			guint mask;
+
+			mask = _mm_movemask_epi8 (_mm_and_si128 (
+				_mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) inptr), eol),
+				_mm_or_si128 (
+					_mm_or_si128 (_mm_cmpeq_epi8 (next, mark0), _mm_cmpeq_epi8 (next, mark1)),
+					_mm_or_si128 (_mm_cmpeq_epi8 (next, mark2), _mm_cmpeq_epi8 (next, mark3)))));
+
+			if (mask) {
+				*midline = FALSE;
+				return inptr + __builtin_ctz (mask) + 1;
+			}
+
+			inptr += 16;
+		}
+	}
+#endif
+
+	while (n_marks > 0 && inptr < inend && (nl = memchr (inptr, '\n', inend - inptr)) != NULL) {
+		inptr = nl + 1;
+
+		if (inptr < inend && memchr (marks, *inptr, n_marks)) {
+			*midline = FALSE;
+			return inptr;
+		}
+	}
+
+	*midline = inend[-1] != '\n';
+
+	return inend;
+}
+
 static struct _header_scan_stack *
 folder_scan_content (struct _header_scan_state *s,
                      gint *lastone,
@@ -1463,6 +1654,8 @@ folder_scan_content (struct _header_scan_state *s,
 	gint len;
 	struct _header_scan_stack *part;
 	gint onboundary = FALSE;
+	gchar marks[MAX_MARKS];
+	gint n_marks = s->skim_content ? 0 : -1;
 
 	c (printf ("scanning content\n"));
 
@@ -1473,6 +1666,18 @@ folder_scan_content (struct _header_scan_state *s,
 		newatleast = 1;
 	*lastone = FALSE;
 
+	/* when the content is skimmed, skip the lines, which cannot be a boundary,
+	   because they do not begin with the first character of any of them */
+	for (part = s->parts; part && n_marks >= 0; part = part->parent) {
+		if (!part->boundary || memchr (marks, *part->boundary, n_marks))
+			continue;
+
+		if (*part->boundary && n_marks < MAX_MARKS)
+			marks[n_marks++] = *part->boundary;
+		else
+			n_marks = -1;
+	}
+
 	c (printf ("atleast = %d\n", newatleast));
 
 	do {
@@ -1502,9 +1707,17 @@ folder_scan_content (struct _header_scan_state *s,
 					goto normal_exit;
 				}
 
-				/* goto the next line */
-				while ((*inptr++) != '\n')
-					;
+				if (n_marks >= 0) {
+					gboolean midline;
+
+					/* skip the lines, which cannot be a boundary */
+					inptr = folder_scan_next_mark (inptr, inend, marks, n_marks, &midline);
+					s->midline = midline;
+					continue;
+				}
+
+				/* goto the next line, there is always the sentinal at the inend */
+				inptr = (gchar *) memchr (inptr, '\n', s->inend - inptr + 1) + 1;
 
 				/* check the sentinal, if we went past the atleast limit, and reset it to there */
 				if (inptr > inend) {
@@ -1568,6 +1781,7 @@ folder_scan_close (struct _header_scan_state *s)
 		close (s->fd);
 	g_clear_object (&s->stream);
 	g_clear_object (&s->input_stream);
+	_camel_name_value_arena_unref (s->header_arena);
 	g_free (s);
 }
 
@@ -1585,12 +1799,18 @@ folder_scan_init (void)
 
 	s->outbuf = g_malloc (1024);
 	s->outptr = s->outbuf;
+	s->header_arena = NULL;
 	s->outend = s->outbuf + 1024;
 
 	s->realbuf = g_malloc0 (SCAN_BUF + SCAN_HEAD * 2);
 	s->inbuf = s->realbuf + SCAN_HEAD;
 	s->inptr = s->inbuf;
 	s->inend = s->inbuf;
+	s->bufsize = SCAN_BUF;
+	s->window = SCAN_BUF;
+	s->window_min = SCAN_BUF;
+	s->window_max = SCAN_BUF_MAX;
+	s->window_filled = FALSE;
 	s->atleast = 0;
 
 	s->seek = 0;		/* current character position in file of the last read block */
@@ -1606,6 +1826,7 @@ folder_scan_init (void)
 	s->check_header_folded = FALSE;
 	s->scan_from = FALSE;
 	s->scan_pre_from = FALSE;
+	s->skim_content = FALSE;
 	s->eof = FALSE;
 
 	s->filters = NULL;
@@ -1642,6 +1863,8 @@ folder_scan_reset (struct _header_scan_state *s)
 	g_clear_object (&s->input_stream);
 	s->ioerrno = 0;
 	s->eof = FALSE;
+	s->window = s->window_min;
+	s->window_filled = FALSE;
 }
 
 static gint
@@ -1651,6 +1874,9 @@ folder_scan_init_with_fd (struct _header_scan_state *s,
 	folder_scan_reset (s);
 	s->fd = fd;
 
+	/* a file descriptor is mostly used for whole mbox files */
+	s->window = CLAMP (SCAN_BUF_FD, s->window_min, s->window_max);
+
 	return 0;
 }
 
@@ -1844,6 +2070,16 @@ tail_recurse:
 		presize = SCAN_HEAD;
 		f = s->filters;
 
+		if (s->skim_content) {
+			/* skip the content up to the boundary, without returning it */
+			do {
+				folder_scan_content (s, &state, databuffer, datalength);
+			} while (*datalength > 0);
+
+			s->state = CAMEL_MIME_PARSER_STATE_BODY_END;
+			break;
+		}
+
 		do {
 			hb = folder_scan_content (s, &state, databuffer, datalength);
 
@@ -1892,7 +2128,7 @@ tail_recurse:
 		do {
 			do {
 				hb = folder_scan_content (s, &state, databuffer, datalength);
-				if (*datalength > 0) {
+				if (*datalength > 0 && !s->skim_content) {
 					/* instead of a new state, we'll just store it locally and provide
 					 * an accessor function */
 					d (printf (
@@ -113,6 +113,12 @@ void camel_mime_parser_scan_from (CamelMimeParser *parser, gboolean scan_from);
 /* Do we want to know about the pre-from data? */
 void camel_mime_parser_scan_pre_from (CamelMimeParser *parser, gboolean scan_pre_from);
 
+/* skip the body content, looking only for the boundaries? */
+void camel_mime_parser_skim_content (CamelMimeParser *parser, gboolean skim_content);
+
+/* how much to read from the input at once */
+void camel_mime_parser_set_read_window (CamelMimeParser *parser, gsize min_size, gsize max_size);
+
 /* what headers to save, MUST include ^Content-Type: */
 gint camel_mime_parser_set_header_regex (CamelMimeParser *parser, gchar *matchstr);
 
@@ -35,6 +35,7 @@
 #include "camel-mime-filter-charset.h"
 #include "camel-mime-filter-crlf.h"
 #include "camel-mime-parser.h"
+#include "camel-mime-parser-private.h"
 #include "camel-mime-part-utils.h"
 #include "camel-mime-part.h"
 #include "camel-mime-utils.h"
@@ -57,6 +58,12 @@ struct _CamelMimePartPrivate {
 	CamelTransferEncoding encoding;
 	/* mime headers */
 	CamelNameValueArray *headers;
+
+	/* the header being added while constructing from the parser,
+	 * which can be borrowed from the header_arena */
+	CamelNameValueArena *header_arena;
+	const gchar *arena_name;
+	const gchar *arena_value;
 };
 
 struct _AsyncContext {
@@ -457,6 +464,17 @@ mime_part_finalize (GObject *object)
 	G_OBJECT_CLASS (camel_mime_part_parent_class)->finalize (object);
 }
 
+static void
+mime_part_append_header (CamelMimePart *part,
+                         const gchar *name,
+                         const gchar *value)
+{
+	if (part->priv->header_arena && name == part->priv->arena_name && value == part->priv->arena_value)
+		_camel_name_value_array_append_borrowed (part->priv->headers, part->priv->header_arena, name, value);
+	else
+		camel_name_value_array_append (part->priv->headers, name, value);
+}
+
 static void
 mime_part_add_header (CamelMedium *medium,
                       const gchar *name,
@@ -472,7 +490,7 @@ mime_part_add_header (CamelMedium *medium,
 	if (mime_part_process_header (medium, name, value))
 		camel_name_value_array_remove_named (part->priv->headers, CAMEL_COMPARE_CASE_INSENSITIVE, name, TRUE);
 
-	camel_name_value_array_append (part->priv->headers, name, value);
+	mime_part_append_header (part, name, value);
 }
 
 static void
@@ -485,7 +503,7 @@ mime_part_set_header (CamelMedium *medium,
 	mime_part_process_header (medium, name, value);
 	camel_name_value_array_remove_named (part->priv->headers, CAMEL_COMPARE_CASE_INSENSITIVE, name, TRUE);
 
-	camel_name_value_array_append (part->priv->headers, name, value);
+	mime_part_append_header (part, name, value);
 }
 
 static void
@@ -950,7 +968,9 @@ mime_part_construct_from_parser_sync (CamelMimePart *mime_part,
 {
 	CamelDataWrapper *dw = (CamelDataWrapper *) mime_part;
 	CamelNameValueArray *headers;
+	CamelNameValueArena *arena = NULL;
 	const gchar *content;
+	const gchar *invalid_content_type = "X-Invalid-Content-Type";
 	gchar *buf;
 	gsize len;
 	gint err;
@@ -967,6 +987,12 @@ mime_part_construct_from_parser_sync (CamelMimePart *mime_part,
 
 	case CAMEL_MIME_PARSER_STATE_HEADER:
 	case CAMEL_MIME_PARSER_STATE_MULTIPART:
+		/* the whole parsed tree stores its headers in one arena */
+		if (!_camel_mime_parser_get_header_arena (parser)) {
+			arena = _camel_name_value_arena_new ();
+			_camel_mime_parser_set_header_arena (parser, arena);
+		}
+
 		/* we have the headers, build them into 'us' */
 		headers = camel_mime_parser_dup_headers (parser);
 
@@ -975,17 +1001,32 @@ mime_part_construct_from_parser_sync (CamelMimePart *mime_part,
 		if (content)
 			mime_part_process_header (CAMEL_MEDIUM (dw), "content-type", content);
 
+		mime_part->priv->header_arena = _camel_mime_parser_get_header_arena (parser);
+
 		for (ii = 0; camel_name_value_array_get (headers, ii, &header_name, &header_value); ii++) {
 			if (g_ascii_strcasecmp (header_name, "content-type") == 0 && header_value != content)
-				camel_medium_add_header (CAMEL_MEDIUM (dw), "X-Invalid-Content-Type", header_value);
-			else
-				camel_medium_add_header (CAMEL_MEDIUM (dw), header_name, header_value);
+				header_name = invalid_content_type;
+
+			/* lets the mime_part_append_header() use the strings without copying them */
+			mime_part->priv->arena_name = header_name;
+			mime_part->priv->arena_value = header_value;
+
+			camel_medium_add_header (CAMEL_MEDIUM (dw), header_name, header_value);
 		}
 
+		mime_part->priv->header_arena = NULL;
+		mime_part->priv->arena_name = NULL;
+		mime_part->priv->arena_value = NULL;
+
 		camel_name_value_array_free (headers);
 
 		success = camel_mime_part_construct_content_from_parser (
 			mime_part, parser, cancellable, error);
+
+		if (arena) {
+			_camel_mime_parser_set_header_arena (parser, NULL);
+			_camel_name_value_arena_unref (arena);
+		}
 		break;
 	default:
 		g_warning ("Invalid state encountered???: %u", camel_mime_parser_state (parser));
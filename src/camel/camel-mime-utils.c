@@ -439,6 +439,18 @@ camel_uudecode_step (guchar *in,
 			continue;
 		}
 
+		if (i == 0 && uulen >= 3 && inend - inptr >= 4 &&
+		    inptr[0] != '\n' && inptr[1] != '\n' && inptr[2] != '\n' && inptr[3] != '\n') {
+			/* a whole group in the middle of the line, without saving the bytes */
+			*outptr++ = CAMEL_UUDECODE_CHAR (inptr[0]) << 2 | CAMEL_UUDECODE_CHAR (inptr[1]) >> 4;
+			*outptr++ = CAMEL_UUDECODE_CHAR (inptr[1]) << 4 | CAMEL_UUDECODE_CHAR (inptr[2]) >> 2;
+			*outptr++ = CAMEL_UUDECODE_CHAR (inptr[2]) << 6 | CAMEL_UUDECODE_CHAR (inptr[3]);
+			uulen -= 3;
+			inptr += 4;
+			saved = 0;
+			continue;
+		}
+
 		ch = *inptr++;
 
 		if (uulen > 0) {
@@ -676,26 +688,23 @@ camel_quoted_decode_step (guchar *in,
 	inptr = in;
 	while (inptr < inend) {
 		switch (state) {
-		case 0:
-			while (inptr < inend) {
-				c = *inptr++;
-				if (c == '=') {
-					state = 1;
-					break;
-				}
-#ifdef CANONICALISE_EOL
-				/*else if (c=='\r') {
-					state = 3;
-				} else if (c == '\n') {
-					*outptr++ = '\r';
-					*outptr++ = c;
-					} */
-#endif
-				else {
-					*outptr++ = c;
-				}
+		case 0: {
+			guchar *eq;
+			gsize n;
+
+			/* the text up to the next '=' is copied as is */
+			eq = memchr (inptr, '=', inend - inptr);
+			n = (eq ? eq : inend) - inptr;
+
+			memcpy (outptr, inptr, n);
+			outptr += n;
+			inptr += n;
+
+			if (eq) {
+				inptr++;
+				state = 1;
 			}
-			break;
+		} break;
 		case 1:
 			c = *inptr++;
 			if (c == '\n') {
@@ -886,7 +895,7 @@ camel_iconv_strndup (GIConv cd,
 		outbuf = out + converted;
 		outleft = outlen - converted;
 
-		converted = g_iconv (cd, (gchar **) &inbuf, &inleft, &outbuf, &outleft);
+		converted = camel_iconv (cd, &inbuf, &inleft, &outbuf, &outleft);
 		if (converted == (gsize) -1) {
 			if (errno != E2BIG && errno != EINVAL)
 				goto fail;
@@ -993,7 +1002,7 @@ decode_8bit (const gchar *text,
 		n = 0;
 
 		do {
-			rc = g_iconv (cd, (gchar **) &inbuf, &inleft, &outbuf, &outleft);
+			rc = camel_iconv (cd, &inbuf, &inleft, &outbuf, &outleft);
 			if (rc == (gsize) -1) {
 				if (errno == EINVAL) {
 					/* incomplete sequence at the end of the input buffer */
@@ -1070,7 +1079,7 @@ decode_8bit (const gchar *text,
 	inbuf = text;
 
 	do {
-		rc = g_iconv (cd, (gchar **) &inbuf, &inleft, &outbuf, &outleft);
+		rc = camel_iconv (cd, &inbuf, &inleft, &outbuf, &outleft);
 		if (rc == (gsize) -1) {
 			if (errno == EINVAL) {
 				/* incomplete sequence at the end of the input buffer */
@@ -0,0 +1,44 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMEL_NAME_VALUE_ARRAY_PRIVATE_H
+#define CAMEL_NAME_VALUE_ARRAY_PRIVATE_H
+
+#include "camel-name-value-array.h"
+
+G_BEGIN_DECLS
+
+/* Holds the strings of the arrays, which are built by the same parser
+   run, thus the whole parsed message shares the memory for its headers */
+typedef struct _CamelNameValueArena CamelNameValueArena;
+
+CamelNameValueArena *
+		_camel_name_value_arena_new	(void);
+CamelNameValueArena *
+		_camel_name_value_arena_ref	(CamelNameValueArena *arena);
+void		_camel_name_value_arena_unref	(CamelNameValueArena *arena);
+void		_camel_name_value_array_append_arena
+						(CamelNameValueArray *array,
+						 CamelNameValueArena *arena,
+						 const gchar *name,
+						 const gchar *value);
+void		_camel_name_value_array_append_borrowed
+						(CamelNameValueArray *array,
+						 CamelNameValueArena *arena,
+						 const gchar *name,
+						 const gchar *value);
+
+G_END_DECLS
+
+#endif /* CAMEL_NAME_VALUE_ARRAY_PRIVATE_H */
@@ -20,31 +20,114 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "camel-mempool.h"
 #include "camel-string-utils.h"
 
 #include "camel-name-value-array.h"
+#include "camel-name-value-array-private.h"
 
 G_DEFINE_BOXED_TYPE (CamelNameValueArray,
 		camel_name_value_array,
 		camel_name_value_array_copy,
 		camel_name_value_array_free)
 
+struct _CamelNameValueArena {
+	volatile gint ref_count;
+	CamelMemPool *pool;
+};
+
 typedef struct _CamelNameValuePair {
 	gchar *name;
 	gchar *value;
+	CamelNameValueArena *arena; /* when set, the name and the value are not owned */
 } CamelNameValuePair;
 
+CamelNameValueArena *
+_camel_name_value_arena_new (void)
+{
+	CamelNameValueArena *arena;
+
+	arena = g_slice_new (CamelNameValueArena);
+	arena->ref_count = 1;
+	arena->pool = camel_mempool_new (4096, 1024, CAMEL_MEMPOOL_ALIGN_BYTE);
+
+	return arena;
+}
+
+CamelNameValueArena *
+_camel_name_value_arena_ref (CamelNameValueArena *arena)
+{
+	g_return_val_if_fail (arena != NULL, NULL);
+
+	g_atomic_int_inc (&arena->ref_count);
+
+	return arena;
+}
+
+void
+_camel_name_value_arena_unref (CamelNameValueArena *arena)
+{
+	if (arena && g_atomic_int_dec_and_test (&arena->ref_count)) {
+		camel_mempool_destroy (arena->pool);
+		g_slice_free (CamelNameValueArena, arena);
+	}
+}
+
+/* Appends the 'name' and the 'value', copied into the 'arena'. The arena can
+   be used only by one thread at a time, the one building the arrays. */
+void
+_camel_name_value_array_append_arena (CamelNameValueArray *array,
+				      CamelNameValueArena *arena,
+				      const gchar *name,
+				      const gchar *value)
+{
+	g_return_if_fail (arena != NULL);
+	g_return_if_fail (name != NULL);
+	g_return_if_fail (value != NULL);
+
+	_camel_name_value_array_append_borrowed (array, arena,
+		camel_mempool_strdup (arena->pool, name),
+		camel_mempool_strdup (arena->pool, value));
+}
+
+/* Appends the 'name' and the 'value' without copying them; they should be
+   allocated in the 'arena', or be static */
+void
+_camel_name_value_array_append_borrowed (CamelNameValueArray *array,
+					 CamelNameValueArena *arena,
+					 const gchar *name,
+					 const gchar *value)
+{
+	CamelNameValuePair pair;
+
+	g_return_if_fail (array != NULL);
+	g_return_if_fail (arena != NULL);
+	g_return_if_fail (name != NULL);
+	g_return_if_fail (value != NULL);
+
+	pair.name = (gchar *) name;
+	pair.value = (gchar *) value;
+	pair.arena = _camel_name_value_arena_ref (arena);
+
+	g_array_append_val ((GArray *) array, pair);
+}
+
 static void
 free_name_value_content (gpointer ptr)
 {
 	CamelNameValuePair *pair = ptr;
 
 	if (pair) {
-		g_free (pair->name);
-		g_free (pair->value);
+		if (pair->arena) {
+			_camel_name_value_arena_unref (pair->arena);
+		} else {
+			g_free (pair->name);
+			g_free (pair->value);
+		}
 
 		pair->name = NULL;
 		pair->value = NULL;
+		pair->arena = NULL;
 	}
 }
 
@@ -123,10 +206,13 @@ camel_name_value_array_copy (const CamelNameValueArray *array)
 	copy = camel_name_value_array_new_sized (len);
 
 	for (ii = 0; ii < len; ii++) {
-		const gchar *name = NULL, *value = NULL;
+		const CamelNameValuePair *pair = &g_array_index ((GArray *) array, CamelNameValuePair, ii);
 
-		if (camel_name_value_array_get (array, ii, &name, &value))
-			camel_name_value_array_append (copy, name, value);
+		/* the strings of the arena are shared, not copied */
+		if (pair->arena)
+			_camel_name_value_array_append_borrowed (copy, pair->arena, pair->name, pair->value);
+		else
+			camel_name_value_array_append (copy, pair->name, pair->value);
 	}
 
 	return copy;
@@ -350,6 +436,7 @@ camel_name_value_array_append (CamelNameValueArray *array,
 
 	pair.name = g_strdup (name);
 	pair.value = g_strdup (value);
+	pair.arena = NULL;
 
 	g_array_append_val (arr, pair);
 }
@@ -362,6 +449,7 @@ camel_name_value_array_set_internal (CamelNameValueArray *array,
 {
 	GArray *arr = (GArray *) array;
 	CamelNameValuePair *pair;
+	CamelNameValueArena *arena = NULL;
 	gboolean changed = FALSE;
 
 	g_return_val_if_fail (array != NULL, FALSE);
@@ -369,6 +457,17 @@ camel_name_value_array_set_internal (CamelNameValueArray *array,
 
 	pair = &g_array_index (arr, CamelNameValuePair, index);
 
+	/* copy on write, the arena strings are shared with other arrays */
+	if (pair->arena &&
+	    ((name && g_strcmp0 (pair->name, name) != 0) ||
+	     (value && g_strcmp0 (pair->value, value) != 0))) {
+		arena = pair->arena;
+
+		pair->name = g_strdup (pair->name);
+		pair->value = g_strdup (pair->value);
+		pair->arena = NULL;
+	}
+
 	if (name && g_strcmp0 (pair->name, name) != 0) {
 		g_free (pair->name);
 		pair->name = g_strdup (name);
@@ -381,6 +480,9 @@ camel_name_value_array_set_internal (CamelNameValueArray *array,
 		changed = TRUE;
 	}
 
+	/* the 'name' or the 'value' can be from the arena too */
+	_camel_name_value_arena_unref (arena);
+
 	return changed;
 }
 
@@ -0,0 +1,2204 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The index consists of a manifest file "<path>.index.pidx" and of immutable
+ * segment files "<path>.index.pidx.<id>".
+ *
+ * The manifest lists the segments, oldest first, and all the indexed names.
+ * A name is identified by its position in the list, its docid. The deleted
+ * names are stored as empty strings, until the index is compressed.
+ *
+ * A segment begins with a header of five 32-bit little-endian values: the magic,
+ * the version, the number of words, the offset of the word table and the number
+ * of postings. The posting lists follow, each being a sequence of varint-encoded
+ * differences between the ascending docids. After them is the word directory,
+ * each entry with a varint word length, the word itself, varint offset, length
+ * and count of its posting list. The word table at the end of the file contains
+ * 32-bit offsets of the directory entries, sorted by the word.
+ *
+ * The segments are read through a memory map and they are never modified,
+ * new postings are gathered in memory and written into a new segment. The newest
+ * segments are merged together, when they are of a similar size, thus there are
+ * only a few of them. Readers need the index lock only to look up the words,
+ * the words cursor holds references to the segments and does not lock at all.
+ */
+
+#include "evolution-data-server-config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "camel-posting-index.h"
+
+#define d(x)
+
+#define CAMEL_POSTING_INDEX_VERSION (1)
+
+/* Longer words are not indexed, they are usually encoded data */
+#define CAMEL_POSTING_INDEX_MAX_WORDLEN (128)
+
+/* How many postings can be gathered in memory before they are written into a new segment */
+#define MAX_MEMORY_POSTINGS (1 << 20)
+
+/* Merge the newest segments when there are more than this many of them, regardless their sizes */
+#define MAX_SEGMENTS (12)
+
+/* Purge deleted names from the segments when they make this many percent of all names */
+#define MAX_DELETED_PERCENT (20)
+
+#define MANIFEST_MAGIC "CPIX"
+#define SEGMENT_MAGIC "CPIS"
+#define SEGMENT_HEADER_SIZE (20)
+
+#define NO_DOCID (G_MAXUINT32)
+
+typedef struct _PostingSegment {
+	volatile gint ref_count;
+	guint32 id;
+	gchar *filename;
+	GMappedFile *mapped;
+	const guchar *data;
+	gsize size;
+	guint32 n_words;
+	guint32 table_offset;
+	guint32 n_postings;
+} PostingSegment;
+
+typedef struct _PostingEntry {
+	const gchar *word; /* not NUL-terminated */
+	guint32 word_len;
+	guint32 offset;
+	guint32 length;
+	guint32 count;
+} PostingEntry;
+
+struct _CamelPostingIndexPrivate {
+	GRWLock lock;
+
+	gboolean read_only;
+	gboolean loaded;
+	gboolean dirty; /* the manifest needs to be written */
+
+	GPtrArray *segments; /* PostingSegment *, the oldest first */
+	guint32 next_segment_id;
+	GPtrArray *obsolete_files; /* gchar *, replaced segments, to be deleted after the manifest is saved */
+
+	GPtrArray *names; /* gchar *, indexed by docid, NULL for deleted names */
+	GHashTable *name_hash; /* gchar *name (from names) ~> docid + 1 */
+	guint32 n_deleted;
+	guint generation; /* increased when the docids change */
+
+	GHashTable *memory_words; /* gchar *word ~> GArray { guint32 docid } */
+	guint32 n_memory_postings;
+};
+
+struct _CamelPostingIndexNamePrivate {
+	GString *buffer;
+	guint32 docid;
+	guint generation;
+};
+
+struct _CamelPostingIndexCursorPrivate {
+	GPtrArray *names; /* gchar * */
+	guint index;
+};
+
+struct _CamelPostingIndexWordsCursorPrivate {
+	GPtrArray *segments; /* PostingSegment * */
+	guint32 *positions; /* current entry in each of the segments */
+	GPtrArray *memory_words; /* gchar *, sorted */
+	guint memory_position;
+	gchar *current;
+};
+
+static CamelPostingIndexName *
+		camel_posting_index_name_new	(CamelPostingIndex *idx,
+						 const gchar *name,
+						 guint32 docid,
+						 guint generation);
+static CamelPostingIndexCursor *
+		camel_posting_index_cursor_new	(CamelPostingIndex *idx,
+						 GPtrArray *names);
+static CamelPostingIndexWordsCursor *
+		camel_posting_index_words_cursor_new
+						(CamelPostingIndex *idx,
+						 GPtrArray *segments,
+						 GPtrArray *memory_words);
+
+/* ********************************************************************** */
+/* Encoding */
+/* ********************************************************************** */
+
+static inline guint32
+read_uint32 (const guchar *ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (((guint32) ptr[3]) << 24);
+}
+
+static void
+append_uint32 (GByteArray *array,
+	       guint32 value)
+{
+	guint8 bytes[4];
+
+	bytes[0] = value & 0xff;
+	bytes[1] = (value >> 8) & 0xff;
+	bytes[2] = (value >> 16) & 0xff;
+	bytes[3] = (value >> 24) & 0xff;
+
+	g_byte_array_append (array, bytes, 4);
+}
+
+static void
+append_varint (GByteArray *array,
+	       guint32 value)
+{
+	guint8 bytes[5];
+	guint len = 0;
+
+	while (value >= 0x80) {
+		bytes[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	bytes[len++] = value;
+
+	g_byte_array_append (array, bytes, len);
+}
+
+static gboolean
+read_varint (const guchar **pptr,
+	     const guchar *end,
+	     guint32 *out_value)
+{
+	const guchar *ptr = *pptr;
+	guint32 value = 0;
+	gint shift;
+
+	for (shift = 0; ptr < end && shift <= 28; shift += 7) {
+		guchar c = *ptr++;
+
+		value |= ((guint32) (c & 0x7f)) << shift;
+
+		if ((c & 0x80) == 0) {
+			*pptr = ptr;
+			*out_value = value;
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gint
+compare_words_cb (gconstpointer ptr1,
+		  gconstpointer ptr2)
+{
+	const gchar *word1 = *((const gchar **) ptr1);
+	const gchar *word2 = *((const gchar **) ptr2);
+
+	return strcmp (word1, word2);
+}
+
+static gint
+compare_docids_cb (gconstpointer ptr1,
+		   gconstpointer ptr2)
+{
+	guint32 docid1 = *((const guint32 *) ptr1);
+	guint32 docid2 = *((const guint32 *) ptr2);
+
+	return docid1 < docid2 ? -1 : docid1 > docid2 ? 1 : 0;
+}
+
+/* The docids are mostly ascending already, only concurrent writers can mix them */
+static void
+posting_docids_normalize (GArray *docids)
+{
+	guint32 *values = (guint32 *) docids->data;
+	guint ii, jj;
+
+	for (ii = 1; ii < docids->len; ii++) {
+		if (values[ii - 1] >= values[ii])
+			break;
+	}
+
+	if (ii >= docids->len)
+		return;
+
+	g_array_sort (docids, compare_docids_cb);
+
+	for (ii = 1, jj = 1; ii < docids->len; ii++) {
+		if (values[ii] != values[jj - 1])
+			values[jj++] = values[ii];
+	}
+
+	g_array_set_size (docids, jj);
+}
+
+static gint
+posting_entry_compare (const PostingEntry *entry,
+		       const gchar *word,
+		       gsize word_len)
+{
+	gint res;
+
+	res = memcmp (entry->word, word, MIN (entry->word_len, word_len));
+	if (!res)
+		res = entry->word_len < word_len ? -1 : entry->word_len > word_len ? 1 : 0;
+
+	return res;
+}
+
+/* ********************************************************************** */
+/* Segments */
+/* ********************************************************************** */
+
+static gchar *
+posting_index_segment_filename (const gchar *index_path,
+				guint32 id)
+{
+	return g_strdup_printf ("%s.pidx.%u", index_path, id);
+}
+
+static gchar *
+posting_index_manifest_filename (const gchar *index_path)
+{
+	return g_strdup_printf ("%s.pidx", index_path);
+}
+
+static PostingSegment *
+posting_segment_ref (PostingSegment *seg)
+{
+	g_atomic_int_inc (&seg->ref_count);
+
+	return seg;
+}
+
+static void
+posting_segment_unref (gpointer ptr)
+{
+	PostingSegment *seg = ptr;
+
+	if (seg && g_atomic_int_dec_and_test (&seg->ref_count)) {
+		g_mapped_file_unref (seg->mapped);
+		g_free (seg->filename);
+		g_slice_free (PostingSegment, seg);
+	}
+}
+
+static PostingSegment *
+posting_segment_open (const gchar *filename,
+		      guint32 id)
+{
+	PostingSegment *seg;
+	GMappedFile *mapped;
+	const guchar *data;
+	gsize size;
+	guint32 n_words, table_offset;
+
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+	if (!mapped) {
+		d (printf ("Cannot map segment '%s'\n", filename));
+		errno = ENOENT;
+		return NULL;
+	}
+
+	data = (const guchar *) g_mapped_file_get_contents (mapped);
+	size = g_mapped_file_get_length (mapped);
+
+	if (!data || size < SEGMENT_HEADER_SIZE || memcmp (data, SEGMENT_MAGIC, 4) != 0 ||
+	    read_uint32 (data + 4) != CAMEL_POSTING_INDEX_VERSION) {
+		g_mapped_file_unref (mapped);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	n_words = read_uint32 (data + 8);
+	table_offset = read_uint32 (data + 12);
+
+	if (table_offset < SEGMENT_HEADER_SIZE || table_offset > size ||
+	    (size - table_offset) / 4 < n_words) {
+		g_mapped_file_unref (mapped);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	seg = g_slice_new0 (PostingSegment);
+	seg->ref_count = 1;
+	seg->id = id;
+	seg->filename = g_strdup (filename);
+	seg->mapped = mapped;
+	seg->data = data;
+	seg->size = size;
+	seg->n_words = n_words;
+	seg->table_offset = table_offset;
+	seg->n_postings = read_uint32 (data + 16);
+
+	return seg;
+}
+
+static gboolean
+posting_segment_read_entry (PostingSegment *seg,
+			    guint32 index,
+			    PostingEntry *entry)
+{
+	const guchar *ptr, *end;
+	guint32 offset;
+
+	if (index >= seg->n_words)
+		return FALSE;
+
+	offset = read_uint32 (seg->data + seg->table_offset + 4 * index);
+	if (offset < SEGMENT_HEADER_SIZE || offset >= seg->table_offset)
+		return FALSE;
+
+	ptr = seg->data + offset;
+	end = seg->data + seg->table_offset;
+
+	if (!read_varint (&ptr, end, &entry->word_len) ||
+	    entry->word_len > end - ptr)
+		return FALSE;
+
+	entry->word = (const gchar *) ptr;
+	ptr += entry->word_len;
+
+	if (!read_varint (&ptr, end, &entry->offset) ||
+	    !read_varint (&ptr, end, &entry->length) ||
+	    !read_varint (&ptr, end, &entry->count))
+		return FALSE;
+
+	return entry->offset >= SEGMENT_HEADER_SIZE &&
+		entry->offset <= seg->table_offset &&
+		entry->length <= seg->table_offset - entry->offset;
+}
+
+static gboolean
+posting_segment_find (PostingSegment *seg,
+		      const gchar *word,
+		      PostingEntry *entry)
+{
+	gsize word_len = strlen (word);
+	guint32 lo = 0, hi = seg->n_words;
+
+	while (lo < hi) {
+		guint32 mid = lo + (hi - lo) / 2;
+		gint cmp;
+
+		if (!posting_segment_read_entry (seg, mid, entry))
+			return FALSE;
+
+		cmp = posting_entry_compare (entry, word, word_len);
+		if (cmp == 0)
+			return TRUE;
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return FALSE;
+}
+
+/* Appends the docids of the 'entry' to the 'docids' */
+static void
+posting_segment_decode (PostingSegment *seg,
+			const PostingEntry *entry,
+			GArray *docids)
+{
+	const guchar *ptr, *end;
+	guint32 docid = 0, delta, ii;
+
+	ptr = seg->data + entry->offset;
+	end = ptr + entry->length;
+
+	for (ii = 0; ii < entry->count; ii++) {
+		if (!read_varint (&ptr, end, &delta))
+			break;
+
+		docid += delta;
+		g_array_append_val (docids, docid);
+	}
+}
+
+/* ********************************************************************** */
+/* Segment writer */
+/* ********************************************************************** */
+
+typedef struct _SegmentWriter {
+	FILE *file;
+	gchar *tmp_filename;
+	guint64 offset;
+	GByteArray *buffer;
+	GByteArray *directory;
+	GArray *table; /* guint32, offsets into the directory */
+	guint32 n_postings;
+} SegmentWriter;
+
+static SegmentWriter *
+segment_writer_new (const gchar *filename)
+{
+	SegmentWriter *writer;
+	guchar header[SEGMENT_HEADER_SIZE] = { 0 };
+	FILE *file;
+	gchar *tmp_filename;
+
+	tmp_filename = g_strconcat (filename, "~", NULL);
+
+	file = g_fopen (tmp_filename, "wb");
+	if (!file || fwrite (header, 1, SEGMENT_HEADER_SIZE, file) != SEGMENT_HEADER_SIZE) {
+		gint err = errno;
+
+		if (file) {
+			fclose (file);
+			g_unlink (tmp_filename);
+		}
+
+		g_free (tmp_filename);
+		errno = err;
+
+		return NULL;
+	}
+
+	writer = g_slice_new0 (SegmentWriter);
+	writer->file = file;
+	writer->tmp_filename = tmp_filename;
+	writer->offset = SEGMENT_HEADER_SIZE;
+	writer->buffer = g_byte_array_new ();
+	writer->directory = g_byte_array_new ();
+	writer->table = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	return writer;
+}
+
+static void
+segment_writer_free (SegmentWriter *writer)
+{
+	if (writer->file) {
+		fclose (writer->file);
+		g_unlink (writer->tmp_filename);
+	}
+
+	g_free (writer->tmp_filename);
+	g_byte_array_free (writer->buffer, TRUE);
+	g_byte_array_free (writer->directory, TRUE);
+	g_array_free (writer->table, TRUE);
+	g_slice_free (SegmentWriter, writer);
+}
+
+/* The 'docids' should be ascending, without duplicates; the words should be added sorted */
+static gboolean
+segment_writer_add (SegmentWriter *writer,
+		    const gchar *word,
+		    guint32 word_len,
+		    const guint32 *docids,
+		    guint32 n_docids)
+{
+	guint32 ii, previous = 0, dir_offset;
+
+	if (!n_docids)
+		return TRUE;
+
+	g_byte_array_set_size (writer->buffer, 0);
+
+	for (ii = 0; ii < n_docids; ii++) {
+		append_varint (writer->buffer, docids[ii] - previous);
+		previous = docids[ii];
+	}
+
+	/* Everything, including the directory and the table, should fit into 4GB */
+	if (writer->offset + writer->buffer->len + writer->directory->len + 4 * (writer->table->len + 1) + word_len + 20 > G_MAXUINT32) {
+		errno = EFBIG;
+		return FALSE;
+	}
+
+	if (fwrite (writer->buffer->data, 1, writer->buffer->len, writer->file) != writer->buffer->len)
+		return FALSE;
+
+	dir_offset = writer->directory->len;
+	g_array_append_val (writer->table, dir_offset);
+
+	append_varint (writer->directory, word_len);
+	g_byte_array_append (writer->directory, (const guint8 *) word, word_len);
+	append_varint (writer->directory, (guint32) writer->offset);
+	append_varint (writer->directory, writer->buffer->len);
+	append_varint (writer->directory, n_docids);
+
+	writer->offset += writer->buffer->len;
+	writer->n_postings += n_docids;
+
+	return TRUE;
+}
+
+/* Frees the 'writer' */
+static gint
+segment_writer_finish (SegmentWriter *writer,
+		       const gchar *filename)
+{
+	GByteArray *tail;
+	guint32 dir_start, ii;
+	gint ret = 0, err = 0;
+
+	dir_start = (guint32) writer->offset;
+
+	tail = g_byte_array_sized_new (writer->directory->len + 4 * writer->table->len);
+	g_byte_array_append (tail, writer->directory->data, writer->directory->len);
+	for (ii = 0; ii < writer->table->len; ii++) {
+		append_uint32 (tail, dir_start + g_array_index (writer->table, guint32, ii));
+	}
+
+	if (fwrite (tail->data, 1, tail->len, writer->file) != tail->len)
+		ret = -1;
+
+	g_byte_array_set_size (tail, 0);
+	g_byte_array_append (tail, (const guint8 *) SEGMENT_MAGIC, 4);
+	append_uint32 (tail, CAMEL_POSTING_INDEX_VERSION);
+	append_uint32 (tail, writer->table->len);
+	append_uint32 (tail, dir_start + writer->directory->len);
+	append_uint32 (tail, writer->n_postings);
+
+	if (ret == 0 && (fseek (writer->file, 0, SEEK_SET) == -1 ||
+	    fwrite (tail->data, 1, tail->len, writer->file) != tail->len ||
+	    fflush (writer->file) != 0 || fsync (fileno (writer->file)) == -1))
+		ret = -1;
+
+	if (ret == -1)
+		err = errno;
+
+	g_byte_array_free (tail, TRUE);
+
+	if (fclose (writer->file) != 0 && ret == 0) {
+		err = errno;
+		ret = -1;
+	}
+
+	writer->file = NULL;
+
+	if (ret == 0 && g_rename (writer->tmp_filename, filename) == -1) {
+		err = errno;
+		ret = -1;
+	}
+
+	if (ret == -1)
+		g_unlink (writer->tmp_filename);
+
+	segment_writer_free (writer);
+
+	if (ret == -1)
+		errno = err;
+
+	return ret;
+}
+
+/* ********************************************************************** */
+/* CamelPostingIndex */
+/* ********************************************************************** */
+
+G_DEFINE_TYPE_WITH_PRIVATE (CamelPostingIndex, camel_posting_index, CAMEL_TYPE_INDEX)
+
+static void
+posting_index_memory_words_free (gpointer ptr)
+{
+	GArray *docids = ptr;
+
+	if (docids)
+		g_array_free (docids, TRUE);
+}
+
+/* Call with the write lock held */
+static void
+posting_index_delete_obsolete_files_locked (CamelPostingIndex *index)
+{
+	guint ii;
+
+	for (ii = 0; ii < index->priv->obsolete_files->len; ii++) {
+		const gchar *filename = index->priv->obsolete_files->pdata[ii];
+
+		if (g_unlink (filename) == -1 && errno != ENOENT)
+			g_warning ("%s: Failed to remove '%s': %s", G_STRFUNC, filename, g_strerror (errno));
+	}
+
+	g_ptr_array_set_size (index->priv->obsolete_files, 0);
+}
+
+/* Call with the write lock held */
+static gint
+posting_index_write_manifest_locked (CamelPostingIndex *index)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	GByteArray *data;
+	GError *local_error = NULL;
+	gchar *filename;
+	guint ii;
+	gint ret = 0;
+
+	data = g_byte_array_new ();
+	g_byte_array_append (data, (const guint8 *) MANIFEST_MAGIC, 4);
+	append_varint (data, CAMEL_POSTING_INDEX_VERSION);
+	append_varint (data, p->next_segment_id);
+
+	append_varint (data, p->segments->len);
+	for (ii = 0; ii < p->segments->len; ii++) {
+		PostingSegment *seg = p->segments->pdata[ii];
+
+		append_varint (data, seg->id);
+	}
+
+	append_varint (data, p->names->len);
+	for (ii = 0; ii < p->names->len; ii++) {
+		const gchar *name = p->names->pdata[ii];
+		guint32 len = name ? strlen (name) : 0;
+
+		append_varint (data, len);
+		if (len)
+			g_byte_array_append (data, (const guint8 *) name, len);
+	}
+
+	filename = posting_index_manifest_filename (index->parent.path);
+
+	if (g_file_set_contents (filename, (const gchar *) data->data, data->len, &local_error)) {
+		p->dirty = FALSE;
+
+		/* only now nothing references the replaced segments */
+		posting_index_delete_obsolete_files_locked (index);
+	} else {
+		g_warning ("%s: Failed to write '%s': %s", G_STRFUNC, filename, local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+		errno = EIO;
+		ret = -1;
+	}
+
+	g_byte_array_free (data, TRUE);
+	g_free (filename);
+
+	return ret;
+}
+
+static gboolean
+posting_index_read_manifest (CamelPostingIndex *index,
+			     GPtrArray **out_segment_ids)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	const guchar *ptr, *end;
+	gchar *filename, *contents = NULL;
+	gsize length = 0;
+	guint32 version, n_segments, n_names, ii;
+	GPtrArray *segment_ids;
+
+	filename = posting_index_manifest_filename (index->parent.path);
+
+	if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+		g_free (filename);
+		errno = ENOENT;
+		return FALSE;
+	}
+
+	g_free (filename);
+
+	ptr = (const guchar *) contents;
+	end = ptr + length;
+
+	if (length < 4 || memcmp (ptr, MANIFEST_MAGIC, 4) != 0)
+		goto corrupt;
+
+	ptr += 4;
+
+	if (!read_varint (&ptr, end, &version) || version != CAMEL_POSTING_INDEX_VERSION ||
+	    !read_varint (&ptr, end, &p->next_segment_id) ||
+	    !read_varint (&ptr, end, &n_segments))
+		goto corrupt;
+
+	segment_ids = g_ptr_array_new ();
+	*out_segment_ids = segment_ids;
+
+	for (ii = 0; ii < n_segments; ii++) {
+		guint32 id;
+
+		if (!read_varint (&ptr, end, &id) || id >= p->next_segment_id)
+			goto corrupt;
+
+		g_ptr_array_add (segment_ids, GUINT_TO_POINTER (id));
+	}
+
+	if (!read_varint (&ptr, end, &n_names))
+		goto corrupt;
+
+	for (ii = 0; ii < n_names; ii++) {
+		guint32 len;
+
+		if (!read_varint (&ptr, end, &len) || len > end - ptr)
+			goto corrupt;
+
+		if (len) {
+			gchar *name = g_strndup ((const gchar *) ptr, len);
+
+			g_ptr_array_add (p->names, name);
+			g_hash_table_insert (p->name_hash, name, GUINT_TO_POINTER (ii + 1));
+			ptr += len;
+		} else {
+			g_ptr_array_add (p->names, NULL);
+			p->n_deleted++;
+		}
+	}
+
+	g_free (contents);
+
+	return TRUE;
+
+ corrupt:
+	d (printf ("Corrupt manifest of '%s'\n", index->parent.path));
+	g_free (contents);
+	errno = EINVAL;
+
+	return FALSE;
+}
+
+/* Call with the write lock held. Merges 'n_segments' segments from the 'first', which
+   are replaced by the result. When 'remap' is not NULL, it translates old docids to
+   new docids, otherwise the docids of deleted names are left out. */
+static gint
+posting_index_merge_segments_locked (CamelPostingIndex *index,
+				     guint first,
+				     guint n_segments,
+				     const guint32 *remap,
+				     guint32 remap_len)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	PostingSegment **segs, *merged;
+	PostingEntry *entries;
+	SegmentWriter *writer;
+	GArray *docids;
+	gboolean *valid;
+	guint32 *positions, id;
+	gchar *filename;
+	guint ii;
+	gint ret = 0;
+
+	g_return_val_if_fail (first + n_segments <= p->segments->len, -1);
+
+	id = p->next_segment_id++;
+	filename = posting_index_segment_filename (index->parent.path, id);
+
+	writer = segment_writer_new (filename);
+	if (!writer) {
+		g_free (filename);
+		return -1;
+	}
+
+	segs = (PostingSegment **) p->segments->pdata + first;
+	entries = g_new0 (PostingEntry, n_segments);
+	valid = g_new0 (gboolean, n_segments);
+	positions = g_new0 (guint32, n_segments);
+	docids = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	for (ii = 0; ii < n_segments; ii++) {
+		valid[ii] = posting_segment_read_entry (segs[ii], 0, &entries[ii]);
+		if (!valid[ii] && segs[ii]->n_words > 0)
+			ret = -1;
+	}
+
+	while (ret == 0) {
+		const PostingEntry *min_entry = NULL;
+		const gchar *word;
+		guint32 word_len, jj, kk;
+
+		for (ii = 0; ii < n_segments; ii++) {
+			if (valid[ii] && (!min_entry || posting_entry_compare (&entries[ii], min_entry->word, min_entry->word_len) < 0))
+				min_entry = &entries[ii];
+		}
+
+		if (!min_entry)
+			break;
+
+		word = min_entry->word;
+		word_len = min_entry->word_len;
+
+		g_array_set_size (docids, 0);
+
+		/* the segments are in the order they had been written, thus the docids are mostly ascending */
+		for (ii = 0; ii < n_segments && ret == 0; ii++) {
+			if (!valid[ii] || posting_entry_compare (&entries[ii], word, word_len) != 0)
+				continue;
+
+			posting_segment_decode (segs[ii], &entries[ii], docids);
+
+			positions[ii]++;
+			if (positions[ii] < segs[ii]->n_words) {
+				/* 'word' points to the mapped data, thus remains valid */
+				if (!posting_segment_read_entry (segs[ii], positions[ii], &entries[ii]))
+					ret = -1;
+			} else {
+				valid[ii] = FALSE;
+			}
+		}
+
+		for (jj = 0, kk = 0; jj < docids->len; jj++) {
+			guint32 docid = g_array_index (docids, guint32, jj);
+
+			if (remap)
+				docid = docid < remap_len ? remap[docid] : NO_DOCID;
+			else if (docid >= p->names->len || !p->names->pdata[docid])
+				docid = NO_DOCID;
+
+			if (docid != NO_DOCID)
+				g_array_index (docids, guint32, kk++) = docid;
+		}
+
+		g_array_set_size (docids, kk);
+		posting_docids_normalize (docids);
+
+		if (ret == 0 && !segment_writer_add (writer, word, word_len, (const guint32 *) docids->data, docids->len))
+			ret = -1;
+	}
+
+	g_array_free (docids, TRUE);
+	g_free (positions);
+	g_free (valid);
+	g_free (entries);
+
+	if (ret == 0)
+		ret = segment_writer_finish (writer, filename);
+	else
+		segment_writer_free (writer);
+
+	merged = ret == 0 ? posting_segment_open (filename, id) : NULL;
+
+	if (merged) {
+		for (ii = 0; ii < n_segments; ii++) {
+			PostingSegment *seg = p->segments->pdata[first + ii];
+
+			g_ptr_array_add (p->obsolete_files, g_strdup (seg->filename));
+		}
+
+		g_ptr_array_remove_range (p->segments, first, n_segments);
+		g_ptr_array_insert (p->segments, first, merged);
+
+		p->dirty = TRUE;
+	} else {
+		if (ret == 0)
+			ret = -1;
+
+		g_unlink (filename);
+	}
+
+	g_free (filename);
+
+	return ret;
+}
+
+/* Call with the write lock held. Keeps the number of the segments logarithmic,
+   by merging the newest segments while they are of a similar size. */
+static void
+posting_index_merge_tail_locked (CamelPostingIndex *index)
+{
+	GPtrArray *segments = index->priv->segments;
+
+	while (segments->len >= 2) {
+		PostingSegment *last = segments->pdata[segments->len - 1];
+		PostingSegment *previous = segments->pdata[segments->len - 2];
+
+		if (segments->len <= MAX_SEGMENTS &&
+		    ((guint64) last->n_postings) * 2 < previous->n_postings)
+			break;
+
+		if (posting_index_merge_segments_locked (index, segments->len - 2, 2, NULL, 0) == -1) {
+			g_warning ("%s: Failed to merge segments of '%s': %s", G_STRFUNC, index->parent.path, g_strerror (errno));
+			break;
+		}
+	}
+}
+
+/* Call with the write lock held */
+static gint
+posting_index_flush_locked (CamelPostingIndex *index)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	PostingSegment *seg;
+	SegmentWriter *writer;
+	GHashTableIter iter;
+	GPtrArray *words;
+	gpointer key;
+	gchar *filename;
+	guint32 id;
+	guint ii;
+	gint ret = 0;
+
+	if (!g_hash_table_size (p->memory_words))
+		return 0;
+
+	id = p->next_segment_id++;
+	filename = posting_index_segment_filename (index->parent.path, id);
+
+	writer = segment_writer_new (filename);
+	if (!writer) {
+		g_free (filename);
+		return -1;
+	}
+
+	words = g_ptr_array_sized_new (g_hash_table_size (p->memory_words));
+
+	g_hash_table_iter_init (&iter, p->memory_words);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (words, key);
+	}
+
+	g_ptr_array_sort (words, compare_words_cb);
+
+	for (ii = 0; ii < words->len && ret == 0; ii++) {
+		const gchar *word = words->pdata[ii];
+		GArray *docids = g_hash_table_lookup (p->memory_words, word);
+
+		posting_docids_normalize (docids);
+
+		if (!segment_writer_add (writer, word, strlen (word), (const guint32 *) docids->data, docids->len))
+			ret = -1;
+	}
+
+	g_ptr_array_free (words, TRUE);
+
+	if (ret == 0)
+		ret = segment_writer_finish (writer, filename);
+	else
+		segment_writer_free (writer);
+
+	seg = ret == 0 ? posting_segment_open (filename, id) : NULL;
+
+	if (seg) {
+		g_ptr_array_add (p->segments, seg);
+		g_hash_table_remove_all (p->memory_words);
+		p->n_memory_postings = 0;
+		p->dirty = TRUE;
+
+		posting_index_merge_tail_locked (index);
+	} else {
+		/* keep the postings in memory, the next flush can succeed */
+		if (ret == 0)
+			ret = -1;
+
+		g_unlink (filename);
+	}
+
+	g_free (filename);
+
+	return ret;
+}
+
+/* Call with the write lock held. Rewrites the segments into one, without the deleted names. */
+static gint
+posting_index_compress_locked (CamelPostingIndex *index)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	GPtrArray *names;
+	guint32 *remap;
+	guint32 ii, n_names;
+	gint ret;
+
+	ret = posting_index_flush_locked (index);
+	if (ret == -1)
+		return ret;
+
+	n_names = p->names->len;
+	remap = g_new (guint32, MAX (n_names, 1));
+	names = g_ptr_array_new_with_free_func (g_free);
+
+	for (ii = 0; ii < n_names; ii++) {
+		if (p->names->pdata[ii]) {
+			remap[ii] = names->len;
+			g_ptr_array_add (names, p->names->pdata[ii]);
+		} else {
+			remap[ii] = NO_DOCID;
+		}
+	}
+
+	if (p->segments->len > 0)
+		ret = posting_index_merge_segments_locked (index, 0, p->segments->len, remap, n_names);
+
+	if (ret == 0) {
+		/* the strings moved to the new array */
+		for (ii = 0; ii < n_names; ii++) {
+			p->names->pdata[ii] = NULL;
+		}
+
+		g_ptr_array_unref (p->names);
+		p->names = names;
+
+		g_hash_table_remove_all (p->name_hash);
+		for (ii = 0; ii < names->len; ii++) {
+			g_hash_table_insert (p->name_hash, names->pdata[ii], GUINT_TO_POINTER (ii + 1));
+		}
+
+		p->n_deleted = 0;
+		p->generation++;
+		p->dirty = TRUE;
+	} else {
+		/* the strings are still owned by the old array */
+		for (ii = 0; ii < names->len; ii++) {
+			names->pdata[ii] = NULL;
+		}
+
+		g_ptr_array_unref (names);
+	}
+
+	g_free (remap);
+
+	return ret;
+}
+
+/* Call with the write lock held */
+static gint
+posting_index_sync_locked (CamelPostingIndex *index)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	gint ret;
+
+	if (p->read_only || !p->loaded)
+		return 0;
+
+	ret = posting_index_flush_locked (index);
+
+	if (ret == 0 && p->n_deleted > 0 &&
+	    ((guint64) p->n_deleted) * 100 / p->names->len > MAX_DELETED_PERCENT)
+		ret = posting_index_compress_locked (index);
+
+	if (ret == 0 && p->dirty)
+		ret = posting_index_write_manifest_locked (index);
+
+	return ret;
+}
+
+static void
+posting_index_dispose (GObject *object)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (object);
+
+	/* Only run this the first time. */
+	if (index->priv->loaded && (index->parent.state & CAMEL_INDEX_DELETED) == 0) {
+		g_rw_lock_writer_lock (&index->priv->lock);
+
+		if (posting_index_sync_locked (index) == -1)
+			g_warning ("%s: Failed to sync '%s': %s", G_STRFUNC, index->parent.path, g_strerror (errno));
+
+		index->priv->loaded = FALSE;
+
+		g_rw_lock_writer_unlock (&index->priv->lock);
+	}
+
+	/* Chain up to parent's dispose () method. */
+	G_OBJECT_CLASS (camel_posting_index_parent_class)->dispose (object);
+}
+
+static void
+posting_index_finalize (GObject *object)
+{
+	CamelPostingIndexPrivate *priv;
+
+	priv = CAMEL_POSTING_INDEX (object)->priv;
+
+	g_ptr_array_unref (priv->segments);
+	g_ptr_array_unref (priv->obsolete_files);
+	g_hash_table_destroy (priv->name_hash);
+	g_ptr_array_unref (priv->names);
+	g_hash_table_destroy (priv->memory_words);
+
+	g_rw_lock_clear (&priv->lock);
+
+	/* Chain up to parent's finalize () method. */
+	G_OBJECT_CLASS (camel_posting_index_parent_class)->finalize (object);
+}
+
+static gint
+posting_index_sync (CamelIndex *idx)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	gint ret;
+
+	g_rw_lock_writer_lock (&index->priv->lock);
+	ret = posting_index_sync_locked (index);
+	g_rw_lock_writer_unlock (&index->priv->lock);
+
+	return ret;
+}
+
+static gint
+posting_index_compress (CamelIndex *idx)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	gint ret = 0;
+
+	g_rw_lock_writer_lock (&index->priv->lock);
+
+	if (!index->priv->read_only) {
+		ret = posting_index_compress_locked (index);
+		if (ret == 0)
+			ret = posting_index_write_manifest_locked (index);
+	}
+
+	g_rw_lock_writer_unlock (&index->priv->lock);
+
+	return ret;
+}
+
+static gint
+posting_index_delete (CamelIndex *idx)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	gchar *base;
+	gint ret;
+
+	g_rw_lock_writer_lock (&index->priv->lock);
+
+	/* the mapped segments stay readable for the existing cursors */
+	base = g_strndup (idx->path, strlen (idx->path) - (g_str_has_suffix (idx->path, ".index") ? 6 : 0));
+	ret = camel_posting_index_remove (base);
+	g_free (base);
+
+	g_ptr_array_set_size (index->priv->obsolete_files, 0);
+	index->priv->loaded = FALSE;
+
+	g_rw_lock_writer_unlock (&index->priv->lock);
+
+	return ret;
+}
+
+static gint
+posting_index_rename (CamelIndex *idx,
+		      const gchar *path)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	gchar *old_base;
+	guint ii;
+	gint ret;
+
+	g_rw_lock_writer_lock (&index->priv->lock);
+
+	/* save the pending changes, to not lose track of the replaced segments */
+	if (!index->priv->read_only && index->priv->loaded && index->priv->dirty)
+		posting_index_write_manifest_locked (index);
+
+	old_base = g_strndup (idx->path, strlen (idx->path) - (g_str_has_suffix (idx->path, ".index") ? 6 : 0));
+
+	ret = camel_posting_index_rename (old_base, path);
+	if (ret == 0) {
+		g_free (idx->path);
+		idx->path = g_strdup_printf ("%s.index", path);
+
+		for (ii = 0; ii < index->priv->segments->len; ii++) {
+			PostingSegment *seg = index->priv->segments->pdata[ii];
+
+			g_free (seg->filename);
+			seg->filename = posting_index_segment_filename (idx->path, seg->id);
+		}
+	}
+
+	g_free (old_base);
+
+	g_rw_lock_writer_unlock (&index->priv->lock);
+
+	return ret;
+}
+
+static gint
+posting_index_has_name (CamelIndex *idx,
+			const gchar *name)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	gboolean has;
+
+	g_rw_lock_reader_lock (&index->priv->lock);
+	has = g_hash_table_contains (index->priv->name_hash, name);
+	g_rw_lock_reader_unlock (&index->priv->lock);
+
+	return has;
+}
+
+/* Call with the write lock held */
+static void
+posting_index_delete_name_locked (CamelPostingIndex *index,
+				  const gchar *name)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	guint32 docid;
+
+	docid = GPOINTER_TO_UINT (g_hash_table_lookup (p->name_hash, name));
+	if (docid) {
+		docid--;
+
+		/* the key is the string from the names array */
+		g_hash_table_remove (p->name_hash, name);
+		g_free (p->names->pdata[docid]);
+		p->names->pdata[docid] = NULL;
+		p->n_deleted++;
+		p->dirty = TRUE;
+	}
+}
+
+static CamelIndexName *
+posting_index_add_name (CamelIndex *idx,
+			const gchar *name)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	CamelPostingIndexPrivate *p = index->priv;
+	guint32 docid;
+	guint generation;
+	gchar *copy;
+
+	g_rw_lock_writer_lock (&p->lock);
+
+	/* If we have it already replace it */
+	posting_index_delete_name_locked (index, name);
+
+	docid = p->names->len;
+	copy = g_strdup (name);
+	g_ptr_array_add (p->names, copy);
+	g_hash_table_insert (p->name_hash, copy, GUINT_TO_POINTER (docid + 1));
+	generation = p->generation;
+	p->dirty = TRUE;
+
+	g_rw_lock_writer_unlock (&p->lock);
+
+	return (CamelIndexName *) camel_posting_index_name_new (index, name, docid, generation);
+}
+
+static gint
+posting_index_write_name (CamelIndex *idx,
+			  CamelIndexName *idn)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	CamelPostingIndexPrivate *p = index->priv;
+	CamelPostingIndexNamePrivate *np = CAMEL_POSTING_INDEX_NAME (idn)->priv;
+	GHashTableIter iter;
+	gpointer key;
+	guint32 docid;
+	gint ret = 0;
+
+	/* force 'flush' of any outstanding data */
+	camel_index_name_add_buffer (idn, NULL, 0);
+
+	g_rw_lock_writer_lock (&p->lock);
+
+	docid = np->docid;
+
+	/* the docids changed since the name had been added */
+	if (np->generation != p->generation) {
+		docid = GPOINTER_TO_UINT (g_hash_table_lookup (p->name_hash, idn->name));
+		docid = docid ? docid - 1 : NO_DOCID;
+	}
+
+	if (docid != NO_DOCID) {
+		g_hash_table_iter_init (&iter, idn->words);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			GArray *docids;
+
+			docids = g_hash_table_lookup (p->memory_words, key);
+			if (!docids) {
+				docids = g_array_new (FALSE, FALSE, sizeof (guint32));
+				g_hash_table_insert (p->memory_words, g_strdup (key), docids);
+			}
+
+			g_array_append_val (docids, docid);
+			p->n_memory_postings++;
+		}
+
+		if (p->n_memory_postings >= MAX_MEMORY_POSTINGS)
+			ret = posting_index_flush_locked (index);
+	}
+
+	g_rw_lock_writer_unlock (&p->lock);
+
+	return ret;
+}
+
+static CamelIndexCursor *
+posting_index_find_name (CamelIndex *idx,
+			 const gchar *name)
+{
+	/* not used by anything, as with the CamelTextIndex */
+	return NULL;
+}
+
+static void
+posting_index_delete_name (CamelIndex *idx,
+			   const gchar *name)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+
+	d (printf ("Delete name: %s\n", name));
+
+	g_rw_lock_writer_lock (&index->priv->lock);
+	posting_index_delete_name_locked (index, name);
+	g_rw_lock_writer_unlock (&index->priv->lock);
+}
+
+static CamelIndexCursor *
+posting_index_find (CamelIndex *idx,
+		    const gchar *word)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	CamelPostingIndexPrivate *p = index->priv;
+	GPtrArray *names;
+	GArray *docids, *memory_docids;
+	guint ii;
+
+	docids = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	g_rw_lock_reader_lock (&p->lock);
+
+	for (ii = 0; ii < p->segments->len; ii++) {
+		PostingSegment *seg = p->segments->pdata[ii];
+		PostingEntry entry;
+
+		if (posting_segment_find (seg, word, &entry))
+			posting_segment_decode (seg, &entry, docids);
+	}
+
+	memory_docids = g_hash_table_lookup (p->memory_words, word);
+	if (memory_docids)
+		g_array_append_vals (docids, memory_docids->data, memory_docids->len);
+
+	posting_docids_normalize (docids);
+
+	names = g_ptr_array_new_full (docids->len, g_free);
+
+	for (ii = 0; ii < docids->len; ii++) {
+		guint32 docid = g_array_index (docids, guint32, ii);
+
+		if (docid < p->names->len && p->names->pdata[docid])
+			g_ptr_array_add (names, g_strdup (p->names->pdata[docid]));
+	}
+
+	g_rw_lock_reader_unlock (&p->lock);
+
+	g_array_free (docids, TRUE);
+
+	return (CamelIndexCursor *) camel_posting_index_cursor_new (index, names);
+}
+
+static CamelIndexCursor *
+posting_index_words (CamelIndex *idx)
+{
+	CamelPostingIndex *index = CAMEL_POSTING_INDEX (idx);
+	CamelPostingIndexPrivate *p = index->priv;
+	GPtrArray *segments, *memory_words;
+	GHashTableIter iter;
+	gpointer key;
+	guint ii;
+
+	g_rw_lock_reader_lock (&p->lock);
+
+	segments = g_ptr_array_new_full (p->segments->len, posting_segment_unref);
+	for (ii = 0; ii < p->segments->len; ii++) {
+		g_ptr_array_add (segments, posting_segment_ref (p->segments->pdata[ii]));
+	}
+
+	memory_words = g_ptr_array_new_full (g_hash_table_size (p->memory_words), g_free);
+
+	g_hash_table_iter_init (&iter, p->memory_words);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_ptr_array_add (memory_words, g_strdup (key));
+	}
+
+	g_rw_lock_reader_unlock (&p->lock);
+
+	g_ptr_array_sort (memory_words, compare_words_cb);
+
+	return (CamelIndexCursor *) camel_posting_index_words_cursor_new (index, segments, memory_words);
+}
+
+static void
+camel_posting_index_class_init (CamelPostingIndexClass *class)
+{
+	GObjectClass *object_class;
+	CamelIndexClass *index_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->dispose = posting_index_dispose;
+	object_class->finalize = posting_index_finalize;
+
+	index_class = CAMEL_INDEX_CLASS (class);
+	index_class->sync = posting_index_sync;
+	index_class->compress = posting_index_compress;
+	index_class->delete_ = posting_index_delete;
+	index_class->rename = posting_index_rename;
+	index_class->has_name = posting_index_has_name;
+	index_class->add_name = posting_index_add_name;
+	index_class->write_name = posting_index_write_name;
+	index_class->find_name = posting_index_find_name;
+	index_class->delete_name = posting_index_delete_name;
+	index_class->find = posting_index_find;
+	index_class->words = posting_index_words;
+}
+
+static void
+camel_posting_index_init (CamelPostingIndex *index)
+{
+	index->priv = camel_posting_index_get_instance_private (index);
+
+	g_rw_lock_init (&index->priv->lock);
+
+	index->priv->segments = g_ptr_array_new_with_free_func (posting_segment_unref);
+	index->priv->obsolete_files = g_ptr_array_new_with_free_func (g_free);
+	index->priv->names = g_ptr_array_new_with_free_func (g_free);
+	index->priv->name_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	index->priv->memory_words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, posting_index_memory_words_free);
+}
+
+static gchar *
+posting_index_normalize (CamelIndex *idx,
+			 const gchar *in,
+			 gpointer data)
+{
+	return g_utf8_strdown (in, -1);
+}
+
+/* Calls 'func' for each file of the index at 'path' (as passed to camel_posting_index_new()),
+   with the file name and the suffix after the common prefix */
+static gint
+posting_index_foreach_file (const gchar *path,
+			    gint (*func) (const gchar *filename, const gchar *suffix, gpointer user_data),
+			    gpointer user_data)
+{
+	GDir *dir;
+	gchar *dirname, *basename, *prefix;
+	const gchar *name;
+	gsize prefix_len;
+	gint ret = 0;
+
+	dirname = g_path_get_dirname (path);
+	basename = g_path_get_basename (path);
+	prefix = g_strconcat (basename, ".index.pidx", NULL);
+	prefix_len = strlen (prefix);
+
+	dir = g_dir_open (dirname, 0, NULL);
+	if (dir) {
+		GPtrArray *names = g_ptr_array_new_with_free_func (g_free);
+		guint ii;
+
+		/* do not modify the directory while reading it */
+		while ((name = g_dir_read_name (dir))) {
+			if (strncmp (name, prefix, prefix_len) == 0 &&
+			    (!name[prefix_len] || name[prefix_len] == '.' || name[prefix_len] == '~'))
+				g_ptr_array_add (names, g_strdup (name));
+		}
+
+		g_dir_close (dir);
+
+		for (ii = 0; ii < names->len; ii++) {
+			gchar *filename;
+
+			name = names->pdata[ii];
+			filename = g_build_filename (dirname, name, NULL);
+
+			if (func (filename, name + prefix_len, user_data) == -1)
+				ret = -1;
+
+			g_free (filename);
+		}
+
+		g_ptr_array_unref (names);
+	}
+
+	g_free (dirname);
+	g_free (basename);
+	g_free (prefix);
+
+	return ret;
+}
+
+static gint
+posting_index_remove_file_cb (const gchar *filename,
+			      const gchar *suffix,
+			      gpointer user_data)
+{
+	GHashTable *keep_ids = user_data;
+
+	/* remove only the orphaned segments and the temporary files */
+	if (keep_ids) {
+		guint64 id;
+		gchar *endptr = NULL;
+
+		if (!*suffix)
+			return 0;
+
+		if (*suffix == '.') {
+			id = g_ascii_strtoull (suffix + 1, &endptr, 10);
+			if (endptr && !*endptr && g_hash_table_contains (keep_ids, GUINT_TO_POINTER ((guint32) id)))
+				return 0;
+		}
+	}
+
+	if (g_unlink (filename) == -1 && errno != ENOENT && errno != ENOTDIR)
+		return -1;
+
+	return 0;
+}
+
+static gboolean
+posting_index_load (CamelPostingIndex *index,
+		    gint flags)
+{
+	CamelPostingIndexPrivate *p = index->priv;
+	GPtrArray *segment_ids = NULL;
+	guint ii;
+
+	p->read_only = (flags & O_ACCMODE) == O_RDONLY;
+
+	if ((flags & O_TRUNC) != 0 && !p->read_only) {
+		gchar *base = g_strndup (index->parent.path, strlen (index->parent.path) - 6);
+
+		camel_posting_index_remove (base);
+
+		g_free (base);
+	}
+
+	if (!posting_index_read_manifest (index, &segment_ids)) {
+		if (segment_ids)
+			g_ptr_array_unref (segment_ids);
+
+		if (errno != ENOENT || (flags & O_CREAT) == 0 || p->read_only)
+			return FALSE;
+
+		/* a new index */
+		g_ptr_array_set_size (p->names, 0);
+		g_hash_table_remove_all (p->name_hash);
+		p->n_deleted = 0;
+		p->next_segment_id = 0;
+		p->dirty = TRUE;
+		p->loaded = TRUE;
+
+		return TRUE;
+	}
+
+	for (ii = 0; ii < segment_ids->len; ii++) {
+		guint32 id = GPOINTER_TO_UINT (segment_ids->pdata[ii]);
+		PostingSegment *seg;
+		gchar *filename;
+
+		filename = posting_index_segment_filename (index->parent.path, id);
+		seg = posting_segment_open (filename, id);
+		g_free (filename);
+
+		if (!seg) {
+			g_ptr_array_unref (segment_ids);
+			return FALSE;
+		}
+
+		g_ptr_array_add (p->segments, seg);
+	}
+
+	if (!p->read_only) {
+		GHashTable *keep_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+		gchar *base;
+
+		for (ii = 0; ii < segment_ids->len; ii++) {
+			g_hash_table_add (keep_ids, segment_ids->pdata[ii]);
+		}
+
+		/* leftovers of an interrupted flush or merge */
+		base = g_strndup (index->parent.path, strlen (index->parent.path) - 6);
+		posting_index_foreach_file (base, posting_index_remove_file_cb, keep_ids);
+		g_free (base);
+
+		g_hash_table_destroy (keep_ids);
+	}
+
+	g_ptr_array_unref (segment_ids);
+
+	p->loaded = TRUE;
+
+	return TRUE;
+}
+
+/**
+ * camel_posting_index_new:
+ * @path: base path of the index files
+ * @flags: open flags, like O_RDWR, O_CREAT and O_TRUNC
+ *
+ * Opens or creates a word index at @path. The index stores compressed sorted
+ * lists of the names for each word in immutable segment files, which are
+ * merged as they grow, thus it does not need to be compressed as a whole.
+ *
+ * Returns: (transfer full) (nullable): a new #CamelPostingIndex, or %NULL
+ *    on error, with errno set
+ *
+ * Since: 3.40
+ **/
+CamelPostingIndex *
+camel_posting_index_new (const gchar *path,
+			 gint flags)
+{
+	CamelPostingIndex *idx;
+
+	g_return_val_if_fail (path != NULL, NULL);
+
+	idx = g_object_new (CAMEL_TYPE_POSTING_INDEX, NULL);
+
+	camel_index_construct ((CamelIndex *) idx, path, flags);
+	camel_index_set_normalize ((CamelIndex *) idx, posting_index_normalize, NULL);
+
+	if (!posting_index_load (idx, flags)) {
+		gint err = errno;
+
+		g_object_unref (idx);
+		errno = err;
+
+		return NULL;
+	}
+
+	return idx;
+}
+
+/**
+ * camel_posting_index_check:
+ * @path: base path of the index files
+ *
+ * Returns: 0 if the index exists, is valid, and synced, -1 otherwise
+ *
+ * Since: 3.40
+ **/
+gint
+camel_posting_index_check (const gchar *path)
+{
+	CamelPostingIndex *idx;
+
+	g_return_val_if_fail (path != NULL, -1);
+
+	idx = camel_posting_index_new (path, O_RDONLY);
+	if (!idx)
+		return -1;
+
+	g_object_unref (idx);
+
+	return 0;
+}
+
+typedef struct _RenameData {
+	const gchar *new_prefix;
+	GSList *renamed; /* gchar *, pairs of the new and the old file name */
+} RenameData;
+
+static gint
+posting_index_rename_file_cb (const gchar *filename,
+			      const gchar *suffix,
+			      gpointer user_data)
+{
+	RenameData *rd = user_data;
+	gchar *new_filename;
+
+	new_filename = g_strconcat (rd->new_prefix, suffix, NULL);
+
+	if (g_rename (filename, new_filename) == -1) {
+		g_free (new_filename);
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	rd->renamed = g_slist_prepend (rd->renamed, g_strdup (filename));
+	rd->renamed = g_slist_prepend (rd->renamed, new_filename);
+
+	return 0;
+}
+
+/**
+ * camel_posting_index_rename:
+ * @old: base path of the existing index files
+ * @new_: new base path for the index files
+ *
+ * Renames files of the index at @old to be at @new_.
+ *
+ * Returns: 0 on success, -1 on error, with errno set
+ *
+ * Since: 3.40
+ **/
+gint
+camel_posting_index_rename (const gchar *old,
+			    const gchar *new_)
+{
+	RenameData rd;
+	gchar *new_prefix;
+	gint ret;
+
+	g_return_val_if_fail (old != NULL, -1);
+	g_return_val_if_fail (new_ != NULL, -1);
+
+	new_prefix = g_strconcat (new_, ".index.pidx", NULL);
+
+	rd.new_prefix = new_prefix;
+	rd.renamed = NULL;
+
+	ret = posting_index_foreach_file (old, posting_index_rename_file_cb, &rd);
+
+	if (ret == 0) {
+		gchar *old_filename, *new_filename;
+
+		/* Bloom filters of the names, see camel_index_may_match() */
+		old_filename = g_strconcat (old, ".index.bloom", NULL);
+		new_filename = g_strconcat (new_, ".index.bloom", NULL);
+
+		if (g_rename (old_filename, new_filename) == -1 && errno != ENOENT)
+			g_unlink (old_filename);
+
+		g_free (old_filename);
+		g_free (new_filename);
+	}
+
+	if (ret == -1) {
+		gint err = errno;
+		GSList *link;
+
+		/* move back what had been renamed already */
+		for (link = rd.renamed; link && link->next; link = link->next->next) {
+			if (g_rename (link->data, link->next->data) == -1) {
+				g_warning (
+					"%s: Failed to rename '%s' to '%s': %s",
+					G_STRFUNC, (gchar *) link->data, (gchar *) link->next->data, g_strerror (errno));
+			}
+		}
+
+		errno = err;
+	}
+
+	g_slist_free_full (rd.renamed, g_free);
+	g_free (new_prefix);
+
+	return ret;
+}
+
+/**
+ * camel_posting_index_remove:
+ * @old: base path of the index files
+ *
+ * Removes all files of the index at @old.
+ *
+ * Returns: 0 on success, -1 on error, with errno set
+ *
+ * Since: 3.40
+ **/
+gint
+camel_posting_index_remove (const gchar *old)
+{
+	gint ret;
+
+	g_return_val_if_fail (old != NULL, -1);
+
+	ret = posting_index_foreach_file (old, posting_index_remove_file_cb, NULL);
+
+	if (ret == 0) {
+		gchar *filename;
+
+		/* Bloom filters of the names, see camel_index_may_match() */
+		filename = g_strconcat (old, ".index.bloom", NULL);
+		if (g_unlink (filename) == -1 && errno != ENOENT && errno != ENOTDIR)
+			ret = -1;
+		g_free (filename);
+	}
+
+	if (ret == 0)
+		errno = 0;
+
+	return ret;
+}
+
+/**
+ * camel_posting_index_info:
+ * @idx: a #CamelPostingIndex
+ *
+ * Prints statistics of the @idx to the standard output.
+ *
+ * Since: 3.40
+ **/
+void
+camel_posting_index_info (CamelPostingIndex *idx)
+{
+	CamelPostingIndexPrivate *p;
+	guint64 total_size = 0, total_postings = 0;
+	guint ii;
+
+	g_return_if_fail (CAMEL_IS_POSTING_INDEX (idx));
+
+	p = idx->priv;
+
+	g_rw_lock_reader_lock (&p->lock);
+
+	printf ("Path: '%s'\n", idx->parent.path);
+	printf ("Version: %u\n", CAMEL_POSTING_INDEX_VERSION);
+	printf ("Flags: %08x\n", idx->parent.flags);
+	printf ("Total names: %u\n", p->names->len);
+	printf ("Total deleted: %u\n", p->n_deleted);
+	printf ("Segments: %u\n", p->segments->len);
+
+	for (ii = 0; ii < p->segments->len; ii++) {
+		PostingSegment *seg = p->segments->pdata[ii];
+
+		printf ("  %u: %u words, %u postings, %" G_GSIZE_FORMAT " bytes\n", seg->id, seg->n_words, seg->n_postings, seg->size);
+
+		total_size += seg->size;
+		total_postings += seg->n_postings;
+	}
+
+	printf ("Total postings: %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " bytes\n", total_postings, total_size);
+	printf ("Postings in memory: %u\n", p->n_memory_postings);
+
+	if (p->names->len > 0)
+		printf ("Name fragmentation: %d%%\n", (gint) (((guint64) p->n_deleted) * 100 / p->names->len));
+
+	g_rw_lock_reader_unlock (&p->lock);
+}
+
+/* ********************************************************************** */
+/* CamelPostingIndexName */
+/* ********************************************************************** */
+
+G_DEFINE_TYPE_WITH_PRIVATE (CamelPostingIndexName, camel_posting_index_name, CAMEL_TYPE_INDEX_NAME)
+
+static void
+posting_index_name_finalize (GObject *object)
+{
+	CamelPostingIndexName *idn = CAMEL_POSTING_INDEX_NAME (object);
+
+	g_hash_table_destroy (idn->parent.words);
+	g_string_free (idn->priv->buffer, TRUE);
+	g_free (idn->parent.name);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (camel_posting_index_name_parent_class)->finalize (object);
+}
+
+static void
+posting_index_name_add_word (CamelIndexName *idn,
+			     const gchar *word)
+{
+	if (!g_hash_table_contains (idn->words, word))
+		g_hash_table_add (idn->words, g_strdup (word));
+}
+
+/* Doesn't hang/loop forever on bad data, skips invalid sequences */
+static inline guint32
+posting_index_utf8_next (const guchar **ptr,
+			 const guchar *ptrend)
+{
+	const guchar *p = *ptr;
+	guint c;
+	guint32 v;
+	gint l;
+
+	while (p < ptrend) {
+		c = *p++;
+
+		if (c < 0x80) {
+			*ptr = p;
+			return c;
+		} else if ((c & 0xe0) == 0xc0) {
+			v = c & 0x1f;
+			l = 1;
+		} else if ((c & 0xf0) == 0xe0) {
+			v = c & 0x0f;
+			l = 2;
+		} else if ((c & 0xf8) == 0xf0) {
+			v = c & 0x07;
+			l = 3;
+		} else {
+			/* invalid, look for the next start character */
+			continue;
+		}
+
+		/* truncated buffer */
+		if (p + l > ptrend)
+			break;
+
+		while (l && ((c = *p) & 0xc0) == 0x80) {
+			p++;
+			l--;
+			v = (v << 6) | (c & 0x3f);
+		}
+
+		if (l == 0) {
+			*ptr = p;
+			return v;
+		}
+
+		/* else look for a start character again */
+	}
+
+	*ptr = ptrend;
+
+	return 0;
+}
+
+static gsize
+posting_index_name_add_buffer (CamelIndexName *idn,
+			       const gchar *buffer,
+			       gsize len)
+{
+	CamelPostingIndexNamePrivate *p = CAMEL_POSTING_INDEX_NAME (idn)->priv;
+	const guchar *ptr, *ptrend;
+	guint32 c;
+	gchar utf8[8];
+	gint utf8len;
+
+	if (buffer == NULL) {
+		if (p->buffer->len > 0 && p->buffer->len <= CAMEL_POSTING_INDEX_MAX_WORDLEN)
+			posting_index_name_add_word (idn, p->buffer->str);
+
+		g_string_truncate (p->buffer, 0);
+
+		return 0;
+	}
+
+	ptr = (const guchar *) buffer;
+	ptrend = (const guchar *) buffer + len;
+	while (ptr < ptrend) {
+		c = posting_index_utf8_next (&ptr, ptrend);
+
+		if (c && g_unichar_isalnum (c)) {
+			c = g_unichar_tolower (c);
+			utf8len = g_unichar_to_utf8 (c, utf8);
+			utf8[utf8len] = 0;
+			g_string_append_len (p->buffer, utf8, utf8len);
+		} else {
+			if (p->buffer->len > 0 && p->buffer->len <= CAMEL_POSTING_INDEX_MAX_WORDLEN)
+				posting_index_name_add_word (idn, p->buffer->str);
+
+			g_string_truncate (p->buffer, 0);
+		}
+	}
+
+	return 0;
+}
+
+static void
+camel_posting_index_name_class_init (CamelPostingIndexNameClass *class)
+{
+	GObjectClass *object_class;
+	CamelIndexNameClass *index_name_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = posting_index_name_finalize;
+
+	index_name_class = CAMEL_INDEX_NAME_CLASS (class);
+	index_name_class->add_word = posting_index_name_add_word;
+	index_name_class->add_buffer = posting_index_name_add_buffer;
+}
+
+static void
+camel_posting_index_name_init (CamelPostingIndexName *posting_index_name)
+{
+	posting_index_name->priv = camel_posting_index_name_get_instance_private (posting_index_name);
+
+	posting_index_name->parent.words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	posting_index_name->priv->buffer = g_string_new ("");
+}
+
+static CamelPostingIndexName *
+camel_posting_index_name_new (CamelPostingIndex *idx,
+			      const gchar *name,
+			      guint32 docid,
+			      guint generation)
+{
+	CamelPostingIndexName *idn = g_object_new (CAMEL_TYPE_POSTING_INDEX_NAME, NULL);
+
+	idn->parent.index = g_object_ref (idx);
+	idn->parent.name = g_strdup (name);
+	idn->priv->docid = docid;
+	idn->priv->generation = generation;
+
+	return idn;
+}
+
+/* ********************************************************************** */
+/* CamelPostingIndexCursor */
+/* ********************************************************************** */
+
+G_DEFINE_TYPE_WITH_PRIVATE (CamelPostingIndexCursor, camel_posting_index_cursor, CAMEL_TYPE_INDEX_CURSOR)
+
+static void
+posting_index_cursor_finalize (GObject *object)
+{
+	CamelPostingIndexCursorPrivate *priv;
+
+	priv = CAMEL_POSTING_INDEX_CURSOR (object)->priv;
+
+	g_ptr_array_unref (priv->names);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (camel_posting_index_cursor_parent_class)->finalize (object);
+}
+
+static const gchar *
+posting_index_cursor_next (CamelIndexCursor *idc)
+{
+	CamelPostingIndexCursorPrivate *p = CAMEL_POSTING_INDEX_CURSOR (idc)->priv;
+
+	if (p->index >= p->names->len)
+		return NULL;
+
+	return p->names->pdata[p->index++];
+}
+
+static void
+camel_posting_index_cursor_class_init (CamelPostingIndexCursorClass *class)
+{
+	GObjectClass *object_class;
+	CamelIndexCursorClass *index_cursor_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = posting_index_cursor_finalize;
+
+	index_cursor_class = CAMEL_INDEX_CURSOR_CLASS (class);
+	index_cursor_class->next = posting_index_cursor_next;
+}
+
+static void
+camel_posting_index_cursor_init (CamelPostingIndexCursor *posting_index_cursor)
+{
+	posting_index_cursor->priv = camel_posting_index_cursor_get_instance_private (posting_index_cursor);
+}
+
+/* Takes ownership of the 'names' */
+static CamelPostingIndexCursor *
+camel_posting_index_cursor_new (CamelPostingIndex *idx,
+				GPtrArray *names)
+{
+	CamelPostingIndexCursor *idc = g_object_new (CAMEL_TYPE_POSTING_INDEX_CURSOR, NULL);
+
+	idc->parent.index = g_object_ref (idx);
+	idc->priv->names = names;
+	idc->priv->index = 0;
+
+	return idc;
+}
+
+/* ********************************************************************** */
+/* CamelPostingIndexWordsCursor */
+/* ********************************************************************** */
+
+G_DEFINE_TYPE_WITH_PRIVATE (CamelPostingIndexWordsCursor, camel_posting_index_words_cursor, CAMEL_TYPE_INDEX_CURSOR)
+
+static void
+posting_index_words_cursor_finalize (GObject *object)
+{
+	CamelPostingIndexWordsCursorPrivate *priv;
+
+	priv = CAMEL_POSTING_INDEX_WORDS_CURSOR (object)->priv;
+
+	g_ptr_array_unref (priv->segments);
+	g_ptr_array_unref (priv->memory_words);
+	g_free (priv->positions);
+	g_free (priv->current);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (camel_posting_index_words_cursor_parent_class)->finalize (object);
+}
+
+/* Merges the sorted words of all the segments and of the memory, without duplicates */
+static const gchar *
+posting_index_words_cursor_next (CamelIndexCursor *idc)
+{
+	CamelPostingIndexWordsCursorPrivate *p = CAMEL_POSTING_INDEX_WORDS_CURSOR (idc)->priv;
+	PostingEntry entry, min_entry = { 0 };
+	const gchar *min_word = NULL;
+	gsize min_len = 0;
+	guint ii;
+
+	for (ii = 0; ii < p->segments->len; ii++) {
+		PostingSegment *seg = p->segments->pdata[ii];
+
+		if (p->positions[ii] < seg->n_words &&
+		    posting_segment_read_entry (seg, p->positions[ii], &entry) &&
+		    (!min_word || posting_entry_compare (&entry, min_word, min_len) < 0)) {
+			min_entry = entry;
+			min_word = entry.word;
+			min_len = entry.word_len;
+		}
+	}
+
+	if (p->memory_position < p->memory_words->len) {
+		const gchar *word = p->memory_words->pdata[p->memory_position];
+
+		if (!min_word || posting_entry_compare (&min_entry, word, strlen (word)) > 0) {
+			min_word = word;
+			min_len = strlen (word);
+		}
+	}
+
+	g_free (p->current);
+	p->current = NULL;
+
+	if (!min_word)
+		return NULL;
+
+	p->current = g_strndup (min_word, min_len);
+
+	/* skip the same word in all the sources */
+	for (ii = 0; ii < p->segments->len; ii++) {
+		PostingSegment *seg = p->segments->pdata[ii];
+
+		if (p->positions[ii] < seg->n_words) {
+			if (!posting_segment_read_entry (seg, p->positions[ii], &entry)) {
+				/* corrupt segment, stop reading it */
+				p->positions[ii] = seg->n_words;
+			} else if (posting_entry_compare (&entry, p->current, min_len) == 0) {
+				p->positions[ii]++;
+			}
+		}
+	}
+
+	if (p->memory_position < p->memory_words->len &&
+	    strcmp (p->memory_words->pdata[p->memory_position], p->current) == 0)
+		p->memory_position++;
+
+	return p->current;
+}
+
+static void
+camel_posting_index_words_cursor_class_init (CamelPostingIndexWordsCursorClass *class)
+{
+	GObjectClass *object_class;
+	CamelIndexCursorClass *index_cursor_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = posting_index_words_cursor_finalize;
+
+	index_cursor_class = CAMEL_INDEX_CURSOR_CLASS (class);
+	index_cursor_class->next = posting_index_words_cursor_next;
+}
+
+static void
+camel_posting_index_words_cursor_init (CamelPostingIndexWordsCursor *posting_index_words_cursor)
+{
+	posting_index_words_cursor->priv = camel_posting_index_words_cursor_get_instance_private (posting_index_words_cursor);
+}
+
+/* Takes ownership of the 'segments' and the 'memory_words' */
+static CamelPostingIndexWordsCursor *
+camel_posting_index_words_cursor_new (CamelPostingIndex *idx,
+				      GPtrArray *segments,
+				      GPtrArray *memory_words)
+{
+	CamelPostingIndexWordsCursor *idc = g_object_new (CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR, NULL);
+
+	idc->parent.index = g_object_ref (idx);
+	idc->priv->segments = segments;
+	idc->priv->positions = g_new0 (guint32, MAX (segments->len, 1));
+	idc->priv->memory_words = memory_words;
+	idc->priv->memory_position = 0;
+
+	return idc;
+}
@@ -0,0 +1,213 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined (__CAMEL_H_INSIDE__) && !defined (CAMEL_COMPILATION)
+#error "Only <camel/camel.h> can be included directly."
+#endif
+
+#ifndef CAMEL_POSTING_INDEX_H
+#define CAMEL_POSTING_INDEX_H
+
+#include <camel/camel-index.h>
+
+/* Standard GObject macros */
+#define CAMEL_TYPE_POSTING_INDEX \
+	(camel_posting_index_get_type ())
+#define CAMEL_POSTING_INDEX(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), CAMEL_TYPE_POSTING_INDEX, CamelPostingIndex))
+#define CAMEL_POSTING_INDEX_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), CAMEL_TYPE_POSTING_INDEX, CamelPostingIndexClass))
+#define CAMEL_IS_POSTING_INDEX(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), CAMEL_TYPE_POSTING_INDEX))
+#define CAMEL_IS_POSTING_INDEX_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), CAMEL_TYPE_POSTING_INDEX))
+#define CAMEL_POSTING_INDEX_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), CAMEL_TYPE_POSTING_INDEX, CamelPostingIndexClass))
+
+#define CAMEL_TYPE_POSTING_INDEX_NAME \
+	(camel_posting_index_name_get_type ())
+#define CAMEL_POSTING_INDEX_NAME(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), CAMEL_TYPE_POSTING_INDEX_NAME, CamelPostingIndexName))
+#define CAMEL_POSTING_INDEX_NAME_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), CAMEL_TYPE_POSTING_INDEX_NAME, CamelPostingIndexNameClass))
+#define CAMEL_IS_POSTING_INDEX_NAME(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), CAMEL_TYPE_POSTING_INDEX_NAME))
+#define CAMEL_IS_POSTING_INDEX_NAME_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), CAMEL_TYPE_POSTING_INDEX_NAME))
+#define CAMEL_POSTING_INDEX_NAME_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), CAMEL_TYPE_POSTING_INDEX_NAME, CamelPostingIndexNameClass))
+
+#define CAMEL_TYPE_POSTING_INDEX_CURSOR \
+	(camel_posting_index_cursor_get_type ())
+#define CAMEL_POSTING_INDEX_CURSOR(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), CAMEL_TYPE_POSTING_INDEX_CURSOR, CamelPostingIndexCursor))
+#define CAMEL_POSTING_INDEX_CURSOR_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), CAMEL_TYPE_POSTING_INDEX_CURSOR, CamelPostingIndexCursorClass))
+#define CAMEL_IS_POSTING_INDEX_CURSOR(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), CAMEL_TYPE_POSTING_INDEX_CURSOR))
+#define CAMEL_IS_POSTING_INDEX_CURSOR_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), CAMEL_TYPE_POSTING_INDEX_CURSOR))
+#define CAMEL_POSTING_INDEX_CURSOR_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), CAMEL_TYPE_POSTING_INDEX_CURSOR, CamelPostingIndexCursorClass))
+
+#define CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR \
+	(camel_posting_index_words_cursor_get_type ())
+#define CAMEL_POSTING_INDEX_WORDS_CURSOR(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR, CamelPostingIndexWordsCursor))
+#define CAMEL_POSTING_INDEX_WORDS_CURSOR_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR, CamelPostingIndexWordsCursorClass))
+#define CAMEL_IS_POSTING_INDEX_WORDS_CURSOR(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR))
+#define CAMEL_IS_POSTING_INDEX_WORDS_CURSOR_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR))
+#define CAMEL_POSTING_INDEX_WORDS_CURSOR_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), CAMEL_TYPE_POSTING_INDEX_WORDS_CURSOR, CamelPostingIndexWordsCursorClass))
+
+G_BEGIN_DECLS
+
+typedef struct _CamelPostingIndex CamelPostingIndex;
+typedef struct _CamelPostingIndexClass CamelPostingIndexClass;
+typedef struct _CamelPostingIndexPrivate CamelPostingIndexPrivate;
+
+typedef struct _CamelPostingIndexName CamelPostingIndexName;
+typedef struct _CamelPostingIndexNameClass CamelPostingIndexNameClass;
+typedef struct _CamelPostingIndexNamePrivate CamelPostingIndexNamePrivate;
+
+typedef struct _CamelPostingIndexCursor CamelPostingIndexCursor;
+typedef struct _CamelPostingIndexCursorClass CamelPostingIndexCursorClass;
+typedef struct _CamelPostingIndexCursorPrivate CamelPostingIndexCursorPrivate;
+
+typedef struct _CamelPostingIndexWordsCursor CamelPostingIndexWordsCursor;
+typedef struct _CamelPostingIndexWordsCursorClass CamelPostingIndexWordsCursorClass;
+typedef struct _CamelPostingIndexWordsCursorPrivate CamelPostingIndexWordsCursorPrivate;
+
+/* ********************************************************************** */
+
+/**
+ * CamelPostingIndexCursor:
+ *
+ * Since: 3.40
+ **/
+struct _CamelPostingIndexCursor {
+	CamelIndexCursor parent;
+	CamelPostingIndexCursorPrivate *priv;
+};
+
+struct _CamelPostingIndexCursorClass {
+	CamelIndexCursorClass parent_class;
+
+	/* Padding for future expansion */
+	gpointer reserved[20];
+};
+
+GType camel_posting_index_cursor_get_type (void);
+
+/* ********************************************************************** */
+
+/**
+ * CamelPostingIndexWordsCursor:
+ *
+ * Since: 3.40
+ **/
+struct _CamelPostingIndexWordsCursor {
+	CamelIndexCursor parent;
+	CamelPostingIndexWordsCursorPrivate *priv;
+};
+
+struct _CamelPostingIndexWordsCursorClass {
+	CamelIndexCursorClass parent_class;
+
+	/* Padding for future expansion */
+	gpointer reserved[20];
+};
+
+GType camel_posting_index_words_cursor_get_type (void);
+
+/* ********************************************************************** */
+
+/**
+ * CamelPostingIndexName:
+ *
+ * Since: 3.40
+ **/
+struct _CamelPostingIndexName {
+	CamelIndexName parent;
+	CamelPostingIndexNamePrivate *priv;
+};
+
+struct _CamelPostingIndexNameClass {
+	CamelIndexNameClass parent_class;
+
+	/* Padding for future expansion */
+	gpointer reserved[20];
+};
+
+GType camel_posting_index_name_get_type (void);
+
+/* ********************************************************************** */
+
+/**
+ * CamelPostingIndex:
+ *
+ * Since: 3.40
+ **/
+struct _CamelPostingIndex {
+	CamelIndex parent;
+	CamelPostingIndexPrivate *priv;
+};
+
+struct _CamelPostingIndexClass {
+	CamelIndexClass parent_class;
+
+	/* Padding for future expansion */
+	gpointer reserved[20];
+};
+
+GType		camel_posting_index_get_type	(void);
+CamelPostingIndex *
+		camel_posting_index_new		(const gchar *path,
+						 gint flags);
+
+/* static utility functions */
+gint		camel_posting_index_check	(const gchar *path);
+gint		camel_posting_index_rename	(const gchar *old,
+						 const gchar *new_);
+gint		camel_posting_index_remove	(const gchar *old);
+
+void		camel_posting_index_info	(CamelPostingIndex *idx);
+
+G_END_DECLS
+
+#endif /* CAMEL_POSTING_INDEX_H */
@@ -30,6 +30,11 @@
 
 #include <glib/gi18n-lib.h>
 
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define SEARCH_NEEDLE_SIMD 1
+#include <immintrin.h>
+#endif
+
 #include "camel-mime-message.h"
 #include "camel-multipart.h"
 #include "camel-search-private.h"
@@ -198,63 +203,322 @@ header_soundex (const gchar *header,
 	return truth;
 }
 
-const gchar *
-camel_ustrstrcase (const gchar *haystack,
-                   const gchar *needle)
+/* A pre-folded needle for the case-insensitive substring search. The haystack
+ * is scanned for the bytes which can start a match, 32 or 16 bytes at a time
+ * when the CPU has the AVX2 or the SSE2, and only these candidates are verified. ASCII spans
+ * are compared byte by byte, the full Unicode folding is done only when
+ * the haystack has a non-ASCII character at the compared position. */
+struct _CamelSearchNeedle {
+	gunichar *uni;		/* folded characters of the needle */
+	gint n_uni;
+	gboolean ascii;		/* all folded characters are ASCII */
+	guchar first_lower;	/* the first character, when it's ASCII; 0 otherwise */
+	guchar first_upper;
+};
+
+/**
+ * camel_search_needle_new: (skip)
+ * @needle: a UTF-8 string to search for
+ *
+ * Prepares the @needle for repeated case-insensitive searches
+ * with camel_search_needle_find().
+ *
+ * Returns: (transfer full): a new #CamelSearchNeedle. Free it
+ *    with camel_search_needle_free(), when no longer needed.
+ **/
+CamelSearchNeedle *
+camel_search_needle_new (const gchar *needle)
 {
-	gunichar *nuni, *puni;
-	gunichar u;
+	CamelSearchNeedle *sn;
 	const guchar *p;
+	gunichar u;
+	gsize len;
 
-	g_return_val_if_fail (haystack != NULL, NULL);
 	g_return_val_if_fail (needle != NULL, NULL);
 
-	if (strlen (needle) == 0)
-		return haystack;
-	if (strlen (haystack) == 0)
-		return NULL;
+	len = strlen (needle);
 
-	puni = nuni = g_alloca (sizeof (gunichar) * (strlen (needle) + 1));
-	nuni[0] = 0;
+	/* One allocation for the structure and the characters */
+	sn = g_malloc0 (sizeof (CamelSearchNeedle) + sizeof (gunichar) * (len + 1));
+	sn->uni = (gunichar *) (sn + 1);
+	sn->ascii = TRUE;
 
 	p = (const guchar *) needle;
-	while ((u = camel_utf8_getc (&p)))
-		*puni++ = g_unichar_tolower (u);
+	while ((u = camel_utf8_getc (&p))) {
+		u = g_unichar_tolower (u);
 
-	/* NULL means there was illegal utf-8 sequence. */
-	if (!p)
-		return NULL;
+		if (u >= 0x80)
+			sn->ascii = FALSE;
 
-	p = (const guchar *) haystack;
-	while ((u = camel_utf8_getc (&p))) {
-		gunichar c;
+		sn->uni[sn->n_uni++] = u;
+	}
+
+	if (sn->n_uni > 0 && sn->uni[0] < 0x80) {
+		sn->first_lower = g_ascii_tolower (sn->uni[0]);
+		sn->first_upper = g_ascii_toupper (sn->uni[0]);
+	}
+
+	return sn;
+}
 
-		c = g_unichar_tolower (u);
-		/* We have valid stripped gchar. */
-		if (c == nuni[0]) {
-			const guchar *q = p;
-			gint npos = 1;
+/**
+ * camel_search_needle_free: (skip)
+ * @needle: (nullable): a #CamelSearchNeedle
+ *
+ * Frees the @needle, previously created with camel_search_needle_new().
+ **/
+void
+camel_search_needle_free (CamelSearchNeedle *needle)
+{
+	g_free (needle);
+}
 
-			while (nuni + npos < puni) {
-				u = camel_utf8_getc (&q);
-				if (!q || !u)
-					return NULL;
+/* Compares the needle with the haystack at the 'pos', which is at a character start */
+static gboolean
+search_needle_matches_at (const CamelSearchNeedle *sn,
+			  const guchar *pos,
+			  const guchar **out_end)
+{
+	const guchar *q = pos;
+	gint ii;
 
-				c = g_unichar_tolower (u);
-				if (c != nuni[npos])
-					break;
+	if (sn->ascii) {
+		for (ii = 0; ii < sn->n_uni; ii++) {
+			guchar c = q[ii];
 
-				npos++;
-			}
+			/* A non-ASCII character can fold into an ASCII one */
+			if (c >= 0x80)
+				break;
+
+			if (g_ascii_tolower (c) != sn->uni[ii])
+				return FALSE;
+		}
+
+		if (ii == sn->n_uni) {
+			*out_end = q + ii;
+			return TRUE;
+		}
+
+		/* The ASCII prefix matched, continue with the full folding */
+		q += ii;
+	} else {
+		ii = 0;
+	}
+
+	for (; ii < sn->n_uni; ii++) {
+		gunichar u = camel_utf8_getc (&q);
+
+		if (!u || g_unichar_tolower (u) != sn->uni[ii])
+			return FALSE;
+	}
+
+	*out_end = q;
+
+	return TRUE;
+}
+
+/* Whether the byte can start a match of the needle */
+#define SEARCH_NEEDLE_IS_CANDIDATE(_sn, _c) \
+	((_c) >= 0xc0 || ((_c) < 0x80 && ((_c) == (_sn)->first_lower || (_c) == (_sn)->first_upper)))
+
+#ifdef SEARCH_NEEDLE_SIMD
+
+/* Scans the whole blocks from the '*inout_p' for the candidates and verifies them;
+   returns the start of the first match, or NULL and the '*inout_p' is set to the first
+   byte, which was not scanned. The UTF-8 lead bytes are those, which are unchanged
+   by the unsigned max with 0xc0; the zero first_lower/first_upper never matches,
+   because the haystack has no zero byte before the 'end'. */
+typedef const guchar * (* SearchNeedleScanFunc) (const CamelSearchNeedle *sn,
+						 const guchar **inout_p,
+						 const guchar *end,
+						 const guchar **out_match_end);
+
+static SearchNeedleScanFunc search_needle_scan = NULL;
+
+/* Verifies the candidates of the 'mask', which has one bit for each byte from the 'p' */
+static inline const guchar *
+search_needle_verify_mask (const CamelSearchNeedle *sn,
+			   const guchar *p,
+			   guint mask,
+			   const guchar **out_match_end)
+{
+	while (mask) {
+		const guchar *pos = p + __builtin_ctz (mask);
+
+		if (search_needle_matches_at (sn, pos, out_match_end))
+			return pos;
+
+		mask &= mask - 1;
+	}
+
+	return NULL;
+}
+
+__attribute__ ((target ("sse2")))
+static const guchar *
+search_needle_scan_sse2 (const CamelSearchNeedle *sn,
+			 const guchar **inout_p,
+			 const guchar *end,
+			 const guchar **out_match_end)
+{
+	const __m128i lower = _mm_set1_epi8 ((gchar) sn->first_lower);
+	const __m128i upper = _mm_set1_epi8 ((gchar) sn->first_upper);
+	const __m128i lead = _mm_set1_epi8 ((gchar) 0xc0);
+	const guchar *p = *inout_p, *pos;
+
+	for (; p + 16 <= end; p += 16) {
+		__m128i block = _mm_loadu_si128 ((const __m128i *) p);
+		guint mask;
+
+		mask = _mm_movemask_epi8 (_mm_or_si128 (
+			_mm_or_si128 (_mm_cmpeq_epi8 (block, lower), _mm_cmpeq_epi8 (block, upper)),
+			_mm_cmpeq_epi8 (_mm_max_epu8 (block, lead), block)));
+
+		pos = search_needle_verify_mask (sn, p, mask, out_match_end);
+		if (pos)
+			return pos;
+	}
+
+	*inout_p = p;
+
+	return NULL;
+}
+
+__attribute__ ((target ("avx2")))
+static const guchar *
+search_needle_scan_avx2 (const CamelSearchNeedle *sn,
+			 const guchar **inout_p,
+			 const guchar *end,
+			 const guchar **out_match_end)
+{
+	const __m256i lower = _mm256_set1_epi8 ((gchar) sn->first_lower);
+	const __m256i upper = _mm256_set1_epi8 ((gchar) sn->first_upper);
+	const __m256i lead = _mm256_set1_epi8 ((gchar) 0xc0);
+	const guchar *p = *inout_p, *pos;
+
+	for (; p + 32 <= end; p += 32) {
+		__m256i block = _mm256_loadu_si256 ((const __m256i *) p);
+		guint mask;
+
+		mask = (guint) _mm256_movemask_epi8 (_mm256_or_si256 (
+			_mm256_or_si256 (_mm256_cmpeq_epi8 (block, lower), _mm256_cmpeq_epi8 (block, upper)),
+			_mm256_cmpeq_epi8 (_mm256_max_epu8 (block, lead), block)));
+
+		pos = search_needle_verify_mask (sn, p, mask, out_match_end);
+		if (pos)
+			return pos;
+	}
+
+	*inout_p = p;
+
+	/* The rest can still have a whole 16 bytes block */
+	return search_needle_scan_sse2 (sn, inout_p, end, out_match_end);
+}
+
+static void
+search_needle_init_scan (void)
+{
+	static gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized)) {
+		__builtin_cpu_init ();
+
+		if (__builtin_cpu_supports ("avx2"))
+			search_needle_scan = search_needle_scan_avx2;
+		else if (__builtin_cpu_supports ("sse2"))
+			search_needle_scan = search_needle_scan_sse2;
+
+		g_once_init_leave (&initialized, 1);
+	}
+}
+
+#endif /* SEARCH_NEEDLE_SIMD */
+
+/**
+ * camel_search_needle_find: (skip)
+ * @needle: a #CamelSearchNeedle
+ * @haystack: a UTF-8 string to search in
+ * @out_match_end: (out) (optional): return location for the end of the match, or %NULL
+ *
+ * Searches for the first case-insensitive occurrence of the @needle
+ * in the @haystack. The @out_match_end is set to the first byte after
+ * the match, when found.
+ *
+ * Returns: (nullable): the start of the match in the @haystack, or %NULL,
+ *    when not found.
+ **/
+const gchar *
+camel_search_needle_find (const CamelSearchNeedle *needle,
+			  const gchar *haystack,
+			  const gchar **out_match_end)
+{
+	const guchar *p, *end, *match_end = NULL;
+	gsize len;
+
+	g_return_val_if_fail (needle != NULL, NULL);
+	g_return_val_if_fail (haystack != NULL, NULL);
+
+	if (!needle->n_uni) {
+		if (out_match_end)
+			*out_match_end = haystack;
+		return haystack;
+	}
+
+	len = strlen (haystack);
+	p = (const guchar *) haystack;
+	end = p + len;
 
-			if (nuni + npos == puni)
-				return (const gchar *) p;
+#ifdef SEARCH_NEEDLE_SIMD
+	if (len >= 16) {
+		const guchar *pos;
+
+		search_needle_init_scan ();
+
+		if (search_needle_scan) {
+			pos = search_needle_scan (needle, &p, end, &match_end);
+			if (pos) {
+				if (out_match_end)
+					*out_match_end = (const gchar *) match_end;
+				return (const gchar *) pos;
+			}
+		}
+	}
+#endif
+
+	for (; p < end; p++) {
+		if (SEARCH_NEEDLE_IS_CANDIDATE (needle, *p) &&
+		    search_needle_matches_at (needle, p, &match_end)) {
+			if (out_match_end)
+				*out_match_end = (const gchar *) match_end;
+			return (const gchar *) p;
 		}
 	}
 
 	return NULL;
 }
 
+const gchar *
+camel_ustrstrcase (const gchar *haystack,
+                   const gchar *needle)
+{
+	CamelSearchNeedle *sn;
+	const gchar *res;
+
+	g_return_val_if_fail (haystack != NULL, NULL);
+	g_return_val_if_fail (needle != NULL, NULL);
+
+	if (!*needle)
+		return haystack;
+	if (!*haystack)
+		return NULL;
+
+	sn = camel_search_needle_new (needle);
+	res = camel_search_needle_find (sn, haystack, NULL);
+	camel_search_needle_free (sn);
+
+	return res;
+}
+
 #define CAMEL_SEARCH_COMPARE(x, y, z) G_STMT_START { \
 	if ((x) == (z)) { \
 		if ((y) == (z)) \
@@ -580,6 +844,109 @@ camel_search_message_body_contains (CamelDataWrapper *object,
 	return truth;
 }
 
+static void
+search_collect_body_text (CamelDataWrapper *object,
+			  GString *text,
+			  GCancellable *cancellable)
+{
+	CamelDataWrapper *containee;
+	gint parts, i;
+
+	if (g_cancellable_is_cancelled (cancellable))
+		return;
+
+	containee = camel_medium_get_content (CAMEL_MEDIUM (object));
+
+	if (containee == NULL)
+		return;
+
+	/* The same parts as the in-memory body-contains search looks into */
+	if (CAMEL_IS_MULTIPART (containee)) {
+		parts = camel_multipart_get_number (CAMEL_MULTIPART (containee));
+		for (i = 0; i < parts; i++) {
+			CamelDataWrapper *part = (CamelDataWrapper *) camel_multipart_get_part (CAMEL_MULTIPART (containee), i);
+			if (part)
+				search_collect_body_text (part, text, cancellable);
+		}
+	} else if (CAMEL_IS_MIME_MESSAGE (containee)) {
+		search_collect_body_text ((CamelDataWrapper *) containee, text, cancellable);
+	} else if (camel_content_type_is (camel_data_wrapper_get_mime_type_field (CAMEL_DATA_WRAPPER (containee)), "text", "*")) {
+		CamelStream *stream;
+		GByteArray *byte_array;
+		const gchar *charset;
+
+		byte_array = g_byte_array_new ();
+		stream = camel_stream_mem_new_with_byte_array (byte_array);
+
+		charset = camel_content_type_param (camel_data_wrapper_get_mime_type_field (CAMEL_DATA_WRAPPER (containee)), "charset");
+		if (charset && *charset) {
+			CamelMimeFilter *filter = camel_mime_filter_charset_new (charset, "UTF-8");
+			if (filter) {
+				CamelStream *filtered = camel_stream_filter_new (stream);
+
+				if (filtered) {
+					camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
+					g_object_unref (stream);
+					stream = filtered;
+				}
+
+				g_object_unref (filter);
+			}
+		}
+
+		camel_data_wrapper_decode_to_stream_sync (
+			containee, stream, cancellable, NULL);
+		camel_stream_flush (stream, NULL, NULL);
+
+		if (byte_array->len) {
+			const gchar *data = (const gchar *) byte_array->data;
+			const gchar *end = NULL;
+
+			if (text->len)
+				g_string_append_c (text, '\n');
+
+			/* Skip the invalid tail, the same as the strstr would stop at it */
+			if (g_utf8_validate (data, byte_array->len, &end))
+				g_string_append_len (text, data, byte_array->len);
+			else
+				g_string_append_len (text, data, end - data);
+		}
+
+		g_object_unref (stream);
+	}
+}
+
+/**
+ * camel_search_get_message_body_text: (skip)
+ * @message: a #CamelMimeMessage
+ * @cancellable: a #GCancellable, or %NULL
+ *
+ * Decodes all the text parts of the @message, the ones the body-contains
+ * search looks into, and converts them into UTF-8.
+ *
+ * Returns: (transfer full): the text of the @message body, or %NULL
+ *    when cancelled. Free it with g_free(), when no longer needed.
+ **/
+gchar *
+camel_search_get_message_body_text (CamelMimeMessage *message,
+				    GCancellable *cancellable)
+{
+	GString *text;
+
+	g_return_val_if_fail (CAMEL_IS_MIME_MESSAGE (message), NULL);
+
+	text = g_string_new ("");
+
+	search_collect_body_text (CAMEL_DATA_WRAPPER (message), text, cancellable);
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_string_free (text, TRUE);
+		return NULL;
+	}
+
+	return g_string_free (text, FALSE);
+}
+
 static void
 output_c (GString *w,
           guint32 c,
@@ -72,10 +72,18 @@ gboolean	camel_search_camel_header_soundex
 						(const gchar *header,
 						 const gchar *match);
 
-/* TODO: replace with a real search function */
 const gchar *	camel_ustrstrcase		(const gchar *haystack,
 						 const gchar *needle);
 
+typedef struct _CamelSearchNeedle CamelSearchNeedle;
+
+CamelSearchNeedle *
+		camel_search_needle_new		(const gchar *needle);
+void		camel_search_needle_free	(CamelSearchNeedle *needle);
+const gchar *	camel_search_needle_find	(const CamelSearchNeedle *needle,
+						 const gchar *haystack,
+						 const gchar **out_match_end);
+
 /* Some crappy utility functions for handling multiple search words */
 typedef enum _camel_search_word_t {
 	CAMEL_SEARCH_WORD_SIMPLE = 1,
@@ -112,6 +120,9 @@ gchar *		camel_search_get_headers_decoded(const CamelNameValueArray *headers,
 						 const gchar *default_charset);
 gchar *		camel_search_get_all_headers_decoded
 						(CamelMimeMessage *message);
+gchar *		camel_search_get_message_body_text
+						(CamelMimeMessage *message,
+						 GCancellable *cancellable);
 
 G_END_DECLS
 
@@ -0,0 +1,28 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMEL_SEARCH_SQL_SEXP_PRIVATE_H
+#define CAMEL_SEARCH_SQL_SEXP_PRIVATE_H
+
+#include "camel-search-sql-sexp.h"
+
+G_BEGIN_DECLS
+
+gchar *		_camel_sexp_to_sql_sexp_prefilter
+						(const gchar *sexp,
+						 const gchar *body_folder_name);
+
+G_END_DECLS
+
+#endif /* CAMEL_SEARCH_SQL_SEXP_PRIVATE_H */
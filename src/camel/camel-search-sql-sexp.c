@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "camel-search-sql-sexp.h"
+#include "camel-search-sql-sexp-private.h"
 #define d(x) /* x;printf("\n"); */
 
 #ifdef TEST_MAIN
@@ -59,6 +60,22 @@ camel_db_free_sqlized_string (gchar *string)
 #include "camel-search-private.h"
 #endif
 
+typedef struct _SQLSExpContext {
+	gboolean contains_unknown_column;
+	const gchar *body_folder_name; /* set when the folder has a full-text index of bodies */
+	gboolean prefilter; /* terms, which cannot be converted, match everything they can */
+	gint n_negations; /* how many 'not' the current term is in */
+} SQLSExpContext;
+
+/* In the prefilter mode a term which cannot be converted is replaced with
+   a constant, which does not exclude any message it could match; that is
+   TRUE, unless the term is negated. */
+static gchar *
+sql_sexp_residual_value (SQLSExpContext *ctx)
+{
+	return g_strdup ((ctx->n_negations % 2) != 0 ? "(0)" : "(1)");
+}
+
 static gchar *
 get_db_safe_string (const gchar *str)
 {
@@ -149,10 +166,13 @@ func_not (CamelSExp *f,
           struct _CamelSExpTerm **argv,
           gpointer data)
 {
+	SQLSExpContext *ctx = data;
 	CamelSExpResult *r = NULL, *r1;
 
 	d (printf ("executing not: %d\n", argc));
+	ctx->n_negations++;
 	r1 = camel_sexp_term_eval (f, argv[0]);
+	ctx->n_negations--;
 
 	if (r1->type == CAMEL_SEXP_RES_STRING) {
 		r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
@@ -396,8 +416,16 @@ check_header (struct _CamelSExp *f,
 			headername = g_strdup ("part");
 		}
 		if (!headername) {
-			gboolean *pcontains_unknown_column = (gboolean *) data;
-			*pcontains_unknown_column = TRUE;
+			SQLSExpContext *ctx = data;
+
+			if (ctx->prefilter) {
+				r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
+				r->value.string = sql_sexp_residual_value (ctx);
+
+				return r;
+			}
+
+			ctx->contains_unknown_column = TRUE;
 
 			headername = g_strdup ("unknown");
 		}
@@ -448,6 +476,117 @@ check_header (struct _CamelSExp *f,
 	return r;
 }
 
+#ifndef TEST_MAIN
+/* The trigram tokenizer cannot match shorter strings */
+#define MIN_BODY_WORD_LENGTH 3
+
+static CamelSExpResult *
+body_contains (struct _CamelSExp *f,
+	       gint argc,
+	       struct _CamelSExpResult **argv,
+	       gpointer data)
+{
+	SQLSExpContext *ctx = data;
+	CamelSExpResult *r;
+	GString *str;
+	gboolean residual = FALSE;
+	gint ii, jj;
+
+	d (printf ("executing body-contains: %d\n", argc));
+
+	r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
+
+	if (argc == 1 && argv[0]->type == CAMEL_SEXP_RES_STRING && !*argv[0]->value.string) {
+		r->value.string = g_strdup ("(1)");
+		return r;
+	}
+
+	if (!ctx->body_folder_name) {
+		if (ctx->prefilter) {
+			r->value.string = sql_sexp_residual_value (ctx);
+		} else {
+			ctx->contains_unknown_column = TRUE;
+			r->value.string = g_strdup ("(0)");
+		}
+
+		return r;
+	}
+
+	str = g_string_new ("");
+
+	/* performs an OR of the arguments, while all words of each argument should match */
+	for (ii = 0; ii < argc; ii++) {
+		struct _camel_search_words *words;
+		GString *match;
+
+		if (argv[ii]->type != CAMEL_SEXP_RES_STRING || !*argv[ii]->value.string)
+			continue;
+
+		words = camel_search_words_split ((const guchar *) argv[ii]->value.string);
+		match = g_string_new ("");
+
+		for (jj = 0; jj < words->len; jj++) {
+			const gchar *word = words->words[jj]->word;
+			const gchar *ptr;
+
+			if (!g_utf8_validate (word, -1, NULL) ||
+			    g_utf8_strlen (word, -1) < MIN_BODY_WORD_LENGTH) {
+				if (ctx->prefilter)
+					residual = TRUE;
+				else
+					ctx->contains_unknown_column = TRUE;
+				break;
+			}
+
+			if (match->len)
+				g_string_append (match, " AND ");
+
+			/* each word is a phrase, to not be interpreted as an FTS5 operator */
+			g_string_append_c (match, '\"');
+			for (ptr = word; *ptr; ptr++) {
+				if (*ptr == '\"')
+					g_string_append_c (match, '\"');
+				g_string_append_c (match, *ptr);
+			}
+			g_string_append_c (match, '\"');
+		}
+
+		if (match->len) {
+			gchar *cond;
+
+			cond = camel_db_get_body_match_sql (ctx->body_folder_name, match->str);
+
+			if (str->len)
+				g_string_append (str, " OR ");
+			g_string_append (str, cond);
+
+			g_free (cond);
+		}
+
+		g_string_free (match, TRUE);
+		camel_search_words_free (words);
+	}
+
+	if (residual) {
+		g_string_free (str, TRUE);
+		r->value.string = sql_sexp_residual_value (ctx);
+
+		return r;
+	}
+
+	if (str->len) {
+		g_string_prepend_c (str, '(');
+		g_string_append_c (str, ')');
+	} else {
+		g_string_append (str, "(0)");
+	}
+
+	r->value.string = g_string_free (str, FALSE);
+
+	return r;
+}
+#endif
+
 static CamelSExpResult *
 header_contains (struct _CamelSExp *f,
                  gint argc,
@@ -514,15 +653,23 @@ header_exists (struct _CamelSExp *f,
 
 	d (printf ("executing header-exists: %d\n", argc));
 
+	r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
+
 	headername = camel_db_get_column_name (argv[0]->value.string);
 	if (!headername) {
-		gboolean *pcontains_unknown_column = (gboolean *) data;
-		*pcontains_unknown_column = TRUE;
+		SQLSExpContext *ctx = data;
+
+		if (ctx->prefilter) {
+			r->value.string = sql_sexp_residual_value (ctx);
+
+			return r;
+		}
+
+		ctx->contains_unknown_column = TRUE;
 
 		headername = g_strdup ("unknown");
 	}
 
-	r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
 	r->value.string = g_strdup_printf ("(%s NOTNULL)", headername);
 	g_free (headername);
 
@@ -596,8 +743,15 @@ system_flag (struct _CamelSExp *f,
 	} else {
 		tstr = camel_db_get_column_name (argv[0]->value.string);
 		if (!tstr) {
-			gboolean *pcontains_unknown_column = (gboolean *) data;
-			*pcontains_unknown_column = TRUE;
+			SQLSExpContext *ctx = data;
+
+			if (ctx->prefilter) {
+				r->value.string = sql_sexp_residual_value (ctx);
+
+				return r;
+			}
+
+			ctx->contains_unknown_column = TRUE;
 
 			tstr = g_strdup ("unknown");
 		}
@@ -781,6 +935,36 @@ sql_exp (struct _CamelSExp *f,
 	return r;
 }
 
+/* Terms, which are evaluated only in memory */
+static CamelSExpResult *
+residual_term (struct _CamelSExp *f,
+	       gint argc,
+	       struct _CamelSExpResult **argv,
+	       gpointer data)
+{
+	CamelSExpResult *r;
+
+	r = camel_sexp_result_new (f, CAMEL_SEXP_RES_STRING);
+	r->value.string = sql_sexp_residual_value (data);
+
+	return r;
+}
+
+/* These are not converted in the prefilter mode, because the SQL
+   does not match them the same way as the in-memory search does */
+static const gchar *residual_symbols[] = {
+	"body-regex",
+	"message-location",
+	"header-soundex",
+	"header-regex",
+	"header-full-regex",
+	"header-contains",
+	"header-has-words",
+	"header-matches",
+	"header-starts-with",
+	"header-ends-with"
+};
+
 /* 'builtin' functions */
 static struct {
 	const gchar *name;
@@ -796,7 +980,9 @@ static struct {
 
 	{ "match-all", (CamelSExpFunc) match_all, 1 },
 	{ "match-threads", (CamelSExpFunc) match_threads, 1 },
-/*	{ "body-contains", body_contains}, */ /* We don't store body on the db. */
+#ifndef TEST_MAIN
+	{ "body-contains", body_contains, 0},
+#endif
 	{ "header-contains", header_contains, 0},
 	{ "header-has-words", header_has_words, 0},
 	{ "header-matches", header_matches, 0},
@@ -818,39 +1004,38 @@ static struct {
 /*	{ "uid", CAMEL_STRUCT_OFFSET(CamelFolderSearchClass, uid), 1 },	*/
 };
 
-/**
- * camel_sexp_to_sql_sexp:
- * @sexp: a search expression to convert
- *
- * Converts a search expression to an SQL 'WHERE' part statement,
- * without the 'WHERE' keyword.
- *
- * Returns: (transfer full): a newly allocated string, an SQL 'WHERE' part statement,
- *    or %NULL, when could not convert it. Free it with g_free(), when done with it.
- *
- * Since: 2.26
- **/
-gchar *
-camel_sexp_to_sql_sexp (const gchar *sexp)
+static gchar *
+sql_sexp_convert (const gchar *sexp,
+		  const gchar *body_folder_name,
+		  gboolean prefilter)
 {
 	CamelSExp *sexpobj;
 	CamelSExpResult *r;
 	gint i;
 	gchar *res = NULL;
-	gboolean contains_unknown_column = FALSE;
+	SQLSExpContext ctx;
 
-	g_return_val_if_fail (sexp != NULL, NULL);
+	ctx.contains_unknown_column = FALSE;
+	ctx.body_folder_name = body_folder_name;
+	ctx.prefilter = prefilter;
+	ctx.n_negations = 0;
 
 	sexpobj = camel_sexp_new ();
 
 	for (i = 0; i < G_N_ELEMENTS (symbols); i++) {
 		if (symbols[i].immediate)
 			camel_sexp_add_ifunction (sexpobj, 0, symbols[i].name,
-					     (CamelSExpIFunc) symbols[i].func, &contains_unknown_column);
+					     (CamelSExpIFunc) symbols[i].func, &ctx);
 		else
 			camel_sexp_add_function (
 				sexpobj, 0, symbols[i].name,
-				symbols[i].func, &contains_unknown_column);
+				symbols[i].func, &ctx);
+	}
+
+	if (prefilter) {
+		for (i = 0; i < G_N_ELEMENTS (residual_symbols); i++) {
+			camel_sexp_add_function (sexpobj, 0, residual_symbols[i], residual_term, &ctx);
+		}
 	}
 
 	camel_sexp_input_text (sexpobj, sexp, strlen (sexp));
@@ -865,7 +1050,7 @@ camel_sexp_to_sql_sexp (const gchar *sexp)
 		return NULL;
 	}
 
-	if (!contains_unknown_column && r->type == CAMEL_SEXP_RES_STRING) {
+	if (!ctx.contains_unknown_column && r->type == CAMEL_SEXP_RES_STRING) {
 		res = g_strdup (r->value.string);
 	}
 
@@ -875,6 +1060,72 @@ camel_sexp_to_sql_sexp (const gchar *sexp)
 	return res;
 }
 
+/**
+ * camel_sexp_to_sql_sexp:
+ * @sexp: a search expression to convert
+ *
+ * Converts a search expression to an SQL 'WHERE' part statement,
+ * without the 'WHERE' keyword.
+ *
+ * Returns: (transfer full): a newly allocated string, an SQL 'WHERE' part statement,
+ *    or %NULL, when could not convert it. Free it with g_free(), when done with it.
+ *
+ * Since: 2.26
+ **/
+gchar *
+camel_sexp_to_sql_sexp (const gchar *sexp)
+{
+	return camel_sexp_to_sql_sexp_with_body_index (sexp, NULL);
+}
+
+/**
+ * camel_sexp_to_sql_sexp_with_body_index:
+ * @sexp: a search expression to convert
+ * @body_folder_name: (nullable): full name of the folder with a full-text index of message bodies, or %NULL
+ *
+ * The same as camel_sexp_to_sql_sexp(), only it converts also the body-contains
+ * terms, into a match against the full-text index of the message bodies
+ * of the folder @body_folder_name (see camel_db_write_message_body()).
+ * The conversion fails for body-contains terms, when the @body_folder_name
+ * is %NULL or when any of the searched words is shorter than three letters.
+ *
+ * Returns: (transfer full): a newly allocated string, an SQL 'WHERE' part statement,
+ *    or %NULL, when could not convert it. Free it with g_free(), when done with it.
+ *
+ * Since: 3.40
+ **/
+gchar *
+camel_sexp_to_sql_sexp_with_body_index (const gchar *sexp,
+					const gchar *body_folder_name)
+{
+	g_return_val_if_fail (sexp != NULL, NULL);
+
+	return sql_sexp_convert (sexp, body_folder_name, FALSE);
+}
+
+/* Converts the 'sexp' into an SQL condition, which is satisfied by all the messages
+   the 'sexp' matches and possibly by some more, thus the result of the SQL query
+   should be checked with the 'sexp' in memory. Returns NULL, when the 'sexp'
+   cannot be converted or when the condition would not exclude anything. */
+gchar *
+_camel_sexp_to_sql_sexp_prefilter (const gchar *sexp,
+				   const gchar *body_folder_name)
+{
+	gchar *res;
+
+	g_return_val_if_fail (sexp != NULL, NULL);
+
+	res = sql_sexp_convert (sexp, body_folder_name, TRUE);
+
+	/* Only constants and operators, no column is involved */
+	if (res && strspn (res, "()01 ANDORT") == strlen (res)) {
+		g_free (res);
+		res = NULL;
+	}
+
+	return res;
+}
+
 #ifdef TEST_MAIN
 /*
  *
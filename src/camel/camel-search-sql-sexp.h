@@ -30,6 +30,9 @@ G_BEGIN_DECLS
 
 /* FIXME: Weird naming, since, I want both parsers to be there for some time.*/
 gchar * camel_sexp_to_sql_sexp (const gchar *sexp);
+gchar * camel_sexp_to_sql_sexp_with_body_index
+					(const gchar *sexp,
+					 const gchar *body_folder_name);
 
 G_END_DECLS
 
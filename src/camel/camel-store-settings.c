@@ -20,12 +20,16 @@
 struct _CamelStoreSettingsPrivate {
 	gboolean filter_inbox;
 	gint store_changes_interval;
+	gint summary_cache_limit;
+	gboolean index_message_bodies;
 };
 
 enum {
 	PROP_0,
 	PROP_FILTER_INBOX,
-	PROP_STORE_CHANGES_INTERVAL
+	PROP_STORE_CHANGES_INTERVAL,
+	PROP_SUMMARY_CACHE_LIMIT,
+	PROP_INDEX_MESSAGE_BODIES
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (
@@ -51,6 +55,18 @@ store_settings_set_property (GObject *object,
 				CAMEL_STORE_SETTINGS (object),
 				g_value_get_int (value));
 			return;
+
+		case PROP_SUMMARY_CACHE_LIMIT:
+			camel_store_settings_set_summary_cache_limit (
+				CAMEL_STORE_SETTINGS (object),
+				g_value_get_int (value));
+			return;
+
+		case PROP_INDEX_MESSAGE_BODIES:
+			camel_store_settings_set_index_message_bodies (
+				CAMEL_STORE_SETTINGS (object),
+				g_value_get_boolean (value));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -76,6 +92,20 @@ store_settings_get_property (GObject *object,
 				camel_store_settings_get_store_changes_interval (
 				CAMEL_STORE_SETTINGS (object)));
 			return;
+
+		case PROP_SUMMARY_CACHE_LIMIT:
+			g_value_set_int (
+				value,
+				camel_store_settings_get_summary_cache_limit (
+				CAMEL_STORE_SETTINGS (object)));
+			return;
+
+		case PROP_INDEX_MESSAGE_BODIES:
+			g_value_set_boolean (
+				value,
+				camel_store_settings_get_index_message_bodies (
+				CAMEL_STORE_SETTINGS (object)));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -117,6 +147,34 @@ camel_store_settings_class_init (CamelStoreSettingsClass *class)
 			G_PARAM_CONSTRUCT |
 			G_PARAM_EXPLICIT_NOTIFY |
 			G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_SUMMARY_CACHE_LIMIT,
+		g_param_spec_int (
+			"summary-cache-limit",
+			"Summary Cache Limit",
+			"How many message infos to keep in memory per folder, 0 for no limit",
+			0,
+			G_MAXINT,
+			0,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT |
+			G_PARAM_EXPLICIT_NOTIFY |
+			G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_INDEX_MESSAGE_BODIES,
+		g_param_spec_boolean (
+			"index-message-bodies",
+			"Index Message Bodies",
+			"Whether to index bodies of the locally stored messages for faster search",
+			FALSE,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT |
+			G_PARAM_EXPLICIT_NOTIFY |
+			G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -212,3 +270,95 @@ camel_store_settings_set_store_changes_interval (CamelStoreSettings *settings,
 
 	g_object_notify (G_OBJECT (settings), "store-changes-interval");
 }
+
+/**
+ * camel_store_settings_get_summary_cache_limit:
+ * @settings: a #CamelStoreSettings
+ *
+ * Returns how many message infos each folder of the store can keep loaded
+ * in memory. When the limit is reached, the least recently used message
+ * infos are released. 0 means no limit, in which case only the message
+ * infos unused for some time are released.
+ *
+ * Returns: the limit of the loaded message infos per folder
+ *
+ * Since: 3.40
+ **/
+gint
+camel_store_settings_get_summary_cache_limit (CamelStoreSettings *settings)
+{
+	g_return_val_if_fail (CAMEL_IS_STORE_SETTINGS (settings), 0);
+
+	return settings->priv->summary_cache_limit;
+}
+
+/**
+ * camel_store_settings_set_summary_cache_limit:
+ * @settings: a #CamelStoreSettings
+ * @limit: the limit of the loaded message infos per folder
+ *
+ * Sets how many message infos each folder of the store can keep loaded
+ * in memory. When the limit is reached, the least recently used message
+ * infos are released. 0 means no limit, in which case only the message
+ * infos unused for some time are released.
+ *
+ * Since: 3.40
+ **/
+void
+camel_store_settings_set_summary_cache_limit (CamelStoreSettings *settings,
+					      gint limit)
+{
+	g_return_if_fail (CAMEL_IS_STORE_SETTINGS (settings));
+
+	if (settings->priv->summary_cache_limit == limit)
+		return;
+
+	settings->priv->summary_cache_limit = limit;
+
+	g_object_notify (G_OBJECT (settings), "summary-cache-limit");
+}
+
+/**
+ * camel_store_settings_get_index_message_bodies:
+ * @settings: a #CamelStoreSettings
+ *
+ * Returns whether the text of the messages, which are stored locally,
+ * should be added into a full-text index, which can be used by
+ * the body-contains search.
+ *
+ * Returns: whether to index message bodies
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_store_settings_get_index_message_bodies (CamelStoreSettings *settings)
+{
+	g_return_val_if_fail (CAMEL_IS_STORE_SETTINGS (settings), FALSE);
+
+	return settings->priv->index_message_bodies;
+}
+
+/**
+ * camel_store_settings_set_index_message_bodies:
+ * @settings: a #CamelStoreSettings
+ * @index_message_bodies: whether to index message bodies
+ *
+ * Sets whether the text of the messages, which are stored locally,
+ * should be added into a full-text index, which can be used by
+ * the body-contains search.
+ *
+ * Since: 3.40
+ **/
+void
+camel_store_settings_set_index_message_bodies (CamelStoreSettings *settings,
+					       gboolean index_message_bodies)
+{
+	g_return_if_fail (CAMEL_IS_STORE_SETTINGS (settings));
+
+	if (!settings->priv->index_message_bodies == !index_message_bodies)
+		return;
+
+	settings->priv->index_message_bodies = index_message_bodies;
+
+	g_object_notify (G_OBJECT (settings), "index-message-bodies");
+}
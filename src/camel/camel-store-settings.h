@@ -81,6 +81,16 @@ gint		camel_store_settings_get_store_changes_interval
 void		camel_store_settings_set_store_changes_interval
 						(CamelStoreSettings *settings,
 						 gint interval);
+gint		camel_store_settings_get_summary_cache_limit
+						(CamelStoreSettings *settings);
+void		camel_store_settings_set_summary_cache_limit
+						(CamelStoreSettings *settings,
+						 gint limit);
+gboolean	camel_store_settings_get_index_message_bodies
+						(CamelStoreSettings *settings);
+void		camel_store_settings_set_index_message_bodies
+						(CamelStoreSettings *settings,
+						 gboolean index_message_bodies);
 
 G_END_DECLS
 
@@ -55,6 +55,7 @@ struct _CamelStorePrivate {
 	GMutex signal_emission_lock;
 	gboolean folder_info_stale_scheduled;
 	volatile gint maintenance_lock;
+	volatile gint maintenance_scheduled;
 };
 
 struct _AsyncContext {
@@ -3256,6 +3257,46 @@ camel_store_initial_setup_finish (CamelStore *store,
 	return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+/* How often to run ANALYZE on the store's CamelDB, in seconds */
+#define STORE_DB_ANALYZE_INTERVAL (60 * 60 * 24 * 7)
+
+static gboolean
+store_db_analyze_due (CamelStore *store)
+{
+	gint64 last_analyze;
+
+	/* It's stored in the DB, thus it's not run on each start */
+	last_analyze = camel_db_get_last_analyze_time (store->priv->cdb);
+
+	return !last_analyze ||
+		g_get_real_time () / G_USEC_PER_SEC - last_analyze >= STORE_DB_ANALYZE_INTERVAL;
+}
+
+static void
+store_db_maintenance_thread (CamelSession *session,
+			     GCancellable *cancellable,
+			     CamelStore *store,
+			     GError **error)
+{
+	if (!store->priv->cdb)
+		return;
+
+	/* Something like an expunge of all folders started since the job had been scheduled */
+	if (g_atomic_int_get (&store->priv->maintenance_lock) > 0)
+		return;
+
+	camel_db_run_maintenance_sync (store->priv->cdb, store_db_analyze_due (store), cancellable, error);
+}
+
+static void
+store_db_maintenance_done (gpointer user_data)
+{
+	CamelStore *store = user_data;
+
+	g_atomic_int_set (&store->priv->maintenance_scheduled, 0);
+	g_object_unref (store);
+}
+
 /**
  * camel_store_maybe_run_db_maintenance:
  * @store: a #CamelStore instance
@@ -3264,6 +3305,10 @@ camel_store_initial_setup_finish (CamelStore *store,
  * Checks the state of the current CamelDB used for the @store and eventually
  * runs maintenance routines on it.
  *
+ * Since 3.40 the maintenance runs in a #CamelSession job, in small steps,
+ * thus it doesn't block access to the @store. It runs in the calling thread
+ * only when the @store has no session.
+ *
  * Returns: Whether succeeded.
  *
  * Since: 3.16
@@ -3272,6 +3317,9 @@ gboolean
 camel_store_maybe_run_db_maintenance (CamelStore *store,
 				      GError **error)
 {
+	CamelSession *session;
+	gchar *description;
+
 	g_return_val_if_fail (CAMEL_IS_STORE (store), FALSE);
 
 	if (g_atomic_int_get (&store->priv->maintenance_lock) > 0)
@@ -3280,7 +3328,30 @@ camel_store_maybe_run_db_maintenance (CamelStore *store,
 	if (!store->priv->cdb)
 		return TRUE;
 
-	return camel_db_maybe_run_maintenance (store->priv->cdb, error);
+	if (!store_db_analyze_due (store) &&
+	    !camel_db_needs_maintenance (store->priv->cdb))
+		return TRUE;
+
+	session = camel_service_ref_session (CAMEL_SERVICE (store));
+	if (!session)
+		return camel_db_maybe_run_maintenance (store->priv->cdb, error);
+
+	if (g_atomic_int_compare_and_exchange (&store->priv->maintenance_scheduled, 0, 1)) {
+		/* Translators: The “%s” is replaced with an account name */
+		description = g_strdup_printf (_("Optimizing local data for “%s”"),
+			camel_service_get_display_name (CAMEL_SERVICE (store)));
+
+		camel_session_submit_job (
+			session, description,
+			(CamelSessionCallback) store_db_maintenance_thread,
+			g_object_ref (store), store_db_maintenance_done);
+
+		g_free (description);
+	}
+
+	g_object_unref (session);
+
+	return TRUE;
 }
 
 /**
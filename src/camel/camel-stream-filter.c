@@ -25,6 +25,8 @@
 
 #include <glib/gi18n-lib.h>
 
+#include "camel-mime-filter-crlf.h"
+#include "camel-mime-filter-crlf-private.h"
 #include "camel-stream-filter.h"
 
 #define d(x)
@@ -52,12 +54,14 @@ struct _CamelStreamFilterPrivate {
 	gchar *filtered;		/* the filtered data */
 	gsize filteredlen;
 
+	gchar *realwritebuffer;	/* the input for write, allocated on demand */
+
 	guint last_was_read:1;	/* was the last op read or write? */
 	guint flushed:1;        /* were the filters flushed? */
 };
 
 #define READ_PAD (128)		/* bytes padded before buffer */
-#define READ_SIZE (4096)
+#define READ_SIZE (32768)	/* large, to not repeat the per-call overhead of each filter often */
 
 static void camel_stream_filter_seekable_init (GSeekableIface *iface);
 
@@ -80,12 +84,63 @@ stream_filter_finalize (GObject *object)
 	}
 
 	g_free (stream->priv->realbuffer);
+	g_free (stream->priv->realwritebuffer);
 	g_object_unref (stream->priv->source);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (camel_stream_filter_parent_class)->finalize (object);
 }
 
+static gboolean
+filter_owns_buffer (CamelMimeFilter *filter,
+		    const gchar *buffer)
+{
+	return filter->outreal && buffer >= filter->outreal &&
+		buffer < filter->outbuf + filter->outsize;
+}
+
+/* Passes the 'buffer' through all the filters. The 'writable' says whether
+   the 'buffer' can be changed; while it is, or when a filter's output is in
+   the filter's own buffer, the following CRLF decoder does not copy the data,
+   it decodes them in place, as part of the previous stage. */
+static void
+stream_filter_run (CamelStreamFilterPrivate *priv,
+		   gboolean complete,
+		   gboolean writable,
+		   gchar **buffer,
+		   gsize *len,
+		   gsize *presize)
+{
+	struct _filter *f;
+
+	for (f = priv->filters; f; f = f->next) {
+		gchar *in = *buffer;
+
+		if (writable && CAMEL_IS_MIME_FILTER_CRLF (f->filter) &&
+		    _camel_mime_filter_crlf_filter_inplace (f->filter, buffer, len, presize)) {
+			d (printf ("Filtered content in place (%s)\n", G_OBJECT_TYPE_NAME (f->filter)));
+			continue;
+		}
+
+		if (complete)
+			camel_mime_filter_complete (f->filter, *buffer, *len, *presize, buffer, len, presize);
+		else
+			camel_mime_filter_filter (f->filter, *buffer, *len, *presize, buffer, len, presize);
+
+		g_check (priv->realbuffer);
+
+		d (printf (
+			"Filtered content (%s): '",
+			G_OBJECT_TYPE_NAME (f->filter)));
+		d (fwrite (*buffer, sizeof (gchar), *len, stdout));
+		d (printf ("'\n"));
+
+		/* the filter can also pass the input through */
+		if (*buffer != in)
+			writable = filter_owns_buffer (f->filter, *buffer);
+	}
+}
+
 static gssize
 stream_filter_read (CamelStream *stream,
                     gchar *buffer,
@@ -95,7 +150,6 @@ stream_filter_read (CamelStream *stream,
 {
 	CamelStreamFilterPrivate *priv;
 	gssize size;
-	struct _filter *f;
 
 	priv = CAMEL_STREAM_FILTER (stream)->priv;
 
@@ -112,23 +166,15 @@ stream_filter_read (CamelStream *stream,
 		if (size <= 0) {
 			/* this is somewhat untested */
 			if (camel_stream_eos (priv->source)) {
-				f = priv->filters;
 				priv->filtered = priv->buffer;
 				priv->filteredlen = 0;
-				while (f) {
-					camel_mime_filter_complete (
-						f->filter, priv->filtered, priv->filteredlen,
-						presize, &priv->filtered, &priv->filteredlen, &presize);
-					g_check (priv->realbuffer);
-					f = f->next;
-				}
+				stream_filter_run (priv, TRUE, TRUE, &priv->filtered, &priv->filteredlen, &presize);
 				size = priv->filteredlen;
 				priv->flushed = TRUE;
 			}
 			if (size <= 0)
 				return size;
 		} else {
-			f = priv->filters;
 			priv->filtered = priv->buffer;
 			priv->filteredlen = size;
 
@@ -138,20 +184,7 @@ stream_filter_read (CamelStream *stream,
 			d (fwrite (priv->filtered, sizeof (gchar), priv->filteredlen, stdout));
 			d (printf ("'\n"));
 
-			while (f) {
-				camel_mime_filter_filter (
-					f->filter, priv->filtered, priv->filteredlen, presize,
-					&priv->filtered, &priv->filteredlen, &presize);
-				g_check (priv->realbuffer);
-
-				d (printf (
-					"Filtered content (%s): '",
-					G_OBJECT_TYPE_NAME (f->filter)));
-				d (fwrite (priv->filtered, sizeof (gchar), priv->filteredlen, stdout));
-				d (printf ("'\n"));
-
-				f = f->next;
-			}
+			stream_filter_run (priv, FALSE, TRUE, &priv->filtered, &priv->filteredlen, &presize);
 		}
 	}
 
@@ -176,12 +209,14 @@ stream_filter_write (CamelStream *stream,
                      GError **error)
 {
 	CamelStreamFilterPrivate *priv;
-	struct _filter *f;
 	gsize presize, len, left = n;
-	gchar *buffer, realbuffer[READ_SIZE + READ_PAD];
+	gchar *buffer;
 
 	priv = CAMEL_STREAM_FILTER (stream)->priv;
 
+	if (!priv->realwritebuffer)
+		priv->realwritebuffer = g_malloc (READ_SIZE + READ_PAD);
+
 	priv->last_was_read = FALSE;
 
 	d (printf (
@@ -195,26 +230,13 @@ stream_filter_write (CamelStream *stream,
 	while (left) {
 		/* Sigh, since filters expect non const args, copy the input first, we do this in handy sized chunks */
 		len = MIN (READ_SIZE, left);
-		buffer = realbuffer + READ_PAD;
+		buffer = priv->realwritebuffer + READ_PAD;
 		memcpy (buffer, buf, len);
 		buf += len;
 		left -= len;
 
-		f = priv->filters;
 		presize = READ_PAD;
-		while (f) {
-			camel_mime_filter_filter (f->filter, buffer, len, presize, &buffer, &len, &presize);
-
-			g_check (priv->realbuffer);
-
-			d (printf (
-				"Filtered content (%s): '",
-				G_OBJECT_TYPE_NAME (f->filter)));
-			d (fwrite (buffer, sizeof (gchar), len, stdout));
-			d (printf ("'\n"));
-
-			f = f->next;
-		}
+		stream_filter_run (priv, FALSE, TRUE, &buffer, &len, &presize);
 
 		if (camel_stream_write (priv->source, buffer, len, cancellable, error) != len)
 			return -1;
@@ -231,7 +253,6 @@ stream_filter_flush (CamelStream *stream,
                      GError **error)
 {
 	CamelStreamFilterPrivate *priv;
-	struct _filter *f;
 	gchar *buffer;
 	gsize presize;
 	gsize len;
@@ -244,7 +265,6 @@ stream_filter_flush (CamelStream *stream,
 	buffer = (gchar *) "";
 	len = 0;
 	presize = 0;
-	f = priv->filters;
 
 	d (printf (
 		"\n\nFlushing: Original content (%s): '",
@@ -252,17 +272,7 @@ stream_filter_flush (CamelStream *stream,
 	d (fwrite (buffer, sizeof (gchar), len, stdout));
 	d (printf ("'\n"));
 
-	while (f) {
-		camel_mime_filter_complete (f->filter, buffer, len, presize, &buffer, &len, &presize);
-
-		d (printf (
-			"Filtered content (%s): '",
-			G_OBJECT_TYPE_NAME (f->filter)));
-		d (fwrite (buffer, sizeof (gchar), len, stdout));
-		d (printf ("'\n"));
-
-		f = f->next;
-	}
+	stream_filter_run (priv, TRUE, FALSE, &buffer, &len, &presize);
 
 	if (len > 0 && camel_stream_write (priv->source, buffer, len, cancellable, error) == -1)
 		return -1;
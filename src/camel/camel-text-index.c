@@ -962,8 +962,8 @@ camel_text_index_rename (const gchar *old,
 
 	/* TODO: camel_text_index_rename should find out if we have an active index and use that instead */
 
-	oldname_len = strlen (old) + 12;
-	newname_len = strlen (new) + 12;
+	oldname_len = strlen (old) + 13;
+	newname_len = strlen (new) + 13;
 	oldname = alloca (oldname_len);
 	newname = alloca (newname_len);
 	g_snprintf (oldname, oldname_len, "%s.index", old);
@@ -988,6 +988,13 @@ camel_text_index_rename (const gchar *old,
 		return -1;
 	}
 
+	/* Bloom filters of the names, see camel_index_may_match() */
+	g_snprintf (oldname, oldname_len, "%s.index.bloom", old);
+	g_snprintf (newname, newname_len, "%s.index.bloom", new);
+
+	if (g_rename (oldname, newname) == -1 && errno != ENOENT)
+		g_unlink (oldname);
+
 	return 0;
 }
 
@@ -1002,7 +1009,7 @@ camel_text_index_remove (const gchar *old)
 
 	block_len = strlen (old) + 12;
 	block = alloca (block_len);
-	key_len = strlen (old) + 12;
+	key_len = strlen (old) + 13;
 	key = alloca (key_len);
 	g_snprintf (block, block_len, "%s.index", old);
 	g_snprintf (key, key_len, "%s.index.data", old);
@@ -1012,6 +1019,10 @@ camel_text_index_remove (const gchar *old)
 	if (g_unlink (key) == -1 && errno != ENOENT && errno != ENOTDIR)
 		ret = -1;
 
+	g_snprintf (key, key_len, "%s.index.bloom", old);
+	if (g_unlink (key) == -1 && errno != ENOENT && errno != ENOTDIR)
+		ret = -1;
+
 	if (ret == 0)
 		errno = 0;
 
@@ -299,6 +299,25 @@ vee_folder_merge_matching (CamelVeeFolder *vfolder,
 	g_hash_table_foreach (all_uids, vee_folder_remove_unmatched_cb, &rud);
 }
 
+struct CollectUnmatchedData
+{
+	GHashTable *matched;	/* const gchar *uid, borrowed from the search result */
+	GHashTable *unmatched;	/* gchar *uid, camel_pstring_strdup()-ed */
+};
+
+static gboolean
+vee_folder_collect_unmatched_cb (CamelFolderSummary *summary,
+				 const gchar *uid,
+				 gpointer user_data)
+{
+	struct CollectUnmatchedData *cud = user_data;
+
+	if (!g_hash_table_contains (cud->matched, uid))
+		g_hash_table_add (cud->unmatched, (gpointer) camel_pstring_strdup (uid));
+
+	return TRUE;
+}
+
 static void
 vee_folder_rebuild_folder_with_changes (CamelVeeFolder *vfolder,
                                         CamelFolder *subfolder,
@@ -324,11 +343,23 @@ vee_folder_rebuild_folder_with_changes (CamelVeeFolder *vfolder,
 	}
 
 	if (!g_cancellable_is_cancelled (cancellable)) {
-		GHashTable *all_uids;
+		struct CollectUnmatchedData cud;
+		guint ii;
+
+		/* Copy only the UIDs, which do not match, not all of them */
+		cud.matched = g_hash_table_new (g_str_hash, g_str_equal);
+		cud.unmatched = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+
+		for (ii = 0; ii < match->len; ii++) {
+			g_hash_table_add (cud.matched, match->pdata[ii]);
+		}
+
+		camel_folder_summary_foreach_uid (camel_folder_get_folder_summary (subfolder), vee_folder_collect_unmatched_cb, &cud);
+
+		vee_folder_merge_matching (vfolder, subfolder, cud.unmatched, match, changes, FALSE);
 
-		all_uids = camel_folder_summary_get_hash (camel_folder_get_folder_summary (subfolder));
-		vee_folder_merge_matching (vfolder, subfolder, all_uids, match, changes, FALSE);
-		g_hash_table_destroy (all_uids);
+		g_hash_table_destroy (cud.unmatched);
+		g_hash_table_destroy (cud.matched);
 	}
 
 	camel_folder_search_free (subfolder, match);
@@ -98,6 +98,7 @@
 #include <camel/camel-offline-store.h>
 #include <camel/camel-operation.h>
 #include <camel/camel-partition-table.h>
+#include <camel/camel-posting-index.h>
 #include <camel/camel-provider.h>
 #include <camel/camel-sasl.h>
 #include <camel/camel-sasl-anonymous.h>
@@ -1509,12 +1509,270 @@ camel_imapx_conn_manager_list_sync (CamelIMAPXConnManager *conn_man,
 	return success;
 }
 
+/* Do not split the fetch of fewer new messages than this */
+#define IMAPX_PARALLEL_FETCH_MIN_MESSAGES 2000
+
+typedef struct _FetchUIDRangeData {
+	CamelIMAPXConnManager *conn_man;
+	CamelIMAPXMailbox *mailbox;
+	ConnectionInfo *cinfo; /* reserved for this range, NULL to fetch it on the refresh connection */
+	guint64 from_uid;
+	guint64 to_uid;
+	CamelFolderChangeInfo *changes;
+	GCancellable *cancellable;
+	gboolean success;
+	GError *error;
+} FetchUIDRangeData;
+
+/* Reserves a connection for a range of the parallel fetch, opening a new one
+   when below the limit, but never waits for a busy connection: the caller
+   holds its own connection reserved, thus the wait could never end when all
+   the other connections are held the same way. Returns NULL when there is
+   no connection available right now. */
+static ConnectionInfo *
+imapx_conn_manager_try_ref_free_connection (CamelIMAPXConnManager *conn_man,
+					    CamelIMAPXMailbox *mailbox,
+					    GCancellable *cancellable)
+{
+	ConnectionInfo *cinfo = NULL;
+	GList *link;
+
+	CON_READ_LOCK (conn_man);
+
+	for (link = conn_man->priv->connections; link; link = g_list_next (link)) {
+		ConnectionInfo *candidate = link->data;
+
+		if (candidate && connection_info_try_reserve (candidate)) {
+			cinfo = connection_info_ref (candidate);
+			break;
+		}
+	}
+
+	CON_READ_UNLOCK (conn_man);
+
+	if (!cinfo) {
+		CON_WRITE_LOCK (conn_man);
+
+		if (g_list_length (conn_man->priv->connections) < imapx_conn_manager_get_max_connections (conn_man)) {
+			GError *local_error = NULL;
+
+			cinfo = imapx_create_new_connection_unlocked (conn_man, mailbox, cancellable, &local_error);
+			if (cinfo) {
+				connection_info_set_busy (cinfo, TRUE);
+				connection_info_ref (cinfo);
+			} else {
+				c ('*', "%s: Failed to open a new connection: %s\n", G_STRFUNC,
+					local_error ? local_error->message : "Unknown error");
+			}
+
+			g_clear_error (&local_error);
+		}
+
+		CON_WRITE_UNLOCK (conn_man);
+	}
+
+	if (cinfo) {
+		CamelIMAPXMailbox *idle_mailbox;
+
+		idle_mailbox = camel_imapx_server_ref_idle_mailbox (cinfo->is);
+		if (idle_mailbox)
+			imapx_conn_manager_dec_mailbox_idle (conn_man, idle_mailbox);
+		g_clear_object (&idle_mailbox);
+
+		if (!camel_imapx_server_stop_idle_sync (cinfo->is, cancellable, NULL)) {
+			camel_imapx_server_disconnect_sync (cinfo->is, cancellable, NULL);
+			imapx_conn_manager_remove_info (conn_man, cinfo);
+			connection_info_unref (cinfo);
+			cinfo = NULL;
+		}
+	}
+
+	return cinfo;
+}
+
+static gpointer
+imapx_conn_manager_fetch_uid_range_thread (gpointer user_data)
+{
+	FetchUIDRangeData *data = user_data;
+	ConnectionInfo *cinfo;
+
+	g_return_val_if_fail (data != NULL, NULL);
+	g_return_val_if_fail (data->cinfo != NULL, NULL);
+
+	cinfo = data->cinfo;
+
+	data->success = camel_imapx_server_fetch_uid_range_sync (cinfo->is, data->mailbox,
+		data->from_uid, data->to_uid, data->changes, data->cancellable, &data->error);
+
+	/* The connection state is unknown after a stream error; a closed
+	   connection is reported as a reconnect request */
+	if (!data->success && data->error && (data->error->domain == G_IO_ERROR ||
+	    data->error->domain == G_TLS_ERROR || data->error->domain == CAMEL_IMAPX_ERROR ||
+	    g_error_matches (data->error, CAMEL_IMAPX_SERVER_ERROR, CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT))) {
+		camel_imapx_server_disconnect_sync (cinfo->is, data->cancellable, NULL);
+		imapx_conn_manager_remove_info (data->conn_man, cinfo);
+	} else {
+		imapx_conn_manager_unmark_busy (data->conn_man, cinfo);
+	}
+
+	connection_info_unref (cinfo);
+	data->cinfo = NULL;
+
+	return NULL;
+}
+
+/* Splits the fetch of many new messages of the 'mailbox' into disjoint UID
+   ranges, one per connection. Only connections available without waiting
+   are used, the ranges left without one are fetched on the 'server'.
+   Failed ranges are not fatal, the following refresh fetches what's missing. */
+static gboolean
+imapx_conn_manager_fetch_new_in_parallel_sync (CamelIMAPXConnManager *conn_man,
+					       CamelIMAPXServer *server,
+					       CamelIMAPXMailbox *mailbox,
+					       GCancellable *cancellable,
+					       GError **error)
+{
+	CamelFolder *folder;
+	CamelFolderSummary *summary;
+	CamelFolderChangeInfo *changes;
+	FetchUIDRangeData *ranges;
+	GThread **threads;
+	guint32 messages, uidnext, uidvalidity, total;
+	guint64 first_uid, range_size;
+	gint max_connections, n_ranges, ii;
+
+	max_connections = imapx_conn_manager_get_max_connections (conn_man);
+	if (max_connections <= 1)
+		return TRUE;
+
+	/* Values from the last STATUS or SELECT; when they are out of date,
+	   the following refresh takes care of the rest */
+	messages = camel_imapx_mailbox_get_messages (mailbox);
+	uidnext = camel_imapx_mailbox_get_uidnext (mailbox);
+	uidvalidity = camel_imapx_mailbox_get_uidvalidity (mailbox);
+
+	if (!uidnext || !uidvalidity || messages < IMAPX_PARALLEL_FETCH_MIN_MESSAGES)
+		return TRUE;
+
+	/* This also clears the summary on UIDVALIDITY change, thus
+	   it cannot happen while the ranges are being fetched */
+	folder = imapx_conn_manager_ref_folder_sync (conn_man, mailbox, cancellable, NULL);
+	if (!folder)
+		return TRUE;
+
+	summary = camel_folder_get_folder_summary (folder);
+	total = camel_folder_summary_count (summary);
+
+	if (messages < total + IMAPX_PARALLEL_FETCH_MIN_MESSAGES) {
+		g_object_unref (folder);
+		return TRUE;
+	}
+
+	first_uid = 1;
+
+	if (total > 0) {
+		gchar *uid = camel_imapx_dup_uid_from_summary_index (folder, total - 1);
+
+		if (uid) {
+			first_uid = g_ascii_strtoull (uid, NULL, 10) + 1;
+			g_free (uid);
+		}
+	}
+
+	if (first_uid >= uidnext) {
+		g_object_unref (folder);
+		return TRUE;
+	}
+
+	n_ranges = MIN (max_connections, (messages - total) / (IMAPX_PARALLEL_FETCH_MIN_MESSAGES / 2));
+	range_size = (uidnext - first_uid + n_ranges - 1) / n_ranges;
+
+	c ('*', "%s: Fetching UIDs %" G_GUINT64_FORMAT ":%u of '%s' in %d ranges\n", G_STRFUNC,
+		first_uid, uidnext - 1, camel_imapx_mailbox_get_name (mailbox), n_ranges);
+
+	ranges = g_new0 (FetchUIDRangeData, n_ranges);
+	threads = g_new0 (GThread *, n_ranges);
+
+	for (ii = 0; ii < n_ranges; ii++) {
+		FetchUIDRangeData *data = &(ranges[ii]);
+
+		data->conn_man = conn_man;
+		data->mailbox = mailbox;
+		data->from_uid = first_uid + ii * range_size;
+		data->to_uid = MIN (data->from_uid + range_size - 1, uidnext - 1);
+		data->changes = camel_folder_change_info_new ();
+		data->cancellable = cancellable;
+
+		/* The newest messages are always fetched on this connection */
+		if (data->from_uid > data->to_uid || ii == n_ranges - 1)
+			continue;
+
+		data->cinfo = imapx_conn_manager_try_ref_free_connection (conn_man, mailbox, cancellable);
+		if (!data->cinfo)
+			continue;
+
+		threads[ii] = g_thread_try_new (NULL, imapx_conn_manager_fetch_uid_range_thread, data, NULL);
+		if (!threads[ii]) {
+			imapx_conn_manager_unmark_busy (conn_man, data->cinfo);
+			connection_info_unref (data->cinfo);
+			data->cinfo = NULL;
+		}
+	}
+
+	/* The ranges without their own connection, from the newest */
+	for (ii = n_ranges - 1; ii >= 0; ii--) {
+		FetchUIDRangeData *data = &(ranges[ii]);
+
+		if (threads[ii] || data->from_uid > data->to_uid)
+			continue;
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		data->success = camel_imapx_server_fetch_uid_range_sync (server, mailbox,
+			data->from_uid, data->to_uid, data->changes, cancellable, &data->error);
+	}
+
+	changes = camel_folder_change_info_new ();
+
+	for (ii = 0; ii < n_ranges; ii++) {
+		FetchUIDRangeData *data = &(ranges[ii]);
+
+		if (threads[ii])
+			g_thread_join (threads[ii]);
+
+		if (data->error) {
+			c ('*', "%s: Failed to fetch UIDs %" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT " of '%s': %s\n", G_STRFUNC,
+				data->from_uid, data->to_uid, camel_imapx_mailbox_get_name (mailbox), data->error->message);
+			g_clear_error (&data->error);
+		}
+
+		camel_folder_change_info_cat (changes, data->changes);
+		camel_folder_change_info_free (data->changes);
+	}
+
+	/* Save and notify once, for all the ranges */
+	if (camel_folder_change_info_changed (changes)) {
+		camel_folder_summary_save (summary, NULL);
+		imapx_update_store_summary (folder);
+		camel_folder_changed (folder, changes);
+	}
+
+	camel_folder_change_info_free (changes);
+	g_object_unref (folder);
+	g_free (threads);
+	g_free (ranges);
+
+	return !g_cancellable_set_error_if_cancelled (cancellable, error);
+}
+
 static gboolean
 imapx_conn_manager_refresh_info_run_sync (CamelIMAPXJob *job,
 					  CamelIMAPXServer *server,
 					  GCancellable *cancellable,
 					  GError **error)
 {
+	CamelIMAPXConnManager *conn_man;
 	CamelIMAPXMailbox *mailbox;
 	gboolean success;
 	GError *local_error = NULL;
@@ -1525,7 +1783,11 @@ imapx_conn_manager_refresh_info_run_sync (CamelIMAPXJob *job,
 	mailbox = camel_imapx_job_get_mailbox (job);
 	g_return_val_if_fail (CAMEL_IS_IMAPX_MAILBOX (mailbox), FALSE);
 
-	success = camel_imapx_server_refresh_info_sync (server, mailbox, cancellable, &local_error);
+	conn_man = camel_imapx_job_get_user_data (job);
+	g_return_val_if_fail (CAMEL_IS_IMAPX_CONN_MANAGER (conn_man), FALSE);
+
+	success = imapx_conn_manager_fetch_new_in_parallel_sync (conn_man, server, mailbox, cancellable, &local_error) &&
+		camel_imapx_server_refresh_info_sync (server, mailbox, cancellable, &local_error);
 
 	camel_imapx_job_set_result (job, success, NULL, local_error, NULL);
 
@@ -1552,6 +1814,9 @@ camel_imapx_conn_manager_refresh_info_sync (CamelIMAPXConnManager *conn_man,
 	job = camel_imapx_job_new (CAMEL_IMAPX_JOB_REFRESH_INFO, mailbox,
 		imapx_conn_manager_refresh_info_run_sync, NULL, NULL);
 
+	/* The job does not outlive the call, thus no reference is needed */
+	camel_imapx_job_set_user_data (job, conn_man, NULL);
+
 	success = camel_imapx_conn_manager_run_job_sync (conn_man, job,
 		imapx_conn_manager_matches_sync_changes_or_refresh_info,
 		cancellable, error);
@@ -2811,7 +3076,7 @@ imapx_conn_manager_uid_search_run_sync (CamelIMAPXJob *job,
 {
 	struct UidSearchJobData *job_data;
 	CamelIMAPXMailbox *mailbox;
-	GPtrArray *uids = NULL;
+	GArray *uids = NULL;
 	GError *local_error = NULL;
 
 	g_return_val_if_fail (job != NULL, FALSE);
@@ -2826,7 +3091,7 @@ imapx_conn_manager_uid_search_run_sync (CamelIMAPXJob *job,
 	uids = camel_imapx_server_uid_search_sync (server, mailbox, job_data->criteria_prefix,
 		job_data->search_key, (const gchar * const *) job_data->words, cancellable, &local_error);
 
-	camel_imapx_job_set_result (job, uids != NULL, uids, local_error, uids ? (GDestroyNotify) g_ptr_array_free : NULL);
+	camel_imapx_job_set_result (job, uids != NULL, uids, local_error, uids ? (GDestroyNotify) g_array_unref : NULL);
 
 	if (local_error)
 		g_propagate_error (error, local_error);
@@ -2858,7 +3123,7 @@ imapx_conn_manager_uid_search_matches (CamelIMAPXJob *job,
 	       imapx_equal_strv ((const gchar * const  *) job_data->words, (const gchar * const  *) other_job_data->words);
 }
 
-GPtrArray *
+GArray *
 camel_imapx_conn_manager_uid_search_sync (CamelIMAPXConnManager *conn_man,
 					  CamelIMAPXMailbox *mailbox,
 					  const gchar *criteria_prefix,
@@ -2868,7 +3133,7 @@ camel_imapx_conn_manager_uid_search_sync (CamelIMAPXConnManager *conn_man,
 					  GError **error)
 {
 	struct UidSearchJobData *job_data;
-	GPtrArray *uids = NULL;
+	GArray *uids = NULL;
 	CamelIMAPXJob *job;
 	gboolean success;
 
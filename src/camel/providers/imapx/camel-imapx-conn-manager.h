@@ -181,7 +181,7 @@ gboolean	camel_imapx_conn_manager_update_quota_info_sync
 						 CamelIMAPXMailbox *mailbox,
 						 GCancellable *cancellable,
 						 GError **error);
-GPtrArray *	camel_imapx_conn_manager_uid_search_sync
+GArray *	camel_imapx_conn_manager_uid_search_sync
 						(CamelIMAPXConnManager *conn_man,
 						 CamelIMAPXMailbox *mailbox,
 						 const gchar *criteria_prefix,
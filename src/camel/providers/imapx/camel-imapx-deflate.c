@@ -0,0 +1,413 @@
+/*
+ * camel-imapx-deflate.c
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * SECTION: camel-imapx-deflate
+ * @include: camel-imapx-deflate.h
+ * @short_description: Compress input/output streams
+ *
+ * #CamelIMAPXDeflate is a #GConverter, which compresses or decompresses
+ * the data with the raw DEFLATE format, as used by the IMAP COMPRESS
+ * extension (RFC 4978). Unlike the #GZlibCompressor, the compressing
+ * converter flushes all the data it is given immediately, thus each
+ * written command is sent to the server without waiting for more data.
+ * It also counts the bytes it converted.
+ **/
+
+#include "evolution-data-server-config.h"
+
+#include "camel-imapx-deflate.h"
+
+#include <zlib.h>
+
+#include <glib/gi18n-lib.h>
+
+struct _CamelIMAPXDeflatePrivate {
+	gboolean inflate;
+	z_stream zstream;
+	gboolean zstream_initialized;
+
+	guint64 total_in;
+	guint64 total_out;
+};
+
+enum {
+	PROP_0,
+	PROP_INFLATE
+};
+
+/* Forward Declarations */
+static void	camel_imapx_deflate_interface_init
+						(GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+	CamelIMAPXDeflate,
+	camel_imapx_deflate,
+	G_TYPE_OBJECT,
+	G_ADD_PRIVATE (CamelIMAPXDeflate)
+	G_IMPLEMENT_INTERFACE (
+		G_TYPE_CONVERTER,
+		camel_imapx_deflate_interface_init))
+
+static void
+imapx_deflate_set_inflate (CamelIMAPXDeflate *deflate,
+                           gboolean inflate)
+{
+	deflate->priv->inflate = inflate;
+}
+
+static void
+imapx_deflate_set_property (GObject *object,
+                            guint property_id,
+                            const GValue *value,
+                            GParamSpec *pspec)
+{
+	switch (property_id) {
+		case PROP_INFLATE:
+			imapx_deflate_set_inflate (
+				CAMEL_IMAPX_DEFLATE (object),
+				g_value_get_boolean (value));
+			return;
+	}
+
+	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+}
+
+static void
+imapx_deflate_get_property (GObject *object,
+                            guint property_id,
+                            GValue *value,
+                            GParamSpec *pspec)
+{
+	switch (property_id) {
+		case PROP_INFLATE:
+			g_value_set_boolean (
+				value,
+				camel_imapx_deflate_get_inflate (
+				CAMEL_IMAPX_DEFLATE (object)));
+			return;
+	}
+
+	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+}
+
+static void
+imapx_deflate_constructed (GObject *object)
+{
+	CamelIMAPXDeflatePrivate *priv;
+	gint res;
+
+	/* Chain up to parent's constructed() method. */
+	G_OBJECT_CLASS (camel_imapx_deflate_parent_class)->constructed (object);
+
+	priv = CAMEL_IMAPX_DEFLATE (object)->priv;
+
+	/* Negative window bits mean the raw DEFLATE, without any header */
+	if (priv->inflate)
+		res = inflateInit2 (&priv->zstream, -15);
+	else
+		res = deflateInit2 (&priv->zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+	priv->zstream_initialized = res == Z_OK;
+
+	if (!priv->zstream_initialized)
+		g_warning ("%s: Failed to initialize zlib stream: %d", G_STRFUNC, res);
+}
+
+static void
+imapx_deflate_finalize (GObject *object)
+{
+	CamelIMAPXDeflatePrivate *priv;
+
+	priv = CAMEL_IMAPX_DEFLATE (object)->priv;
+
+	if (priv->zstream_initialized) {
+		if (priv->inflate)
+			inflateEnd (&priv->zstream);
+		else
+			deflateEnd (&priv->zstream);
+	}
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (camel_imapx_deflate_parent_class)->finalize (object);
+}
+
+static GConverterResult
+imapx_deflate_compress (CamelIMAPXDeflatePrivate *priv,
+                        gconstpointer inbuf,
+                        gsize inbuf_size,
+                        gpointer outbuf,
+                        gsize outbuf_size,
+                        GConverterFlags flags,
+                        gsize *bytes_read,
+                        gsize *bytes_written,
+                        GError **error)
+{
+	gint res;
+
+	/* All the input is compressed and flushed at once, thus nothing is
+	   left in the zlib stream waiting for the next write. The sync flush
+	   marker is at most 6 bytes long. */
+	if (outbuf_size < deflateBound (&priv->zstream, inbuf_size) + 16) {
+		g_set_error_literal (
+			error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+			_("Not enough space in destination"));
+		return G_CONVERTER_ERROR;
+	}
+
+	priv->zstream.next_in = (Bytef *) inbuf;
+	priv->zstream.avail_in = inbuf_size;
+	priv->zstream.next_out = outbuf;
+	priv->zstream.avail_out = outbuf_size;
+
+	res = deflate (&priv->zstream, (flags & G_CONVERTER_INPUT_AT_END) != 0 ? Z_FINISH : Z_SYNC_FLUSH);
+
+	/* Z_BUF_ERROR means there was nothing to do */
+	if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+		g_set_error (
+			error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			_("Failed to compress data: %s"), priv->zstream.msg ? priv->zstream.msg : "");
+		return G_CONVERTER_ERROR;
+	}
+
+	*bytes_read = inbuf_size - priv->zstream.avail_in;
+	*bytes_written = outbuf_size - priv->zstream.avail_out;
+
+	if (res == Z_STREAM_END)
+		return G_CONVERTER_FINISHED;
+
+	if ((flags & G_CONVERTER_FLUSH) != 0)
+		return G_CONVERTER_FLUSHED;
+
+	return G_CONVERTER_CONVERTED;
+}
+
+static GConverterResult
+imapx_deflate_decompress (CamelIMAPXDeflatePrivate *priv,
+                          gconstpointer inbuf,
+                          gsize inbuf_size,
+                          gpointer outbuf,
+                          gsize outbuf_size,
+                          GConverterFlags flags,
+                          gsize *bytes_read,
+                          gsize *bytes_written,
+                          GError **error)
+{
+	gint res;
+
+	priv->zstream.next_in = (Bytef *) inbuf;
+	priv->zstream.avail_in = inbuf_size;
+	priv->zstream.next_out = outbuf;
+	priv->zstream.avail_out = outbuf_size;
+
+	res = inflate (&priv->zstream, Z_SYNC_FLUSH);
+
+	if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+		g_set_error (
+			error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			_("Failed to decompress data: %s"), priv->zstream.msg ? priv->zstream.msg : "");
+		return G_CONVERTER_ERROR;
+	}
+
+	*bytes_read = inbuf_size - priv->zstream.avail_in;
+	*bytes_written = outbuf_size - priv->zstream.avail_out;
+
+	if (res == Z_STREAM_END)
+		return G_CONVERTER_FINISHED;
+
+	if (!*bytes_read && !*bytes_written) {
+		/* The connection was closed */
+		if ((flags & G_CONVERTER_INPUT_AT_END) != 0)
+			return G_CONVERTER_FINISHED;
+
+		if (!outbuf_size) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+				_("Not enough space in destination"));
+		} else {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+				_("Need more input"));
+		}
+
+		return G_CONVERTER_ERROR;
+	}
+
+	if ((flags & G_CONVERTER_FLUSH) != 0 && !priv->zstream.avail_in && priv->zstream.avail_out)
+		return G_CONVERTER_FLUSHED;
+
+	return G_CONVERTER_CONVERTED;
+}
+
+static GConverterResult
+imapx_deflate_convert (GConverter *converter,
+                       gconstpointer inbuf,
+                       gsize inbuf_size,
+                       gpointer outbuf,
+                       gsize outbuf_size,
+                       GConverterFlags flags,
+                       gsize *bytes_read,
+                       gsize *bytes_written,
+                       GError **error)
+{
+	CamelIMAPXDeflatePrivate *priv;
+	GConverterResult result;
+
+	priv = CAMEL_IMAPX_DEFLATE (converter)->priv;
+
+	if (!priv->zstream_initialized) {
+		g_set_error_literal (
+			error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+			_("Failed to initialize zlib stream"));
+		return G_CONVERTER_ERROR;
+	}
+
+	if (priv->inflate)
+		result = imapx_deflate_decompress (priv, inbuf, inbuf_size, outbuf, outbuf_size, flags, bytes_read, bytes_written, error);
+	else
+		result = imapx_deflate_compress (priv, inbuf, inbuf_size, outbuf, outbuf_size, flags, bytes_read, bytes_written, error);
+
+	if (result != G_CONVERTER_ERROR) {
+		priv->total_in += *bytes_read;
+		priv->total_out += *bytes_written;
+	}
+
+	return result;
+}
+
+static void
+imapx_deflate_reset (GConverter *converter)
+{
+	CamelIMAPXDeflatePrivate *priv;
+
+	priv = CAMEL_IMAPX_DEFLATE (converter)->priv;
+
+	if (priv->zstream_initialized) {
+		if (priv->inflate)
+			inflateReset (&priv->zstream);
+		else
+			deflateReset (&priv->zstream);
+	}
+
+	priv->total_in = 0;
+	priv->total_out = 0;
+}
+
+static void
+camel_imapx_deflate_class_init (CamelIMAPXDeflateClass *class)
+{
+	GObjectClass *object_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->set_property = imapx_deflate_set_property;
+	object_class->get_property = imapx_deflate_get_property;
+	object_class->constructed = imapx_deflate_constructed;
+	object_class->finalize = imapx_deflate_finalize;
+
+	g_object_class_install_property (
+		object_class,
+		PROP_INFLATE,
+		g_param_spec_boolean (
+			"inflate",
+			"Inflate",
+			"Whether to decompress, instead of compress, the data",
+			FALSE,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT_ONLY |
+			G_PARAM_STATIC_STRINGS));
+}
+
+static void
+camel_imapx_deflate_interface_init (GConverterIface *iface)
+{
+	iface->convert = imapx_deflate_convert;
+	iface->reset = imapx_deflate_reset;
+}
+
+static void
+camel_imapx_deflate_init (CamelIMAPXDeflate *deflate)
+{
+	deflate->priv = camel_imapx_deflate_get_instance_private (deflate);
+}
+
+/**
+ * camel_imapx_deflate_new:
+ * @inflate: %TRUE to decompress the data, %FALSE to compress them
+ *
+ * Creates a new #CamelIMAPXDeflate.
+ *
+ * Returns: a #CamelIMAPXDeflate
+ *
+ * Since: 3.40
+ **/
+GConverter *
+camel_imapx_deflate_new (gboolean inflate)
+{
+	return g_object_new (
+		CAMEL_TYPE_IMAPX_DEFLATE,
+		"inflate", inflate, NULL);
+}
+
+/**
+ * camel_imapx_deflate_get_inflate:
+ * @deflate: a #CamelIMAPXDeflate
+ *
+ * Returns: whether the @deflate decompresses the data
+ *
+ * Since: 3.40
+ **/
+gboolean
+camel_imapx_deflate_get_inflate (CamelIMAPXDeflate *deflate)
+{
+	g_return_val_if_fail (CAMEL_IS_IMAPX_DEFLATE (deflate), FALSE);
+
+	return deflate->priv->inflate;
+}
+
+/**
+ * camel_imapx_deflate_get_total_in:
+ * @deflate: a #CamelIMAPXDeflate
+ *
+ * Returns: how many bytes the @deflate consumed since it was created
+ *    or reset; the compressed data for the decompressing converter
+ *
+ * Since: 3.40
+ **/
+guint64
+camel_imapx_deflate_get_total_in (CamelIMAPXDeflate *deflate)
+{
+	g_return_val_if_fail (CAMEL_IS_IMAPX_DEFLATE (deflate), 0);
+
+	return deflate->priv->total_in;
+}
+
+/**
+ * camel_imapx_deflate_get_total_out:
+ * @deflate: a #CamelIMAPXDeflate
+ *
+ * Returns: how many bytes the @deflate produced since it was created
+ *    or reset; the compressed data for the compressing converter
+ *
+ * Since: 3.40
+ **/
+guint64
+camel_imapx_deflate_get_total_out (CamelIMAPXDeflate *deflate)
+{
+	g_return_val_if_fail (CAMEL_IS_IMAPX_DEFLATE (deflate), 0);
+
+	return deflate->priv->total_out;
+}
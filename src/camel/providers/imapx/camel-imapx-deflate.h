@@ -0,0 +1,79 @@
+/*
+ * camel-imapx-deflate.h
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CAMEL_IMAPX_DEFLATE_H
+#define CAMEL_IMAPX_DEFLATE_H
+
+#include <gio/gio.h>
+
+/* Standard GObject macros */
+#define CAMEL_TYPE_IMAPX_DEFLATE \
+	(camel_imapx_deflate_get_type ())
+#define CAMEL_IMAPX_DEFLATE(obj) \
+	(G_TYPE_CHECK_INSTANCE_CAST \
+	((obj), CAMEL_TYPE_IMAPX_DEFLATE, CamelIMAPXDeflate))
+#define CAMEL_IMAPX_DEFLATE_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_CAST \
+	((cls), CAMEL_TYPE_IMAPX_DEFLATE, CamelIMAPXDeflateClass))
+#define CAMEL_IS_IMAPX_DEFLATE(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), CAMEL_TYPE_IMAPX_DEFLATE))
+#define CAMEL_IS_IMAPX_DEFLATE_CLASS(cls) \
+	(G_TYPE_CHECK_CLASS_TYPE \
+	((cls), CAMEL_TYPE_IMAPX_DEFLATE))
+#define CAMEL_IMAPX_DEFLATE_GET_CLASS(obj) \
+	(G_TYPE_INSTANCE_GET_CLASS \
+	((obj), CAMEL_TYPE_IMAPX_DEFLATE, CamelIMAPXDeflateClass))
+
+G_BEGIN_DECLS
+
+typedef struct _CamelIMAPXDeflate CamelIMAPXDeflate;
+typedef struct _CamelIMAPXDeflateClass CamelIMAPXDeflateClass;
+typedef struct _CamelIMAPXDeflatePrivate CamelIMAPXDeflatePrivate;
+
+/**
+ * CamelIMAPXDeflate:
+ *
+ * Contains only private data that should be read and manipulated using the
+ * functions below.
+ *
+ * Since: 3.40
+ **/
+struct _CamelIMAPXDeflate {
+	/*< private >*/
+	GObject parent;
+	CamelIMAPXDeflatePrivate *priv;
+};
+
+struct _CamelIMAPXDeflateClass {
+	GObjectClass parent_class;
+
+	/* Padding for future expansion */
+	gpointer reserved[20];
+};
+
+GType		camel_imapx_deflate_get_type	(void) G_GNUC_CONST;
+GConverter *	camel_imapx_deflate_new		(gboolean inflate);
+gboolean	camel_imapx_deflate_get_inflate	(CamelIMAPXDeflate *deflate);
+guint64		camel_imapx_deflate_get_total_in
+						(CamelIMAPXDeflate *deflate);
+guint64		camel_imapx_deflate_get_total_out
+						(CamelIMAPXDeflate *deflate);
+
+G_END_DECLS
+
+#endif /* CAMEL_IMAPX_DEFLATE_H */
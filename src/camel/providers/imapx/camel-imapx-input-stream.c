@@ -911,6 +911,89 @@ protocol_error:
 	return IMAPX_TOK_ERROR;
 }
 
+/* Like camel_imapx_input_stream_token(), except the atoms and the numbers
+ * are not copied; the 'data' points into the input buffer, it is not
+ * NUL-terminated and it is valid only until the next read from the stream.
+ * Do not unget such tokens. */
+camel_imapx_token_t
+camel_imapx_input_stream_token_slice (CamelIMAPXInputStream *is,
+				      guchar **data,
+				      guint *len,
+				      GCancellable *cancellable,
+				      GError **error)
+{
+	guchar c, *p, *e, *start;
+	gsize offset;
+	gboolean digits;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_INPUT_STREAM (is), IMAPX_TOK_ERROR);
+	g_return_val_if_fail (data != NULL, IMAPX_TOK_ERROR);
+	g_return_val_if_fail (len != NULL, IMAPX_TOK_ERROR);
+
+	if (is->priv->unget > 0 || is->priv->literal > 0)
+		return camel_imapx_input_stream_token (is, data, len, cancellable, error);
+
+	p = is->priv->ptr;
+	e = is->priv->end;
+
+	/* skip whitespace/prefill buffer */
+	do {
+		while (p >= e) {
+			is->priv->ptr = p;
+			if (imapx_input_stream_fill (is, cancellable, error) == IMAPX_TOK_ERROR)
+				return IMAPX_TOK_ERROR;
+			p = is->priv->ptr;
+			e = is->priv->end;
+		}
+		c = *p++;
+	} while (c == ' ' || c == '\r');
+
+	/* Only the atoms are sliced, the rest is left on the token() */
+	if (imapx_is_token_char (c) || c == '{' || c == '"' || c == '~') {
+		is->priv->ptr = p - 1;
+		return camel_imapx_input_stream_token (is, data, len, cancellable, error);
+	}
+
+	start = p - 1;
+	digits = isdigit (c) != 0;
+
+	while (1) {
+		while (p < e) {
+			c = *p;
+
+			if (imapx_is_notid_char (c)) {
+				*data = start;
+				*len = p - start;
+
+				if (c == ' ' || c == '\r')
+					p++;
+
+				is->priv->ptr = p;
+
+				return digits ? IMAPX_TOK_INT : IMAPX_TOK_TOKEN;
+			}
+
+			digits = digits && isdigit (c);
+			p++;
+		}
+
+		/* The atom continues after the buffered data; the fill moves it
+		 * to the beginning of the buffer, which grows when it is full. */
+		offset = p - start;
+		is->priv->ptr = start;
+
+		if (start == is->priv->buf && (gsize) (is->priv->end - is->priv->buf) >= is->priv->bufsize)
+			camel_imapx_input_stream_grow (is, 0, NULL, NULL);
+
+		if (imapx_input_stream_fill (is, cancellable, error) == IMAPX_TOK_ERROR)
+			return IMAPX_TOK_ERROR;
+
+		start = is->priv->ptr;
+		p = start + offset;
+		e = is->priv->end;
+	}
+}
+
 void
 camel_imapx_input_stream_ungettoken (CamelIMAPXInputStream *is,
                                      camel_imapx_token_t tok,
@@ -91,6 +91,13 @@ camel_imapx_token_t
 						 guint *len,
 						 GCancellable *cancellable,
 						 GError **error);
+camel_imapx_token_t
+		camel_imapx_input_stream_token_slice
+						(CamelIMAPXInputStream *is,
+						 guchar **start,
+						 guint *len,
+						 GCancellable *cancellable,
+						 GError **error);
 
 void		camel_imapx_input_stream_ungettoken
 						(CamelIMAPXInputStream *is,
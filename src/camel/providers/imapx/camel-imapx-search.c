@@ -24,12 +24,13 @@
 #include <camel/camel-search-private.h>
 
 #include "camel-imapx-folder.h"
+#include "camel-imapx-utils.h"
 
 struct _CamelIMAPXSearchPrivate {
 	GWeakRef imapx_store;
 	gint *local_data_search; /* not NULL, if testing whether all used headers are all locally available */
 
-	GHashTable *cached_results; /* gchar * (search description) ~> GHashTable { gchar * (uid {from string pool}) ~> NULL } */
+	GHashTable *cached_results; /* gchar * (search description) ~> GArray { struct _uid_range } */
 	GCancellable *cancellable; /* not referenced */
 	GError **error; /* not referenced */
 };
@@ -192,6 +193,22 @@ imapx_search_describe_criteria (const GString *criteria_prefix,
 	return g_string_free (desc, FALSE);
 }
 
+static gboolean
+imapx_search_results_contain_uid (const GArray *uid_ranges,
+				  const gchar *uid)
+{
+	guint64 number;
+	gchar *endptr = NULL;
+
+	if (!uid || !*uid)
+		return FALSE;
+
+	number = g_ascii_strtoull (uid, &endptr, 10);
+
+	return endptr && !*endptr && number <= G_MAXUINT32 &&
+		imapx_uid_ranges_contain (uid_ranges, (guint32) number);
+}
+
 static CamelSExpResult *
 imapx_search_process_criteria (CamelSExp *sexp,
                                CamelFolderSearch *search,
@@ -205,15 +222,16 @@ imapx_search_process_criteria (CamelSExp *sexp,
 	CamelIMAPXSearch *imapx_search = CAMEL_IMAPX_SEARCH (search);
 	CamelIMAPXMailbox *mailbox;
 	CamelMessageInfo *info;
-	GHashTable *cached_results;
+	GArray *cached_results;
 	gchar *criteria_desc;
-	GPtrArray *uids = NULL;
 	GError *local_error = NULL;
 
 	criteria_desc = imapx_search_describe_criteria (criteria_prefix, search_key, words);
 	cached_results = g_hash_table_lookup (imapx_search->priv->cached_results, criteria_desc);
 
 	if (!cached_results) {
+		GArray *uids = NULL;
+
 		mailbox = camel_imapx_folder_list_mailbox (
 			CAMEL_IMAPX_FOLDER (camel_folder_search_get_folder (search)), imapx_search->priv->cancellable, &local_error);
 
@@ -240,20 +258,12 @@ imapx_search_process_criteria (CamelSExp *sexp,
 			g_propagate_error (imapx_search->priv->error, local_error);
 
 			/* Make like we've got an empty result */
-			uids = g_ptr_array_new ();
+			uids = g_array_new (FALSE, FALSE, sizeof (struct _uid_range));
 		}
-	}
-
-	if (!cached_results) {
-		cached_results = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
-
-		if (uids) {
-			guint ii;
 
-			for (ii = 0; ii < uids->len; ii++) {
-				g_hash_table_insert (cached_results, (gpointer) camel_pstring_strdup (uids->pdata[ii]), NULL);
-			}
-		}
+		/* The results are kept as the UID ranges returned by the server,
+		   which can be much smaller than the list of the matching UIDs */
+		cached_results = uids;
 
 		g_hash_table_insert (imapx_search->priv->cached_results, criteria_desc, cached_results);
 	} else {
@@ -264,28 +274,24 @@ imapx_search_process_criteria (CamelSExp *sexp,
 
 	if (info) {
 		result = camel_sexp_result_new (sexp, CAMEL_SEXP_RES_BOOL);
-		result->value.boolean = g_hash_table_contains (cached_results, camel_message_info_get_uid (info));
+		result->value.boolean = imapx_search_results_contain_uid (cached_results, camel_message_info_get_uid (info));
 	} else {
-		if (!uids) {
-			GHashTableIter iter;
-			gpointer key;
+		GPtrArray *summary;
+		guint ii;
+
+		summary = camel_folder_search_get_summary (search);
 
-			uids = g_ptr_array_sized_new (g_hash_table_size (cached_results));
+		result = camel_sexp_result_new (sexp, CAMEL_SEXP_RES_ARRAY_PTR);
+		result->value.ptrarray = g_ptr_array_new ();
 
-			g_hash_table_iter_init (&iter, cached_results);
+		for (ii = 0; summary && cached_results->len && ii < summary->len; ii++) {
+			const gchar *uid = summary->pdata[ii];
 
-			while (g_hash_table_iter_next (&iter, &key, NULL)) {
-				g_ptr_array_add (uids, (gpointer) camel_pstring_strdup (key));
-			}
+			if (imapx_search_results_contain_uid (cached_results, uid))
+				g_ptr_array_add (result->value.ptrarray, (gpointer) uid);
 		}
-
-		result = camel_sexp_result_new (sexp, CAMEL_SEXP_RES_ARRAY_PTR);
-		result->value.ptrarray = g_ptr_array_ref (uids);
 	}
 
-	if (uids)
-		g_ptr_array_unref (uids);
-
 	return result;
 }
 
@@ -643,7 +649,7 @@ camel_imapx_search_init (CamelIMAPXSearch *search)
 {
 	search->priv = camel_imapx_search_get_instance_private (search);
 	search->priv->local_data_search = NULL;
-	search->priv->cached_results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_destroy);
+	search->priv->cached_results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_array_unref);
 
 	g_weak_ref_init (&search->priv->imapx_store, NULL);
 }
@@ -40,6 +40,7 @@
 #include "camel-imapx-folder.h"
 #include "camel-imapx-input-stream.h"
 #include "camel-imapx-job.h"
+#include "camel-imapx-deflate.h"
 #include "camel-imapx-logger.h"
 #include "camel-imapx-message-info.h"
 #include "camel-imapx-settings.h"
@@ -115,6 +116,10 @@ static gboolean	imapx_untagged_capability	(CamelIMAPXServer *is,
 						 GInputStream *input_stream,
 						 GCancellable *cancellable,
 						 GError **error);
+static gboolean	imapx_untagged_esearch		(CamelIMAPXServer *is,
+						 GInputStream *input_stream,
+						 GCancellable *cancellable,
+						 GError **error);
 static gboolean	imapx_untagged_exists		(CamelIMAPXServer *is,
 						 GInputStream *input_stream,
 						 GCancellable *cancellable,
@@ -180,6 +185,7 @@ enum {
 	IMAPX_UNTAGGED_ID_BAD = 0,
 	IMAPX_UNTAGGED_ID_BYE,
 	IMAPX_UNTAGGED_ID_CAPABILITY,
+	IMAPX_UNTAGGED_ID_ESEARCH,
 	IMAPX_UNTAGGED_ID_EXISTS,
 	IMAPX_UNTAGGED_ID_EXPUNGE,
 	IMAPX_UNTAGGED_ID_FETCH,
@@ -203,6 +209,7 @@ static const CamelIMAPXUntaggedRespHandlerDesc _untagged_descr[] = {
 	{CAMEL_IMAPX_UNTAGGED_BAD, imapx_untagged_ok_no_bad, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_BYE, imapx_untagged_bye, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_CAPABILITY, imapx_untagged_capability, NULL, FALSE},
+	{CAMEL_IMAPX_UNTAGGED_ESEARCH, imapx_untagged_esearch, NULL, FALSE},
 	{CAMEL_IMAPX_UNTAGGED_EXISTS, imapx_untagged_exists, NULL, TRUE},
 	{CAMEL_IMAPX_UNTAGGED_EXPUNGE, imapx_untagged_expunge, NULL, TRUE},
 	{CAMEL_IMAPX_UNTAGGED_FETCH, imapx_untagged_fetch, NULL, TRUE},
@@ -243,6 +250,10 @@ struct _CamelIMAPXServerPrivate {
 	GSubprocess *subprocess;
 	GMutex stream_lock;
 
+	/* RFC 4978 COMPRESS=DEFLATE, set when the compression is active */
+	GConverter *inflater;
+	GConverter *deflater;
+
 	GSource *inactivity_timeout;
 	GMutex inactivity_timeout_lock;
 
@@ -263,9 +274,10 @@ struct _CamelIMAPXServerPrivate {
 	 * LIST "" $pattern RETURN ($list_return_opts) */
 	gchar *list_return_opts;
 
-	/* Untagged SEARCH data gets deposited here.
-	 * The search command should claim the results
-	 * when finished and reset the pointer to NULL. */
+	/* Untagged SEARCH and ESEARCH data gets deposited here,
+	 * as an array of struct _uid_range. The search command
+	 * should claim the results when finished and reset
+	 * the pointer to NULL. */
 	GArray *search_results;
 	GMutex search_results_lock;
 
@@ -302,6 +314,7 @@ struct _CamelIMAPXServerPrivate {
 
 	CamelIMAPXCommand *current_command;
 	CamelIMAPXCommand *continuation_command;
+	GQueue pipelined_commands; /* CamelIMAPXCommand *, sent, waiting for completion; the head is the current_command */
 
 	/* operation data */
 	GIOStream *get_message_stream;
@@ -1095,6 +1108,54 @@ imapx_server_cinfo_has_attachment_cb (CamelMessageContentInfo *ci,
 	return !*pbool;
 }
 
+/* Stores the flags of a message from the flags scan of the fetch_changes();
+   the 'user_flags' can be NULL and it is consumed */
+static void
+imapx_server_fetch_changes_take_flags (CamelIMAPXServer *is,
+				       const gchar *uid,
+				       guint32 flags,
+				       CamelNamedFlags *user_flags,
+				       GCancellable *cancellable)
+{
+	FetchChangesInfo *nfo;
+	gint64 monotonic_time;
+	gint n_messages;
+
+	nfo = g_hash_table_lookup (is->priv->fetch_changes_infos, uid);
+	if (!nfo) {
+		nfo = g_slice_new0 (FetchChangesInfo);
+
+		g_hash_table_insert (is->priv->fetch_changes_infos, (gpointer) camel_pstring_strdup (uid), nfo);
+	} else {
+		camel_named_flags_free (nfo->server_user_flags);
+	}
+
+	nfo->server_flags = flags;
+	nfo->server_user_flags = user_flags;
+
+	monotonic_time = g_get_monotonic_time ();
+	n_messages = camel_imapx_mailbox_get_messages (is->priv->fetch_changes_mailbox);
+
+	if (n_messages > 0 && is->priv->fetch_changes_last_progress + G_USEC_PER_SEC / 2 < monotonic_time &&
+	    is->priv->context && is->priv->context->id <= n_messages) {
+		COMMAND_LOCK (is);
+
+		if (is->priv->current_command) {
+			guint32 n_messages;
+
+			COMMAND_UNLOCK (is);
+
+			is->priv->fetch_changes_last_progress = monotonic_time;
+
+			n_messages = camel_imapx_mailbox_get_messages (is->priv->fetch_changes_mailbox);
+			if (n_messages > 0)
+				camel_operation_progress (cancellable, 100 * is->priv->context->id / n_messages);
+		} else {
+			COMMAND_UNLOCK (is);
+		}
+	}
+}
+
 static gboolean
 imapx_untagged_fetch (CamelIMAPXServer *is,
                       GInputStream *input_stream,
@@ -1106,11 +1167,25 @@ imapx_untagged_fetch (CamelIMAPXServer *is,
 
 	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
 
-	finfo = imapx_parse_fetch (
-		CAMEL_IMAPX_INPUT_STREAM (input_stream), cancellable, error);
-	if (finfo == NULL) {
-		imapx_free_fetch (finfo);
-		return FALSE;
+	if (is->priv->fetch_changes_mailbox && is->priv->fetch_changes_folder && is->priv->fetch_changes_infos) {
+		struct _fetch_uid_flags ufinfo;
+
+		/* The flags scan returns one response per message, thus
+		   avoid building the whole fetch info for each of them */
+		if (!imapx_parse_fetch_uid_flags (CAMEL_IMAPX_INPUT_STREAM (input_stream), &ufinfo, &finfo, cancellable, error))
+			return FALSE;
+
+		if (!finfo) {
+			imapx_server_fetch_changes_take_flags (is, ufinfo.uid, ufinfo.flags, ufinfo.user_flags, cancellable);
+			return TRUE;
+		}
+	} else {
+		finfo = imapx_parse_fetch (
+			CAMEL_IMAPX_INPUT_STREAM (input_stream), cancellable, error);
+		if (finfo == NULL) {
+			imapx_free_fetch (finfo);
+			return FALSE;
+		}
 	}
 
 	/* Some IMAP servers respond with BODY[HEADER] when
@@ -1194,42 +1269,8 @@ imapx_untagged_fetch (CamelIMAPXServer *is,
 		 * and update if so, otherwise it must've been an unsolicited
 		 * response, so update the summary to match. */
 		if ((finfo->got & FETCH_UID) != 0 && is->priv->fetch_changes_folder && is->priv->fetch_changes_infos) {
-			FetchChangesInfo *nfo;
-			gint64 monotonic_time;
-			gint n_messages;
-
-			nfo = g_hash_table_lookup (is->priv->fetch_changes_infos, finfo->uid);
-			if (!nfo) {
-				nfo = g_slice_new0 (FetchChangesInfo);
-
-				g_hash_table_insert (is->priv->fetch_changes_infos, (gpointer) camel_pstring_strdup (finfo->uid), nfo);
-			}
-
-			nfo->server_flags = finfo->flags;
-			nfo->server_user_flags = finfo->user_flags;
+			imapx_server_fetch_changes_take_flags (is, finfo->uid, finfo->flags, finfo->user_flags, cancellable);
 			finfo->user_flags = NULL;
-
-			monotonic_time = g_get_monotonic_time ();
-			n_messages = camel_imapx_mailbox_get_messages (is->priv->fetch_changes_mailbox);
-
-			if (n_messages > 0 && is->priv->fetch_changes_last_progress + G_USEC_PER_SEC / 2 < monotonic_time &&
-			    is->priv->context && is->priv->context->id <= n_messages) {
-				COMMAND_LOCK (is);
-
-				if (is->priv->current_command) {
-					guint32 n_messages;
-
-					COMMAND_UNLOCK (is);
-
-					is->priv->fetch_changes_last_progress = monotonic_time;
-
-					n_messages = camel_imapx_mailbox_get_messages (is->priv->fetch_changes_mailbox);
-					if (n_messages > 0)
-						camel_operation_progress (cancellable, 100 * is->priv->context->id / n_messages);
-				} else {
-					COMMAND_UNLOCK (is);
-				}
-			}
 		} else if (select_mailbox != NULL) {
 			CamelFolder *select_folder;
 			CamelMessageInfo *mi = NULL;
@@ -1697,6 +1738,22 @@ imapx_untagged_recent (CamelIMAPXServer *is,
 	return TRUE;
 }
 
+static void
+imapx_server_take_search_results (CamelIMAPXServer *is,
+				  GArray *search_results)
+{
+	g_mutex_lock (&is->priv->search_results_lock);
+
+	if (is->priv->search_results == NULL)
+		is->priv->search_results = g_array_ref (search_results);
+	else
+		g_warning ("%s: Conflicting search results", G_STRFUNC);
+
+	g_mutex_unlock (&is->priv->search_results_lock);
+
+	g_array_unref (search_results);
+}
+
 static gboolean
 imapx_untagged_search (CamelIMAPXServer *is,
                        GInputStream *input_stream,
@@ -1708,11 +1765,11 @@ imapx_untagged_search (CamelIMAPXServer *is,
 	guint len;
 	guchar *token;
 	guint64 number;
-	gboolean success = FALSE;
 
-	search_results = g_array_new (FALSE, FALSE, sizeof (guint64));
+	search_results = g_array_new (FALSE, FALSE, sizeof (struct _uid_range));
 
 	while (TRUE) {
+		struct _uid_range range;
 		gboolean success;
 
 		/* Peek at the next token, and break
@@ -1722,8 +1779,10 @@ imapx_untagged_search (CamelIMAPXServer *is,
 			&token, &len, cancellable, error);
 		if (tok == '\n')
 			break;
-		if (tok == IMAPX_TOK_ERROR)
-			goto exit;
+		if (tok == IMAPX_TOK_ERROR) {
+			g_array_unref (search_results);
+			return FALSE;
+		}
 		camel_imapx_input_stream_ungettoken (
 			CAMEL_IMAPX_INPUT_STREAM (input_stream),
 			tok, token, len);
@@ -1732,27 +1791,96 @@ imapx_untagged_search (CamelIMAPXServer *is,
 			CAMEL_IMAPX_INPUT_STREAM (input_stream),
 			&number, cancellable, error);
 
-		if (!success)
-			goto exit;
+		if (!success) {
+			g_array_unref (search_results);
+			return FALSE;
+		}
+
+		range.first = (guint32) number;
+		range.last = range.first;
 
-		g_array_append_val (search_results, number);
+		g_array_append_val (search_results, range);
 	}
 
-	g_mutex_lock (&is->priv->search_results_lock);
+	imapx_uid_ranges_normalize (search_results);
+	imapx_server_take_search_results (is, search_results);
 
-	if (is->priv->search_results == NULL)
-		is->priv->search_results = g_array_ref (search_results);
-	else
-		g_warning ("%s: Conflicting search results", G_STRFUNC);
+	return TRUE;
+}
 
-	g_mutex_unlock (&is->priv->search_results_lock);
+/* RFC 4731, with the matches returned as a sequence-set in the ALL item;
+   no ALL means nothing matched */
+static gboolean
+imapx_untagged_esearch (CamelIMAPXServer *is,
+			GInputStream *input_stream,
+			GCancellable *cancellable,
+			GError **error)
+{
+	CamelIMAPXInputStream *stream = CAMEL_IMAPX_INPUT_STREAM (input_stream);
+	GArray *search_results;
+	gint tok;
+	guint len;
+	guchar *token;
 
-	success = TRUE;
+	search_results = g_array_new (FALSE, FALSE, sizeof (struct _uid_range));
 
-exit:
-	g_array_unref (search_results);
+	tok = camel_imapx_input_stream_token (stream, &token, &len, cancellable, error);
 
-	return success;
+	/* Skip the search correlator, (TAG "tag") */
+	if (tok == '(') {
+		do {
+			tok = camel_imapx_input_stream_token (stream, &token, &len, cancellable, error);
+		} while (tok != ')' && tok != '\n' && tok != IMAPX_TOK_ERROR);
+
+		if (tok == ')')
+			tok = camel_imapx_input_stream_token (stream, &token, &len, cancellable, error);
+	}
+
+	while (tok == IMAPX_TOK_TOKEN) {
+		if (len == 3 && g_ascii_strncasecmp ((const gchar *) token, "UID", 3) == 0) {
+			/* The UID indicator has no value */
+		} else if (len == 3 && g_ascii_strncasecmp ((const gchar *) token, "ALL", 3) == 0) {
+			if (!imapx_parse_uid_ranges (stream, search_results, cancellable, error)) {
+				g_array_unref (search_results);
+				return FALSE;
+			}
+		} else {
+			gint depth = 0;
+
+			/* COUNT, MIN, MAX and any extension; their value can be a parenthesized list */
+			do {
+				tok = camel_imapx_input_stream_token (stream, &token, &len, cancellable, error);
+
+				if (tok == '(')
+					depth++;
+				else if (tok == ')')
+					depth--;
+			} while (depth > 0 && tok != '\n' && tok != IMAPX_TOK_ERROR);
+
+			if (tok == '\n' || tok == IMAPX_TOK_ERROR)
+				break;
+		}
+
+		tok = camel_imapx_input_stream_token (stream, &token, &len, cancellable, error);
+	}
+
+	if (tok == IMAPX_TOK_ERROR) {
+		g_array_unref (search_results);
+		return FALSE;
+	}
+
+	if (tok != '\n') {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+			"esearch: unexpected token");
+		g_array_unref (search_results);
+		return FALSE;
+	}
+
+	imapx_uid_ranges_normalize (search_results);
+	imapx_server_take_search_results (is, search_results);
+
+	return TRUE;
 }
 
 static gboolean
@@ -2496,11 +2624,24 @@ imapx_completion (CamelIMAPXServer *is,
 
 	COMMAND_LOCK (is);
 
-	if (is->priv->current_command != NULL && is->priv->current_command->tag == tag)
+	if (is->priv->current_command != NULL && is->priv->current_command->tag == tag) {
 		ic = camel_imapx_command_ref (is->priv->current_command);
-	else
+	} else {
+		GList *link;
+
 		ic = NULL;
 
+		/* Servers can complete the pipelined commands in any order */
+		for (link = g_queue_peek_head_link (&is->priv->pipelined_commands); link; link = g_list_next (link)) {
+			CamelIMAPXCommand *pipelined = link->data;
+
+			if (pipelined->tag == tag) {
+				ic = camel_imapx_command_ref (pipelined);
+				break;
+			}
+		}
+	}
+
 	COMMAND_UNLOCK (is);
 
 	if (ic == NULL) {
@@ -2671,11 +2812,21 @@ imapx_server_set_streams (CamelIMAPXServer *is,
 	if (input_stream != NULL) {
 		GInputStream *temp_stream;
 
+		/* The inflater decompresses the data before the logger sees them. */
+		if (is->priv->inflater) {
+			input_stream = g_converter_input_stream_new (
+				input_stream, is->priv->inflater);
+		} else {
+			g_object_ref (input_stream);
+		}
+
 		/* The logger produces debugging output. */
 		logger = camel_imapx_logger_new (is->priv->tagprefix);
-		input_stream = g_converter_input_stream_new (
+		temp_stream = g_converter_input_stream_new (
 			input_stream, logger);
 		g_clear_object (&logger);
+		g_object_unref (input_stream);
+		input_stream = temp_stream;
 
 		/* Buffer the input stream for parsing. */
 		temp_stream = camel_imapx_input_stream_new (input_stream);
@@ -2688,11 +2839,23 @@ imapx_server_set_streams (CamelIMAPXServer *is,
 	}
 
 	if (output_stream != NULL) {
+		GOutputStream *temp_stream;
+
+		/* The deflater compresses the data after the logger saw them. */
+		if (is->priv->deflater) {
+			output_stream = g_converter_output_stream_new (
+				output_stream, is->priv->deflater);
+		} else {
+			g_object_ref (output_stream);
+		}
+
 		/* The logger produces debugging output. */
 		logger = camel_imapx_logger_new (is->priv->tagprefix);
-		output_stream = g_converter_output_stream_new (
+		temp_stream = g_converter_output_stream_new (
 			output_stream, logger);
 		g_clear_object (&logger);
+		g_object_unref (output_stream);
+		output_stream = temp_stream;
 	}
 
 	g_mutex_lock (&is->priv->stream_lock);
@@ -2720,6 +2883,55 @@ imapx_server_set_streams (CamelIMAPXServer *is,
 	g_mutex_unlock (&is->priv->stream_lock);
 }
 
+/* Puts the inflater and the deflater between the raw connection streams
+   and the logger, once the server accepted the COMPRESS DEFLATE command. */
+static gboolean
+imapx_server_start_compress (CamelIMAPXServer *is,
+			     GError **error)
+{
+	GInputStream *input_stream = NULL;
+	GOutputStream *output_stream = NULL;
+	gboolean success = FALSE;
+
+	g_mutex_lock (&is->priv->stream_lock);
+
+	/* Anything already read would be compressed data, read
+	   by the streams, which do not decompress it. */
+	if (CAMEL_IS_IMAPX_INPUT_STREAM (is->priv->input_stream) &&
+	    camel_imapx_input_stream_buffered (CAMEL_IMAPX_INPUT_STREAM (is->priv->input_stream)) == 0 &&
+	    G_IS_FILTER_OUTPUT_STREAM (is->priv->output_stream)) {
+		GInputStream *logger_stream;
+
+		logger_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (is->priv->input_stream));
+
+		if (G_IS_FILTER_INPUT_STREAM (logger_stream)) {
+			input_stream = g_object_ref (g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (logger_stream)));
+			output_stream = g_object_ref (g_filter_output_stream_get_base_stream (G_FILTER_OUTPUT_STREAM (is->priv->output_stream)));
+		}
+	}
+
+	if (input_stream && output_stream) {
+		is->priv->inflater = camel_imapx_deflate_new (TRUE);
+		is->priv->deflater = camel_imapx_deflate_new (FALSE);
+		success = TRUE;
+	}
+
+	g_mutex_unlock (&is->priv->stream_lock);
+
+	if (success) {
+		imapx_server_set_streams (is, input_stream, output_stream);
+	} else {
+		g_set_error_literal (
+			error, CAMEL_IMAPX_SERVER_ERROR, CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT,
+			_("Failed to start the compression of the connection"));
+	}
+
+	g_clear_object (&input_stream);
+	g_clear_object (&output_stream);
+
+	return success;
+}
+
 #ifdef G_OS_UNIX
 static void
 imapx_server_child_process_setup (gpointer user_data)
@@ -3450,9 +3662,39 @@ imapx_reconnect (CamelIMAPXServer *is,
 	is->priv->state = IMAPX_AUTHENTICATED;
 
 preauthed:
-	/* Fetch namespaces (if supported). */
 	g_mutex_lock (&is->priv->stream_lock);
 
+	/* RFC 4978; the compression starts right after the tagged OK */
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->priv->cinfo, COMPRESS_DEFLATE) && !is->priv->inflater) {
+		GError *local_error = NULL;
+		gboolean compress;
+
+		g_mutex_unlock (&is->priv->stream_lock);
+
+		ic = camel_imapx_command_new (is, CAMEL_IMAPX_JOB_ENABLE, "COMPRESS DEFLATE");
+		compress = camel_imapx_server_process_command_sync (is, ic, _("Failed to issue COMPRESS DEFLATE"), cancellable, &local_error);
+
+		/* The server can refuse it, then continue without the compression */
+		if (!compress && ic->status && ic->status->result != IMAPX_OK) {
+			c (is->priv->tagprefix, "COMPRESS DEFLATE refused: %s\n", local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+		}
+
+		camel_imapx_command_unref (ic);
+
+		if (local_error != NULL) {
+			g_propagate_error (error, local_error);
+			goto exception;
+		}
+
+		if (compress && !imapx_server_start_compress (is, error))
+			goto exception;
+
+		g_mutex_lock (&is->priv->stream_lock);
+	}
+
+	/* Fetch namespaces (if supported). */
+
 	is->priv->utf8_accept = FALSE;
 
 	/* RFC 6855 */
@@ -3792,6 +4034,7 @@ camel_imapx_server_init (CamelIMAPXServer *is)
 	is->priv->idle_stamp = 0;
 
 	g_rec_mutex_init (&is->priv->command_lock);
+	g_queue_init (&is->priv->pipelined_commands);
 }
 
 CamelIMAPXServer *
@@ -4226,6 +4469,183 @@ camel_imapx_server_process_command_sync (CamelIMAPXServer *is,
 	return success;
 }
 
+/* How many commands can wait for their completion at once */
+#define IMAPX_PIPELINE_WINDOW 8
+
+typedef void (* IMAPXCommandDoneFunc) (CamelIMAPXServer *is,
+				       CamelIMAPXCommand *ic,
+				       gpointer user_data);
+
+/* Sends the 'commands' without waiting for the completion of the previous
+   one, with up to IMAPX_PIPELINE_WINDOW of them in flight, thus the server
+   round-trip is paid once per window, not once per command. The commands
+   cannot have literals. The 'done_func' is called for each successfully
+   completed command, in the order of the 'commands'. After the first command
+   failed no other is sent, but those already sent are still waited for. */
+static gboolean
+imapx_server_process_commands_pipelined_sync (CamelIMAPXServer *is,
+					      GPtrArray *commands,
+					      IMAPXCommandDoneFunc done_func,
+					      gpointer user_data,
+					      const gchar *error_prefix,
+					      GCancellable *cancellable,
+					      GError **error)
+{
+	GInputStream *input_stream = NULL;
+	GOutputStream *output_stream = NULL;
+	GError *local_error = NULL;
+	GError *command_error = NULL;
+	gboolean success = TRUE;
+	guint next = 0;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
+	g_return_val_if_fail (commands != NULL, FALSE);
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, &local_error))
+		goto exit;
+
+	input_stream = camel_imapx_server_ref_input_stream (is);
+	output_stream = camel_imapx_server_ref_output_stream (is);
+
+	if (output_stream == NULL) {
+		local_error = g_error_new_literal (
+			CAMEL_IMAPX_SERVER_ERROR, CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT,
+			_("Cannot issue command, no stream available"));
+		goto exit;
+	}
+
+	COMMAND_LOCK (is);
+
+	if (is->priv->current_command != NULL) {
+		g_warning ("%s: [%c] %p: Starting pipelined commands while still processing %p (%s)", G_STRFUNC,
+			is->priv->tagprefix, is, is->priv->current_command,
+			camel_imapx_job_get_kind_name (is->priv->current_command->job_kind));
+	}
+
+	COMMAND_UNLOCK (is);
+
+	while (success && (next < commands->len || !g_queue_is_empty (&is->priv->pipelined_commands))) {
+		CamelIMAPXCommand *ic;
+
+		/* Fill the window, unless any command failed */
+		while (success && !command_error && next < commands->len &&
+		       g_queue_get_length (&is->priv->pipelined_commands) < IMAPX_PIPELINE_WINDOW) {
+			CamelIMAPXCommandPart *cp;
+			gchar *string;
+
+			ic = g_ptr_array_index (commands, next);
+			next++;
+
+			camel_imapx_command_close (ic);
+			g_clear_pointer (&ic->status, imapx_free_status);
+			ic->completed = FALSE;
+			ic->current_part = g_queue_peek_head_link (&ic->parts);
+
+			g_warn_if_fail (g_queue_get_length (&ic->parts) == 1);
+
+			if (g_cancellable_set_error_if_cancelled (cancellable, &local_error)) {
+				success = FALSE;
+				break;
+			}
+
+			cp = ic->current_part->data;
+
+			COMMAND_LOCK (is);
+
+			g_queue_push_tail (&is->priv->pipelined_commands, camel_imapx_command_ref (ic));
+			is->priv->current_command = g_queue_peek_head (&is->priv->pipelined_commands);
+			is->priv->continuation_command = NULL;
+
+			COMMAND_UNLOCK (is);
+
+			c (is->priv->tagprefix, "Starting pipelined command %c%05u %s\r\n", is->priv->tagprefix, ic->tag, cp->data);
+
+			string = g_strdup_printf ("%c%05u %s\r\n", is->priv->tagprefix, ic->tag, cp->data);
+			g_mutex_lock (&is->priv->stream_lock);
+			success = g_output_stream_write_all (
+				output_stream, string, strlen (string),
+				NULL, cancellable, &local_error);
+			g_mutex_unlock (&is->priv->stream_lock);
+			g_free (string);
+		}
+
+		if (!success || g_queue_is_empty (&is->priv->pipelined_commands))
+			break;
+
+		/* The responses are processed as they come, for any of the commands */
+		success = imapx_step (is, input_stream, output_stream, cancellable, &local_error);
+
+		COMMAND_LOCK (is);
+
+		while (ic = g_queue_peek_head (&is->priv->pipelined_commands), ic && ic->completed) {
+			g_queue_pop_head (&is->priv->pipelined_commands);
+			is->priv->current_command = g_queue_peek_head (&is->priv->pipelined_commands);
+
+			COMMAND_UNLOCK (is);
+
+			if (ic->status && ic->status->result != IMAPX_OK) {
+				if (!command_error) {
+					command_error = g_error_new (
+						CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+						"%s", ic->status->text);
+				}
+			} else if (!command_error && done_func) {
+				done_func (is, ic, user_data);
+			}
+
+			camel_imapx_command_unref (ic);
+
+			COMMAND_LOCK (is);
+		}
+
+		COMMAND_UNLOCK (is);
+	}
+
+	if (success)
+		imapx_server_reset_inactivity_timer (is);
+
+ exit:
+	COMMAND_LOCK (is);
+
+	/* Some were not completed, when an error interrupted the processing */
+	while (!g_queue_is_empty (&is->priv->pipelined_commands)) {
+		camel_imapx_command_unref (g_queue_pop_head (&is->priv->pipelined_commands));
+	}
+
+	is->priv->current_command = NULL;
+	is->priv->continuation_command = NULL;
+
+	COMMAND_UNLOCK (is);
+
+	if (!local_error && command_error) {
+		local_error = command_error;
+		command_error = NULL;
+	}
+
+	g_clear_error (&command_error);
+
+	if (local_error) {
+		if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_FAILED) ||
+		    g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE) ||
+		    g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)) {
+			local_error->domain = CAMEL_IMAPX_SERVER_ERROR;
+			local_error->code = CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT;
+		}
+
+		if (error_prefix)
+			g_prefix_error (&local_error, "%s: ", error_prefix);
+
+		g_propagate_error (error, local_error);
+
+		success = FALSE;
+	}
+
+	g_clear_object (&input_stream);
+	g_clear_object (&output_stream);
+
+	return success;
+}
+
 static void
 imapx_disconnect (CamelIMAPXServer *is)
 {
@@ -4238,10 +4658,20 @@ imapx_disconnect (CamelIMAPXServer *is)
 		imapx_server_set_connection_timeout (is->priv->connection, 3);
 	}
 
+	if (is->priv->inflater && is->priv->deflater) {
+		c (is->priv->tagprefix, "COMPRESS DEFLATE: read %" G_GUINT64_FORMAT " bytes as %" G_GUINT64_FORMAT ", wrote %" G_GUINT64_FORMAT " bytes as %" G_GUINT64_FORMAT "\n",
+			camel_imapx_deflate_get_total_out (CAMEL_IMAPX_DEFLATE (is->priv->inflater)),
+			camel_imapx_deflate_get_total_in (CAMEL_IMAPX_DEFLATE (is->priv->inflater)),
+			camel_imapx_deflate_get_total_in (CAMEL_IMAPX_DEFLATE (is->priv->deflater)),
+			camel_imapx_deflate_get_total_out (CAMEL_IMAPX_DEFLATE (is->priv->deflater)));
+	}
+
 	g_clear_object (&is->priv->input_stream);
 	g_clear_object (&is->priv->output_stream);
 	g_clear_object (&is->priv->connection);
 	g_clear_object (&is->priv->subprocess);
+	g_clear_object (&is->priv->inflater);
+	g_clear_object (&is->priv->deflater);
 
 	g_clear_pointer (&is->priv->cinfo, imapx_free_capability);
 
@@ -5292,6 +5722,16 @@ imapx_uids_desc_cmp (gconstpointer ap,
 	return imapx_refresh_info_uid_cmp (a, b, FALSE);
 }
 
+static gint
+imapx_uid_numbers_cmp (gconstpointer ap,
+		       gconstpointer bp)
+{
+	guint32 a = *((const guint32 *) ap);
+	guint32 b = *((const guint32 *) bp);
+
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
 static void
 imapx_server_process_fetch_changes_infos (CamelIMAPXServer *is,
 					  CamelIMAPXMailbox *mailbox,
@@ -5353,6 +5793,17 @@ imapx_server_process_fetch_changes_infos (CamelIMAPXServer *is,
 	}
 }
 
+static void
+imapx_server_fetch_changes_command_done (CamelIMAPXServer *is,
+					 CamelIMAPXCommand *ic,
+					 gpointer user_data)
+{
+	GHashTable *infos = user_data;
+
+	imapx_server_process_fetch_changes_infos (is, is->priv->fetch_changes_mailbox, is->priv->fetch_changes_folder, infos, NULL, NULL, 0, 0);
+	g_hash_table_remove_all (infos);
+}
+
 static gboolean
 imapx_server_fetch_changes (CamelIMAPXServer *is,
 			    CamelIMAPXMailbox *mailbox,
@@ -5360,6 +5811,7 @@ imapx_server_fetch_changes (CamelIMAPXServer *is,
 			    GHashTable *known_uids,
 			    guint64 from_uidl,
 			    guint64 to_uidl,
+			    gboolean notify_changes,
 			    GCancellable *cancellable,
 			    GError **error)
 {
@@ -5413,11 +5865,18 @@ imapx_server_fetch_changes (CamelIMAPXServer *is,
 
 	if (success && fetch_summary_uids) {
 		struct _uidset_state uidset;
+		GPtrArray *commands;
 		GSList *link;
+		GError *local_error = NULL;
+		gboolean bodystructure_enabled;
+		CamelIMAPXStore *imapx_store;
 
 		ic = NULL;
 		imapx_uidset_init (&uidset, 0, 100);
 
+		imapx_store = camel_imapx_server_ref_store (is);
+		bodystructure_enabled = imapx_store && camel_imapx_store_get_bodystructure_enabled (imapx_store);
+
 		camel_operation_push_message (cancellable,
 			/* Translators: The first “%s” is replaced with an account name and the second “%s”
 			   is replaced with a full path name. The spaces around “:” are intentional, as
@@ -5427,6 +5886,7 @@ imapx_server_fetch_changes (CamelIMAPXServer *is,
 			camel_folder_get_full_name (folder));
 
 		fetch_summary_uids = g_slist_sort (fetch_summary_uids, imapx_uids_desc_cmp);
+		commands = g_ptr_array_new_with_free_func ((GDestroyNotify) camel_imapx_command_unref);
 
 		for (link = fetch_summary_uids; link; link = g_slist_next (link)) {
 			const gchar *uid = link->data;
@@ -5438,44 +5898,39 @@ imapx_server_fetch_changes (CamelIMAPXServer *is,
 				ic = camel_imapx_command_new (is, CAMEL_IMAPX_JOB_REFRESH_INFO, "UID FETCH ");
 
 			if (imapx_uidset_add (&uidset, ic, uid) == 1 || (!link->next && ic && imapx_uidset_done (&uidset, ic))) {
-				GError *local_error = NULL;
-				gboolean bodystructure_enabled;
-				CamelIMAPXStore *imapx_store;
-
-				imapx_store = camel_imapx_server_ref_store (is);
-				bodystructure_enabled = imapx_store && camel_imapx_store_get_bodystructure_enabled (imapx_store);
-
 				if (bodystructure_enabled)
 					camel_imapx_command_add (ic, " (RFC822.SIZE RFC822.HEADER BODYSTRUCTURE FLAGS)");
 				else
 					camel_imapx_command_add (ic, " (RFC822.SIZE RFC822.HEADER FLAGS)");
 
-				success = camel_imapx_server_process_command_sync (is, ic, _("Error fetching message info"), cancellable, &local_error);
-
-				camel_imapx_command_unref (ic);
+				g_ptr_array_add (commands, ic);
 				ic = NULL;
+			}
+		}
 
-				/* Some servers can return broken BODYSTRUCTURE response, thus disable it
-				   even when it's not 100% sure the BODYSTRUCTURE response was the broken one. */
-				if (bodystructure_enabled && !success &&
-				    g_error_matches (local_error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED)) {
-					camel_imapx_store_set_bodystructure_enabled (imapx_store, FALSE);
-					local_error->domain = CAMEL_IMAPX_SERVER_ERROR;
-					local_error->code = CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT;
-				}
-
-				g_clear_object (&imapx_store);
+		if (ic)
+			camel_imapx_command_unref (ic);
 
-				if (local_error)
-					g_propagate_error (error, local_error);
+		/* The responses of all the commands are stored in the 'infos',
+		   thus processed after each, in order, it does not matter which */
+		success = imapx_server_process_commands_pipelined_sync (is, commands,
+			imapx_server_fetch_changes_command_done, infos,
+			_("Error fetching message info"), cancellable, &local_error);
+
+		/* Some servers can return broken BODYSTRUCTURE response, thus disable it
+		   even when it's not 100% sure the BODYSTRUCTURE response was the broken one. */
+		if (bodystructure_enabled && !success &&
+		    g_error_matches (local_error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED)) {
+			camel_imapx_store_set_bodystructure_enabled (imapx_store, FALSE);
+			local_error->domain = CAMEL_IMAPX_SERVER_ERROR;
+			local_error->code = CAMEL_IMAPX_SERVER_ERROR_TRY_RECONNECT;
+		}
 
-				if (!success)
-					break;
+		if (local_error)
+			g_propagate_error (error, local_error);
 
-				imapx_server_process_fetch_changes_infos (is, mailbox, folder, infos, NULL, NULL, 0, 0);
-				g_hash_table_remove_all (infos);
-			}
-		}
+		g_ptr_array_unref (commands);
+		g_clear_object (&imapx_store);
 
 		camel_operation_pop_message (cancellable);
 
@@ -5493,6 +5948,9 @@ imapx_server_fetch_changes (CamelIMAPXServer *is,
 	g_slist_free_full (fetch_summary_uids, (GDestroyNotify) camel_pstring_free);
 	g_hash_table_destroy (infos);
 
+	if (!notify_changes)
+		return success;
+
 	g_mutex_lock (&is->priv->changes_lock);
 
 	/* Notify about new messages, thus they are shown in the UI early. */
@@ -5678,9 +6136,9 @@ camel_imapx_server_refresh_info_sync (CamelIMAPXServer *is,
 
 	skip_old_flags_update = camel_imapx_server_skip_old_flags_update (camel_folder_get_parent_store (folder));
 
-	success = imapx_server_fetch_changes (is, mailbox, folder, known_uids, uidl, 0, cancellable, error);
+	success = imapx_server_fetch_changes (is, mailbox, folder, known_uids, uidl, 0, TRUE, cancellable, error);
 	if (success && uidl != 1 && !skip_old_flags_update)
-		success = imapx_server_fetch_changes (is, mailbox, folder, known_uids, 0, uidl, cancellable, error);
+		success = imapx_server_fetch_changes (is, mailbox, folder, known_uids, 0, uidl, TRUE, cancellable, error);
 
 	if (success) {
 		imapx_summary->modseq = highestmodseq;
@@ -5698,35 +6156,72 @@ camel_imapx_server_refresh_info_sync (CamelIMAPXServer *is,
 
 	if (success && !skip_old_flags_update) {
 		GList *removed = NULL;
-		GPtrArray *array;
-		gint ii;
+		GArray *server_uids, *only_in_summary = NULL;
+		GHashTableIter iter;
+		gpointer key;
+		guint ii;
+
+		/* The UIDs from the server are numeric, thus compare them with the summary's
+		   numeric UID index, without copying all the UIDs of the summary */
+		server_uids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), g_hash_table_size (known_uids));
+
+		g_hash_table_iter_init (&iter, known_uids);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			guint64 number = g_ascii_strtoull (key, NULL, 10);
+
+			if (number > 0 && number <= G_MAXUINT32) {
+				guint32 number32 = (guint32) number;
+
+				g_array_append_val (server_uids, number32);
+			}
+		}
+
+		g_array_sort (server_uids, imapx_uid_numbers_cmp);
 
 		camel_folder_summary_lock (CAMEL_FOLDER_SUMMARY (imapx_summary));
 
-		array = camel_folder_summary_get_array (CAMEL_FOLDER_SUMMARY (imapx_summary));
-		for (ii = 0; array && ii < array->len; ii++) {
-			const gchar *uid = array->pdata[ii];
+		if (camel_folder_summary_diff_numeric_uids (CAMEL_FOLDER_SUMMARY (imapx_summary),
+			(const guint32 *) server_uids->data, server_uids->len, &only_in_summary, NULL)) {
+			for (ii = 0; ii < only_in_summary->len; ii++) {
+				gchar *uid;
 
-			if (!uid)
-				continue;
+				uid = g_strdup_printf ("%u", g_array_index (only_in_summary, guint32, ii));
+
+				removed = g_list_prepend (removed, (gpointer) camel_pstring_add (uid, TRUE));
+			}
+
+			g_array_unref (only_in_summary);
+		} else {
+			GPtrArray *array;
 
-			if (!g_hash_table_contains (known_uids, uid)) {
-				removed = g_list_prepend (removed, (gpointer) uid);
-				camel_folder_change_info_remove_uid (changes, uid);
+			/* Not all the UIDs in the summary are numeric */
+			array = camel_folder_summary_get_array (CAMEL_FOLDER_SUMMARY (imapx_summary));
+			for (ii = 0; array && ii < array->len; ii++) {
+				const gchar *uid = array->pdata[ii];
+
+				if (uid && !g_hash_table_contains (known_uids, uid))
+					removed = g_list_prepend (removed, (gpointer) camel_pstring_strdup (uid));
 			}
+
+			camel_folder_summary_free_array (array);
 		}
 
 		camel_folder_summary_unlock (CAMEL_FOLDER_SUMMARY (imapx_summary));
 
+		g_array_unref (server_uids);
+
 		if (removed != NULL) {
+			GList *link;
+
+			for (link = removed; link; link = g_list_next (link)) {
+				camel_folder_change_info_remove_uid (changes, link->data);
+			}
+
 			camel_folder_summary_remove_uids (CAMEL_FOLDER_SUMMARY (imapx_summary), removed);
 			camel_folder_summary_touch (CAMEL_FOLDER_SUMMARY (imapx_summary));
 
-			/* Shares UIDs with the 'array'. */
-			g_list_free (removed);
+			g_list_free_full (removed, (GDestroyNotify) camel_pstring_free);
 		}
-
-		camel_folder_summary_free_array (array);
 	}
 
 	camel_folder_summary_save (CAMEL_FOLDER_SUMMARY (imapx_summary), NULL);
@@ -5743,6 +6238,46 @@ camel_imapx_server_refresh_info_sync (CamelIMAPXServer *is,
 	return success;
 }
 
+/* Fetches the summary of the messages from the UID range, which are not
+   in the folder summary yet, and updates the flags of those, which are.
+   The summary is not saved and the folder is not notified; the changes
+   are added into the 'changes' instead, thus the caller can fetch disjoint
+   ranges over several connections and merge the results. */
+gboolean
+camel_imapx_server_fetch_uid_range_sync (CamelIMAPXServer *is,
+					 CamelIMAPXMailbox *mailbox,
+					 guint64 from_uid,
+					 guint64 to_uid,
+					 CamelFolderChangeInfo *changes,
+					 GCancellable *cancellable,
+					 GError **error)
+{
+	CamelFolder *folder;
+	gboolean success;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_SERVER (is), FALSE);
+	g_return_val_if_fail (CAMEL_IS_IMAPX_MAILBOX (mailbox), FALSE);
+	g_return_val_if_fail (from_uid > 0 && from_uid <= to_uid, FALSE);
+	g_return_val_if_fail (changes != NULL, FALSE);
+
+	folder = imapx_server_ref_folder (is, mailbox);
+	g_return_val_if_fail (folder != NULL, FALSE);
+
+	success = camel_imapx_server_ensure_selected_sync (is, mailbox, cancellable, error) &&
+		imapx_server_fetch_changes (is, mailbox, folder, NULL, from_uid, to_uid, FALSE, cancellable, error);
+
+	g_mutex_lock (&is->priv->changes_lock);
+
+	camel_folder_change_info_cat (changes, is->priv->changes);
+	camel_folder_change_info_clear (is->priv->changes);
+
+	g_mutex_unlock (&is->priv->changes_lock);
+
+	g_object_unref (folder);
+
+	return success;
+}
+
 static void
 imapx_sync_free_user (GArray *user_set)
 {
@@ -6806,7 +7341,8 @@ camel_imapx_server_update_quota_info_sync (CamelIMAPXServer *is,
 	return success;
 }
 
-GPtrArray *
+/* Returns the matching UIDs as a sorted array of struct _uid_range */
+GArray *
 camel_imapx_server_uid_search_sync (CamelIMAPXServer *is,
 				    CamelIMAPXMailbox *mailbox,
 				    const gchar *criteria_prefix,
@@ -6817,7 +7353,6 @@ camel_imapx_server_uid_search_sync (CamelIMAPXServer *is,
 {
 	CamelIMAPXCommand *ic;
 	GArray *uid_search_results;
-	GPtrArray *results = NULL;
 	gint ii;
 	gboolean need_charset = FALSE;
 	gboolean success;
@@ -6837,6 +7372,9 @@ camel_imapx_server_uid_search_sync (CamelIMAPXServer *is,
 	}
 
 	ic = camel_imapx_command_new (is, CAMEL_IMAPX_JOB_UID_SEARCH, "UID SEARCH");
+	/* The ALL is a compact sequence-set, not a list of every matching UID */
+	if (CAMEL_IMAPX_HAVE_CAPABILITY (is->priv->cinfo, ESEARCH))
+		camel_imapx_command_add (ic, " RETURN (ALL)");
 	if (need_charset)
 		camel_imapx_command_add (ic, " CHARSET UTF-8");
 	if (criteria_prefix && *criteria_prefix)
@@ -6873,31 +7411,18 @@ camel_imapx_server_uid_search_sync (CamelIMAPXServer *is,
 	is->priv->search_results = NULL;
 	g_mutex_unlock (&is->priv->search_results_lock);
 
-	if (success) {
-		guint ii;
-
-		/* Convert the numeric UIDs to strings. */
-
-		g_return_val_if_fail (uid_search_results != NULL, NULL);
-
-		results = g_ptr_array_new_full (uid_search_results->len, (GDestroyNotify) camel_pstring_free);
-
-		for (ii = 0; ii < uid_search_results->len; ii++) {
-			const gchar *pooled_uid;
-			guint64 numeric_uid;
-			gchar *alloced_uid;
+	if (!success) {
+		if (uid_search_results)
+			g_array_unref (uid_search_results);
 
-			numeric_uid = g_array_index (uid_search_results, guint64, ii);
-			alloced_uid = g_strdup_printf ("%" G_GUINT64_FORMAT, numeric_uid);
-			pooled_uid = camel_pstring_add (alloced_uid, TRUE);
-			g_ptr_array_add (results, (gpointer) pooled_uid);
-		}
+		return NULL;
 	}
 
-	if (uid_search_results)
-		g_array_unref (uid_search_results);
+	/* The server may not send an ESEARCH response at all, when nothing matched */
+	if (!uid_search_results)
+		uid_search_results = g_array_new (FALSE, FALSE, sizeof (struct _uid_range));
 
-	return results;
+	return uid_search_results;
 }
 
 typedef struct _IdleThreadData {
@@ -194,6 +194,14 @@ gboolean	camel_imapx_server_refresh_info_sync
 						 CamelIMAPXMailbox *mailbox,
 						 GCancellable *cancellable,
 						 GError **error);
+gboolean	camel_imapx_server_fetch_uid_range_sync
+						(CamelIMAPXServer *is,
+						 CamelIMAPXMailbox *mailbox,
+						 guint64 from_uid,
+						 guint64 to_uid,
+						 CamelFolderChangeInfo *changes,
+						 GCancellable *cancellable,
+						 GError **error);
 gboolean	camel_imapx_server_sync_changes_sync
 						(CamelIMAPXServer *is,
 						 CamelIMAPXMailbox *mailbox,
@@ -274,7 +282,7 @@ gboolean	camel_imapx_server_update_quota_info_sync
 						 CamelIMAPXMailbox *mailbox,
 						 GCancellable *cancellable,
 						 GError **error);
-GPtrArray *	camel_imapx_server_uid_search_sync
+GArray *	camel_imapx_server_uid_search_sync
 						(CamelIMAPXServer *is,
 						 CamelIMAPXMailbox *mailbox,
 						 const gchar *criteria_prefix,
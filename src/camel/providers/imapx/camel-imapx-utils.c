@@ -96,15 +96,14 @@ static struct {
 	{ "\\*", CAMEL_MESSAGE_USER }
 };
 
-/* utility functions
- * should this be part of imapx-driver? */
-/* maybe this should be a stream op? */
-gboolean
-imapx_parse_flags (CamelIMAPXInputStream *stream,
-                   guint32 *flagsp,
-                   CamelNamedFlags *user_flags,
-                   GCancellable *cancellable,
-                   GError **error)
+/* Collects the user flags only when 'puser_flags' is not NULL; the *puser_flags
+   is created on the first user flag, when it is NULL. */
+static gboolean
+imapx_parse_flags_internal (CamelIMAPXInputStream *stream,
+			    guint32 *flagsp,
+			    CamelNamedFlags **puser_flags,
+			    GCancellable *cancellable,
+			    GError **error)
 {
 	camel_imapx_token_t tok;
 	guint len;
@@ -129,7 +128,8 @@ imapx_parse_flags (CamelIMAPXInputStream *stream,
 	}
 
 	do {
-		tok = camel_imapx_input_stream_token (
+		/* The flags are compared in place, without copying them */
+		tok = camel_imapx_input_stream_token_slice (
 			stream, &token, &len, cancellable, error);
 
 		if (tok == IMAPX_TOK_ERROR)
@@ -137,26 +137,24 @@ imapx_parse_flags (CamelIMAPXInputStream *stream,
 
 		if (tok == IMAPX_TOK_TOKEN || tok == IMAPX_TOK_INT) {
 			gboolean match_found = FALSE;
-			gchar *upper;
 			gint ii;
 
-			upper = g_ascii_strup ((gchar *) token, len);
-
 			for (ii = 0; ii < G_N_ELEMENTS (flag_table); ii++) {
-				if (!strcmp (upper, flag_table[ii].name)) {
+				if (g_ascii_strncasecmp ((gchar *) token, flag_table[ii].name, len) == 0 &&
+				    !flag_table[ii].name[len]) {
 					flags |= flag_table[ii].flag;
 					match_found = TRUE;
 					break;
 				}
 			}
 
-			if (!match_found && user_flags) {
+			if (!match_found && puser_flags) {
 				const gchar *flag_name;
-				gchar *utf8;
+				gchar *flag, *utf8;
+
+				flag = g_strndup ((gchar *) token, len);
 
-				flag_name = rename_label_flag (
-					(gchar *) token,
-					strlen ((gchar *) token), TRUE);
+				flag_name = rename_label_flag (flag, len, TRUE);
 
 				utf8 = camel_utf7_utf8 (flag_name);
 				if (utf8 && !g_utf8_validate (utf8, -1, NULL)) {
@@ -164,13 +162,14 @@ imapx_parse_flags (CamelIMAPXInputStream *stream,
 					utf8 = NULL;
 				}
 
-				camel_named_flags_insert (user_flags, utf8 ? utf8 : flag_name);
+				if (!*puser_flags)
+					*puser_flags = camel_named_flags_new ();
+
+				camel_named_flags_insert (*puser_flags, utf8 ? utf8 : flag_name);
 
 				g_free (utf8);
+				g_free (flag);
 			}
-
-			g_free (upper);
-
 		} else if (tok != ')') {
 			gboolean success;
 
@@ -186,6 +185,19 @@ imapx_parse_flags (CamelIMAPXInputStream *stream,
 	return TRUE;
 }
 
+/* utility functions
+ * should this be part of imapx-driver? */
+/* maybe this should be a stream op? */
+gboolean
+imapx_parse_flags (CamelIMAPXInputStream *stream,
+                   guint32 *flagsp,
+                   CamelNamedFlags *user_flags,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+	return imapx_parse_flags_internal (stream, flagsp, user_flags ? &user_flags : NULL, cancellable, error);
+}
+
 /*
  * rename_flag
  * Converts label flag name on server to name used in Evolution or back.
@@ -438,6 +450,16 @@ camel_imapx_dup_uid_from_summary_index (CamelFolder *folder,
 	summary = camel_folder_get_folder_summary (folder);
 	g_return_val_if_fail (CAMEL_IS_FOLDER_SUMMARY (summary), NULL);
 
+	/* The IMAP UIDs are numeric, thus avoid copying and sorting all of them */
+	if (camel_folder_summary_has_numeric_uids (summary)) {
+		guint32 numeric_uid;
+
+		if (camel_folder_summary_get_nth_numeric_uid (summary, summary_index, &numeric_uid))
+			uid = g_strdup_printf ("%u", numeric_uid);
+
+		return uid;
+	}
+
 	array = camel_folder_summary_get_array (summary);
 	g_return_val_if_fail (array != NULL, NULL);
 
@@ -483,7 +505,9 @@ struct {
 	{ "X-GM-EXT-1", IMAPX_CAPABILITY_X_GM_EXT_1 },
 	{ "UTF8=ACCEPT", IMAPX_CAPABILITY_UTF8_ACCEPT },
 	{ "UTF8=ONLY", IMAPX_CAPABILITY_UTF8_ONLY },
-	{ "LOGINDISABLED", IMAPX_CAPABILITY_LOGINDISABLED }
+	{ "LOGINDISABLED", IMAPX_CAPABILITY_LOGINDISABLED },
+	{ "COMPRESS=DEFLATE", IMAPX_CAPABILITY_COMPRESS_DEFLATE },
+	{ "ESEARCH", IMAPX_CAPABILITY_ESEARCH }
 };
 
 static GMutex capa_htable_lock;         /* capabilities lookup table lock */
@@ -2106,41 +2130,23 @@ imapx_parse_fetch_uid (CamelIMAPXInputStream *stream,
 	return TRUE;
 }
 
-struct _fetch_info *
-imapx_parse_fetch (CamelIMAPXInputStream *stream,
-                   GCancellable *cancellable,
-                   GError **error)
+/* Parses the items of a FETCH response, the first of them already read
+   as the 'tok', up to the closing ')' */
+static gboolean
+imapx_parse_fetch_items (CamelIMAPXInputStream *stream,
+			 struct _fetch_info *finfo,
+			 gint tok,
+			 guchar *token,
+			 guint len,
+			 GCancellable *cancellable,
+			 GError **error)
 {
-	gint tok;
-	guint len;
-	guchar *token, *p, c;
-	struct _fetch_info *finfo;
-
-	finfo = g_malloc0 (sizeof (*finfo));
-	finfo->user_flags = camel_named_flags_new ();
-
-	tok = camel_imapx_input_stream_token (
-		stream, &token, &len, cancellable, error);
-
-	if (tok == IMAPX_TOK_ERROR)
-		goto fail;
-
-	if (tok != '(') {
-		g_set_error (
-			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
-			"fetch: expecting '('");
-		goto fail;
-	}
-
-	tok = camel_imapx_input_stream_token (
-		stream, &token, &len, cancellable, error);
-
 	while (tok == IMAPX_TOK_TOKEN) {
 		gboolean success = FALSE;
+		guint ii;
 
-		p = token;
-		while ((c=*p))
-			*p++ = toupper(c);
+		for (ii = 0; ii < len; ii++)
+			token[ii] = g_ascii_toupper (token[ii]);
 
 		switch (imapx_tokenise ((gchar *) token, len)) {
 			case IMAPX_BODY:
@@ -2201,26 +2207,62 @@ imapx_parse_fetch (CamelIMAPXInputStream *stream,
 		}
 
 		if (!success)
-			goto fail;
+			return FALSE;
 
-		tok = camel_imapx_input_stream_token (
+		tok = camel_imapx_input_stream_token_slice (
 			stream, &token, &len, cancellable, error);
 		if (tok == '\n') {
-			tok = camel_imapx_input_stream_token (
+			tok = camel_imapx_input_stream_token_slice (
 				stream, &token, &len, cancellable, error);
 		}
 	}
 
 	if (tok == IMAPX_TOK_ERROR)
-		goto fail;
+		return FALSE;
 
 	if (tok != ')') {
 		g_set_error (
 			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
 			"missing closing ')' on fetch response (got 0x%x)", tok);
+		return FALSE;
+	}
+
+
+	return TRUE;
+}
+
+struct _fetch_info *
+imapx_parse_fetch (CamelIMAPXInputStream *stream,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+	gint tok;
+	guint len;
+	guchar *token;
+	struct _fetch_info *finfo;
+
+	finfo = g_malloc0 (sizeof (*finfo));
+	finfo->user_flags = camel_named_flags_new ();
+
+	tok = camel_imapx_input_stream_token (
+		stream, &token, &len, cancellable, error);
+
+	if (tok == IMAPX_TOK_ERROR)
+		goto fail;
+
+	if (tok != '(') {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+			"fetch: expecting '('");
 		goto fail;
 	}
 
+	tok = camel_imapx_input_stream_token_slice (
+		stream, &token, &len, cancellable, error);
+
+	if (!imapx_parse_fetch_items (stream, finfo, tok, token, len, cancellable, error))
+		goto fail;
+
 	goto exit;
 
 fail:
@@ -2231,6 +2273,117 @@ exit:
 	return finfo;
 }
 
+/* Parses a FETCH response without allocating anything, beside the user flags,
+ * when it consists of only the UID, FLAGS and, optionally, the MODSEQ items,
+ * which is what the flags scan of a whole mailbox returns for each message.
+ * Any other response is parsed into the 'out_finfo' instead, which is left
+ * NULL for the fast case. */
+gboolean
+imapx_parse_fetch_uid_flags (CamelIMAPXInputStream *stream,
+			     struct _fetch_uid_flags *ufinfo,
+			     struct _fetch_info **out_finfo,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	struct _fetch_info *finfo;
+	gint tok;
+	guint len;
+	guchar *token;
+
+	g_return_val_if_fail (ufinfo != NULL, FALSE);
+	g_return_val_if_fail (out_finfo != NULL, FALSE);
+
+	memset (ufinfo, 0, sizeof (*ufinfo));
+	*out_finfo = NULL;
+
+	tok = camel_imapx_input_stream_token (
+		stream, &token, &len, cancellable, error);
+
+	if (tok == IMAPX_TOK_ERROR)
+		return FALSE;
+
+	if (tok != '(') {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+			"fetch: expecting '('");
+		return FALSE;
+	}
+
+	tok = camel_imapx_input_stream_token_slice (
+		stream, &token, &len, cancellable, error);
+
+	while (tok == IMAPX_TOK_TOKEN) {
+		if (len == 3 && g_ascii_strncasecmp ((gchar *) token, "UID", 3) == 0) {
+			tok = camel_imapx_input_stream_token_slice (
+				stream, &token, &len, cancellable, error);
+
+			if (tok == IMAPX_TOK_ERROR)
+				goto fail;
+
+			if (tok != IMAPX_TOK_INT || len >= sizeof (ufinfo->uid)) {
+				g_set_error (
+					error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+					"uid not integer");
+				goto fail;
+			}
+
+			memcpy (ufinfo->uid, token, len);
+			ufinfo->uid[len] = '\0';
+			ufinfo->got |= FETCH_UID;
+		} else if (len == 5 && g_ascii_strncasecmp ((gchar *) token, "FLAGS", 5) == 0) {
+			if (!imapx_parse_flags_internal (stream, &ufinfo->flags, &ufinfo->user_flags, cancellable, error))
+				goto fail;
+
+			ufinfo->got |= FETCH_FLAGS;
+		} else if (len == 6 && g_ascii_strncasecmp ((gchar *) token, "MODSEQ", 6) == 0) {
+			ufinfo->modseq = imapx_parse_modseq (stream, cancellable, error);
+
+			if (!ufinfo->modseq)
+				goto fail;
+
+			ufinfo->got |= FETCH_MODSEQ;
+		} else {
+			break;
+		}
+
+		tok = camel_imapx_input_stream_token_slice (
+			stream, &token, &len, cancellable, error);
+		if (tok == '\n') {
+			tok = camel_imapx_input_stream_token_slice (
+				stream, &token, &len, cancellable, error);
+		}
+	}
+
+	if (tok == ')' && (ufinfo->got & (FETCH_UID | FETCH_FLAGS)) == (FETCH_UID | FETCH_FLAGS))
+		return TRUE;
+
+	/* Continue with the full fetch info */
+	finfo = g_malloc0 (sizeof (*finfo));
+	finfo->got = ufinfo->got;
+	finfo->flags = ufinfo->flags;
+	finfo->modseq = ufinfo->modseq;
+	finfo->user_flags = ufinfo->user_flags ? ufinfo->user_flags : camel_named_flags_new ();
+	ufinfo->user_flags = NULL;
+
+	if (ufinfo->got & FETCH_UID)
+		finfo->uid = g_strdup (ufinfo->uid);
+
+	if (!imapx_parse_fetch_items (stream, finfo, tok, token, len, cancellable, error)) {
+		imapx_free_fetch (finfo);
+		return FALSE;
+	}
+
+	*out_finfo = finfo;
+
+	return TRUE;
+
+ fail:
+	camel_named_flags_free (ufinfo->user_flags);
+	ufinfo->user_flags = NULL;
+
+	return FALSE;
+}
+
 static gboolean
 imapx_fill_uids_array_cb (guint32 uid,
 			  gpointer user_data)
@@ -2299,6 +2452,144 @@ imapx_parse_uids_with_callback (CamelIMAPXInputStream *stream,
 	return TRUE;
 }
 
+/* Parses a sequence-set, like "1:3,7,10:20", into the 'ranges' array
+   of struct _uid_range, without expanding the ranges into single UIDs */
+gboolean
+imapx_parse_uid_ranges (CamelIMAPXInputStream *stream,
+			GArray *ranges,
+			GCancellable *cancellable,
+			GError **error)
+{
+	const gchar *ptr;
+	guchar *token = NULL;
+	guint len;
+	gint tok;
+
+	g_return_val_if_fail (CAMEL_IS_IMAPX_INPUT_STREAM (stream), FALSE);
+	g_return_val_if_fail (ranges != NULL, FALSE);
+
+	tok = camel_imapx_input_stream_token (
+		stream, &token, &len, cancellable, error);
+	if (tok == IMAPX_TOK_ERROR)
+		return FALSE;
+
+	if ((tok != IMAPX_TOK_TOKEN && tok != IMAPX_TOK_INT) || !token) {
+		g_set_error (
+			error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+			"expecting sequence-set");
+		return FALSE;
+	}
+
+	ptr = (const gchar *) token;
+
+	while (*ptr) {
+		struct _uid_range range;
+		gchar *endptr = NULL;
+
+		range.first = strtoul (ptr, &endptr, 10);
+		range.last = range.first;
+
+		if (endptr && *endptr == ':') {
+			ptr = endptr + 1;
+			range.last = strtoul (ptr, &endptr, 10);
+
+			/* The range can be in any order */
+			if (range.last < range.first) {
+				guint32 tmp = range.first;
+
+				range.first = range.last;
+				range.last = tmp;
+			}
+		}
+
+		if (!endptr || endptr == ptr || (*endptr && *endptr != ',')) {
+			g_set_error (
+				error, CAMEL_IMAPX_ERROR, CAMEL_IMAPX_ERROR_SERVER_RESPONSE_MALFORMED,
+				"invalid sequence-set '%s'", (const gchar *) token);
+			return FALSE;
+		}
+
+		g_array_append_val (ranges, range);
+
+		ptr = *endptr ? endptr + 1 : endptr;
+	}
+
+	return TRUE;
+}
+
+static gint
+imapx_uid_range_compare (gconstpointer ptr1,
+			 gconstpointer ptr2)
+{
+	const struct _uid_range *range1 = ptr1, *range2 = ptr2;
+
+	if (range1->first < range2->first)
+		return -1;
+
+	if (range1->first > range2->first)
+		return 1;
+
+	return 0;
+}
+
+/* Sorts the ranges and merges those overlapping or adjacent,
+   which is required by imapx_uid_ranges_contain() */
+void
+imapx_uid_ranges_normalize (GArray *ranges)
+{
+	guint ii, jj;
+
+	g_return_if_fail (ranges != NULL);
+
+	if (ranges->len < 2)
+		return;
+
+	g_array_sort (ranges, imapx_uid_range_compare);
+
+	for (ii = 0, jj = 1; jj < ranges->len; jj++) {
+		struct _uid_range *prev = &g_array_index (ranges, struct _uid_range, ii);
+		const struct _uid_range *range = &g_array_index (ranges, struct _uid_range, jj);
+
+		if (prev->last == G_MAXUINT32 || range->first <= prev->last + 1) {
+			if (range->last > prev->last)
+				prev->last = range->last;
+		} else {
+			ii++;
+
+			if (ii != jj)
+				g_array_index (ranges, struct _uid_range, ii) = *range;
+		}
+	}
+
+	g_array_set_size (ranges, ii + 1);
+}
+
+gboolean
+imapx_uid_ranges_contain (const GArray *ranges,
+			  guint32 uid)
+{
+	guint low, high;
+
+	g_return_val_if_fail (ranges != NULL, FALSE);
+
+	low = 0;
+	high = ranges->len;
+
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+		const struct _uid_range *range = &g_array_index (ranges, struct _uid_range, middle);
+
+		if (uid < range->first)
+			high = middle;
+		else if (uid > range->last)
+			low = middle + 1;
+		else
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 GArray *
 imapx_parse_uids (CamelIMAPXInputStream *stream,
                   GCancellable *cancellable,
@@ -104,6 +104,7 @@ typedef enum _camel_imapx_id_t {
 #define CAMEL_IMAPX_UNTAGGED_BAD        "BAD"
 #define CAMEL_IMAPX_UNTAGGED_BYE        "BYE"
 #define CAMEL_IMAPX_UNTAGGED_CAPABILITY "CAPABILITY"
+#define CAMEL_IMAPX_UNTAGGED_ESEARCH    "ESEARCH"
 #define CAMEL_IMAPX_UNTAGGED_EXISTS     "EXISTS"
 #define CAMEL_IMAPX_UNTAGGED_EXPUNGE    "EXPUNGE"
 #define CAMEL_IMAPX_UNTAGGED_FETCH      "FETCH"
@@ -141,6 +142,19 @@ gboolean	imapx_parse_uids_with_callback	(CamelIMAPXInputStream *stream,
 						 gpointer user_data,
 						 GCancellable *cancellable,
 						 GError **error);
+/* An inclusive range of UIDs, as used in a sequence-set */
+struct _uid_range {
+	guint32 first;
+	guint32 last;
+};
+
+gboolean	imapx_parse_uid_ranges		(CamelIMAPXInputStream *stream,
+						 GArray *ranges,
+						 GCancellable *cancellable,
+						 GError **error);
+void		imapx_uid_ranges_normalize	(GArray *ranges);
+gboolean	imapx_uid_ranges_contain	(const GArray *ranges,
+						 guint32 uid);
 gboolean	imapx_parse_flags		(CamelIMAPXInputStream *stream,
 						 guint32 *flagsp,
 						 CamelNamedFlags *user_flags,
@@ -197,7 +211,9 @@ enum {
 	IMAPX_CAPABILITY_X_GM_EXT_1 = (1 << 16),
 	IMAPX_CAPABILITY_UTF8_ACCEPT = (1 << 17),
 	IMAPX_CAPABILITY_UTF8_ONLY = (1 << 18),
-	IMAPX_CAPABILITY_LOGINDISABLED = (1 << 19)
+	IMAPX_CAPABILITY_LOGINDISABLED = (1 << 19),
+	IMAPX_CAPABILITY_COMPRESS_DEFLATE = (1 << 20),
+	IMAPX_CAPABILITY_ESEARCH = (1 << 21)
 };
 
 struct _capability_info {
@@ -279,6 +295,21 @@ struct _fetch_info *
 						 GCancellable *cancellable,
 						 GError **error);
 void		imapx_free_fetch		(struct _fetch_info *finfo);
+
+/* The UID, FLAGS and MODSEQ items of a FETCH response */
+struct _fetch_uid_flags {
+	guint32 got;		/* FETCH_UID, FETCH_FLAGS, FETCH_MODSEQ */
+	guint32 flags;		/* FLAGS */
+	guint64 modseq;		/* MODSEQ */
+	CamelNamedFlags *user_flags; /* NULL, when there are none */
+	gchar uid[16];		/* UID */
+};
+
+gboolean	imapx_parse_fetch_uid_flags	(CamelIMAPXInputStream *stream,
+						 struct _fetch_uid_flags *ufinfo,
+						 struct _fetch_info **out_finfo,
+						 GCancellable *cancellable,
+						 GError **error);
 void		imapx_dump_fetch		(struct _fetch_info *finfo);
 
 /* ********************************************************************** */
@@ -619,15 +619,20 @@ camel_local_folder_construct (CamelLocalFolder *lf,
 
 	/* FIXME: Need to run indexing off of the setv method */
 
+	/* the block-file text index had been replaced by the posting index,
+	 * the messages are indexed again when the old one is still there */
+	if (camel_text_index_check (lf->index_path) == 0)
+		camel_text_index_remove (lf->index_path);
+
 	/* if we have no/invalid index file, force it */
-	forceindex = camel_text_index_check (lf->index_path) == -1;
+	forceindex = camel_posting_index_check (lf->index_path) == -1;
 	if (lf->flags & CAMEL_STORE_FOLDER_BODY_INDEX) {
 		gint flag = O_RDWR | O_CREAT;
 
 		if (forceindex)
 			flag |= O_TRUNC;
 
-		lf->index = (CamelIndex *) camel_text_index_new (lf->index_path, flag);
+		lf->index = (CamelIndex *) camel_posting_index_new (lf->index_path, flag);
 		if (lf->index == NULL) {
 			/* yes, this isn't fatal at all */
 			g_warning ("Could not open/create index file: %s: indexing not performed", g_strerror (errno));
@@ -638,7 +643,7 @@ camel_local_folder_construct (CamelLocalFolder *lf,
 	} else {
 		/* if we do have an index file, remove it (?) */
 		if (forceindex == FALSE)
-			camel_text_index_remove (lf->index_path);
+			camel_posting_index_remove (lf->index_path);
 		forceindex = FALSE;
 	}
 
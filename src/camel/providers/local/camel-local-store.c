@@ -433,7 +433,8 @@ local_store_delete_folder_sync (CamelStore *store,
 	/* remove metadata only */
 	name = g_build_filename (path, folder_name, NULL);
 	str = g_strdup_printf ("%s.ibex", name);
-	if (camel_text_index_remove (str) == -1 && errno != ENOENT && errno != ENOTDIR) {
+	if ((camel_text_index_remove (str) == -1 || camel_posting_index_remove (str) == -1) &&
+	    errno != ENOENT && errno != ENOTDIR) {
 		g_set_error (
 			error, G_IO_ERROR,
 			g_io_error_from_errno (errno),
@@ -533,9 +534,10 @@ local_store_rename_folder_sync (CamelStore *store,
 		if (camel_index_rename (folder->index, newibex) == -1)
 			goto ibex_failed;
 	} else {
-		/* TODO camel_text_index_rename() should find
+		/* TODO camel_posting_index_rename() should find
 		 *      out if we have an active index itself? */
-		if (camel_text_index_rename (oldibex, newibex) == -1)
+		if (camel_text_index_rename (oldibex, newibex) == -1 ||
+		    camel_posting_index_rename (oldibex, newibex) == -1)
 			goto ibex_failed;
 	}
 
@@ -571,8 +573,10 @@ summary_failed:
 	if (folder) {
 		if (folder->index)
 			camel_index_rename (folder->index, oldibex);
-	} else
+	} else {
 		camel_text_index_rename (newibex, oldibex);
+		camel_posting_index_rename (newibex, oldibex);
+	}
 ibex_failed:
 	if (error && !*error)
 		g_set_error (
@@ -0,0 +1,391 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* batched summary save, with a benchmark of per-row SQL vs. batched prepared
+   statement and flags-only updates vs. full rows */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "folders.h"
+
+#define N_RECORDS (1000)
+#define N_FLAG_CHANGES (100)
+#define BENCHMARK_N_RECORDS (100000)
+#define BENCHMARK_N_FLAG_CHANGES (10000)
+#define FOLDER_NAME "bench"
+
+/* The columns written from the CamelMIRecord, that is without the timestamps */
+#define RECORD_COLUMNS "uid, flags, msg_type, read, deleted, replied, important, junk, attachment, dirty, " \
+	"size, dsent, dreceived, subject, mail_from, mail_to, mail_cc, mlist, followup_flag, " \
+	"followup_completed_on, followup_due_by, part, labels, usertags, cinfo, bdata"
+
+/* This is what camel_db_write_message_info_record() used to do for each row;
+   the test data contains no quotes, thus no need to escape the values here */
+static gint
+write_record_sql (CamelDB *cdb,
+		  CamelMIRecord *mir,
+		  GError **error)
+{
+	gchar *ins_query;
+	gint ret;
+
+	ins_query = g_strdup_printf (
+		"INSERT OR REPLACE INTO '" FOLDER_NAME "' VALUES ("
+		"'%s', %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, "
+		"%" G_GINT64_FORMAT ", %" G_GINT64_FORMAT ", '%s', '%s', '%s', '%s', '%s', NULL, NULL, NULL, "
+		"'%s', '%s', '%s', '%s', '%s', "
+		"strftime(\"%%s\", 'now'), "
+		"strftime(\"%%s\", 'now') )",
+		mir->uid, mir->flags, mir->msg_type, mir->read, mir->deleted,
+		mir->replied, mir->important, mir->junk, mir->attachment, mir->dirty,
+		mir->size, mir->dsent, mir->dreceived, mir->subject, mir->from,
+		mir->to, mir->cc, mir->mlist, mir->part, mir->labels, mir->usertags,
+		mir->cinfo, mir->bdata);
+
+	ret = camel_db_add_to_transaction (cdb, ins_query, error);
+
+	g_free (ins_query);
+
+	return ret;
+}
+
+static CamelDB *
+open_db (const gchar *filename)
+{
+	CamelDB *cdb;
+	GError *error = NULL;
+
+	g_unlink (filename);
+
+	cdb = camel_db_new (filename, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+
+	camel_db_prepare_message_info_table (cdb, FOLDER_NAME, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	return cdb;
+}
+
+static guint32
+count_records (CamelDB *cdb)
+{
+	guint32 count = 0;
+	GError *error = NULL;
+
+	camel_db_count_total_message_info (cdb, FOLDER_NAME, &count, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	return count;
+}
+
+static gint
+dump_row_cb (gpointer user_data,
+	     gint ncol,
+	     gchar **colvalues,
+	     gchar **colnames)
+{
+	GString *dump = user_data;
+	gint ii;
+
+	for (ii = 0; ii < ncol; ii++) {
+		g_string_append (dump, colvalues[ii] ? colvalues[ii] : "(null)");
+		g_string_append_c (dump, '|');
+	}
+
+	g_string_append_c (dump, '\n');
+
+	return 0;
+}
+
+/* Returns all the rows of the table as one string */
+static gchar *
+dump_records (CamelDB *cdb,
+	      const gchar *columns)
+{
+	GString *dump;
+	GError *error = NULL;
+	gchar *query;
+
+	dump = g_string_new (NULL);
+	query = g_strdup_printf ("SELECT %s FROM '" FOLDER_NAME "' ORDER BY uid", columns);
+
+	camel_db_select (cdb, query, dump_row_cb, dump, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	g_free (query);
+
+	return g_string_free (dump, FALSE);
+}
+
+static void
+write_records_sql (CamelDB *cdb,
+		   gint n_records)
+{
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gint ii;
+
+	check (camel_db_begin_transaction (cdb, &error) == 0);
+	for (ii = 0; ii < n_records; ii++) {
+		test_folder_fill_record (&mir, ii, (ii % 3) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+		check (write_record_sql (cdb, &mir, &error) == 0);
+	}
+	check (camel_db_end_transaction (cdb, &error) == 0);
+}
+
+static void
+write_records_batched (CamelDB *cdb,
+		       gint n_records,
+		       guint max_rows,
+		       guint max_msecs)
+{
+	CamelDBMessageInfoBatch *batch;
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gint ii;
+
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, max_rows, max_msecs, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	for (ii = 0; ii < n_records; ii++) {
+		test_folder_fill_record (&mir, ii, (ii % 3) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+		check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+	}
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+}
+
+/* Changes the flags of the first 'n_changes' records; either with
+   flags-only updates or with the full rows */
+static void
+write_flag_changes (CamelDB *cdb,
+		    gint n_changes,
+		    gboolean seen,
+		    gboolean flags_only)
+{
+	CamelDBMessageInfoBatch *batch;
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gboolean updated;
+	gint ii;
+
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 5000, 500, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	for (ii = 0; ii < n_changes; ii++) {
+		test_folder_fill_record (&mir, ii, (ii % 3) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+		if (seen)
+			mir.flags |= CAMEL_MESSAGE_SEEN;
+		else
+			mir.flags &= ~CAMEL_MESSAGE_SEEN;
+		mir.read = seen;
+
+		if (flags_only) {
+			updated = FALSE;
+			check (camel_db_message_info_batch_update_flags (batch, &mir, &updated, &error) == 0);
+			check (updated);
+		} else {
+			check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+		}
+	}
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+}
+
+static void
+test_batched_writes (void)
+{
+	CamelDB *cdb;
+	gchar *expected, *dump;
+
+	push ("batched rows match the per-row SQL");
+	cdb = open_db ("/tmp/camel-test/per-row.db");
+	write_records_sql (cdb, N_RECORDS);
+	check (count_records (cdb) == N_RECORDS);
+	expected = dump_records (cdb, RECORD_COLUMNS);
+	check_unref (cdb, 1);
+
+	/* Commits in the middle of the batch, by the row count and by the time */
+	cdb = open_db ("/tmp/camel-test/batched.db");
+	write_records_batched (cdb, N_RECORDS, 64, 0);
+	check (count_records (cdb) == N_RECORDS);
+	dump = dump_records (cdb, RECORD_COLUMNS);
+	check_msg (g_strcmp0 (dump, expected) == 0, "batched rows differ from the per-row SQL");
+	g_free (dump);
+
+	write_records_batched (cdb, N_RECORDS, 0, 1);
+	check (count_records (cdb) == N_RECORDS);
+	dump = dump_records (cdb, RECORD_COLUMNS);
+	check_msg (g_strcmp0 (dump, expected) == 0, "rewritten batched rows differ from the per-row SQL");
+	g_free (dump);
+
+	check_unref (cdb, 1);
+	g_free (expected);
+	pull ();
+}
+
+static void
+test_batch_commits (void)
+{
+	CamelDB *cdb;
+	CamelDBMessageInfoBatch *batch;
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gint ii;
+
+	push ("intermediate commits");
+	cdb = open_db ("/tmp/camel-test/commits.db");
+
+	/* Abort keeps what had been committed after each 7 rows */
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 7, 0, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	for (ii = 0; ii < 17; ii++) {
+		test_folder_fill_record (&mir, ii, (ii % 3) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+		check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+	}
+	camel_db_message_info_batch_abort (batch);
+	check_msg (count_records (cdb) == 14, "count:%u expected:14", count_records (cdb));
+
+	/* Inside of the caller's transaction the intermediate commits only release the savepoints */
+	check (camel_db_begin_transaction (cdb, &error) == 0);
+	write_records_batched (cdb, 17 + 20, 7, 0);
+	check (camel_db_abort_transaction (cdb, &error) == 0);
+	check_msg (count_records (cdb) == 14, "count:%u expected:14", count_records (cdb));
+
+	check_unref (cdb, 1);
+	pull ();
+}
+
+static void
+test_flags_only (void)
+{
+	CamelDB *cdb;
+	CamelDBMessageInfoBatch *batch;
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gchar *expected, *dump;
+	guint32 unread = 0, expected_unread;
+	gboolean updated;
+	gint ii;
+
+	push ("flags-only updates");
+	cdb = open_db ("/tmp/camel-test/flags.db");
+	write_records_batched (cdb, N_RECORDS, 5000, 500);
+
+	/* The same as the full rows, except of the flags */
+	write_flag_changes (cdb, N_FLAG_CHANGES, FALSE, FALSE);
+	expected = dump_records (cdb, RECORD_COLUMNS);
+	write_flag_changes (cdb, N_FLAG_CHANGES, TRUE, TRUE);
+	write_flag_changes (cdb, N_FLAG_CHANGES, FALSE, TRUE);
+	dump = dump_records (cdb, RECORD_COLUMNS);
+	check_msg (g_strcmp0 (dump, expected) == 0, "flags-only updates differ from the full rows");
+	g_free (dump);
+	g_free (expected);
+
+	/* Rows not in the table are not added */
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 5000, 500, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	test_folder_fill_record (&mir, N_RECORDS, (N_RECORDS % 3) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+	updated = TRUE;
+	check (camel_db_message_info_batch_update_flags (batch, &mir, &updated, &error) == 0);
+	check (!updated);
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+
+	check (count_records (cdb) == N_RECORDS);
+
+	/* Every third record was unread, now also all the updated are */
+	expected_unread = N_FLAG_CHANGES;
+	for (ii = N_FLAG_CHANGES; ii < N_RECORDS; ii++) {
+		if (!(ii % 3))
+			expected_unread++;
+	}
+
+	camel_db_count_unread_message_info (cdb, FOLDER_NAME, &unread, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (unread == expected_unread, "unread:%u expected:%u", unread, expected_unread);
+
+	check_unref (cdb, 1);
+	pull ();
+}
+
+static void
+run_benchmark (void)
+{
+	CamelDB *cdb;
+	GTimer *timer;
+	gdouble per_row_sql, batched, full_rows, flags_only;
+
+	timer = g_timer_new ();
+
+	cdb = open_db ("/tmp/camel-test/per-row.db");
+	g_timer_start (timer);
+	write_records_sql (cdb, BENCHMARK_N_RECORDS);
+	g_timer_stop (timer);
+	per_row_sql = g_timer_elapsed (timer, NULL);
+	check_unref (cdb, 1);
+
+	cdb = open_db ("/tmp/camel-test/batched.db");
+	g_timer_start (timer);
+	write_records_batched (cdb, BENCHMARK_N_RECORDS, 5000, 500);
+	g_timer_stop (timer);
+	batched = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	write_flag_changes (cdb, BENCHMARK_N_FLAG_CHANGES, TRUE, FALSE);
+	g_timer_stop (timer);
+	full_rows = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	write_flag_changes (cdb, BENCHMARK_N_FLAG_CHANGES, FALSE, TRUE);
+	g_timer_stop (timer);
+	flags_only = g_timer_elapsed (timer, NULL);
+
+	check_unref (cdb, 1);
+
+	printf ("Saving %d rows: per-row SQL %.3fs, batched %.3fs (%.1fx)\n",
+		BENCHMARK_N_RECORDS, per_row_sql, batched, batched > 0.0 ? per_row_sql / batched : 0.0);
+	printf ("Saving %d flag changes: full rows %.3fs, flags-only %.3fs (%.1fx)\n",
+		BENCHMARK_N_FLAG_CHANGES, full_rows, flags_only, flags_only > 0.0 ? full_rows / flags_only : 0.0);
+
+	g_timer_destroy (timer);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+	g_mkdir_with_parents ("/tmp/camel-test", 0700);
+
+	camel_test_start ("Batched summary save");
+
+	test_batched_writes ();
+	test_batch_commits ();
+	test_flags_only ();
+
+	camel_test_end ();
+
+	/* The timing is not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_benchmark ();
+
+	return 0;
+}
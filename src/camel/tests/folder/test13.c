@@ -0,0 +1,206 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* concurrent summary readers and writer, default journal vs. WAL */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "folders.h"
+
+#define N_BATCHES (20)
+#define BENCHMARK_N_BATCHES (200)
+#define BATCH_SIZE (500)
+#define N_READERS (4)
+#define FOLDER_NAME "stress"
+
+typedef struct _StressData {
+	CamelDB *cdb;
+	gint n_batches;
+	volatile gint writer_done;
+	volatile gint n_queries;
+	volatile gint n_inconsistent;
+	volatile gint n_errors;
+} StressData;
+
+static gpointer
+writer_thread (gpointer user_data)
+{
+	StressData *sd = user_data;
+	CamelMIRecord mir;
+	gchar uid_buff[16], subject_buff[128];
+	gint ii, jj;
+
+	for (ii = 0; ii < sd->n_batches; ii++) {
+		CamelDBMessageInfoBatch *batch;
+
+		/* Each batch is committed as a whole, thus the readers
+		   should always see a multiple of the BATCH_SIZE rows */
+		batch = camel_db_message_info_batch_new (sd->cdb, FOLDER_NAME, BATCH_SIZE, 0, NULL);
+		if (!batch) {
+			g_atomic_int_inc (&sd->n_errors);
+			break;
+		}
+
+		for (jj = 0; jj < BATCH_SIZE; jj++) {
+			test_folder_fill_record (&mir, ii * BATCH_SIZE + jj, (jj % 2) ? CAMEL_MESSAGE_SEEN : 0, uid_buff, subject_buff);
+			if (camel_db_message_info_batch_add (batch, &mir, NULL) != 0)
+				g_atomic_int_inc (&sd->n_errors);
+		}
+
+		if (camel_db_message_info_batch_end (batch, NULL) != 0)
+			g_atomic_int_inc (&sd->n_errors);
+	}
+
+	g_atomic_int_set (&sd->writer_done, 1);
+
+	return NULL;
+}
+
+static gpointer
+reader_thread (gpointer user_data)
+{
+	StressData *sd = user_data;
+
+	while (!g_atomic_int_get (&sd->writer_done)) {
+		guint32 total = 0;
+		guint64 unread = 0;
+
+		if (camel_db_count_total_message_info (sd->cdb, FOLDER_NAME, &total, NULL) != 0 ||
+		    camel_db_select (sd->cdb, "SELECT COUNT(*) FROM '" FOLDER_NAME "' WHERE read = 0 AND subject LIKE '%number%'",
+			test_folder_read_number_cb, &unread, NULL) != 0) {
+			g_atomic_int_inc (&sd->n_errors);
+			continue;
+		}
+
+		/* The counts come from separate statements, thus only each of them
+		   is required to match a committed state */
+		if ((total % BATCH_SIZE) != 0 || (unread % (BATCH_SIZE / 2)) != 0)
+			g_atomic_int_inc (&sd->n_inconsistent);
+
+		g_atomic_int_inc (&sd->n_queries);
+	}
+
+	return NULL;
+}
+
+static gdouble
+run_stress (const gchar *filename,
+	    gint n_batches,
+	    gint *out_n_queries)
+{
+	StressData sd;
+	GThread *writer, *readers[N_READERS];
+	GTimer *timer;
+	GError *error = NULL;
+	guint32 total = 0;
+	gdouble elapsed;
+	gint ii;
+
+	memset (&sd, 0, sizeof (StressData));
+	sd.n_batches = n_batches;
+
+	sd.cdb = camel_db_new (filename, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (sd.cdb != NULL);
+
+	camel_db_prepare_message_info_table (sd.cdb, FOLDER_NAME, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < N_READERS; ii++) {
+		readers[ii] = g_thread_new ("reader", reader_thread, &sd);
+	}
+
+	writer = g_thread_new ("writer", writer_thread, &sd);
+
+	g_thread_join (writer);
+
+	for (ii = 0; ii < N_READERS; ii++) {
+		g_thread_join (readers[ii]);
+	}
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	check_msg (sd.n_errors == 0, "%d errors", sd.n_errors);
+	check_msg (sd.n_inconsistent == 0, "%d inconsistent reads", sd.n_inconsistent);
+
+	camel_db_count_total_message_info (sd.cdb, FOLDER_NAME, &total, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (total == n_batches * BATCH_SIZE);
+
+	check_unref (sd.cdb, 1);
+
+	*out_n_queries = sd.n_queries;
+
+	return elapsed;
+}
+
+static void
+run_benchmark (void)
+{
+	gdouble elapsed_default, elapsed_wal;
+	gint queries_default = 0, queries_wal = 0;
+
+	g_unsetenv ("CAMEL_SQLITE_WAL");
+	elapsed_default = run_stress ("/tmp/camel-test/bench-default.db", BENCHMARK_N_BATCHES, &queries_default);
+
+	g_setenv ("CAMEL_SQLITE_WAL", "1", TRUE);
+	elapsed_wal = run_stress ("/tmp/camel-test/bench-wal.db", BENCHMARK_N_BATCHES, &queries_wal);
+	g_unsetenv ("CAMEL_SQLITE_WAL");
+
+	printf ("Writing %d rows with %d readers: default %.3fs, %.1f queries/s; WAL %.3fs, %.1f queries/s\n",
+		BENCHMARK_N_BATCHES * BATCH_SIZE, N_READERS,
+		elapsed_default, elapsed_default > 0.0 ? queries_default / elapsed_default : 0.0,
+		elapsed_wal, elapsed_wal > 0.0 ? queries_wal / elapsed_wal : 0.0);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	gint n_queries = 0;
+
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+	g_mkdir_with_parents ("/tmp/camel-test", 0700);
+
+	camel_test_start ("Concurrent summary readers and writer");
+
+	push ("default journal mode, %d readers", N_READERS);
+	g_unsetenv ("CAMEL_SQLITE_WAL");
+	run_stress ("/tmp/camel-test/default.db", N_BATCHES, &n_queries);
+	pull ();
+
+	push ("WAL journal mode, %d readers", N_READERS);
+	g_setenv ("CAMEL_SQLITE_WAL", "1", TRUE);
+	run_stress ("/tmp/camel-test/wal.db", N_BATCHES, &n_queries);
+	g_unsetenv ("CAMEL_SQLITE_WAL");
+	pull ();
+
+	camel_test_end ();
+
+	/* The timing is not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_benchmark ();
+
+	return 0;
+}
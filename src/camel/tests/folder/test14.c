@@ -0,0 +1,144 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* incremental database maintenance */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "folders.h"
+
+#define N_RECORDS (20000)
+#define FOLDER_NAME "maintenance"
+
+static guint64
+read_pragma (CamelDB *cdb,
+	     const gchar *pragma)
+{
+	GError *error = NULL;
+	guint64 value = 0;
+
+	camel_db_select (cdb, pragma, test_folder_read_number_cb, &value, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	return value;
+}
+
+static void
+fill_and_clear (CamelDB *cdb)
+{
+	CamelDBMessageInfoBatch *batch;
+	CamelMIRecord mir;
+	GError *error = NULL;
+	gchar uid_buff[16], subject_buff[128];
+	gint ii;
+
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 5000, 0, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	for (ii = 0; ii < N_RECORDS; ii++) {
+		test_folder_fill_record (&mir, ii, 0, uid_buff, subject_buff);
+		check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+	}
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+
+	check (camel_db_command (cdb, "DELETE FROM '" FOLDER_NAME "'", &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	GCancellable *cancellable;
+	GError *error = NULL;
+	guint64 freelist_count;
+	gint64 last_analyze;
+
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+	g_mkdir_with_parents ("/tmp/camel-test", 0700);
+
+	camel_test_start ("Database maintenance");
+
+	push ("incremental vacuum");
+	cdb = camel_db_new ("/tmp/camel-test/maintenance.db", &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+
+	camel_db_prepare_message_info_table (cdb, FOLDER_NAME, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	check (camel_db_get_last_analyze_time (cdb) == 0);
+
+	/* New databases use the incremental vacuum */
+	check (read_pragma (cdb, "PRAGMA main.auto_vacuum") == 2);
+
+	fill_and_clear (cdb);
+
+	freelist_count = read_pragma (cdb, "PRAGMA main.freelist_count");
+	check (freelist_count > 0);
+	check (camel_db_needs_maintenance (cdb));
+
+	check (camel_db_run_maintenance_sync (cdb, TRUE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+
+	check (read_pragma (cdb, "PRAGMA main.freelist_count") < freelist_count);
+	check (!camel_db_needs_maintenance (cdb));
+	pull ();
+
+	push ("analyze time");
+	last_analyze = camel_db_get_last_analyze_time (cdb);
+	check (last_analyze > 0);
+	check (last_analyze <= g_get_real_time () / G_USEC_PER_SEC);
+
+	/* It survives reopening */
+	check_unref (cdb, 1);
+	cdb = camel_db_new ("/tmp/camel-test/maintenance.db", &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+	check (camel_db_get_last_analyze_time (cdb) == last_analyze);
+
+	/* Not analyzed, not updated */
+	check (camel_db_run_maintenance_sync (cdb, FALSE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check (camel_db_get_last_analyze_time (cdb) == last_analyze);
+	pull ();
+
+	push ("cancelled maintenance");
+	fill_and_clear (cdb);
+	check (camel_db_needs_maintenance (cdb));
+
+	cancellable = camel_operation_new ();
+	g_cancellable_cancel (cancellable);
+
+	check (!camel_db_run_maintenance_sync (cdb, TRUE, cancellable, &error));
+	check (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED));
+	g_clear_error (&error);
+
+	/* Nothing freed */
+	check (camel_db_needs_maintenance (cdb));
+
+	g_object_unref (cancellable);
+	check_unref (cdb, 1);
+	pull ();
+
+	camel_test_end ();
+
+	return 0;
+}
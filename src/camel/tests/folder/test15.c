@@ -0,0 +1,188 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* full-text index of message bodies */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "folders.h"
+
+#define FOLDER_NAME "bodies"
+
+static const struct {
+	const gchar *uid;
+	const gchar *body;
+} messages[] = {
+	{ "1", "Hello, the meeting is on Tuesday." },
+	{ "2", "Please find the attached Invoice number 42." },
+	{ "3", "Příliš žluťoučký kůň úpěl ďábelské ódy" },
+	{ "4", "The \"quoted\" text and the meeting notes" }
+};
+
+static const struct {
+	const gchar *expr;
+	gint n_matches;
+} searches[] = {
+	{ "(match-all (body-contains \"meeting\"))", 2 },
+	{ "(match-all (body-contains \"MEETING\"))", 2 },
+	{ "(match-all (body-contains \"eetin\"))", 2 },
+	{ "(match-all (body-contains \"meeting notes\"))", 1 },
+	{ "(match-all (body-contains \"invoice\" \"tuesday\"))", 2 },
+	{ "(match-all (body-contains \"ŽLUŤOUČKÝ\"))", 1 },
+	{ "(match-all (body-contains \"\\\"quoted\\\"\"))", 1 },
+	{ "(match-all (body-contains \"nothing\"))", 0 },
+	{ "(match-all (and (body-contains \"meeting\") (body-contains \"tuesday\")))", 1 }
+};
+
+static guint64
+count_matches (CamelDB *cdb,
+	       const gchar *expr)
+{
+	GError *error = NULL;
+	guint64 count = 0;
+	gchar *where, *query;
+
+	where = camel_sexp_to_sql_sexp_with_body_index (expr, FOLDER_NAME);
+	check_msg (where != NULL, "Failed to convert '%s'", expr);
+
+	query = g_strdup_printf ("SELECT COUNT(*) FROM '" FOLDER_NAME "' WHERE %s", where);
+	camel_db_select (cdb, query, test_folder_read_number_cb, &count, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	g_free (query);
+	g_free (where);
+
+	return count;
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	CamelDBMessageInfoBatch *batch;
+	GError *error = NULL;
+	GList *uids;
+	guint32 count = 0;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+	g_mkdir_with_parents ("/tmp/camel-test", 0700);
+
+	camel_test_start ("Full-text index of message bodies");
+
+	cdb = camel_db_new ("/tmp/camel-test/bodies.db", &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+
+	camel_db_create_folders_table (cdb, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	camel_db_prepare_message_info_table (cdb, FOLDER_NAME, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 0, 0, &error);
+	check_msg (batch != NULL, "%s", error->message);
+	for (ii = 0; ii < G_N_ELEMENTS (messages); ii++) {
+		CamelMIRecord mir;
+
+		memset (&mir, 0, sizeof (CamelMIRecord));
+		mir.uid = (gchar *) messages[ii].uid;
+		mir.subject = (gchar *) "subject";
+		check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+	}
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+
+	push ("index bodies");
+	check (!camel_db_has_message_body (cdb, FOLDER_NAME, "1"));
+
+	if (camel_db_write_message_body (cdb, FOLDER_NAME, messages[0].uid, messages[0].body, &error) != 0) {
+		printf ("Skipping the test, the full-text index is not supported: %s\n", error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		pull ();
+		check_unref (cdb, 1);
+		camel_test_end ();
+
+		return 0;
+	}
+
+	for (ii = 1; ii < G_N_ELEMENTS (messages); ii++) {
+		check (camel_db_write_message_body (cdb, FOLDER_NAME, messages[ii].uid, messages[ii].body, &error) == 0);
+		check_msg (error == NULL, "%s", error->message);
+	}
+
+	/* Already indexed messages are skipped */
+	check (camel_db_write_message_body (cdb, FOLDER_NAME, messages[0].uid, "other text", &error) == 0);
+
+	check (camel_db_has_message_body (cdb, FOLDER_NAME, "1"));
+	check (camel_db_count_message_bodies (cdb, FOLDER_NAME, &count, &error) == 0);
+	check (count == G_N_ELEMENTS (messages));
+	pull ();
+
+	push ("search bodies");
+	for (ii = 0; ii < G_N_ELEMENTS (searches); ii++) {
+		guint64 n_matches = count_matches (cdb, searches[ii].expr);
+
+		check_msg (n_matches == searches[ii].n_matches, "'%s' matched %d, expected %d",
+			searches[ii].expr, (gint) n_matches, searches[ii].n_matches);
+	}
+
+	/* Too short words cannot be searched in the index */
+	check (camel_sexp_to_sql_sexp_with_body_index ("(match-all (body-contains \"on\"))", FOLDER_NAME) == NULL);
+	check (camel_sexp_to_sql_sexp ("(match-all (body-contains \"meeting\"))") == NULL);
+	pull ();
+
+	push ("delete messages");
+	uids = g_list_prepend (NULL, (gpointer) "1");
+	check (camel_db_delete_uids (cdb, FOLDER_NAME, uids, &error) == 0);
+	g_list_free (uids);
+
+	check (!camel_db_has_message_body (cdb, FOLDER_NAME, "1"));
+	check (count_matches (cdb, "(match-all (body-contains \"meeting\"))") == 1);
+
+	check (camel_db_clear_folder_summary (cdb, FOLDER_NAME, &error) == 0);
+	check (camel_db_count_message_bodies (cdb, FOLDER_NAME, &count, &error) == 0);
+	check (count == 0);
+	pull ();
+
+	check_unref (cdb, 1);
+
+	push ("rollback of the index creation");
+	cdb = camel_db_new ("/tmp/camel-test/rollback.db", &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+
+	check (camel_db_begin_transaction (cdb, &error) == 0);
+	check (camel_db_write_message_body (cdb, FOLDER_NAME, messages[0].uid, messages[0].body, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check (camel_db_abort_transaction (cdb, &error) == 0);
+
+	check (!camel_db_has_message_body (cdb, FOLDER_NAME, messages[0].uid));
+	check (camel_db_write_message_body (cdb, FOLDER_NAME, messages[0].uid, messages[0].body, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check (camel_db_has_message_body (cdb, FOLDER_NAME, messages[0].uid));
+	pull ();
+
+	check_unref (cdb, 1);
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* cached search results and SQL prefiltered searches, local */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "camel-test-provider.h"
+#include "messages.h"
+#include "folders.h"
+#include "session.h"
+
+#define N_MESSAGES (200)
+
+static const gchar *searches[] = {
+	"(match-all (not (system-flag \"deleted\")))",
+	"(match-all (and (not (system-flag \"seen\")) (header-contains \"subject\" \"message1\")))",
+	"(match-all (or (system-flag \"flagged\") (header-ends-with \"subject\" \"7 subject\")))",
+	"(match-all (and (user-flag \"every3\") (not (header-contains \"subject\" \"Test1\"))))",
+	"(match-all (not (and (system-flag \"seen\") (header-contains \"subject\" \"Test2\"))))"
+};
+
+/* The search with the uids is never cached nor prefiltered, it returns
+   the matches in the order of the 'uids'; the cached search returns them
+   sorted by camel_folder_sort_uids() */
+static void
+check_search (CamelFolder *folder,
+	      const gchar *expr)
+{
+	GPtrArray *all_uids, *uids, *cached, *expected;
+	GError *error = NULL;
+	gint ii;
+
+	all_uids = camel_folder_get_uids (folder);
+	camel_folder_sort_uids (folder, all_uids);
+
+	expected = camel_folder_search_by_uids (folder, expr, all_uids, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (expected != NULL);
+
+	uids = camel_folder_search_by_expression (folder, expr, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (uids != NULL);
+
+	/* nothing changed since the previous search, thus this one is cached */
+	cached = camel_folder_search_by_expression (folder, expr, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cached != NULL);
+
+	check_msg (uids->len == expected->len, "search %s expected %d got %d", expr, expected->len, uids->len);
+	check_msg (cached->len == expected->len, "cached search %s expected %d got %d", expr, expected->len, cached->len);
+
+	for (ii = 0; ii < expected->len; ii++) {
+		check_msg (g_strcmp0 (uids->pdata[ii], expected->pdata[ii]) == 0,
+			"search %s at %d expected uid %s got %s", expr, ii, (gchar *) expected->pdata[ii], (gchar *) uids->pdata[ii]);
+		check_msg (g_strcmp0 (cached->pdata[ii], expected->pdata[ii]) == 0,
+			"cached search %s at %d expected uid %s got %s", expr, ii, (gchar *) expected->pdata[ii], (gchar *) cached->pdata[ii]);
+	}
+
+	camel_folder_search_free (folder, cached);
+	camel_folder_search_free (folder, uids);
+	camel_folder_search_free (folder, expected);
+	camel_folder_free_uids (folder, all_uids);
+}
+
+static void
+check_searches (CamelFolder *folder)
+{
+	gint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (searches); ii++) {
+		push ("search %d: %s", ii, searches[ii]);
+		check_search (folder, searches[ii]);
+		pull ();
+	}
+}
+
+static gdouble
+time_searches (CamelFolder *folder,
+	       gint n_rounds)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	gint ii, jj;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < n_rounds; ii++) {
+		for (jj = 0; jj < G_N_ELEMENTS (searches); jj++) {
+			GPtrArray *uids;
+
+			uids = camel_folder_search_by_expression (folder, searches[jj], NULL, NULL);
+			check (uids != NULL);
+			camel_folder_search_free (folder, uids);
+		}
+	}
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed;
+}
+
+static const gchar *local_drivers[] = { "local" };
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelService *service;
+	CamelSession *session;
+	CamelStore *store;
+	CamelFolder *folder;
+	CamelMimeMessage *msg;
+	GPtrArray *uids;
+	GError *error = NULL;
+	gdouble elapsed_first, elapsed_cached;
+	gint ii;
+
+	camel_test_init (argc, argv);
+	camel_test_provider_init (1, local_drivers);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+
+	session = camel_test_session_new ("/tmp/camel-test");
+
+	camel_test_start ("Cached and prefiltered folder searches");
+
+	push ("getting store");
+	service = camel_session_add_service (
+		session, "test-uid", "mbox:///tmp/camel-test/mbox",
+		CAMEL_PROVIDER_STORE, &error);
+	check_msg (error == NULL, "adding store: %s", error->message);
+	check (CAMEL_IS_STORE (service));
+	store = CAMEL_STORE (service);
+	pull ();
+
+	push ("creating folder");
+	folder = camel_store_get_folder_sync (
+		store, "testbox", CAMEL_STORE_FOLDER_CREATE, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (folder != NULL);
+	pull ();
+
+	push ("appending %d test messages", N_MESSAGES);
+	for (ii = 0; ii < N_MESSAGES; ii++) {
+		gchar *content, *subject;
+
+		msg = test_message_create_simple ();
+		content = g_strdup_printf ("data%d content\n", ii);
+		test_message_set_content_simple (
+			(CamelMimePart *) msg, 0, "text/plain",
+			content, strlen (content));
+		test_free (content);
+		subject = g_strdup_printf ("Test%d message%d subject", ii, N_MESSAGES - ii);
+		camel_mime_message_set_subject (msg, subject);
+		test_free (subject);
+
+		camel_folder_append_message_sync (
+			folder, msg, NULL, NULL, NULL, &error);
+		check_msg (error == NULL, "%s", error->message);
+
+		check_unref (msg, 1);
+	}
+	pull ();
+
+	push ("setting flags");
+	uids = camel_folder_get_uids (folder);
+	check (uids->len == N_MESSAGES);
+	for (ii = 0; ii < uids->len; ii++) {
+		if ((ii % 2) == 0)
+			camel_folder_set_message_flags (folder, uids->pdata[ii], CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
+		if ((ii % 3) == 0)
+			camel_folder_set_message_user_flag (folder, uids->pdata[ii], "every3", TRUE);
+	}
+	camel_folder_free_uids (folder, uids);
+	pull ();
+
+	push ("searching");
+	check_searches (folder);
+	pull ();
+
+	push ("searching again, after flag changes");
+	uids = camel_folder_get_uids (folder);
+	for (ii = 0; ii < uids->len; ii += 5) {
+		camel_folder_set_message_flags (folder, uids->pdata[ii], CAMEL_MESSAGE_SEEN | CAMEL_MESSAGE_FLAGGED, CAMEL_MESSAGE_FLAGGED);
+		camel_folder_set_message_user_flag (folder, uids->pdata[ii], "every3", (ii % 2) == 0);
+	}
+	camel_folder_free_uids (folder, uids);
+	check_searches (folder);
+	pull ();
+
+	push ("searching again, after deleting and expunging");
+	uids = camel_folder_get_uids (folder);
+	for (ii = 0; ii < uids->len; ii += 7) {
+		camel_folder_delete_message (folder, uids->pdata[ii]);
+	}
+	camel_folder_free_uids (folder, uids);
+	check_searches (folder);
+
+	camel_folder_expunge_sync (folder, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check_searches (folder);
+	pull ();
+
+	push ("repeated searches");
+	/* each first search after a change of any message is not cached */
+	uids = camel_folder_get_uids (folder);
+	camel_folder_set_message_flags (folder, uids->pdata[0], CAMEL_MESSAGE_SEEN, 0);
+	camel_folder_free_uids (folder, uids);
+	elapsed_first = time_searches (folder, 1);
+	elapsed_cached = time_searches (folder, 1);
+	pull ();
+
+	check_unref (folder, 1);
+	check_unref (store, 1);
+
+	camel_test_end ();
+
+	check_unref (session, 1);
+
+	/* The timing is not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK")) {
+		printf ("Searching %d messages with %d expressions: updated %.4fs, cached %.4fs\n",
+			N_MESSAGES, (gint) G_N_ELEMENTS (searches), elapsed_first, elapsed_cached);
+	}
+
+	return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* body index, block-file text index vs. posting-list index */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "camel-test.h"
+
+#define TEST_DIR "/tmp/camel-test"
+#define TEXT_PATH TEST_DIR "/text"
+#define POSTING_PATH TEST_DIR "/posting"
+
+#define MESSAGE_SIZE (4096)
+#define N_MESSAGES (2000)
+/* About the size of a 1GB mbox, in message bodies of MESSAGE_SIZE bytes */
+#define BENCHMARK_TOTAL_SIZE (G_GINT64_CONSTANT (1024) * 1024 * 1024)
+#define BENCHMARK_N_MESSAGES ((gint) (BENCHMARK_TOTAL_SIZE / MESSAGE_SIZE))
+#define N_VOCABULARY (100000)
+
+#define N_QUERY_ROUNDS (10)
+
+static gchar **vocabulary;
+
+static void
+create_vocabulary (void)
+{
+	gint ii;
+
+	vocabulary = g_new0 (gchar *, N_VOCABULARY + 1);
+
+	for (ii = 0; ii < N_VOCABULARY; ii++) {
+		GString *word = g_string_new ("");
+		gint value = ii;
+
+		do {
+			g_string_append_c (word, 'a' + (value % 26));
+			value /= 26;
+		} while (value > 0);
+
+		g_string_append_printf (word, "%d", ii % 7);
+
+		vocabulary[ii] = g_string_free (word, FALSE);
+	}
+}
+
+/* The lower words are picked more often, thus there are frequent and rare words,
+   similar to a natural language. The message body depends only on the 'msgno'. */
+static void
+create_body (GString *body,
+	     GRand *rand,
+	     gint msgno)
+{
+	g_string_truncate (body, 0);
+	g_rand_set_seed (rand, msgno);
+
+	while (body->len < MESSAGE_SIZE) {
+		gint index;
+
+		index = g_rand_int_range (rand, 0, g_rand_int_range (rand, 1, N_VOCABULARY + 1));
+
+		g_string_append (body, vocabulary[index]);
+		g_string_append_c (body, (body->len % 72) < 64 ? ' ' : '\n');
+	}
+}
+
+static void
+index_body (CamelIndex *idx,
+	    const gchar *name,
+	    const GString *body)
+{
+	CamelIndexName *idn;
+
+	idn = camel_index_add_name (idx, name);
+	check (idn != NULL);
+	/* split, as it comes from the mime parser */
+	camel_index_name_add_buffer (idn, body->str, body->len / 2);
+	camel_index_name_add_buffer (idn, body->str + body->len / 2, body->len - body->len / 2);
+	check (camel_index_write_name (idx, idn) == 0);
+	g_object_unref (idn);
+}
+
+static GPtrArray *
+find_names (CamelIndex *idx,
+	    const gchar *word)
+{
+	CamelIndexCursor *idc;
+	GPtrArray *names;
+	const gchar *name;
+
+	names = g_ptr_array_new_with_free_func (g_free);
+
+	idc = camel_index_find (idx, word);
+	if (idc) {
+		while ((name = camel_index_cursor_next (idc)) != NULL) {
+			g_ptr_array_add (names, g_strdup (name));
+		}
+
+		g_object_unref (idc);
+	}
+
+	g_ptr_array_sort (names, (GCompareFunc) g_strcmp0);
+
+	return names;
+}
+
+static void
+check_same_names (CamelIndex *idx1,
+		  CamelIndex *idx2,
+		  const gchar *word)
+{
+	GPtrArray *names1, *names2;
+	guint ii;
+
+	names1 = find_names (idx1, word);
+	names2 = find_names (idx2, word);
+
+	check_msg (names1->len == names2->len, "word '%s' expected %u names, got %u", word, names1->len, names2->len);
+
+	for (ii = 0; ii < names1->len && ii < names2->len; ii++) {
+		check_msg (strcmp (names1->pdata[ii], names2->pdata[ii]) == 0,
+			"word '%s' expected name '%s', got '%s'", word,
+			(gchar *) names1->pdata[ii], (gchar *) names2->pdata[ii]);
+	}
+
+	g_ptr_array_unref (names1);
+	g_ptr_array_unref (names2);
+}
+
+static gdouble
+time_queries (CamelIndex *idx,
+	      const gchar **words,
+	      guint n_words)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	gint ii;
+	guint jj;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < N_QUERY_ROUNDS; ii++) {
+		for (jj = 0; jj < n_words; jj++) {
+			GPtrArray *names = find_names (idx, words[jj]);
+			g_ptr_array_unref (names);
+		}
+	}
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed / (N_QUERY_ROUNDS * n_words);
+}
+
+static guint64
+get_files_size (const gchar *prefix)
+{
+	GDir *dir;
+	const gchar *name;
+	guint64 size = 0;
+
+	dir = g_dir_open (TEST_DIR, 0, NULL);
+	check (dir != NULL);
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (g_str_has_prefix (name, prefix)) {
+			gchar *filename = g_build_filename (TEST_DIR, name, NULL);
+			struct stat st;
+
+			if (g_stat (filename, &st) == 0)
+				size += st.st_size;
+
+			g_free (filename);
+		}
+	}
+
+	g_dir_close (dir);
+
+	return size;
+}
+
+/* Builds both indexes of the 'n_messages' and checks they return the same
+   names; the build and query times are printed when 'print_timing' is set */
+static void
+run_indexes (const gchar **query_words,
+	     guint n_query_words,
+	     gint n_messages,
+	     gboolean print_timing)
+{
+	CamelIndex *text_idx, *posting_idx;
+	GTimer *text_timer, *posting_timer;
+	GString *body;
+	GRand *rand;
+	gdouble text_query = 0.0, posting_query = 0.0, posting_reopened_query = 0.0;
+	guint64 text_size, posting_size;
+	gint ii;
+
+	push ("creating indexes");
+	text_idx = (CamelIndex *) camel_text_index_new (TEXT_PATH, O_RDWR | O_CREAT | O_TRUNC);
+	check (text_idx != NULL);
+	posting_idx = (CamelIndex *) camel_posting_index_new (POSTING_PATH, O_RDWR | O_CREAT | O_TRUNC);
+	check (posting_idx != NULL);
+	pull ();
+
+	push ("indexing %d messages", n_messages);
+	body = g_string_sized_new (MESSAGE_SIZE + 64);
+	rand = g_rand_new ();
+	text_timer = g_timer_new ();
+	g_timer_stop (text_timer);
+	posting_timer = g_timer_new ();
+	g_timer_stop (posting_timer);
+
+	for (ii = 0; ii < n_messages; ii++) {
+		gchar name[16];
+
+		g_snprintf (name, sizeof (name), "%d", ii + 1);
+		create_body (body, rand, ii);
+
+		g_timer_continue (text_timer);
+		index_body (text_idx, name, body);
+		g_timer_stop (text_timer);
+
+		g_timer_continue (posting_timer);
+		index_body (posting_idx, name, body);
+		g_timer_stop (posting_timer);
+	}
+
+	g_timer_continue (text_timer);
+	check (camel_index_sync (text_idx) == 0);
+	g_timer_stop (text_timer);
+
+	g_timer_continue (posting_timer);
+	check (camel_index_sync (posting_idx) == 0);
+	g_timer_stop (posting_timer);
+	pull ();
+
+	push ("comparing query results");
+	for (ii = 0; ii < n_query_words; ii++) {
+		check_same_names (text_idx, posting_idx, query_words[ii]);
+	}
+	pull ();
+
+	if (print_timing) {
+		push ("timing queries");
+		text_query = time_queries (text_idx, query_words, n_query_words);
+		posting_query = time_queries (posting_idx, query_words, n_query_words);
+		pull ();
+	}
+
+	push ("deleting names");
+	for (ii = 0; ii < n_messages; ii += 10) {
+		gchar name[16];
+
+		g_snprintf (name, sizeof (name), "%d", ii + 1);
+		camel_index_delete_name (text_idx, name);
+		camel_index_delete_name (posting_idx, name);
+	}
+
+	check (camel_index_sync (text_idx) == 0);
+	check (camel_index_sync (posting_idx) == 0);
+
+	for (ii = 0; ii < n_query_words; ii++) {
+		check_same_names (text_idx, posting_idx, query_words[ii]);
+	}
+	pull ();
+
+	text_size = get_files_size ("text.");
+	posting_size = get_files_size ("posting.");
+
+	push ("reopening the posting index");
+	check_unref (posting_idx, 1);
+	check (camel_posting_index_check (POSTING_PATH) == 0);
+	posting_idx = (CamelIndex *) camel_posting_index_new (POSTING_PATH, O_RDWR);
+	check (posting_idx != NULL);
+
+	for (ii = 0; ii < n_query_words; ii++) {
+		check_same_names (text_idx, posting_idx, query_words[ii]);
+	}
+
+	if (print_timing)
+		posting_reopened_query = time_queries (posting_idx, query_words, n_query_words);
+	pull ();
+
+	check_unref (text_idx, 1);
+	check_unref (posting_idx, 1);
+
+	if (print_timing) {
+		printf ("Indexing %d messages, %" G_GINT64_FORMAT " bytes:\n", n_messages, (gint64) n_messages * MESSAGE_SIZE);
+		printf ("  text index: build %.2fs, size %" G_GUINT64_FORMAT " bytes, query %.6fs\n",
+			g_timer_elapsed (text_timer, NULL), text_size, text_query);
+		printf ("  posting index: build %.2fs, size %" G_GUINT64_FORMAT " bytes, query %.6fs, reopened %.6fs\n",
+			g_timer_elapsed (posting_timer, NULL), posting_size, posting_query, posting_reopened_query);
+	}
+
+	g_timer_destroy (text_timer);
+	g_timer_destroy (posting_timer);
+	g_string_free (body, TRUE);
+	g_rand_free (rand);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	const gchar *query_words[6];
+
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf " TEST_DIR);
+	g_mkdir_with_parents (TEST_DIR, 0700);
+
+	create_vocabulary ();
+
+	/* frequent, medium and rare words */
+	query_words[0] = vocabulary[0];
+	query_words[1] = vocabulary[5];
+	query_words[2] = vocabulary[300];
+	query_words[3] = vocabulary[4000];
+	query_words[4] = vocabulary[N_VOCABULARY - 1];
+	query_words[5] = "notindexed";
+
+	camel_test_start ("Body index build and query");
+
+	run_indexes (query_words, G_N_ELEMENTS (query_words), N_MESSAGES, FALSE);
+
+	camel_test_end ();
+
+	/* The large index and the timing are not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_indexes (query_words, G_N_ELEMENTS (query_words), BENCHMARK_N_MESSAGES, TRUE);
+
+	g_strfreev (vocabulary);
+
+	return 0;
+}
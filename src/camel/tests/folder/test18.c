@@ -0,0 +1,227 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* mbox summary rebuild, 4KB reads vs. adaptive read window */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "camel-test.h"
+
+#define TEST_DIR "/tmp/camel-test"
+#define MBOX_PATH TEST_DIR "/mbox"
+
+#define MBOX_SIZE (G_GINT64_CONSTANT (8) * 1024 * 1024)
+#define BENCHMARK_MBOX_SIZE (G_GINT64_CONSTANT (1024) * 1024 * 1024)
+
+static gint
+write_mbox (gint64 mbox_size)
+{
+	GRand *rand;
+	GString *msg;
+	FILE *fp;
+	gint64 written = 0;
+	gint n_messages = 0;
+
+	fp = fopen (MBOX_PATH, "wb");
+	check (fp != NULL);
+
+	rand = g_rand_new_with_seed (1);
+	msg = g_string_sized_new (65536);
+
+	while (written < mbox_size) {
+		gint ii, n_lines;
+
+		g_string_truncate (msg, 0);
+		g_string_append_printf (msg,
+			"From sender%d@example.com Mon Jan  1 00:00:00 2020\n"
+			"From: Sender %d <sender%d@example.com>\n"
+			"To: receiver@example.com\n"
+			"Subject: Message number %d with a longer subject,\n"
+			" which continues on the next line\n"
+			"Date: Mon, 1 Jan 2020 00:00:00 +0000\n"
+			"Message-ID: <message%d@example.com>\n"
+			"MIME-Version: 1.0\n",
+			n_messages, n_messages, n_messages, n_messages, n_messages);
+
+		if (n_messages % 3 == 0) {
+			g_string_append (msg,
+				"Content-Type: multipart/mixed; boundary=\"=-boundary\"\n"
+				"\n"
+				"This is a multi-part message in MIME format.\n"
+				"--=-boundary\n"
+				"Content-Type: text/plain; charset=us-ascii\n"
+				"\n");
+		} else {
+			g_string_append (msg, "Content-Type: text/plain; charset=us-ascii\n\n");
+		}
+
+		n_lines = g_rand_int_range (rand, 5, 200);
+		for (ii = 0; ii < n_lines; ii++) {
+			g_string_append (msg, "The quick brown fox jumps over the lazy dog, again and again.\n");
+			if (ii % 50 == 49)
+				g_string_append (msg, ">From the quoted line\n");
+		}
+
+		if (n_messages % 3 == 0) {
+			g_string_append (msg,
+				"--=-boundary\n"
+				"Content-Type: application/octet-stream; name=\"data.bin\"\n"
+				"Content-Transfer-Encoding: base64\n"
+				"\n");
+
+			n_lines = g_rand_int_range (rand, 10, 2000);
+			for (ii = 0; ii < n_lines; ii++) {
+				g_string_append (msg, "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5\n");
+			}
+
+			g_string_append (msg, "--=-boundary--\n");
+		}
+
+		g_string_append_c (msg, '\n');
+
+		check (fwrite (msg->str, 1, msg->len, fp) == msg->len);
+
+		written += msg->len;
+		n_messages++;
+	}
+
+	check (fclose (fp) == 0);
+
+	g_string_free (msg, TRUE);
+	g_rand_free (rand);
+
+	return n_messages;
+}
+
+/* Does the same as the mbox summary does, when it rebuilds itself */
+static gdouble
+rebuild_summary (gsize min_window,
+		 gsize max_window,
+		 GArray *offsets)
+{
+	CamelFolderSummary *summary;
+	CamelMimeParser *mp;
+	GTimer *timer;
+	gdouble elapsed;
+	gint fd;
+
+	summary = camel_folder_summary_new (NULL);
+
+	fd = open (MBOX_PATH, O_RDONLY);
+	check (fd != -1);
+
+	timer = g_timer_new ();
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_set_read_window (mp, min_window, max_window);
+	camel_mime_parser_init_with_fd (mp, fd);
+	camel_mime_parser_scan_from (mp, TRUE);
+
+	while (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM) {
+		CamelMessageInfo *info;
+		goffset offset;
+
+		offset = camel_mime_parser_tell_start_from (mp);
+		g_array_append_val (offsets, offset);
+
+		info = camel_folder_summary_info_new_from_parser (summary, mp);
+		check (info != NULL);
+		g_object_unref (info);
+
+		check (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM_END);
+	}
+
+	check_unref (mp, 1);
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	check_unref (summary, 1);
+
+	return elapsed;
+}
+
+/* Writes an mbox of about the 'mbox_size' and checks both read windows find
+   the same messages; the times are printed when 'print_timing' is set */
+static void
+run_rebuilds (gint64 mbox_size,
+	      gboolean print_timing)
+{
+	GArray *offsets_small, *offsets_adaptive;
+	gdouble elapsed_small, elapsed_adaptive;
+	gint n_messages, ii;
+
+	push ("writing mbox");
+	n_messages = write_mbox (mbox_size);
+	pull ();
+
+	offsets_small = g_array_new (FALSE, FALSE, sizeof (goffset));
+	offsets_adaptive = g_array_new (FALSE, FALSE, sizeof (goffset));
+
+	push ("rebuilding with 4KB reads");
+	elapsed_small = rebuild_summary (4096, 4096, offsets_small);
+	check_msg (offsets_small->len == n_messages, "expected %d messages, got %u", n_messages, offsets_small->len);
+	pull ();
+
+	push ("rebuilding with the adaptive read window");
+	elapsed_adaptive = rebuild_summary (0, 0, offsets_adaptive);
+	check_msg (offsets_adaptive->len == n_messages, "expected %d messages, got %u", n_messages, offsets_adaptive->len);
+	pull ();
+
+	push ("comparing message offsets");
+	for (ii = 0; ii < n_messages; ii++) {
+		check_msg (g_array_index (offsets_small, goffset, ii) == g_array_index (offsets_adaptive, goffset, ii),
+			"message %d at %" G_GINT64_FORMAT " and %" G_GINT64_FORMAT, ii,
+			(gint64) g_array_index (offsets_small, goffset, ii),
+			(gint64) g_array_index (offsets_adaptive, goffset, ii));
+	}
+	pull ();
+
+	if (print_timing) {
+		printf ("Rebuilding summary of %d messages, %" G_GINT64_FORMAT " bytes: 4KB reads %.2fs, adaptive window %.2fs\n",
+			n_messages, mbox_size, elapsed_small, elapsed_adaptive);
+	}
+
+	g_array_free (offsets_small, TRUE);
+	g_array_free (offsets_adaptive, TRUE);
+
+	g_unlink (MBOX_PATH);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf " TEST_DIR);
+	g_mkdir_with_parents (TEST_DIR, 0700);
+
+	camel_test_start ("mbox summary rebuild with different read windows");
+
+	run_rebuilds (MBOX_SIZE, FALSE);
+
+	camel_test_end ();
+
+	/* The large mbox and the timing are not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_rebuilds (BENCHMARK_MBOX_SIZE, TRUE);
+
+	return 0;
+}
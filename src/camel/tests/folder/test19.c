@@ -0,0 +1,205 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* message counts maintained by the folder_counts triggers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "folders.h"
+
+#define FOLDER_NAME "counts"
+#define RENAMED_FOLDER_NAME "renamed counts"
+#define N_MESSAGES (50)
+
+static const struct {
+	const gchar *what;
+	gint (* count_func) (CamelDB *cdb, const gchar *table_name, guint32 *count, GError **error);
+	const gchar *where;
+} counts[] = {
+	{ "total", camel_db_count_total_message_info, "read = 0 OR read = 1" },
+	{ "unread", camel_db_count_unread_message_info, "read = 0" },
+	{ "deleted", camel_db_count_deleted_message_info, "deleted = 1" },
+	{ "junk", camel_db_count_junk_message_info, "junk = 1" },
+	{ "visible", camel_db_count_visible_message_info, "junk = 0 AND deleted = 0" },
+	{ "visible unread", camel_db_count_visible_unread_message_info, "read = 0 AND junk = 0 AND deleted = 0" },
+	{ "junk not deleted", camel_db_count_junk_not_deleted_message_info, "junk = 1 AND deleted = 0" }
+};
+
+static guint64
+select_number (CamelDB *cdb,
+	       const gchar *query)
+{
+	GError *error = NULL;
+	guint64 number = 0;
+
+	camel_db_select (cdb, query, test_folder_read_number_cb, &number, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	return number;
+}
+
+/* The counts read from the folder_counts table match the COUNT (*) of the rows */
+static void
+check_counts (CamelDB *cdb,
+	      const gchar *folder_name)
+{
+	gchar *query;
+	gint ii;
+
+	/* otherwise the count functions fall back to the COUNT (*) */
+	query = g_strdup_printf ("SELECT COUNT (*) FROM folder_counts WHERE folder_name = '%s'", folder_name);
+	check_msg (select_number (cdb, query) == 1, "no folder_counts row for '%s'", folder_name);
+	g_free (query);
+
+	for (ii = 0; ii < G_N_ELEMENTS (counts); ii++) {
+		GError *error = NULL;
+		guint32 count = 0;
+		guint64 expected;
+
+		query = g_strdup_printf ("SELECT COUNT (*) FROM '%s' WHERE %s", folder_name, counts[ii].where);
+		expected = select_number (cdb, query);
+		g_free (query);
+
+		check (counts[ii].count_func (cdb, folder_name, &count, &error) == 0);
+		check_msg (error == NULL, "%s", error->message);
+		check_msg (count == expected, "%s count is %u, expected %u", counts[ii].what, count, (guint) expected);
+	}
+}
+
+static void
+write_messages (CamelDB *cdb,
+		gint from,
+		gint to,
+		gint variant)
+{
+	CamelDBMessageInfoBatch *batch;
+	GError *error = NULL;
+	gint ii;
+
+	batch = camel_db_message_info_batch_new (cdb, FOLDER_NAME, 0, 0, &error);
+	check_msg (batch != NULL, "%s", error->message);
+
+	for (ii = from; ii < to; ii++) {
+		CamelMIRecord mir;
+		gchar uid[16];
+
+		g_snprintf (uid, sizeof (uid), "%d", ii);
+
+		memset (&mir, 0, sizeof (CamelMIRecord));
+		mir.uid = uid;
+		mir.subject = (gchar *) "subject";
+		mir.read = ((ii + variant) % 2) == 0;
+		mir.deleted = ((ii + variant) % 3) == 0;
+		mir.junk = ((ii + variant) % 5) == 0;
+
+		check (camel_db_message_info_batch_add (batch, &mir, &error) == 0);
+		check_msg (error == NULL, "%s", error->message);
+	}
+
+	check (camel_db_message_info_batch_end (batch, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelDB *cdb;
+	GError *error = NULL;
+	GList *uids = NULL;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+	g_mkdir_with_parents ("/tmp/camel-test", 0700);
+
+	camel_test_start ("Message counts maintained by triggers");
+
+	cdb = camel_db_new ("/tmp/camel-test/counts.db", &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (cdb != NULL);
+
+	camel_db_create_folders_table (cdb, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	camel_db_prepare_message_info_table (cdb, FOLDER_NAME, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	push ("insert");
+	write_messages (cdb, 0, N_MESSAGES, 0);
+	check_counts (cdb, FOLDER_NAME);
+	pull ();
+
+	push ("insert or replace");
+	/* half of the messages are already there, with different flags */
+	write_messages (cdb, N_MESSAGES / 2, N_MESSAGES + N_MESSAGES / 2, 1);
+	check_counts (cdb, FOLDER_NAME);
+	pull ();
+
+	push ("flag updates");
+	check (camel_db_command (cdb, "UPDATE '" FOLDER_NAME "' SET read = 1 - read WHERE CAST (uid AS INTEGER) % 4 = 0", &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, FOLDER_NAME);
+
+	check (camel_db_command (cdb, "UPDATE '" FOLDER_NAME "' SET deleted = 1, junk = 0 WHERE CAST (uid AS INTEGER) % 7 = 0", &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, FOLDER_NAME);
+
+	/* not touching the counted columns */
+	check (camel_db_command (cdb, "UPDATE '" FOLDER_NAME "' SET subject = 'other'", &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, FOLDER_NAME);
+	pull ();
+
+	push ("delete");
+	for (ii = 0; ii < N_MESSAGES; ii += 3) {
+		uids = g_list_prepend (uids, g_strdup_printf ("%d", ii));
+	}
+
+	check (camel_db_delete_uids (cdb, FOLDER_NAME, uids, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	g_list_free_full (uids, g_free);
+	check_counts (cdb, FOLDER_NAME);
+	pull ();
+
+	push ("rename");
+	check (camel_db_rename_folder (cdb, FOLDER_NAME, RENAMED_FOLDER_NAME, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, RENAMED_FOLDER_NAME);
+	check (select_number (cdb, "SELECT COUNT (*) FROM folder_counts WHERE folder_name = '" FOLDER_NAME "'") == 0);
+
+	/* the triggers follow the table */
+	check (camel_db_command (cdb, "UPDATE '" RENAMED_FOLDER_NAME "' SET junk = 1 WHERE read = 0", &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, RENAMED_FOLDER_NAME);
+	pull ();
+
+	push ("clear");
+	check (camel_db_clear_folder_summary (cdb, RENAMED_FOLDER_NAME, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_counts (cdb, RENAMED_FOLDER_NAME);
+	check (select_number (cdb, "SELECT saved_count FROM folder_counts WHERE folder_name = '" RENAMED_FOLDER_NAME "'") == 0);
+	pull ();
+
+	check_unref (cdb, 1);
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* limit of the loaded message infos of the folder summary, local */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "camel-test-provider.h"
+#include "messages.h"
+#include "folders.h"
+#include "session.h"
+
+#define N_MESSAGES (100)
+
+static const gchar *local_drivers[] = { "local" };
+
+static guint
+get_n_loaded (CamelFolderSummary *summary)
+{
+	guint loaded = 0;
+
+	camel_folder_summary_get_cache_stats (summary, &loaded, NULL, NULL, NULL);
+
+	return loaded;
+}
+
+/* Gets each message info once, without keeping any of them */
+static void
+get_all_infos (CamelFolderSummary *summary,
+	       GPtrArray *uids)
+{
+	gint ii;
+
+	for (ii = 0; ii < uids->len; ii++) {
+		CamelMessageInfo *info;
+
+		info = camel_folder_summary_get (summary, uids->pdata[ii]);
+		check_msg (info != NULL, "info for '%s' not found", (const gchar *) uids->pdata[ii]);
+		g_clear_object (&info);
+	}
+}
+
+static void
+set_cache_limit (CamelStore *store,
+		 gint limit)
+{
+	CamelSettings *settings;
+
+	settings = camel_service_ref_settings (CAMEL_SERVICE (store));
+	check (CAMEL_IS_STORE_SETTINGS (settings));
+	camel_store_settings_set_summary_cache_limit (CAMEL_STORE_SETTINGS (settings), limit);
+	g_object_unref (settings);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelService *service;
+	CamelSession *session;
+	CamelStore *store;
+	CamelFolder *folder;
+	CamelFolderSummary *summary;
+	CamelMessageInfo *kept_info, *info;
+	GPtrArray *uids;
+	GError *error = NULL;
+	guint64 hits = 0, misses = 0, misses_after = 0, evictions = 0;
+	gint ii;
+
+	camel_test_init (argc, argv);
+	camel_test_provider_init (1, local_drivers);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+
+	session = camel_test_session_new ("/tmp/camel-test");
+
+	camel_test_start ("Limit of the loaded message infos");
+
+	push ("getting store");
+	service = camel_session_add_service (
+		session, "test-uid", "maildir:///tmp/camel-test/maildir",
+		CAMEL_PROVIDER_STORE, &error);
+	check_msg (error == NULL, "adding store: %s", error->message);
+	check (CAMEL_IS_STORE (service));
+	store = CAMEL_STORE (service);
+	pull ();
+
+	push ("creating folder");
+	folder = camel_store_get_folder_sync (
+		store, "testbox", CAMEL_STORE_FOLDER_CREATE, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (folder != NULL);
+	summary = camel_folder_get_folder_summary (folder);
+	pull ();
+
+	push ("appending %d test messages", N_MESSAGES);
+	for (ii = 0; ii < N_MESSAGES; ii++) {
+		CamelMimeMessage *msg;
+		gchar *subject;
+
+		msg = test_message_create_simple ();
+		subject = g_strdup_printf ("Test%d message subject", ii);
+		camel_mime_message_set_subject (msg, subject);
+		test_free (subject);
+
+		camel_folder_append_message_sync (
+			folder, msg, NULL, NULL, NULL, &error);
+		check_msg (error == NULL, "%s", error->message);
+
+		check_unref (msg, 1);
+	}
+
+	/* the dirty infos cannot be evicted */
+	camel_folder_synchronize_sync (folder, FALSE, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+
+	uids = camel_folder_summary_get_array (summary);
+	check (uids != NULL);
+	check (uids->len == N_MESSAGES);
+	pull ();
+
+	push ("no limit");
+	get_all_infos (summary, uids);
+	check_msg (get_n_loaded (summary) == N_MESSAGES, "loaded %u infos", get_n_loaded (summary));
+	pull ();
+
+	push ("limit set after the folder was opened");
+	set_cache_limit (store, 10);
+	get_all_infos (summary, uids);
+	check_msg (get_n_loaded (summary) <= 10, "loaded %u infos", get_n_loaded (summary));
+
+	camel_folder_summary_get_cache_stats (summary, NULL, &hits, &misses, &evictions);
+	check (evictions >= N_MESSAGES - 10);
+	check (hits > 0);
+	pull ();
+
+	push ("the most recently used are kept");
+	camel_folder_summary_get_cache_stats (summary, NULL, NULL, &misses, NULL);
+
+	for (ii = N_MESSAGES - 10; ii < N_MESSAGES; ii++) {
+		info = camel_folder_summary_peek_loaded (summary, uids->pdata[ii]);
+		check_msg (info != NULL, "info for '%s' not loaded", (const gchar *) uids->pdata[ii]);
+		g_clear_object (&info);
+	}
+
+	/* each info is evicted before it is used again */
+	get_all_infos (summary, uids);
+	camel_folder_summary_get_cache_stats (summary, NULL, NULL, &misses_after, NULL);
+	check_msg (misses_after == misses + N_MESSAGES, "%u misses, expected %u", (guint) (misses_after - misses), N_MESSAGES);
+	pull ();
+
+	push ("referenced infos are not evicted");
+	kept_info = camel_folder_summary_get (summary, uids->pdata[0]);
+	check (kept_info != NULL);
+
+	set_cache_limit (store, 5);
+	get_all_infos (summary, uids);
+	check_msg (get_n_loaded (summary) <= 5, "loaded %u infos", get_n_loaded (summary));
+
+	info = camel_folder_summary_peek_loaded (summary, uids->pdata[0]);
+	check (info == kept_info);
+	g_clear_object (&info);
+	g_clear_object (&kept_info);
+	pull ();
+
+	push ("limit removed");
+	set_cache_limit (store, 0);
+	get_all_infos (summary, uids);
+	check_msg (get_n_loaded (summary) == N_MESSAGES, "loaded %u infos", get_n_loaded (summary));
+	pull ();
+
+	camel_folder_summary_free_array (uids);
+	check_unref (folder, 1);
+	check_unref (store, 1);
+
+	camel_test_end ();
+
+	check_unref (session, 1);
+
+	return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* body search of the cached messages, in parallel and serially */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "camel-test-provider.h"
+#include "session.h"
+
+#define N_MESSAGES (64)
+
+/* Every second message contains the searched word and every fifth
+   message is not in the cache, thus it is read with get_message_sync() */
+#define HAS_WORD(_index) (((_index) % 2) == 0)
+#define IS_CACHED(_index) (((_index) % 5) != 0)
+
+static const gchar *local_drivers[] = { "local" };
+
+/* A folder with messages in memory; the messages are read from worker threads */
+typedef struct _TestFolder {
+	CamelFolder parent;
+	gint n_get_cached; /* atomic */
+	gint n_get_sync; /* atomic */
+} TestFolder;
+
+typedef struct _TestFolderClass {
+	CamelFolderClass parent_class;
+} TestFolderClass;
+
+/* The same folder, only without the support for the cached messages */
+typedef TestFolder TestPlainFolder;
+typedef TestFolderClass TestPlainFolderClass;
+
+GType test_folder_get_type (void);
+GType test_plain_folder_get_type (void);
+
+G_DEFINE_TYPE (TestFolder, test_folder, CAMEL_TYPE_FOLDER)
+G_DEFINE_TYPE (TestPlainFolder, test_plain_folder, test_folder_get_type ())
+
+static CamelMimeMessage *
+test_folder_create_message (const gchar *uid)
+{
+	CamelMimeMessage *message;
+	gchar *text;
+	gint index;
+
+	index = (gint) g_ascii_strtoll (uid, NULL, 10);
+	text = g_strdup_printf ("Body of the message %d%s.\n", index, HAS_WORD (index) ? ", with a needle" : "");
+
+	message = camel_mime_message_new ();
+	camel_mime_message_set_subject (message, "Message subject");
+	camel_mime_part_set_content (CAMEL_MIME_PART (message), text, strlen (text), "text/plain");
+
+	g_free (text);
+
+	return message;
+}
+
+static CamelMimeMessage *
+test_folder_get_message_cached (CamelFolder *folder,
+				const gchar *message_uid,
+				GCancellable *cancellable)
+{
+	TestFolder *test_folder = (TestFolder *) folder;
+
+	g_atomic_int_inc (&test_folder->n_get_cached);
+
+	if (!IS_CACHED (g_ascii_strtoll (message_uid, NULL, 10)))
+		return NULL;
+
+	return test_folder_create_message (message_uid);
+}
+
+static CamelMimeMessage *
+test_folder_get_message_sync (CamelFolder *folder,
+			      const gchar *message_uid,
+			      GCancellable *cancellable,
+			      GError **error)
+{
+	TestFolder *test_folder = (TestFolder *) folder;
+
+	g_atomic_int_inc (&test_folder->n_get_sync);
+
+	return test_folder_create_message (message_uid);
+}
+
+static void
+test_folder_class_init (TestFolderClass *class)
+{
+	CamelFolderClass *folder_class;
+
+	folder_class = CAMEL_FOLDER_CLASS (class);
+	folder_class->get_message_cached = test_folder_get_message_cached;
+	folder_class->get_message_sync = test_folder_get_message_sync;
+}
+
+static void
+test_folder_init (TestFolder *test_folder)
+{
+}
+
+static void
+test_plain_folder_class_init (TestPlainFolderClass *class)
+{
+	CamelFolderClass *folder_class;
+
+	folder_class = CAMEL_FOLDER_CLASS (class);
+	folder_class->get_message_cached = NULL;
+}
+
+static void
+test_plain_folder_init (TestPlainFolder *test_folder)
+{
+}
+
+static CamelFolder *
+create_folder (GType folder_type,
+	       CamelStore *store)
+{
+	CamelFolder *folder;
+	CamelFolderSummary *summary;
+	gint ii;
+
+	folder = g_object_new (folder_type,
+		"full-name", "test",
+		"display-name", "test",
+		"parent-store", store,
+		NULL);
+
+	summary = camel_folder_summary_new (folder);
+	camel_folder_summary_set_flags (summary, camel_folder_summary_get_flags (summary) | CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY);
+
+	for (ii = 0; ii < N_MESSAGES; ii++) {
+		CamelMessageInfo *info;
+		gchar *uid;
+
+		uid = g_strdup_printf ("%d", ii);
+
+		info = camel_message_info_new (summary);
+		camel_message_info_set_uid (info, uid);
+		camel_message_info_set_subject (info, "Message subject");
+		camel_folder_summary_add (summary, info, TRUE);
+
+		g_object_unref (info);
+		g_free (uid);
+	}
+
+	camel_folder_take_folder_summary (folder, summary);
+
+	return folder;
+}
+
+static void
+check_body_search (CamelFolder *folder,
+		   gint expect_n_get_cached,
+		   gint expect_n_get_sync)
+{
+	TestFolder *test_folder = (TestFolder *) folder;
+	CamelFolderSearch *search;
+	GPtrArray *matches;
+	GError *error = NULL;
+	gint ii, jj;
+
+	search = camel_folder_search_new ();
+	camel_folder_search_set_folder (search, folder);
+
+	matches = camel_folder_search_search (search, "(match-all (body-contains \"needle\"))", NULL, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (matches != NULL);
+
+	/* the matches are in the order of the summary */
+	for (ii = 0, jj = 0; ii < N_MESSAGES; ii++) {
+		gchar *uid;
+
+		if (!HAS_WORD (ii))
+			continue;
+
+		uid = g_strdup_printf ("%d", ii);
+		check_msg (jj < matches->len, "uid '%s' not found", uid);
+		check_msg (g_strcmp0 (matches->pdata[jj], uid) == 0, "at %d expected uid '%s' got '%s'", jj, uid, (gchar *) matches->pdata[jj]);
+		g_free (uid);
+
+		jj++;
+	}
+
+	check_msg (jj == matches->len, "found %d matches, expected %d", matches->len, jj);
+
+	check_msg (g_atomic_int_get (&test_folder->n_get_cached) == expect_n_get_cached,
+		"%d cached reads, expected %d", g_atomic_int_get (&test_folder->n_get_cached), expect_n_get_cached);
+	check_msg (g_atomic_int_get (&test_folder->n_get_sync) == expect_n_get_sync,
+		"%d reads, expected %d", g_atomic_int_get (&test_folder->n_get_sync), expect_n_get_sync);
+
+	camel_folder_search_free_result (search, matches);
+	check_unref (search, 1);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelService *service;
+	CamelSession *session;
+	CamelStore *store;
+	CamelFolder *folder;
+	GError *error = NULL;
+	gint ii, n_not_cached = 0;
+
+	camel_test_init (argc, argv);
+	camel_test_provider_init (1, local_drivers);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf /tmp/camel-test");
+
+	session = camel_test_session_new ("/tmp/camel-test");
+
+	camel_test_start ("Body search of the cached messages");
+
+	push ("getting store");
+	service = camel_session_add_service (
+		session, "test-uid", "maildir:///tmp/camel-test/maildir",
+		CAMEL_PROVIDER_STORE, &error);
+	check_msg (error == NULL, "adding store: %s", error->message);
+	check (CAMEL_IS_STORE (service));
+	store = CAMEL_STORE (service);
+	pull ();
+
+	for (ii = 0; ii < N_MESSAGES; ii++) {
+		if (!IS_CACHED (ii))
+			n_not_cached++;
+	}
+
+	push ("folder with the cached messages");
+	folder = create_folder (test_folder_get_type (), store);
+	if (g_get_num_processors () > 1) {
+		/* The workers read all the candidates from the cache, then the not cached
+		   are read serially, where camel_folder_get_message_sync() checks the cache first */
+		check_body_search (folder, N_MESSAGES + n_not_cached, n_not_cached);
+	} else {
+		check_body_search (folder, N_MESSAGES, n_not_cached);
+	}
+	check_unref (folder, 1);
+	pull ();
+
+	push ("folder without the cached messages");
+	folder = create_folder (test_plain_folder_get_type (), store);
+	check_body_search (folder, 0, N_MESSAGES);
+	check_unref (folder, 1);
+	pull ();
+
+	check_unref (store, 1);
+
+	camel_test_end ();
+
+	check_unref (session, 1);
+
+	return 0;
+}
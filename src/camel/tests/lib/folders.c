@@ -625,3 +625,47 @@ test_folder_message_ops (CamelSession *session,
 		camel_test_end ();
 	}
 }
+
+void
+test_folder_fill_record (CamelMIRecord *mir,
+                         gint index,
+                         guint32 flags,
+                         gchar *uid_buff,
+                         gchar *subject_buff)
+{
+	g_snprintf (uid_buff, 16, "%d", index + 1);
+	g_snprintf (subject_buff, 128, "Re: [list] test message number %d, with some longer text", index + 1);
+
+	memset (mir, 0, sizeof (CamelMIRecord));
+
+	mir->uid = uid_buff;
+	mir->flags = flags;
+	mir->read = (flags & CAMEL_MESSAGE_SEEN) != 0;
+	mir->size = 1024 + index % 4096;
+	mir->dsent = 1500000000 + index;
+	mir->dreceived = 1500000000 + index + 10;
+	mir->subject = subject_buff;
+	mir->from = "Sender Name <sender@example.com>";
+	mir->to = "Recipient <recipient@example.com>, other@example.com";
+	mir->cc = "";
+	mir->mlist = "list@example.com";
+	mir->part = (gchar *) "1 1 12345678 87654321";
+	mir->labels = (gchar *) "";
+	mir->usertags = (gchar *) "0";
+	mir->cinfo = (gchar *) "0";
+	mir->bdata = (gchar *) "0 0";
+}
+
+gint
+test_folder_read_number_cb (gpointer user_data,
+                            gint ncol,
+                            gchar **colvalues,
+                            gchar **colnames)
+{
+	guint64 *pnumber = user_data;
+
+	if (ncol == 1 && colvalues[0])
+		*pnumber = g_ascii_strtoull (colvalues[0], NULL, 10);
+
+	return 0;
+}
@@ -26,3 +26,8 @@ void test_folder_not_message (CamelFolder *folder, const gchar *uid);
 void test_folder_basic (CamelSession *session, const gchar *storename, gint local, gint spool);
 /* test basic message operations on a folder */
 void test_folder_message_ops (CamelSession *session, const gchar *storename, gint local, const gchar *foldername);
+/* fill the summary record of the index-th test message, with the UID index + 1;
+   the record references the uid_buff of 16 and the subject_buff of 128 bytes */
+void test_folder_fill_record (CamelMIRecord *mir, gint index, guint32 flags, gchar *uid_buff, gchar *subject_buff);
+/* camel_db_select() callback, which reads a single number into the guint64 user_data */
+gint test_folder_read_number_cb (gpointer user_data, gint ncol, gchar **colvalues, gchar **colnames);
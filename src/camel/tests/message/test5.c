@@ -0,0 +1,241 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  test5.c
+ *
+  Parse a message with many headers and a deep multipart nesting,
+  check the headers of its parts, also after changing them or after
+  freeing the message, and time the parsing.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+#define N_RECEIVED 300
+#define DEPTH 20
+#define N_PARSES 500
+
+static gchar *
+create_message (void)
+{
+	GString *msg;
+	gint ii;
+
+	msg = g_string_new ("");
+
+	for (ii = 0; ii < N_RECEIVED; ii++) {
+		g_string_append_printf (msg,
+			"Received: from relay%d.example.com (relay%d.example.com [192.0.2.%d])\n"
+			"\tby mx.example.com with ESMTPS id %08x; Mon, 1 Jan 2020 00:00:00 +0000\n",
+			ii, ii, ii % 256, ii);
+	}
+
+	g_string_append (msg,
+		"From: Sender <sender@example.com>\n"
+		"To: Receiver <receiver@example.com>\n"
+		"Subject: Deeply nested\n"
+		"Date: Mon, 1 Jan 2020 00:00:00 +0000\n"
+		"Message-ID: <nested@example.com>\n"
+		"MIME-Version: 1.0\n");
+
+	for (ii = 0; ii < DEPTH; ii++) {
+		g_string_append_printf (msg,
+			"Content-Type: multipart/mixed; boundary=\"level%d\"\n"
+			"X-Level: %d\n"
+			"\n"
+			"--level%d\n"
+			"Content-Type: text/plain\n"
+			"X-Level: %d\n"
+			"\n"
+			"Text at the level %d.\n"
+			"--level%d\n",
+			ii, ii, ii, ii, ii, ii);
+	}
+
+	g_string_append (msg,
+		"Content-Type: text/plain\n"
+		"X-Level: innermost\n"
+		"\n"
+		"The innermost text.\n");
+
+	for (ii = DEPTH - 1; ii >= 0; ii--) {
+		g_string_append_printf (msg, "--level%d--\n", ii);
+	}
+
+	return g_string_free (msg, FALSE);
+}
+
+static CamelMimeMessage *
+parse_message (const gchar *text)
+{
+	CamelMimeMessage *message;
+	CamelMimeParser *parser;
+
+	parser = camel_mime_parser_new ();
+	camel_mime_parser_init_with_bytes (parser, g_bytes_new_static (text, strlen (text)));
+
+	message = camel_mime_message_new ();
+	check (camel_mime_part_construct_from_parser_sync (CAMEL_MIME_PART (message), parser, NULL, NULL));
+
+	check_unref (parser, 1);
+
+	return message;
+}
+
+/* Returns the innermost text part */
+static CamelMimePart *
+check_structure (CamelMimeMessage *message)
+{
+	CamelMimePart *part = CAMEL_MIME_PART (message);
+	gint ii;
+
+	for (ii = 0; ii < DEPTH; ii++) {
+		CamelDataWrapper *content;
+		CamelMimePart *text;
+		gchar *level;
+
+		level = g_strdup_printf (" %d", ii);
+
+		check_msg (g_strcmp0 (camel_medium_get_header (CAMEL_MEDIUM (part), "X-Level"), level) == 0,
+			"level %d has X-Level '%s'", ii, camel_medium_get_header (CAMEL_MEDIUM (part), "X-Level"));
+
+		content = camel_medium_get_content (CAMEL_MEDIUM (part));
+		check (CAMEL_IS_MULTIPART (content));
+		check (camel_multipart_get_number (CAMEL_MULTIPART (content)) == 2);
+
+		text = camel_multipart_get_part (CAMEL_MULTIPART (content), 0);
+		check (g_strcmp0 (camel_medium_get_header (CAMEL_MEDIUM (text), "X-Level"), level) == 0);
+
+		g_free (level);
+
+		part = camel_multipart_get_part (CAMEL_MULTIPART (content), 1);
+	}
+
+	check (g_strcmp0 (camel_medium_get_header (CAMEL_MEDIUM (part), "X-Level"), " innermost") == 0);
+
+	return part;
+}
+
+static void
+check_headers (CamelMimeMessage *message)
+{
+	const CamelNameValueArray *headers;
+	const gchar *name, *value;
+	guint ii, n_received = 0;
+
+	headers = camel_medium_get_headers (CAMEL_MEDIUM (message));
+
+	for (ii = 0; camel_name_value_array_get (headers, ii, &name, &value); ii++) {
+		if (g_ascii_strcasecmp (name, "Received") == 0) {
+			gchar *expected;
+
+			expected = g_strdup_printf (" from relay%d.example.com", n_received);
+			check_msg (g_str_has_prefix (value, expected), "Received header %u is '%s'", n_received, value);
+			g_free (expected);
+
+			n_received++;
+		}
+	}
+
+	check_msg (n_received == N_RECEIVED, "expected %d Received headers, got %u", N_RECEIVED, n_received);
+
+	check (g_strcmp0 (camel_mime_message_get_subject (message), "Deeply nested") == 0);
+	check (g_strcmp0 (camel_mime_message_get_message_id (message), "nested@example.com") == 0);
+}
+
+static void
+run_benchmark (const gchar *text)
+{
+	CamelMimeMessage *message;
+	GTimer *timer;
+	gint ii;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < N_PARSES; ii++) {
+		message = parse_message (text);
+		g_object_unref (message);
+	}
+
+	g_timer_stop (timer);
+
+	printf ("Parsing a message of %d headers and %d nested multiparts %d times: %.3fs\n",
+		N_RECEIVED + 6 + 2 * DEPTH + 1, DEPTH, N_PARSES, g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelMimeMessage *message;
+	CamelMimePart *innermost;
+	CamelNameValueArray *copy;
+	gchar *text;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Headers of a parsed message");
+
+	text = create_message ();
+
+	push ("parsing the message");
+	message = parse_message (text);
+	check_headers (message);
+	innermost = check_structure (message);
+	pull ();
+
+	push ("changing the headers");
+	copy = camel_medium_dup_headers (CAMEL_MEDIUM (message));
+
+	camel_medium_set_header (CAMEL_MEDIUM (message), "X-Level", "changed");
+	camel_medium_add_header (CAMEL_MEDIUM (message), "Received", "from another.example.com");
+	camel_mime_message_set_subject (message, "Changed subject");
+
+	check (g_strcmp0 (camel_medium_get_header (CAMEL_MEDIUM (message), "X-Level"), "changed") == 0);
+	check (g_strcmp0 (camel_mime_message_get_subject (message), "Changed subject") == 0);
+	check (g_strcmp0 (camel_name_value_array_get_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "X-Level"), " 0") == 0);
+	check (g_strcmp0 (camel_name_value_array_get_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "Subject"), " Deeply nested") == 0);
+
+	check (camel_name_value_array_set_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "Subject", " Changed copy"));
+	check (g_strcmp0 (camel_name_value_array_get_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "Subject"), " Changed copy") == 0);
+	check (g_strcmp0 (camel_mime_message_get_subject (message), "Changed subject") == 0);
+	pull ();
+
+	push ("using the headers after the message is freed");
+	g_object_ref (innermost);
+	check_unref (message, 1);
+
+	check (g_strcmp0 (camel_medium_get_header (CAMEL_MEDIUM (innermost), "X-Level"), " innermost") == 0);
+	check_unref (innermost, 1);
+
+	check (g_strcmp0 (camel_name_value_array_get_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "X-Level"), " 0") == 0);
+	check (g_strcmp0 (camel_name_value_array_get_named (copy, CAMEL_COMPARE_CASE_INSENSITIVE, "Message-ID"), " <nested@example.com>") == 0);
+	camel_name_value_array_free (copy);
+	pull ();
+
+	camel_test_end ();
+
+	/* The timing is not part of the regular test run */
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_benchmark (text);
+
+	g_free (text);
+
+	return 0;
+}
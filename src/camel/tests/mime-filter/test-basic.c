@@ -0,0 +1,431 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  test - basic.c
+ *
+  Test the CamelMimeFilterBasic class against the GLib base64 codec;
+  set CAMEL_TEST_BENCHMARK to also time it on an attachment-sized input
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+#define DATA_SIZE (256 * 1024)
+#define BENCHMARK_DATA_SIZE (25 * 1024 * 1024)
+#define CHUNK_SIZE 65536
+
+/* Passes the 'data' through the filter in chunks of CHUNK_SIZE bytes,
+   or in random chunks, when the 'rand' is set */
+static GByteArray *
+run_filter (CamelMimeFilterBasicType type,
+	    const guint8 *data,
+	    gsize len,
+	    GRand *rand,
+	    gdouble *elapsed)
+{
+	CamelMimeFilter *filter;
+	GByteArray *result;
+	GTimer *timer;
+	gchar *out;
+	gsize pos, chunk, outlen, outprespace;
+
+	filter = camel_mime_filter_basic_new (type);
+	result = g_byte_array_sized_new (len * 2);
+	timer = g_timer_new ();
+
+	for (pos = 0; pos < len; pos += chunk) {
+		chunk = rand ? g_rand_int_range (rand, 1, CHUNK_SIZE) : CHUNK_SIZE;
+		chunk = MIN (chunk, len - pos);
+
+		camel_mime_filter_filter (filter, (const gchar *) data + pos, chunk, 0, &out, &outlen, &outprespace);
+		g_byte_array_append (result, (const guint8 *) out, outlen);
+	}
+
+	camel_mime_filter_complete (filter, "", 0, 0, &out, &outlen, &outprespace);
+	g_byte_array_append (result, (const guint8 *) out, outlen);
+
+	g_timer_stop (timer);
+	if (elapsed)
+		*elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	check_unref (filter, 1);
+
+	return result;
+}
+
+static GByteArray *
+glib_base64_encode (const guint8 *data,
+		    gsize len,
+		    gdouble *elapsed)
+{
+	GByteArray *result;
+	GTimer *timer;
+	gsize pos, chunk, outlen;
+	gint state = 0, save = 0;
+
+	result = g_byte_array_sized_new (len * 2);
+	timer = g_timer_new ();
+
+	for (pos = 0; pos < len; pos += chunk) {
+		chunk = MIN (CHUNK_SIZE, len - pos);
+
+		outlen = g_base64_encode_step (data + pos, chunk, TRUE, (gchar *) result->data + result->len, &state, &save);
+		g_byte_array_set_size (result, result->len + outlen);
+	}
+
+	outlen = g_base64_encode_close (TRUE, (gchar *) result->data + result->len, &state, &save);
+	g_byte_array_set_size (result, result->len + outlen);
+
+	g_timer_stop (timer);
+	if (elapsed)
+		*elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return result;
+}
+
+static GByteArray *
+glib_base64_decode (const guint8 *data,
+		    gsize len,
+		    gdouble *elapsed)
+{
+	GByteArray *result;
+	GTimer *timer;
+	gsize pos, chunk, outlen;
+	gint state = 0;
+	guint save = 0;
+
+	result = g_byte_array_sized_new (len);
+	timer = g_timer_new ();
+
+	for (pos = 0; pos < len; pos += chunk) {
+		chunk = MIN (CHUNK_SIZE, len - pos);
+
+		outlen = g_base64_decode_step ((const gchar *) data + pos, chunk, result->data + result->len, &state, &save);
+		g_byte_array_set_size (result, result->len + outlen);
+	}
+
+	g_timer_stop (timer);
+	if (elapsed)
+		*elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return result;
+}
+
+static void
+check_same (GByteArray *expected,
+	    GByteArray *result)
+{
+	guint ii;
+
+	check_msg (expected->len == result->len, "expected %u bytes, got %u", expected->len, result->len);
+
+	for (ii = 0; ii < expected->len && ii < result->len; ii++) {
+		if (expected->data[ii] != result->data[ii])
+			break;
+	}
+
+	check_msg (ii == expected->len, "differs at offset %u", ii);
+}
+
+/* Every length and split of a short input, to cover the saved state between the calls */
+static void
+test_base64_short (GRand *rand)
+{
+	guint8 data[200];
+	gint len, ii;
+
+	for (ii = 0; ii < sizeof (data); ii++) {
+		data[ii] = g_rand_int_range (rand, 0, 256);
+	}
+
+	for (len = 0; len <= sizeof (data); len++) {
+		GByteArray *encoded, *decoded;
+		gchar *expected;
+		gsize expected_len;
+		gint state = 0, save = 0;
+
+		expected = g_malloc (len * 2 + 6);
+		expected_len = g_base64_encode_step (data, len, TRUE, expected, &state, &save);
+		expected_len += g_base64_encode_close (TRUE, expected + expected_len, &state, &save);
+
+		encoded = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_ENC, data, len, rand, NULL);
+		check_msg (encoded->len == expected_len && memcmp (encoded->data, expected, expected_len) == 0,
+			"encoding of %d bytes", len);
+
+		decoded = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, encoded->data, encoded->len, rand, NULL);
+		check_msg (decoded->len == len && memcmp (decoded->data, data, len) == 0,
+			"decoding of %d bytes", len);
+
+		g_byte_array_unref (decoded);
+		g_byte_array_unref (encoded);
+		g_free (expected);
+	}
+}
+
+/* The vector kernels load and store unaligned blocks; use odd lengths
+   around their block sizes at each alignment, compared with the GLib codec */
+static void
+test_base64_alignment (GRand *rand)
+{
+	const gsize lengths[] = { 11, 13, 25, 37, 49, 95, 97, 191, 193, 383, 385, 1021, 4099 };
+	guint8 *data, *encoded_buffer;
+	gsize offset, ii;
+
+	data = g_malloc (4099 + 64);
+	encoded_buffer = g_malloc (4099 * 2 + 64);
+
+	for (ii = 0; ii < 4099 + 64; ii++) {
+		data[ii] = g_rand_int_range (rand, 0, 256);
+	}
+
+	for (offset = 0; offset < 32; offset++) {
+		for (ii = 0; ii < G_N_ELEMENTS (lengths); ii++) {
+			GByteArray *expected, *encoded, *decoded;
+
+			expected = glib_base64_encode (data + offset, lengths[ii], NULL);
+
+			encoded = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_ENC, data + offset, lengths[ii], NULL, NULL);
+			check_msg (encoded->len == expected->len && memcmp (encoded->data, expected->data, expected->len) == 0,
+				"encoding of %u bytes at offset %u", (guint) lengths[ii], (guint) offset);
+
+			memcpy (encoded_buffer + offset, expected->data, expected->len);
+
+			decoded = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, encoded_buffer + offset, expected->len, NULL, NULL);
+			check_msg (decoded->len == lengths[ii] && memcmp (decoded->data, data + offset, lengths[ii]) == 0,
+				"decoding of %u bytes at offset %u", (guint) lengths[ii], (guint) offset);
+
+			g_byte_array_unref (decoded);
+			g_byte_array_unref (encoded);
+			g_byte_array_unref (expected);
+		}
+	}
+
+	g_free (encoded_buffer);
+	g_free (data);
+}
+
+/* The characters out of the alphabet are skipped, and a padding inside the text
+   ends a group the same way as with the GLib decoder */
+static void
+test_base64_garbage (GRand *rand,
+		     GByteArray *encoded)
+{
+	const gchar *garbage = "\r\n =!*-\t\x80\xff";
+	GByteArray *expected, *result;
+	guint8 *data;
+	gsize len, ii;
+
+	len = MIN (encoded->len, 1024 * 1024);
+	data = g_malloc (len);
+	memcpy (data, encoded->data, len);
+
+	for (ii = 0; ii < len / 50; ii++) {
+		data[g_rand_int_range (rand, 0, len)] = garbage[g_rand_int_range (rand, 0, strlen (garbage))];
+	}
+
+	expected = glib_base64_decode (data, len, NULL);
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, data, len, rand, NULL);
+	check_same (expected, result);
+
+	g_byte_array_unref (expected);
+	g_byte_array_unref (result);
+	g_free (data);
+}
+
+/* The quoted-printable encoder turns the CRLF into the LF, thus its input is a text */
+static GByteArray *
+create_text (GRand *rand,
+	     gsize size)
+{
+	const gchar *lines[] = {
+		"The quick brown fox jumps over the lazy dog.\n",
+		"P\xc5\x99\xc3\xadli\xc5\xa1 \xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88 \xc3\xbap\xc4\x9bl \xc4\x8f\xc3\xa1" "belsk\xc3\xa9 \xc3\xb3" "dy\n",
+		"1 + 1 = 2, and a trailing space \n",
+		"A long line, which is wrapped by the encoder, because it is longer than the 76 characters allowed on a line.\n",
+		"\tindented\n",
+		"\n"
+	};
+	GByteArray *text;
+
+	text = g_byte_array_sized_new (size + 256);
+
+	while (text->len < size) {
+		const gchar *line = lines[g_rand_int_range (rand, 0, G_N_ELEMENTS (lines))];
+
+		g_byte_array_append (text, (const guint8 *) line, strlen (line));
+	}
+
+	return text;
+}
+
+static GByteArray *
+create_data (GRand *rand,
+	     gsize size)
+{
+	GByteArray *data;
+	gsize ii;
+
+	data = g_byte_array_sized_new (size);
+
+	for (ii = 0; ii < size; ii += 4) {
+		guint32 value = g_rand_int (rand);
+
+		g_byte_array_append (data, (const guint8 *) &value, 4);
+	}
+
+	return data;
+}
+
+static void
+run_benchmark (GRand *rand)
+{
+	GByteArray *data, *text, *encoded;
+	gdouble glib_encode, glib_decode, encode, decode, qp_decode, uu_decode;
+
+	data = create_data (rand, BENCHMARK_DATA_SIZE);
+
+	encoded = glib_base64_encode (data->data, data->len, &glib_encode);
+	g_byte_array_unref (run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_ENC, data->data, data->len, NULL, &encode));
+	g_byte_array_unref (glib_base64_decode (encoded->data, encoded->len, &glib_decode));
+	g_byte_array_unref (run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, encoded->data, encoded->len, NULL, &decode));
+	g_byte_array_unref (encoded);
+
+	text = create_text (rand, BENCHMARK_DATA_SIZE);
+	encoded = run_filter (CAMEL_MIME_FILTER_BASIC_QP_ENC, text->data, text->len, NULL, NULL);
+	g_byte_array_unref (run_filter (CAMEL_MIME_FILTER_BASIC_QP_DEC, encoded->data, encoded->len, NULL, &qp_decode));
+	g_byte_array_unref (encoded);
+	g_byte_array_unref (text);
+
+	encoded = g_byte_array_new ();
+	g_byte_array_append (encoded, (const guint8 *) "begin 644 data.bin\n", 19);
+	text = run_filter (CAMEL_MIME_FILTER_BASIC_UU_ENC, data->data, data->len, NULL, NULL);
+	g_byte_array_append (encoded, text->data, text->len);
+	g_byte_array_unref (text);
+	g_byte_array_unref (run_filter (CAMEL_MIME_FILTER_BASIC_UU_DEC, encoded->data, encoded->len, NULL, &uu_decode));
+	g_byte_array_unref (encoded);
+
+	printf ("Coding %u bytes: base64 encode GLib %.3fs, filter %.3fs; base64 decode GLib %.3fs, filter %.3fs; "
+		"quoted-printable decode %.3fs; uudecode %.3fs\n",
+		data->len, glib_encode, encode, glib_decode, decode, qp_decode, uu_decode);
+
+	g_byte_array_unref (data);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GByteArray *data, *text, *expected, *result, *crlf;
+	GRand *rand;
+	guint ii;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("CamelMimeFilterBasic codecs");
+
+	rand = g_rand_new_with_seed (1);
+	data = create_data (rand, DATA_SIZE);
+
+	push ("short base64 inputs");
+	test_base64_short (rand);
+	pull ();
+
+	push ("base64 inputs at each alignment");
+	test_base64_alignment (rand);
+	pull ();
+
+	push ("base64 encoding");
+	expected = glib_base64_encode (data->data, data->len, NULL);
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_ENC, data->data, data->len, NULL, NULL);
+	check_same (expected, result);
+	g_byte_array_unref (result);
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_ENC, data->data, data->len, rand, NULL);
+	check_same (expected, result);
+	g_byte_array_unref (result);
+	pull ();
+
+	push ("base64 decoding");
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, expected->data, expected->len, NULL, NULL);
+	check_same (data, result);
+	g_byte_array_unref (result);
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, expected->data, expected->len, rand, NULL);
+	check_same (data, result);
+	g_byte_array_unref (result);
+
+	crlf = g_byte_array_sized_new (expected->len + expected->len / 76 + 1);
+	for (ii = 0; ii < expected->len; ii++) {
+		if (expected->data[ii] == '\n')
+			g_byte_array_append (crlf, (const guint8 *) "\r", 1);
+		g_byte_array_append (crlf, expected->data + ii, 1);
+	}
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_BASE64_DEC, crlf->data, crlf->len, rand, NULL);
+	check_same (data, result);
+	g_byte_array_unref (result);
+	g_byte_array_unref (crlf);
+
+	test_base64_garbage (rand, expected);
+	g_byte_array_unref (expected);
+	pull ();
+
+	push ("quoted-printable");
+	text = create_text (rand, DATA_SIZE);
+	expected = run_filter (CAMEL_MIME_FILTER_BASIC_QP_ENC, text->data, text->len, NULL, NULL);
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_QP_DEC, expected->data, expected->len, NULL, NULL);
+	check_same (text, result);
+	g_byte_array_unref (result);
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_QP_DEC, expected->data, expected->len, rand, NULL);
+	check_same (text, result);
+	g_byte_array_unref (result);
+	g_byte_array_unref (expected);
+	g_byte_array_unref (text);
+	pull ();
+
+	push ("uuencode");
+	expected = g_byte_array_new ();
+	g_byte_array_append (expected, (const guint8 *) "begin 644 data.bin\n", 19);
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_UU_ENC, data->data, data->len, NULL, NULL);
+	g_byte_array_append (expected, result->data, result->len);
+	g_byte_array_unref (result);
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_UU_DEC, expected->data, expected->len, NULL, NULL);
+	check_same (data, result);
+	g_byte_array_unref (result);
+
+	result = run_filter (CAMEL_MIME_FILTER_BASIC_UU_DEC, expected->data, expected->len, rand, NULL);
+	check_same (data, result);
+	g_byte_array_unref (result);
+	g_byte_array_unref (expected);
+	pull ();
+
+	camel_test_end ();
+
+	g_byte_array_unref (data);
+
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_benchmark (rand);
+
+	g_rand_free (rand);
+
+	return 0;
+}
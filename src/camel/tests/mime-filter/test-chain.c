@@ -0,0 +1,310 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  test - chain.c
+ *
+  Test the chains of filters in the CamelStreamFilter against
+  running the filters one after another
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+enum {
+	CHAIN_CRLF,
+	CHAIN_BASE64_CRLF,
+	CHAIN_BASE64_CRLF_CHARSET,
+	CHAIN_CHARSET_CRLF,
+	CHAIN_DONE
+};
+
+static const gchar *chain_names[] = {
+	"crlf",
+	"base64, crlf",
+	"base64, crlf, charset",
+	"charset, crlf"
+};
+
+static GPtrArray *
+create_chain (gint chain)
+{
+	GPtrArray *filters;
+
+	filters = g_ptr_array_new_with_free_func (g_object_unref);
+
+	if (chain == CHAIN_BASE64_CRLF || chain == CHAIN_BASE64_CRLF_CHARSET)
+		g_ptr_array_add (filters, camel_mime_filter_basic_new (CAMEL_MIME_FILTER_BASIC_BASE64_DEC));
+
+	if (chain == CHAIN_CHARSET_CRLF)
+		g_ptr_array_add (filters, camel_mime_filter_charset_new ("iso-8859-1", "UTF-8"));
+
+	g_ptr_array_add (filters, camel_mime_filter_crlf_new (CAMEL_MIME_FILTER_CRLF_DECODE, CAMEL_MIME_FILTER_CRLF_MODE_CRLF_ONLY));
+
+	if (chain == CHAIN_BASE64_CRLF_CHARSET)
+		g_ptr_array_add (filters, camel_mime_filter_charset_new ("iso-8859-1", "UTF-8"));
+
+	return filters;
+}
+
+/* Latin-1 text with CRLF line ends and some lone CRs */
+static GByteArray *
+create_text (gsize size)
+{
+	GByteArray *text;
+	guint32 seed = 1;
+
+	text = g_byte_array_sized_new (size + 128);
+
+	while (text->len < size) {
+		const gchar *line;
+
+		seed = seed * 1103515245 + 12345;
+
+		switch ((seed >> 16) % 8) {
+		case 0:
+			line = "..dot-stuffed line\r\n";
+			break;
+		case 1:
+			line = "lone \r carriage return\r\r\n";
+			break;
+		case 2:
+			line = "Gr\xfc\xdf" "e aus M\xfcnchen, \xe9t\xe9 \xe0 Paris\r\n";
+			break;
+		case 3:
+			line = "\r\n";
+			break;
+		case 4:
+			line = ".\r\n";
+			break;
+		default:
+			line = "The quick brown fox jumps over the lazy dog, many times over.\r\n";
+			break;
+		}
+
+		g_byte_array_append (text, (const guint8 *) line, strlen (line));
+	}
+
+	return text;
+}
+
+static GByteArray *
+encode_base64 (GByteArray *text)
+{
+	GByteArray *encoded;
+	gchar *base64;
+	gsize ii, len;
+
+	base64 = g_base64_encode (text->data, text->len);
+	len = strlen (base64);
+
+	encoded = g_byte_array_sized_new (len + len / 38 + 2);
+
+	for (ii = 0; ii < len; ii += 76) {
+		g_byte_array_append (encoded, (const guint8 *) base64 + ii, MIN (76, len - ii));
+		g_byte_array_append (encoded, (const guint8 *) "\r\n", 2);
+	}
+
+	g_free (base64);
+
+	return encoded;
+}
+
+/* The expected output, each filter run over the whole input, one after another */
+static GByteArray *
+run_filters_separately (gint chain,
+			GByteArray *input)
+{
+	GPtrArray *filters;
+	GByteArray *data;
+	guint ii;
+
+	filters = create_chain (chain);
+	data = g_byte_array_new ();
+	g_byte_array_append (data, input->data, input->len);
+
+	for (ii = 0; ii < filters->len; ii++) {
+		CamelMimeFilter *filter = filters->pdata[ii];
+		GByteArray *output;
+		gchar *out;
+		gsize outlen, outprespace;
+
+		output = g_byte_array_new ();
+
+		camel_mime_filter_filter (filter, (const gchar *) data->data, data->len, 0, &out, &outlen, &outprespace);
+		g_byte_array_append (output, (const guint8 *) out, outlen);
+
+		out = NULL;
+		outlen = 0;
+		camel_mime_filter_complete (filter, "", 0, 0, &out, &outlen, &outprespace);
+		if (out)
+			g_byte_array_append (output, (const guint8 *) out, outlen);
+
+		g_byte_array_unref (data);
+		data = output;
+	}
+
+	g_ptr_array_unref (filters);
+
+	return data;
+}
+
+static CamelStream *
+create_filter_stream (gint chain,
+		      CamelStream *source)
+{
+	CamelStream *filter_stream;
+	GPtrArray *filters;
+	guint ii;
+
+	filters = create_chain (chain);
+	filter_stream = camel_stream_filter_new (source);
+
+	for (ii = 0; ii < filters->len; ii++) {
+		camel_stream_filter_add (CAMEL_STREAM_FILTER (filter_stream), filters->pdata[ii]);
+	}
+
+	g_ptr_array_unref (filters);
+
+	return filter_stream;
+}
+
+static GByteArray *
+read_through_chain (gint chain,
+		    GByteArray *input,
+		    gsize read_size)
+{
+	CamelStream *source, *filter_stream;
+	GByteArray *output;
+	gchar *buffer;
+	gssize n_read;
+
+	source = camel_stream_mem_new_with_buffer ((const gchar *) input->data, input->len);
+	filter_stream = create_filter_stream (chain, source);
+	g_object_unref (source);
+
+	output = g_byte_array_new ();
+	buffer = g_malloc (read_size);
+
+	while (n_read = camel_stream_read (filter_stream, buffer, read_size, NULL, NULL), n_read > 0) {
+		g_byte_array_append (output, (const guint8 *) buffer, n_read);
+	}
+
+	check (n_read == 0);
+	check (camel_stream_eos (filter_stream));
+
+	g_free (buffer);
+	check_unref (filter_stream, 1);
+
+	return output;
+}
+
+static GByteArray *
+write_through_chain (gint chain,
+		     GByteArray *input,
+		     gsize write_size)
+{
+	CamelStream *target, *filter_stream;
+	GByteArray *output;
+	gsize ii;
+
+	output = g_byte_array_new ();
+	target = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (target), output);
+
+	filter_stream = create_filter_stream (chain, target);
+	g_object_unref (target);
+
+	for (ii = 0; ii < input->len; ii += write_size) {
+		gsize len = MIN (write_size, input->len - ii);
+
+		check (camel_stream_write (filter_stream, (const gchar *) input->data + ii, len, NULL, NULL) == len);
+	}
+
+	check (camel_stream_flush (filter_stream, NULL, NULL) == 0);
+
+	/* the memory stream does not own the 'output' */
+	check_unref (filter_stream, 1);
+
+	return output;
+}
+
+static void
+check_same (GByteArray *expected,
+	    GByteArray *output,
+	    const gchar *how,
+	    gsize chunk_size)
+{
+	check_msg (expected->len == output->len && memcmp (expected->data, output->data, expected->len) == 0,
+		"%s in chunks of %" G_GSIZE_FORMAT " bytes: expected %u bytes, got %u bytes",
+		how, chunk_size, expected->len, output->len);
+}
+
+static void
+test_chain (gint chain,
+	    GByteArray *text,
+	    GByteArray *base64)
+{
+	GByteArray *input, *expected, *output;
+	gsize chunk_sizes[] = { 1, 3, 76, 4095, 4096, 65536, 1024 * 1024 };
+	gint ii;
+
+	camel_test_push ("Chain of %s", chain_names[chain]);
+
+	input = (chain == CHAIN_BASE64_CRLF || chain == CHAIN_BASE64_CRLF_CHARSET) ? base64 : text;
+	expected = run_filters_separately (chain, input);
+
+	check (expected->len > 0);
+
+	for (ii = 0; ii < G_N_ELEMENTS (chunk_sizes); ii++) {
+		output = read_through_chain (chain, input, chunk_sizes[ii]);
+		check_same (expected, output, "read", chunk_sizes[ii]);
+		g_byte_array_unref (output);
+
+		output = write_through_chain (chain, input, chunk_sizes[ii]);
+		check_same (expected, output, "written", chunk_sizes[ii]);
+		g_byte_array_unref (output);
+	}
+
+	g_byte_array_unref (expected);
+
+	camel_test_pull ();
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GByteArray *text, *base64;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Chains of filters in the CamelStreamFilter");
+
+	text = create_text (256 * 1024);
+	base64 = encode_base64 (text);
+
+	for (ii = 0; ii < CHAIN_DONE; ii++)
+		test_chain (ii, text, base64);
+
+	g_byte_array_unref (text);
+	g_byte_array_unref (base64);
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-data-server-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+#define N_WORDS (4000)
+#define BENCHMARK_N_WORDS (1000 * 1000)
+#define WORDS_PER_HEADER 4
+#define N_THREADS 4
+
+static const struct {
+	const gchar *charset;
+	gchar encoding;
+	const gchar *text; /* in UTF-8 */
+} samples[] = {
+	{ "iso-8859-1", 'q', "Caf\xc3\xa9 cr\xc3\xa8me \xc3\xa0 la fran\xc3\xa7" "aise" },
+	{ "windows-1252", 'b', "\xe2\x80\x9cSmart quotes\xe2\x80\x9d \xe2\x80\x93 \xe2\x82\xac" "100 \xe2\x80\xa6 \xe2\x84\xa2" },
+	{ "utf-8", 'b', "P\xc5\x99\xc3\xadli\xc5\xa1 \xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88 \xe6\x97\xa5\xe6\x9c\xac" },
+	{ "iso-8859-2", 'q', "Za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87 g\xc4\x99\xc5\x9bl\xc4\x85 ja\xc5\xba\xc5\x84" },
+	{ "koi8-r", 'b', "\xd0\xa1\xd1\x8a\xd0\xb5\xd1\x88\xd1\x8c \xd0\xb6\xd0\xb5 \xd0\xb5\xd1\x89\xd1\x91" },
+	{ "iso-2022-jp", 'b', "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88" },
+	{ "us-ascii", 'q', "Plain ASCII subject" }
+};
+
+typedef struct {
+	GPtrArray *headers;
+	GPtrArray *expected;
+	guint from, to;
+	gint mismatches;
+} DecodeData;
+
+static gchar *
+encode_word (gint index)
+{
+	GString *word;
+	gchar *converted, *base64;
+	gsize len, ii;
+
+	converted = g_convert (samples[index].text, -1, samples[index].charset, "UTF-8", NULL, &len, NULL);
+	check_msg (converted != NULL, "cannot convert to %s", samples[index].charset);
+
+	word = g_string_new ("");
+	g_string_append_printf (word, "=?%s?%c?", samples[index].charset, samples[index].encoding);
+
+	if (samples[index].encoding == 'b') {
+		base64 = g_base64_encode ((const guchar *) converted, len);
+		g_string_append (word, base64);
+		g_free (base64);
+	} else {
+		for (ii = 0; ii < len; ii++) {
+			guchar c = converted[ii];
+
+			if (c == ' ')
+				g_string_append_c (word, '_');
+			else if (g_ascii_isalnum (c))
+				g_string_append_c (word, c);
+			else
+				g_string_append_printf (word, "=%02X", c);
+		}
+	}
+
+	g_string_append (word, "?=");
+	g_free (converted);
+
+	return g_string_free (word, FALSE);
+}
+
+static void
+create_headers (DecodeData *data,
+		gint n_words)
+{
+	gchar *words[G_N_ELEMENTS (samples)];
+	GRand *rand;
+	gint ii, jj;
+
+	for (ii = 0; ii < G_N_ELEMENTS (samples); ii++) {
+		words[ii] = encode_word (ii);
+	}
+
+	rand = g_rand_new_with_seed (1);
+
+	data->headers = g_ptr_array_new_with_free_func (g_free);
+	data->expected = g_ptr_array_new_with_free_func (g_free);
+
+	for (ii = 0; ii < n_words / WORDS_PER_HEADER; ii++) {
+		GString *header, *expected;
+
+		header = g_string_new ("Re:");
+		expected = g_string_new ("Re:");
+
+		/* separate the encoded-words, the white space between them is dropped */
+		for (jj = 0; jj < WORDS_PER_HEADER; jj++) {
+			gint index = g_rand_int_range (rand, 0, G_N_ELEMENTS (samples));
+
+			g_string_append_printf (header, " %s w%d", words[index], jj);
+			g_string_append_printf (expected, " %s w%d", samples[index].text, jj);
+		}
+
+		g_ptr_array_add (data->headers, g_string_free (header, FALSE));
+		g_ptr_array_add (data->expected, g_string_free (expected, FALSE));
+	}
+
+	g_rand_free (rand);
+
+	for (ii = 0; ii < G_N_ELEMENTS (samples); ii++) {
+		g_free (words[ii]);
+	}
+}
+
+static gpointer
+decode_headers_thread (gpointer user_data)
+{
+	DecodeData *data = user_data;
+	guint ii;
+
+	for (ii = data->from; ii < data->to; ii++) {
+		gchar *decoded;
+
+		decoded = camel_header_decode_string (data->headers->pdata[ii], NULL);
+		if (g_strcmp0 (decoded, data->expected->pdata[ii]) != 0)
+			data->mismatches++;
+		g_free (decoded);
+	}
+
+	return NULL;
+}
+
+static gdouble
+decode_headers (DecodeData *data,
+		gint n_threads)
+{
+	DecodeData thread_data[N_THREADS];
+	GThread *threads[N_THREADS];
+	GTimer *timer;
+	gdouble elapsed;
+	gint ii;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < n_threads; ii++) {
+		thread_data[ii] = *data;
+		thread_data[ii].from = data->headers->len * ii / n_threads;
+		thread_data[ii].to = data->headers->len * (ii + 1) / n_threads;
+		thread_data[ii].mismatches = 0;
+
+		threads[ii] = g_thread_new ("decode", decode_headers_thread, &thread_data[ii]);
+	}
+
+	for (ii = 0; ii < n_threads; ii++) {
+		g_thread_join (threads[ii]);
+		check_msg (thread_data[ii].mismatches == 0, "%d headers decoded wrong", thread_data[ii].mismatches);
+	}
+
+	g_timer_stop (timer);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed;
+}
+
+/* The conversions without the iconv have the same results and errors */
+static void
+test_fast_conversions (void)
+{
+	const gchar *charsets[] = { "ISO-8859-1", "windows-1252", "UTF-8", "us-ascii", "iso-8859-2", "koi8-r", "utf-16" };
+	const gchar *inputs[] = {
+		"plain text",
+		"Caf\xc3\xa9 \xe2\x82\xac \xe2\x80\x9cquoted\xe2\x80\x9d",
+		"\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd \xe6\x97\xa5",
+		"Caf\xe9 \x80 \x93quoted\x94",
+		"\x81\x8d\x8f\x90\x9d",
+		"incomplete \xc3",
+		"invalid \xc3 sequence \xed\xa0\x80",
+		"\xf0\x9f\x98\x80 \xef\xbf\xbe"
+	};
+	gint ii, jj, kk;
+
+	for (ii = 0; ii < G_N_ELEMENTS (charsets); ii++) {
+		for (jj = 0; jj < G_N_ELEMENTS (charsets); jj++) {
+			GIConv cd, ref;
+
+			cd = camel_iconv_open (charsets[jj], charsets[ii]);
+			ref = g_iconv_open (charsets[jj], charsets[ii]);
+			check (cd != (GIConv) -1 && ref != (GIConv) -1);
+
+			for (kk = 0; kk < G_N_ELEMENTS (inputs); kk++) {
+				gsize outsize;
+
+				/* also with the output buffer being too small */
+				for (outsize = 0; outsize <= 64; outsize++) {
+					gchar out1[64], out2[64];
+					const gchar *inbuf1 = inputs[kk];
+					gchar *inbuf2 = (gchar *) inputs[kk], *outbuf1 = out1, *outbuf2 = out2;
+					gsize inleft1 = strlen (inputs[kk]), inleft2 = inleft1, outleft1 = outsize, outleft2 = outsize;
+					gsize rc1, rc2;
+					gint errno1, errno2;
+
+					errno = 0;
+					rc1 = camel_iconv (cd, &inbuf1, &inleft1, &outbuf1, &outleft1);
+					errno1 = errno;
+
+					errno = 0;
+					rc2 = g_iconv (ref, &inbuf2, &inleft2, &outbuf2, &outleft2);
+					errno2 = errno;
+
+					check_msg (rc1 == rc2 && (rc1 != (gsize) -1 || errno1 == errno2) &&
+						inleft1 == inleft2 && outleft1 == outleft2 &&
+						memcmp (out1, out2, outsize - outleft1) == 0,
+						"converting '%s' from %s to %s into %d bytes",
+						inputs[kk], charsets[ii], charsets[jj], (gint) outsize);
+
+					g_iconv (cd, NULL, NULL, NULL, NULL);
+					g_iconv (ref, NULL, NULL, NULL, NULL);
+				}
+			}
+
+			camel_iconv_close (cd);
+			g_iconv_close (ref);
+		}
+	}
+}
+
+/* Opening the same conversion while its converter is in use gives another one;
+   a closed converter is reused and the used ones are never flushed from the cache */
+static void
+test_thread_cache (void)
+{
+	const gchar *charsets[] = {
+		"iso-8859-1", "iso-8859-2", "iso-8859-3", "iso-8859-4", "iso-8859-5",
+		"iso-8859-7", "iso-8859-9", "iso-8859-13", "iso-8859-15", "koi8-r",
+		"koi8-u", "windows-1250", "windows-1251", "windows-1252", "windows-1253",
+		"windows-1254", "windows-1257", "us-ascii"
+	};
+	GIConv opened[G_N_ELEMENTS (charsets)];
+	GIConv cd1, cd2, cd3;
+	gint ii;
+
+	cd1 = camel_iconv_open ("UTF-8", "iso-8859-2");
+	cd2 = camel_iconv_open ("UTF-8", "iso-8859-2");
+	check (cd1 != (GIConv) -1 && cd2 != (GIConv) -1);
+	check (cd1 != cd2);
+
+	camel_iconv_close (cd1);
+	cd3 = camel_iconv_open ("UTF-8", "iso-8859-2");
+	check (cd3 == cd1);
+
+	camel_iconv_close (cd2);
+	camel_iconv_close (cd3);
+
+	/* more than the cache size, all of them in use */
+	for (ii = 0; ii < G_N_ELEMENTS (charsets); ii++) {
+		opened[ii] = camel_iconv_open ("UTF-8", charsets[ii]);
+		check_msg (opened[ii] != (GIConv) -1, "cannot open converter from %s", charsets[ii]);
+	}
+
+	for (ii = 0; ii < G_N_ELEMENTS (charsets); ii++) {
+		const gchar *inbuf = "abc";
+		gchar out[16], *outbuf = out;
+		gsize inleft = 3, outleft = sizeof (out);
+
+		check_msg (camel_iconv (opened[ii], &inbuf, &inleft, &outbuf, &outleft) == 0,
+			"converting from %s", charsets[ii]);
+		check (outbuf - out == 3 && memcmp (out, "abc", 3) == 0);
+	}
+
+	for (ii = 0; ii < G_N_ELEMENTS (charsets); ii++) {
+		camel_iconv_close (opened[ii]);
+	}
+}
+
+static gpointer
+open_converter_thread (gpointer user_data)
+{
+	return camel_iconv_open ("UTF-8", user_data);
+}
+
+/* A converter can be closed by another thread, even after that thread ended */
+static void
+test_close_in_another_thread (void)
+{
+	GThread *thread;
+	GIConv cd;
+	const gchar *inbuf = "Caf\xe9";
+	gchar out[16], *outbuf = out;
+	gsize inleft = strlen (inbuf), outleft = sizeof (out);
+
+	thread = g_thread_new ("open", open_converter_thread, (gpointer) "iso-8859-1");
+	cd = g_thread_join (thread);
+	check (cd != (GIConv) -1);
+
+	check (camel_iconv (cd, &inbuf, &inleft, &outbuf, &outleft) == 0);
+	check (outbuf - out == 5 && memcmp (out, "Caf\xc3\xa9", 5) == 0);
+
+	camel_iconv_close (cd);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	DecodeData data;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Charset conversions");
+
+	push ("conversions without the iconv");
+	test_fast_conversions ();
+	pull ();
+
+	push ("converters cached by the thread");
+	test_thread_cache ();
+	pull ();
+
+	push ("closing the converter in another thread");
+	test_close_in_another_thread ();
+	pull ();
+
+	push ("decoding RFC 2047 encoded-words");
+	create_headers (&data, N_WORDS);
+	decode_headers (&data, 1);
+	decode_headers (&data, N_THREADS);
+	g_ptr_array_unref (data.headers);
+	g_ptr_array_unref (data.expected);
+	pull ();
+
+	camel_test_end ();
+
+	if (g_getenv ("CAMEL_TEST_BENCHMARK")) {
+		gdouble elapsed_single, elapsed_threads;
+
+		create_headers (&data, BENCHMARK_N_WORDS);
+		elapsed_single = decode_headers (&data, 1);
+		elapsed_threads = decode_headers (&data, N_THREADS);
+		g_ptr_array_unref (data.headers);
+		g_ptr_array_unref (data.expected);
+
+		printf ("Decoding %d encoded-words: 1 thread %.3fs, %d threads %.3fs\n",
+			BENCHMARK_N_WORDS, elapsed_single, N_THREADS, elapsed_threads);
+	}
+
+	return 0;
+}
@@ -0,0 +1,373 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* COMPRESS DEFLATE (RFC 4978) negotiation of the IMAPX provider
+   against a mock IMAP server on the loopback */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "camel-test-provider.h"
+#include "session.h"
+
+#define TEST_DIR "/tmp/camel-test"
+
+static const gchar *imapx_drivers[] = { "imapx" };
+
+typedef struct _MockCommand {
+	gchar *text; /* without the tag */
+	gboolean compressed;
+} MockCommand;
+
+typedef struct _MockServer {
+	GSocketListener *listener;
+	GCancellable *cancellable;
+	GThread *thread;
+	guint16 port;
+	gboolean accept_compress;
+
+	/* filled by the server thread, read after it finished */
+	GPtrArray *commands; /* MockCommand * */
+	gchar *error_text;
+} MockServer;
+
+static void
+mock_command_free (gpointer ptr)
+{
+	MockCommand *command = ptr;
+
+	if (command) {
+		g_free (command->text);
+		g_free (command);
+	}
+}
+
+static gboolean
+mock_server_write (GOutputStream *output,
+		   const gchar *format,
+		   ...) G_GNUC_PRINTF (2, 3);
+
+static gboolean
+mock_server_write (GOutputStream *output,
+		   const gchar *format,
+		   ...)
+{
+	gchar *text;
+	va_list ap;
+	gboolean success;
+
+	va_start (ap, format);
+	text = g_strdup_vprintf (format, ap);
+	va_end (ap);
+
+	/* the flush does the sync flush of the compressed stream */
+	success = g_output_stream_write_all (output, text, strlen (text), NULL, NULL, NULL) &&
+		  g_output_stream_flush (output, NULL, NULL);
+
+	g_free (text);
+
+	return success;
+}
+
+static GDataInputStream *
+mock_server_new_data_stream (GInputStream *base_stream)
+{
+	GDataInputStream *data_stream;
+
+	data_stream = g_data_input_stream_new (base_stream);
+	g_data_input_stream_set_newline_type (data_stream, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+	g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (data_stream), FALSE);
+
+	return data_stream;
+}
+
+static gpointer
+mock_server_thread (gpointer user_data)
+{
+	MockServer *ms = user_data;
+	GSocketConnection *connection;
+	GInputStream *raw_input, *compressed_input = NULL;
+	GOutputStream *raw_output, *output;
+	GDataInputStream *input;
+	GError *error = NULL;
+	gboolean compressed = FALSE;
+
+	connection = g_socket_listener_accept (ms->listener, NULL, ms->cancellable, &error);
+	if (!connection) {
+		ms->error_text = g_strdup_printf ("Failed to accept: %s", error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		return NULL;
+	}
+
+	raw_input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+	raw_output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+	input = mock_server_new_data_stream (raw_input);
+	output = g_object_ref (raw_output);
+
+	mock_server_write (output, "* PREAUTH Mock IMAP server ready\r\n");
+
+	while (TRUE) {
+		MockCommand *command;
+		gchar *line, *tag;
+		gboolean success;
+
+		line = g_data_input_stream_read_line (input, NULL, ms->cancellable, NULL);
+		if (!line)
+			break;
+
+		tag = line;
+		line = strchr (line, ' ');
+		if (!line) {
+			ms->error_text = g_strdup_printf ("Invalid command '%s'", tag);
+			g_free (tag);
+			break;
+		}
+
+		*line = '\0';
+		line++;
+
+		command = g_new0 (MockCommand, 1);
+		command->text = g_strdup (line);
+		command->compressed = compressed;
+		g_ptr_array_add (ms->commands, command);
+
+		if (g_ascii_strcasecmp (line, "CAPABILITY") == 0) {
+			success = mock_server_write (output, "* CAPABILITY IMAP4rev1 COMPRESS=DEFLATE\r\n%s OK CAPABILITY completed\r\n", tag);
+		} else if (g_ascii_strcasecmp (line, "COMPRESS DEFLATE") == 0) {
+			if (compressed) {
+				success = mock_server_write (output, "%s NO [COMPRESSIONACTIVE] DEFLATE active already\r\n", tag);
+			} else if (!ms->accept_compress) {
+				success = mock_server_write (output, "%s NO Compression is not allowed\r\n", tag);
+			} else if (g_buffered_input_stream_get_available (G_BUFFERED_INPUT_STREAM (input)) > 0) {
+				ms->error_text = g_strdup ("Data sent before the COMPRESS DEFLATE response");
+				success = FALSE;
+			} else {
+				GConverter *converter;
+
+				/* the response is the last uncompressed data */
+				success = mock_server_write (output, "%s OK DEFLATE active\r\n", tag);
+
+				converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+				compressed_input = g_converter_input_stream_new (raw_input, converter);
+				g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (compressed_input), FALSE);
+				g_object_unref (converter);
+
+				g_object_unref (input);
+				input = mock_server_new_data_stream (compressed_input);
+
+				converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+				g_object_unref (output);
+				output = g_converter_output_stream_new (raw_output, converter);
+				g_filter_output_stream_set_close_base_stream (G_FILTER_OUTPUT_STREAM (output), FALSE);
+				g_object_unref (converter);
+
+				compressed = TRUE;
+			}
+		} else if (g_ascii_strcasecmp (line, "LOGOUT") == 0) {
+			mock_server_write (output, "* BYE Mock IMAP server logging out\r\n%s OK LOGOUT completed\r\n", tag);
+			g_free (tag);
+			break;
+		} else {
+			/* LIST, LSUB, NOOP and the like, without any data */
+			success = mock_server_write (output, "%s OK Completed\r\n", tag);
+		}
+
+		g_free (tag);
+
+		if (!success)
+			break;
+	}
+
+	g_object_unref (input);
+	g_clear_object (&compressed_input);
+	g_object_unref (output);
+
+	g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+	g_object_unref (connection);
+
+	return NULL;
+}
+
+static void
+mock_server_start (MockServer *ms,
+		   gboolean accept_compress)
+{
+	GSocketAddress *address, *effective_address = NULL;
+	GError *error = NULL;
+
+	memset (ms, 0, sizeof (MockServer));
+
+	ms->accept_compress = accept_compress;
+	ms->commands = g_ptr_array_new_with_free_func (mock_command_free);
+	ms->cancellable = g_cancellable_new ();
+	ms->listener = g_socket_listener_new ();
+
+	address = g_inet_socket_address_new_from_string ("127.0.0.1", 0);
+	check (g_socket_listener_add_address (ms->listener, address, G_SOCKET_TYPE_STREAM,
+		G_SOCKET_PROTOCOL_TCP, NULL, &effective_address, &error));
+	check_msg (error == NULL, "%s", error->message);
+
+	ms->port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (effective_address));
+
+	g_object_unref (effective_address);
+	g_object_unref (address);
+
+	ms->thread = g_thread_new ("mock-imap-server", mock_server_thread, ms);
+}
+
+static void
+mock_server_stop (MockServer *ms)
+{
+	/* in case the client did not connect at all */
+	g_cancellable_cancel (ms->cancellable);
+	g_thread_join (ms->thread);
+
+	g_socket_listener_close (ms->listener);
+	g_clear_object (&ms->listener);
+	g_clear_object (&ms->cancellable);
+}
+
+static void
+mock_server_clear (MockServer *ms)
+{
+	g_ptr_array_unref (ms->commands);
+	g_free (ms->error_text);
+}
+
+/* Returns the index of the first command starting with 'prefix', or -1 */
+static gint
+mock_server_find_command (MockServer *ms,
+			  const gchar *prefix,
+			  gint from_index)
+{
+	guint ii;
+
+	for (ii = MAX (from_index, 0); ii < ms->commands->len; ii++) {
+		MockCommand *command = g_ptr_array_index (ms->commands, ii);
+
+		if (g_ascii_strncasecmp (command->text, prefix, strlen (prefix)) == 0)
+			return ii;
+	}
+
+	return -1;
+}
+
+static void
+test_compress (CamelSession *session,
+	       gboolean accept_compress)
+{
+	CamelService *service;
+	CamelSettings *settings;
+	MockServer ms;
+	GError *error = NULL;
+	gint compress_index, list_index;
+	guint ii;
+
+	mock_server_start (&ms, accept_compress);
+
+	service = camel_session_add_service (session,
+		accept_compress ? "compress-accepted" : "compress-refused",
+		"imapx", CAMEL_PROVIDER_STORE, &error);
+	check_msg (error == NULL, "adding store: %s", error->message);
+	check (CAMEL_IS_OFFLINE_STORE (service));
+
+	settings = camel_service_ref_settings (service);
+	g_object_set (settings,
+		"host", "127.0.0.1",
+		"port", (guint) ms.port,
+		"user", "user",
+		"security-method", CAMEL_NETWORK_SECURITY_METHOD_NONE,
+		"concurrent-connections", 1,
+		NULL);
+	g_object_unref (settings);
+
+	push ("connecting");
+	check (camel_offline_store_set_online_sync (CAMEL_OFFLINE_STORE (service), TRUE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	pull ();
+
+	push ("disconnecting");
+	check (camel_service_disconnect_sync (service, TRUE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	camel_session_remove_service (session, service);
+	g_object_unref (service);
+	pull ();
+
+	mock_server_stop (&ms);
+
+	push ("checking the server side");
+	check_msg (ms.error_text == NULL, "%s", ms.error_text);
+
+	compress_index = mock_server_find_command (&ms, "COMPRESS DEFLATE", 0);
+	check_msg (compress_index >= 0, "COMPRESS DEFLATE not issued");
+	check_msg (mock_server_find_command (&ms, "COMPRESS", compress_index + 1) == -1, "COMPRESS issued twice");
+
+	for (ii = 0; ii <= (guint) compress_index; ii++) {
+		MockCommand *command = g_ptr_array_index (ms.commands, ii);
+
+		check_msg (!command->compressed, "'%s' compressed", command->text);
+	}
+
+	/* the connection is usable after the negotiation, in both directions */
+	list_index = mock_server_find_command (&ms, "LIST", compress_index + 1);
+	check_msg (list_index > compress_index, "no LIST after COMPRESS DEFLATE");
+
+	for (ii = compress_index + 1; ii < ms.commands->len; ii++) {
+		MockCommand *command = g_ptr_array_index (ms.commands, ii);
+
+		check_msg (command->compressed == accept_compress, "'%s' %scompressed",
+			command->text, command->compressed ? "" : "not ");
+	}
+	pull ();
+
+	mock_server_clear (&ms);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelSession *session;
+
+	camel_test_init (argc, argv);
+	camel_test_provider_init (1, imapx_drivers);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf " TEST_DIR);
+	g_mkdir_with_parents (TEST_DIR, 0700);
+
+	session = camel_test_session_new (TEST_DIR);
+
+	camel_test_start ("IMAP COMPRESS DEFLATE negotiation");
+
+	push ("server accepts the compression");
+	test_compress (session, TRUE);
+	pull ();
+
+	push ("server refuses the compression");
+	test_compress (session, FALSE);
+	pull ();
+
+	g_object_unref (session);
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The DEFLATE converter of the IMAP COMPRESS extension (RFC 4978) */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "providers/imapx/camel-imapx-deflate.h"
+
+#include "camel-test.h"
+
+#define DATA_SIZE (256 * 1024)
+
+/* The sync flush ends with an empty stored block */
+static const guint8 sync_flush_marker[] = { 0x00, 0x00, 0xff, 0xff };
+
+static GByteArray *
+build_data (GRand *rand)
+{
+	GByteArray *data;
+
+	data = g_byte_array_sized_new (DATA_SIZE);
+
+	while (data->len < DATA_SIZE) {
+		gchar *line;
+
+		/* mostly compressible IMAP-like lines, with some noise */
+		if (g_rand_int_range (rand, 0, 8) == 0) {
+			guint8 noise[64];
+			gint ii;
+
+			for (ii = 0; ii < G_N_ELEMENTS (noise); ii++) {
+				noise[ii] = g_rand_int_range (rand, 0, 256);
+			}
+
+			g_byte_array_append (data, noise, G_N_ELEMENTS (noise));
+		} else {
+			line = g_strdup_printf ("* %d FETCH (UID %d FLAGS (\\Seen) RFC822.SIZE %d)\r\n",
+				data->len, g_rand_int (rand), g_rand_int_range (rand, 100, 100000));
+			g_byte_array_append (data, (const guint8 *) line, strlen (line));
+			g_free (line);
+		}
+	}
+
+	g_byte_array_set_size (data, DATA_SIZE);
+
+	return data;
+}
+
+static gsize
+random_chunk_size (GRand *rand)
+{
+	switch (g_rand_int_range (rand, 0, 4)) {
+	case 0:
+		return 1;
+	case 1:
+		return g_rand_int_range (rand, 1, 16);
+	case 2:
+		return g_rand_int_range (rand, 16, 4096);
+	default:
+		/* larger than the buffers of the converter streams */
+		return g_rand_int_range (rand, 4096, 40000);
+	}
+}
+
+/* Feeds the 'inbuf' to the 'inflater' in random pieces, using a small output buffer */
+static void
+inflate_chunked (GConverter *inflater,
+		 const guint8 *inbuf,
+		 gsize inbuf_size,
+		 GByteArray *output,
+		 GRand *rand)
+{
+	guint8 outbuf[17];
+	gsize n_read = 0, n_written = sizeof (outbuf);
+	GError *error = NULL;
+
+	while (inbuf_size > 0) {
+		GConverterResult result;
+		gsize chunk = MIN (inbuf_size, random_chunk_size (rand));
+
+		result = g_converter_convert (inflater, inbuf, chunk, outbuf, sizeof (outbuf),
+			G_CONVERTER_NO_FLAGS, &n_read, &n_written, &error);
+		check_msg (result == G_CONVERTER_CONVERTED, "%s", error ? error->message : "Unexpected result");
+
+		g_byte_array_append (output, outbuf, n_written);
+		inbuf += n_read;
+		inbuf_size -= n_read;
+	}
+
+	/* drain what did not fit into the output buffer */
+	while (n_written == sizeof (outbuf)) {
+		GConverterResult result;
+
+		result = g_converter_convert (inflater, NULL, 0, outbuf, sizeof (outbuf),
+			G_CONVERTER_NO_FLAGS, &n_read, &n_written, &error);
+
+		if (result == G_CONVERTER_ERROR) {
+			check_msg (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT), "%s", error->message);
+			g_clear_error (&error);
+			break;
+		}
+
+		g_byte_array_append (output, outbuf, n_written);
+	}
+}
+
+static void
+test_round_trip (GRand *rand)
+{
+	GConverter *deflater, *inflater;
+	GOutputStream *memory_stream, *stream;
+	GByteArray *data, *inflated;
+	GError *error = NULL;
+	const guint8 *compressed;
+	gsize offset, compressed_len, inflated_len = 0;
+
+	data = build_data (rand);
+	inflated = g_byte_array_new ();
+
+	deflater = camel_imapx_deflate_new (FALSE);
+	inflater = camel_imapx_deflate_new (TRUE);
+	check (!camel_imapx_deflate_get_inflate (CAMEL_IMAPX_DEFLATE (deflater)));
+	check (camel_imapx_deflate_get_inflate (CAMEL_IMAPX_DEFLATE (inflater)));
+
+	memory_stream = g_memory_output_stream_new_resizable ();
+	stream = g_converter_output_stream_new (memory_stream, deflater);
+
+	for (offset = 0; offset < data->len;) {
+		gsize chunk = MIN (data->len - offset, random_chunk_size (rand));
+		gsize n_written = 0;
+
+		/* no explicit flush; each write should reach the base stream as a whole */
+		check (g_output_stream_write_all (stream, data->data + offset, chunk, &n_written, NULL, &error));
+		check_msg (error == NULL, "%s", error->message);
+		check (n_written == chunk);
+		offset += chunk;
+
+		compressed = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (memory_stream));
+		compressed_len = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (memory_stream));
+
+		check_msg (compressed_len >= sizeof (sync_flush_marker) &&
+			memcmp (compressed + compressed_len - sizeof (sync_flush_marker), sync_flush_marker, sizeof (sync_flush_marker)) == 0,
+			"the write of %u bytes at %u is not sync-flushed", (guint) chunk, (guint) (offset - chunk));
+
+		/* everything written so far can be decompressed */
+		inflate_chunked (inflater, compressed + inflated_len, compressed_len - inflated_len, inflated, rand);
+		inflated_len = compressed_len;
+
+		check_msg (inflated->len == offset, "inflated %u bytes, expected %u", inflated->len, (guint) offset);
+		check (memcmp (inflated->data, data->data, offset) == 0);
+	}
+
+	check (camel_imapx_deflate_get_total_in (CAMEL_IMAPX_DEFLATE (deflater)) == data->len);
+	check (camel_imapx_deflate_get_total_out (CAMEL_IMAPX_DEFLATE (deflater)) == compressed_len);
+	check (camel_imapx_deflate_get_total_in (CAMEL_IMAPX_DEFLATE (inflater)) == compressed_len);
+	check (camel_imapx_deflate_get_total_out (CAMEL_IMAPX_DEFLATE (inflater)) == data->len);
+
+	/* the data compresses */
+	check (compressed_len < data->len);
+
+	g_object_unref (stream);
+	g_object_unref (memory_stream);
+	g_object_unref (inflater);
+	g_object_unref (deflater);
+	g_byte_array_free (inflated, TRUE);
+	g_byte_array_free (data, TRUE);
+}
+
+/* The inflater is the server side of the compressed stream, with
+   data compressed by zlib itself, read through a converter stream */
+static void
+test_inflate_stream (GRand *rand)
+{
+	GConverter *compressor, *inflater;
+	GOutputStream *memory_stream, *stream;
+	GInputStream *input, *converter_stream;
+	GByteArray *data, *inflated;
+	GError *error = NULL;
+	gsize offset;
+
+	data = build_data (rand);
+
+	compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+	memory_stream = g_memory_output_stream_new_resizable ();
+	stream = g_converter_output_stream_new (memory_stream, compressor);
+
+	for (offset = 0; offset < data->len;) {
+		gsize chunk = MIN (data->len - offset, random_chunk_size (rand));
+
+		check (g_output_stream_write_all (stream, data->data + offset, chunk, NULL, NULL, &error));
+		check (g_output_stream_flush (stream, NULL, &error));
+		check_msg (error == NULL, "%s", error->message);
+		offset += chunk;
+	}
+
+	check (g_output_stream_close (stream, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+
+	input = g_memory_input_stream_new_from_data (
+		g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (memory_stream)),
+		g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (memory_stream)),
+		NULL);
+
+	inflater = camel_imapx_deflate_new (TRUE);
+	converter_stream = g_converter_input_stream_new (input, inflater);
+	inflated = g_byte_array_new ();
+
+	while (TRUE) {
+		guint8 buffer[40000];
+		gssize n_read;
+
+		n_read = g_input_stream_read (converter_stream, buffer, MIN (sizeof (buffer), random_chunk_size (rand)), NULL, &error);
+		check_msg (n_read >= 0, "%s", error->message);
+
+		if (n_read <= 0)
+			break;
+
+		g_byte_array_append (inflated, buffer, n_read);
+	}
+
+	check_msg (inflated->len == data->len, "inflated %u bytes, expected %u", inflated->len, data->len);
+	check (memcmp (inflated->data, data->data, data->len) == 0);
+
+	g_byte_array_free (inflated, TRUE);
+	g_object_unref (converter_stream);
+	g_object_unref (inflater);
+	g_object_unref (input);
+	g_object_unref (stream);
+	g_object_unref (memory_stream);
+	g_object_unref (compressor);
+	g_byte_array_free (data, TRUE);
+}
+
+static void
+test_invalid_data (void)
+{
+	GConverter *inflater;
+	GConverterResult result;
+	/* a block with the reserved type 11 */
+	const guint8 invalid[] = { 0x07, 0x00, 0x00, 0x00 };
+	guint8 outbuf[64];
+	gsize n_read = 0, n_written = 0;
+	GError *error = NULL;
+
+	inflater = camel_imapx_deflate_new (TRUE);
+
+	result = g_converter_convert (inflater, invalid, sizeof (invalid), outbuf, sizeof (outbuf),
+		G_CONVERTER_NO_FLAGS, &n_read, &n_written, &error);
+	check (result == G_CONVERTER_ERROR);
+	check (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA));
+	g_clear_error (&error);
+
+	g_object_unref (inflater);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GRand *rand;
+
+	camel_test_init (argc, argv);
+
+	/* a fixed seed, thus any failure can be reproduced */
+	rand = g_rand_new_with_seed (4978);
+
+	camel_test_start ("IMAP COMPRESS DEFLATE converter");
+
+	push ("round trip, each write sync-flushed");
+	test_round_trip (rand);
+	pull ();
+
+	push ("inflate of a zlib stream");
+	test_inflate_stream (rand);
+	pull ();
+
+	push ("invalid data");
+	test_invalid_data ();
+	pull ();
+
+	camel_test_end ();
+
+	g_rand_free (rand);
+
+	return 0;
+}
@@ -0,0 +1,1032 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The pipelined and the parallel fetch of the summary of the new messages
+   by the IMAPX provider against a mock IMAP server on the loopback */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+#include "camel-test-provider.h"
+#include "session.h"
+
+#define TEST_DIR "/tmp/camel-test"
+
+/* The IMAPX_PIPELINE_WINDOW of the camel-imapx-server.c */
+#define PIPELINE_WINDOW 8
+
+/* The summary of the new messages is asked for in commands of 100 UIDs,
+   thus this makes more commands than fit into the pipeline window */
+#define N_MESSAGES 1000
+
+/* Twice the IMAPX_PARALLEL_FETCH_MIN_MESSAGES of the camel-imapx-conn-manager.c,
+   thus the new messages are split into one UID range per connection: 1:1334,
+   1335:2668 on the added connections and 2669:4000 on the refreshing one */
+#define N_PARALLEL_MESSAGES 4000
+#define N_PARALLEL_CONNECTIONS 3
+
+/* How long the server waits for more pipelined commands, before it answers those it has */
+#define PIPELINE_WAIT_USEC (200 * G_TIME_SPAN_MILLISECOND)
+
+static const gchar *imapx_drivers[] = { "imapx" };
+
+typedef struct _MockRange {
+	guint32 first;
+	guint32 last;
+} MockRange;
+
+typedef struct _MockCommand {
+	guint connection; /* index of the connection, from 1 */
+	gchar *text; /* without the tag */
+} MockCommand;
+
+typedef struct _MockServer {
+	GSocketListener *listener;
+	GCancellable *cancellable;
+	GThread *accept_thread;
+	guint16 port;
+	guint32 n_messages; /* with UIDs 1 to n_messages */
+	guint32 no_uid; /* the summary fetch of this UID fails with NO, 0 for none */
+	guint32 bad_uid; /* the summary fetch of this UID fails with BAD, 0 for none */
+	guint32 drop_uid; /* the connection is closed in the middle of the summary fetch of this UID, once */
+	guint32 cancel_uid; /* the 'client_cancellable' is cancelled on the summary fetch of this UID, once */
+	GCancellable *client_cancellable;
+
+	GMutex lock;
+	GPtrArray *threads; /* GThread *, one per connection */
+	GPtrArray *commands; /* MockCommand * */
+	guint n_connections;
+	guint max_in_flight; /* the most summary fetches completed at once */
+	guint n_reordered; /* how many times more of them were completed in the reverse order */
+	guint n_dropped;
+	gchar *error_text;
+} MockServer;
+
+typedef struct _MockConnection {
+	MockServer *ms;
+	GSocketConnection *connection;
+	guint index;
+} MockConnection;
+
+static void
+mock_command_free (gpointer ptr)
+{
+	MockCommand *command = ptr;
+
+	if (command) {
+		g_free (command->text);
+		g_free (command);
+	}
+}
+
+static gboolean
+mock_server_write (GOutputStream *output,
+		   const gchar *format,
+		   ...) G_GNUC_PRINTF (2, 3);
+
+static gboolean
+mock_server_write (GOutputStream *output,
+		   const gchar *format,
+		   ...)
+{
+	gchar *text;
+	va_list ap;
+	gboolean success;
+
+	va_start (ap, format);
+	text = g_strdup_vprintf (format, ap);
+	va_end (ap);
+
+	success = g_output_stream_write_all (output, text, strlen (text), NULL, NULL, NULL);
+
+	g_free (text);
+
+	return success;
+}
+
+static void
+mock_server_set_error (MockServer *ms,
+		       const gchar *format,
+		       ...) G_GNUC_PRINTF (2, 3);
+
+static void
+mock_server_set_error (MockServer *ms,
+		       const gchar *format,
+		       ...)
+{
+	va_list ap;
+
+	g_mutex_lock (&ms->lock);
+
+	if (!ms->error_text) {
+		va_start (ap, format);
+		ms->error_text = g_strdup_vprintf (format, ap);
+		va_end (ap);
+	}
+
+	g_mutex_unlock (&ms->lock);
+}
+
+static guint32
+mock_parse_uid (const gchar *text,
+		guint32 max_uid)
+{
+	if (*text == '*')
+		return max_uid;
+
+	return (guint32) g_ascii_strtoull (text, NULL, 10);
+}
+
+/* Parses an IMAP sequence set, like "1,3:5,10:*" */
+static GArray *
+mock_parse_uid_set (const gchar *set,
+		    guint32 max_uid)
+{
+	GArray *ranges;
+	gchar **parts;
+	guint ii;
+
+	ranges = g_array_new (FALSE, FALSE, sizeof (MockRange));
+	parts = g_strsplit (set, ",", -1);
+
+	for (ii = 0; parts[ii]; ii++) {
+		const gchar *colon = strchr (parts[ii], ':');
+		MockRange range;
+
+		range.first = mock_parse_uid (parts[ii], max_uid);
+		range.last = colon ? mock_parse_uid (colon + 1, max_uid) : range.first;
+
+		/* "n:*" with 'n' above the last UID means the last UID */
+		if (range.first > range.last) {
+			guint32 tmp = range.first;
+
+			range.first = range.last;
+			range.last = tmp;
+		}
+
+		g_array_append_val (ranges, range);
+	}
+
+	g_strfreev (parts);
+
+	return ranges;
+}
+
+static gboolean
+mock_ranges_contain (GArray *ranges,
+		     guint32 uid)
+{
+	guint ii;
+
+	for (ii = 0; ii < ranges->len; ii++) {
+		MockRange *range = &g_array_index (ranges, MockRange, ii);
+
+		if (range->first <= uid && uid <= range->last)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* The summary fetch is the one with the headers */
+static gboolean
+mock_is_summary_fetch (const gchar *text)
+{
+	return g_ascii_strncasecmp (text, "UID FETCH ", 10) == 0 &&
+		strstr (text, "RFC822.HEADER") != NULL;
+}
+
+static gboolean
+mock_connection_complete_pending (MockServer *ms,
+				  GOutputStream *output,
+				  GPtrArray *pending)
+{
+	GString *response;
+	gboolean success;
+	guint ii;
+
+	g_mutex_lock (&ms->lock);
+	ms->max_in_flight = MAX (ms->max_in_flight, pending->len);
+	if (pending->len > 1)
+		ms->n_reordered++;
+	g_mutex_unlock (&ms->lock);
+
+	response = g_string_new ("");
+
+	/* The last sent is completed first */
+	for (ii = pending->len; ii > 0; ii--) {
+		g_string_append (response, g_ptr_array_index (pending, ii - 1));
+	}
+
+	g_ptr_array_set_size (pending, 0);
+
+	success = mock_server_write (output, "%s", response->str);
+
+	g_string_free (response, TRUE);
+
+	return success;
+}
+
+/* The 'args' is the "<uid set> (<items>)" */
+static gboolean
+mock_connection_fetch (MockConnection *mc,
+		       GOutputStream *output,
+		       const gchar *tag,
+		       const gchar *args,
+		       GPtrArray *pending)
+{
+	MockServer *ms = mc->ms;
+	GArray *ranges;
+	GString *response;
+	const gchar *items;
+	const gchar *failure = NULL;
+	gchar *set;
+	gboolean with_header, success, drop = FALSE;
+	guint32 uid, n_uids = 0, n_sent = 0;
+
+	items = strchr (args, ' ');
+	if (!items)
+		return mock_server_write (output, "%s BAD Missing fetch items\r\n", tag);
+
+	set = g_strndup (args, items - args);
+	ranges = mock_parse_uid_set (set, ms->n_messages);
+	with_header = strstr (items, "RFC822.HEADER") != NULL;
+
+	if (with_header) {
+		GCancellable *cancel = NULL;
+
+		if (ms->no_uid && mock_ranges_contain (ranges, ms->no_uid))
+			failure = "NO";
+		else if (ms->bad_uid && mock_ranges_contain (ranges, ms->bad_uid))
+			failure = "BAD";
+
+		g_mutex_lock (&ms->lock);
+
+		if (ms->drop_uid && mock_ranges_contain (ranges, ms->drop_uid)) {
+			ms->drop_uid = 0;
+			ms->n_dropped++;
+			drop = TRUE;
+		}
+
+		if (ms->cancel_uid && mock_ranges_contain (ranges, ms->cancel_uid)) {
+			ms->cancel_uid = 0;
+			cancel = ms->client_cancellable;
+		}
+
+		g_mutex_unlock (&ms->lock);
+
+		/* As if the user cancelled the operation in the middle */
+		if (cancel)
+			g_cancellable_cancel (cancel);
+	}
+
+	/* The dropped connection sends only the first half of the messages */
+	for (uid = 1; drop && uid <= ms->n_messages; uid++) {
+		if (mock_ranges_contain (ranges, uid))
+			n_uids++;
+	}
+
+	response = g_string_new ("");
+
+	for (uid = 1; !failure && uid <= ms->n_messages; uid++) {
+		if (!mock_ranges_contain (ranges, uid))
+			continue;
+
+		if (drop && n_sent >= n_uids / 2)
+			break;
+
+		n_sent++;
+
+		if (with_header) {
+			gchar *header;
+
+			header = g_strdup_printf (
+				"From: sender@example.com\r\n"
+				"To: user@example.com\r\n"
+				"Subject: Message %u\r\n"
+				"Message-ID: <%u@example.com>\r\n"
+				"\r\n", uid, uid);
+
+			/* the sequence numbers match the UIDs */
+			g_string_append_printf (response, "* %u FETCH (UID %u RFC822.SIZE %u FLAGS (\\Seen) RFC822.HEADER {%u}\r\n%s)\r\n",
+				uid, uid, (guint) strlen (header) + 100, (guint) strlen (header), header);
+
+			g_free (header);
+		} else {
+			g_string_append_printf (response, "* %u FETCH (UID %u FLAGS (\\Seen))\r\n", uid, uid);
+		}
+	}
+
+	if (!with_header) {
+		g_string_append_printf (response, "%s OK FETCH completed\r\n", tag);
+	} else if (!drop) {
+		/* The summary fetches are pipelined, thus wait with the completion for the others */
+		if (failure)
+			g_ptr_array_add (pending, g_strdup_printf ("%s %s Mock failure of UIDs %s\r\n", tag, failure, set));
+		else
+			g_ptr_array_add (pending, g_strdup_printf ("%s OK Fetched UIDs %s\r\n", tag, set));
+	}
+
+	success = response->len == 0 || mock_server_write (output, "%s", response->str);
+
+	g_string_free (response, TRUE);
+	g_array_unref (ranges);
+	g_free (set);
+
+	/* the dropped connection is closed without the completion */
+	return success && !drop;
+}
+
+static gpointer
+mock_connection_thread (gpointer user_data)
+{
+	MockConnection *mc = user_data;
+	MockServer *ms = mc->ms;
+	GSocket *socket;
+	GDataInputStream *input;
+	GOutputStream *output;
+	GPtrArray *pending; /* gchar *, the postponed completions of the summary fetches */
+
+	socket = g_socket_connection_get_socket (mc->connection);
+	input = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (mc->connection)));
+	g_data_input_stream_set_newline_type (input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+	g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (input), FALSE);
+	output = g_io_stream_get_output_stream (G_IO_STREAM (mc->connection));
+	pending = g_ptr_array_new_with_free_func (g_free);
+
+	mock_server_write (output, "* PREAUTH Mock IMAP server ready\r\n");
+
+	while (TRUE) {
+		MockCommand *command;
+		gchar *line, *text;
+		gboolean success = TRUE;
+
+		/* Complete the pipelined commands only after the client stopped sending
+		   more of them, thus the most the client has in flight is seen */
+		if (pending->len > 0 &&
+		    g_buffered_input_stream_get_available (G_BUFFERED_INPUT_STREAM (input)) == 0 &&
+		    !g_socket_condition_timed_wait (socket, G_IO_IN, PIPELINE_WAIT_USEC, ms->cancellable, NULL) &&
+		    !mock_connection_complete_pending (ms, output, pending))
+			break;
+
+		line = g_data_input_stream_read_line (input, NULL, ms->cancellable, NULL);
+		if (!line)
+			break;
+
+		text = strchr (line, ' ');
+		if (!text) {
+			mock_server_set_error (ms, "Invalid command '%s'", line);
+			g_free (line);
+			break;
+		}
+
+		*text = '\0';
+		text++;
+
+		command = g_new0 (MockCommand, 1);
+		command->connection = mc->index;
+		command->text = g_strdup (text);
+
+		g_mutex_lock (&ms->lock);
+		g_ptr_array_add (ms->commands, command);
+		g_mutex_unlock (&ms->lock);
+
+		/* Only the summary fetches are expected to be pipelined */
+		if (pending->len > 0 && !mock_is_summary_fetch (text)) {
+			mock_server_set_error (ms, "'%s' sent while waiting for the summary fetches", text);
+			success = mock_connection_complete_pending (ms, output, pending);
+		}
+
+		if (!success) {
+			g_free (line);
+			break;
+		}
+
+		if (g_ascii_strncasecmp (text, "UID FETCH ", 10) == 0) {
+			success = mock_connection_fetch (mc, output, line, text + 10, pending);
+		} else if (g_ascii_strcasecmp (text, "CAPABILITY") == 0) {
+			success = mock_server_write (output, "* CAPABILITY IMAP4rev1\r\n%s OK CAPABILITY completed\r\n", line);
+		} else if (g_ascii_strncasecmp (text, "SELECT ", 7) == 0 ||
+			   g_ascii_strncasecmp (text, "EXAMINE ", 8) == 0) {
+			success = mock_server_write (output,
+				"* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
+				"* %u EXISTS\r\n"
+				"* 0 RECENT\r\n"
+				"* OK [UIDVALIDITY 1] UIDs valid\r\n"
+				"* OK [UIDNEXT %u] Predicted next UID\r\n"
+				"%s OK [READ-WRITE] SELECT completed\r\n",
+				ms->n_messages, ms->n_messages + 1, line);
+		} else if (g_ascii_strncasecmp (text, "STATUS ", 7) == 0) {
+			success = mock_server_write (output,
+				"* STATUS INBOX (MESSAGES %u UIDNEXT %u UIDVALIDITY 1 UNSEEN 0)\r\n"
+				"%s OK STATUS completed\r\n",
+				ms->n_messages, ms->n_messages + 1, line);
+		} else if (g_ascii_strncasecmp (text, "LIST ", 5) == 0) {
+			success = mock_server_write (output, "* LIST (\\HasNoChildren) \"/\" INBOX\r\n%s OK LIST completed\r\n", line);
+		} else if (g_ascii_strncasecmp (text, "LSUB ", 5) == 0) {
+			success = mock_server_write (output, "* LSUB () \"/\" INBOX\r\n%s OK LSUB completed\r\n", line);
+		} else if (g_ascii_strcasecmp (text, "LOGOUT") == 0) {
+			mock_server_write (output, "* BYE Mock IMAP server logging out\r\n%s OK LOGOUT completed\r\n", line);
+			g_free (line);
+			break;
+		} else {
+			/* NOOP and the like, without any data */
+			success = mock_server_write (output, "%s OK Completed\r\n", line);
+		}
+
+		g_free (line);
+
+		if (!success)
+			break;
+	}
+
+	g_ptr_array_unref (pending);
+	g_object_unref (input);
+
+	g_io_stream_close (G_IO_STREAM (mc->connection), NULL, NULL);
+	g_object_unref (mc->connection);
+	g_free (mc);
+
+	return NULL;
+}
+
+static gpointer
+mock_server_accept_thread (gpointer user_data)
+{
+	MockServer *ms = user_data;
+
+	while (TRUE) {
+		GSocketConnection *connection;
+		MockConnection *mc;
+
+		connection = g_socket_listener_accept (ms->listener, NULL, ms->cancellable, NULL);
+		if (!connection)
+			break;
+
+		mc = g_new0 (MockConnection, 1);
+		mc->ms = ms;
+		mc->connection = connection;
+
+		g_mutex_lock (&ms->lock);
+		ms->n_connections++;
+		mc->index = ms->n_connections;
+		g_ptr_array_add (ms->threads, g_thread_new ("mock-imap-connection", mock_connection_thread, mc));
+		g_mutex_unlock (&ms->lock);
+	}
+
+	return NULL;
+}
+
+static void
+mock_server_start (MockServer *ms,
+		   guint32 n_messages)
+{
+	GSocketAddress *address, *effective_address = NULL;
+	GError *error = NULL;
+
+	memset (ms, 0, sizeof (MockServer));
+
+	g_mutex_init (&ms->lock);
+	ms->n_messages = n_messages;
+	ms->threads = g_ptr_array_new ();
+	ms->commands = g_ptr_array_new_with_free_func (mock_command_free);
+	ms->cancellable = g_cancellable_new ();
+	ms->listener = g_socket_listener_new ();
+
+	address = g_inet_socket_address_new_from_string ("127.0.0.1", 0);
+	check (g_socket_listener_add_address (ms->listener, address, G_SOCKET_TYPE_STREAM,
+		G_SOCKET_PROTOCOL_TCP, NULL, &effective_address, &error));
+	check_msg (error == NULL, "%s", error->message);
+
+	ms->port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (effective_address));
+
+	g_object_unref (effective_address);
+	g_object_unref (address);
+
+	ms->accept_thread = g_thread_new ("mock-imap-server", mock_server_accept_thread, ms);
+}
+
+static void
+mock_server_stop (MockServer *ms)
+{
+	guint ii;
+
+	/* also stops the connections the client did not close */
+	g_cancellable_cancel (ms->cancellable);
+	g_thread_join (ms->accept_thread);
+
+	/* no new connection can come */
+	for (ii = 0; ii < ms->threads->len; ii++) {
+		g_thread_join (g_ptr_array_index (ms->threads, ii));
+	}
+
+	g_socket_listener_close (ms->listener);
+	g_clear_object (&ms->listener);
+	g_clear_object (&ms->cancellable);
+}
+
+static void
+mock_server_clear (MockServer *ms)
+{
+	g_ptr_array_unref (ms->threads);
+	g_ptr_array_unref (ms->commands);
+	g_free (ms->error_text);
+	g_mutex_clear (&ms->lock);
+}
+
+/* Counts the summary fetches, of any UID when 'uid' is 0 */
+static guint
+mock_server_count_summary_fetches (MockServer *ms,
+				   guint32 uid)
+{
+	guint ii, count = 0;
+
+	for (ii = 0; ii < ms->commands->len; ii++) {
+		MockCommand *command = g_ptr_array_index (ms->commands, ii);
+		const gchar *set = command->text + 10;
+		gchar *set_end;
+		GArray *ranges;
+
+		if (!mock_is_summary_fetch (command->text))
+			continue;
+
+		if (!uid) {
+			count++;
+			continue;
+		}
+
+		set_end = g_strndup (set, strcspn (set, " "));
+		ranges = mock_parse_uid_set (set_end, ms->n_messages);
+
+		if (mock_ranges_contain (ranges, uid))
+			count++;
+
+		g_array_unref (ranges);
+		g_free (set_end);
+	}
+
+	return count;
+}
+
+/* Returns the index of the connection, which sent the command 'text', 0 when none did */
+static guint
+mock_server_find_command (MockServer *ms,
+			  const gchar *text)
+{
+	guint ii;
+
+	for (ii = 0; ii < ms->commands->len; ii++) {
+		MockCommand *command = g_ptr_array_index (ms->commands, ii);
+
+		if (g_ascii_strcasecmp (command->text, text) == 0)
+			return command->connection;
+	}
+
+	return 0;
+}
+
+static CamelService *
+create_store (CamelSession *session,
+	      const gchar *uid,
+	      MockServer *ms,
+	      gint concurrent_connections)
+{
+	CamelService *service;
+	CamelSettings *settings;
+	GError *error = NULL;
+
+	service = camel_session_add_service (session, uid, "imapx", CAMEL_PROVIDER_STORE, &error);
+	check_msg (error == NULL, "adding store: %s", error->message);
+	check (CAMEL_IS_OFFLINE_STORE (service));
+
+	settings = camel_service_ref_settings (service);
+	g_object_set (settings,
+		"host", "127.0.0.1",
+		"port", (guint) ms->port,
+		"user", "user",
+		"security-method", CAMEL_NETWORK_SECURITY_METHOD_NONE,
+		"concurrent-connections", concurrent_connections,
+		NULL);
+	g_object_unref (settings);
+
+	check (camel_offline_store_set_online_sync (CAMEL_OFFLINE_STORE (service), TRUE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+
+	return service;
+}
+
+static void
+remove_store (CamelSession *session,
+	      CamelService *service)
+{
+	GError *error = NULL;
+
+	check (camel_service_disconnect_sync (service, TRUE, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	camel_session_remove_service (session, service);
+	g_object_unref (service);
+}
+
+/* Checks the UIDs from 'first_uid' to 'last_uid' are, or are not, in the summary */
+static void
+check_summary_uids (CamelFolder *folder,
+		    guint32 first_uid,
+		    guint32 last_uid,
+		    gboolean expect_present)
+{
+	CamelFolderSummary *summary;
+	guint32 uid;
+
+	summary = camel_folder_get_folder_summary (folder);
+
+	for (uid = first_uid; uid <= last_uid; uid++) {
+		CamelMessageInfo *info;
+		gchar uid_str[16];
+		gchar *subject;
+
+		g_snprintf (uid_str, sizeof (uid_str), "%u", uid);
+
+		info = camel_folder_summary_get (summary, uid_str);
+
+		if (!expect_present) {
+			check_msg (info == NULL, "UID %u is in the summary", uid);
+			continue;
+		}
+
+		check_msg (info != NULL, "UID %u is not in the summary", uid);
+
+		/* the headers are of the message asked for */
+		subject = g_strdup_printf ("Message %u", uid);
+		check_msg (g_strcmp0 (camel_message_info_get_subject (info), subject) == 0,
+			"UID %u has subject '%s'", uid, camel_message_info_get_subject (info));
+		g_free (subject);
+
+		g_object_unref (info);
+	}
+}
+
+typedef struct _ChangedData {
+	GHashTable *added_uids; /* gchar * */
+	guint n_added;
+} ChangedData;
+
+static void
+folder_changed_cb (CamelFolder *folder,
+		   CamelFolderChangeInfo *changes,
+		   gpointer user_data)
+{
+	ChangedData *cd = user_data;
+	GPtrArray *added;
+	guint ii;
+
+	added = camel_folder_change_info_get_added_uids (changes);
+
+	for (ii = 0; added && ii < added->len; ii++) {
+		g_hash_table_add (cd->added_uids, g_strdup (g_ptr_array_index (added, ii)));
+		cd->n_added++;
+	}
+}
+
+static void
+test_parallel_fetch (CamelSession *session)
+{
+	CamelService *service;
+	CamelFolder *folder;
+	ChangedData cd;
+	MockServer ms;
+	GError *error = NULL;
+	gulong handler_id;
+	guint32 count = 0;
+	guint conn1, conn2, conn3;
+
+	mock_server_start (&ms, N_PARALLEL_MESSAGES);
+
+	push ("connecting");
+	service = create_store (session, "parallel-complete", &ms, N_PARALLEL_CONNECTIONS);
+	folder = camel_store_get_folder_sync (CAMEL_STORE (service), "INBOX", 0, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (CAMEL_IS_FOLDER (folder));
+	pull ();
+
+	cd.added_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	cd.n_added = 0;
+
+	handler_id = g_signal_connect (folder, "changed", G_CALLBACK (folder_changed_cb), &cd);
+
+	push ("refreshing");
+	check (camel_folder_refresh_info_sync (folder, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) == N_PARALLEL_MESSAGES,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	check_summary_uids (folder, 1, N_PARALLEL_MESSAGES, TRUE);
+	pull ();
+
+	push ("merged save and notification");
+	/* The ranges are saved together */
+	check (camel_db_count_total_message_info (camel_store_get_db (CAMEL_STORE (service)), "INBOX", &count, &error) == 0);
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (count == N_PARALLEL_MESSAGES, "%u messages saved", count);
+
+	/* The "changed" signal is emitted from an idle callback */
+	while (g_main_context_pending (NULL))
+		g_main_context_iteration (NULL, FALSE);
+
+	/* Each message is announced once, whichever connection fetched it */
+	check_msg (cd.n_added == N_PARALLEL_MESSAGES, "%u messages announced as added", cd.n_added);
+	check_msg (g_hash_table_size (cd.added_uids) == N_PARALLEL_MESSAGES,
+		"%u distinct messages announced as added", g_hash_table_size (cd.added_uids));
+	pull ();
+
+	g_signal_handler_disconnect (folder, handler_id);
+	g_hash_table_destroy (cd.added_uids);
+
+	g_object_unref (folder);
+	remove_store (session, service);
+
+	mock_server_stop (&ms);
+
+	push ("checking the server side");
+	check_msg (ms.error_text == NULL, "%s", ms.error_text);
+
+	/* The flags of each range are fetched on its own connection */
+	conn1 = mock_server_find_command (&ms, "UID FETCH 1:1334 (UID FLAGS)");
+	conn2 = mock_server_find_command (&ms, "UID FETCH 1335:2668 (UID FLAGS)");
+	conn3 = mock_server_find_command (&ms, "UID FETCH 2669:4000 (UID FLAGS)");
+	check_msg (conn1 != 0 && conn2 != 0 && conn3 != 0, "ranges fetched on connections %u, %u and %u", conn1, conn2, conn3);
+	check_msg (conn1 != conn2 && conn1 != conn3 && conn2 != conn3, "ranges fetched on connections %u, %u and %u", conn1, conn2, conn3);
+	check_msg (ms.n_connections == N_PARALLEL_CONNECTIONS, "%u connections", ms.n_connections);
+
+	/* No message is fetched twice */
+	check (mock_server_count_summary_fetches (&ms, 1) == 1);
+	check (mock_server_count_summary_fetches (&ms, 1334) == 1);
+	check (mock_server_count_summary_fetches (&ms, 1335) == 1);
+	check (mock_server_count_summary_fetches (&ms, 2668) == 1);
+	check (mock_server_count_summary_fetches (&ms, 2669) == 1);
+	check (mock_server_count_summary_fetches (&ms, N_PARALLEL_MESSAGES) == 1);
+	pull ();
+
+	mock_server_clear (&ms);
+}
+
+static void
+test_parallel_fetch_dropped (CamelSession *session)
+{
+	CamelService *service;
+	CamelFolder *folder;
+	MockServer ms;
+	GError *error = NULL;
+
+	mock_server_start (&ms, N_PARALLEL_MESSAGES);
+
+	/* The range 1335:2668 is fetched from the newest, thus its connection is
+	   closed in the 7th command, for the UIDs 1969:2068, after the UID 2018 */
+	ms.drop_uid = 2000;
+
+	push ("connecting");
+	service = create_store (session, "parallel-dropped", &ms, N_PARALLEL_CONNECTIONS);
+	folder = camel_store_get_folder_sync (CAMEL_STORE (service), "INBOX", 0, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (CAMEL_IS_FOLDER (folder));
+	pull ();
+
+	push ("refreshing");
+	/* The failed range is not fatal, the refresh fetches what's missing */
+	check (camel_folder_refresh_info_sync (folder, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) == N_PARALLEL_MESSAGES,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	check_summary_uids (folder, 1, N_PARALLEL_MESSAGES, TRUE);
+	pull ();
+
+	g_object_unref (folder);
+	remove_store (session, service);
+
+	mock_server_stop (&ms);
+
+	push ("checking the server side");
+	check_msg (ms.error_text == NULL, "%s", ms.error_text);
+	check (ms.n_dropped == 1);
+	/* Not received on the closed connection, thus fetched again */
+	check_msg (mock_server_count_summary_fetches (&ms, 2060) == 2,
+		"UID 2060 fetched %u times", mock_server_count_summary_fetches (&ms, 2060));
+	/* The other ranges are not affected */
+	check (mock_server_count_summary_fetches (&ms, 1) == 1);
+	check (mock_server_count_summary_fetches (&ms, N_PARALLEL_MESSAGES) == 1);
+	pull ();
+
+	mock_server_clear (&ms);
+}
+
+static void
+test_parallel_fetch_cancelled (CamelSession *session)
+{
+	CamelService *service;
+	CamelFolder *folder;
+	MockServer ms;
+	GError *error = NULL;
+
+	mock_server_start (&ms, N_PARALLEL_MESSAGES);
+
+	/* Cancelled on the first command of the range 1:1334, while
+	   the other ranges are being fetched on their connections */
+	ms.cancel_uid = 1334;
+	ms.client_cancellable = g_cancellable_new ();
+
+	push ("connecting");
+	service = create_store (session, "parallel-cancelled", &ms, N_PARALLEL_CONNECTIONS);
+	folder = camel_store_get_folder_sync (CAMEL_STORE (service), "INBOX", 0, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (CAMEL_IS_FOLDER (folder));
+	pull ();
+
+	push ("refreshing with cancel");
+	check (!camel_folder_refresh_info_sync (folder, ms.client_cancellable, &error));
+	check_msg (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED), "%s", error ? error->message : "no error");
+	g_clear_error (&error);
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) < N_PARALLEL_MESSAGES,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	pull ();
+
+	push ("refreshing again");
+	/* The connections closed by the cancel are replaced */
+	check (camel_folder_refresh_info_sync (folder, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) == N_PARALLEL_MESSAGES,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	check_summary_uids (folder, 1, N_PARALLEL_MESSAGES, TRUE);
+	pull ();
+
+	g_object_unref (folder);
+	remove_store (session, service);
+
+	mock_server_stop (&ms);
+
+	/* The cancelled connections can be closed with the summary fetches
+	   still in flight, thus only the cancel itself is checked */
+	check (ms.cancel_uid == 0);
+
+	g_clear_object (&ms.client_cancellable);
+	mock_server_clear (&ms);
+}
+
+static void
+test_pipelined_fetch (CamelSession *session)
+{
+	CamelService *service;
+	CamelFolder *folder;
+	MockServer ms;
+	GError *error = NULL;
+
+	mock_server_start (&ms, N_MESSAGES);
+
+	push ("connecting");
+	service = create_store (session, "pipeline-complete", &ms, 1);
+	folder = camel_store_get_folder_sync (CAMEL_STORE (service), "INBOX", 0, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (CAMEL_IS_FOLDER (folder));
+	pull ();
+
+	push ("refreshing");
+	check (camel_folder_refresh_info_sync (folder, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) == N_MESSAGES,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	check_summary_uids (folder, 1, N_MESSAGES, TRUE);
+	pull ();
+
+	g_object_unref (folder);
+	remove_store (session, service);
+
+	mock_server_stop (&ms);
+
+	push ("checking the server side");
+	check_msg (ms.error_text == NULL, "%s", ms.error_text);
+	check_msg (mock_server_count_summary_fetches (&ms, 0) == N_MESSAGES / 100,
+		"%u summary fetches", mock_server_count_summary_fetches (&ms, 0));
+	/* The whole window was in flight and completed in the reverse order; a completion
+	   matched to a wrong command would leave the right one waiting, or fail the refresh
+	   with an unexpected tag */
+	check_msg (ms.max_in_flight == PIPELINE_WINDOW, "%u commands in flight", ms.max_in_flight);
+	check (ms.n_reordered > 0);
+	pull ();
+
+	mock_server_clear (&ms);
+}
+
+static void
+test_pipelined_fetch_failure (CamelSession *session)
+{
+	CamelService *service;
+	CamelFolder *folder;
+	MockServer ms;
+	GError *error = NULL;
+
+	mock_server_start (&ms, N_MESSAGES);
+
+	/* The new messages are fetched from the newest, thus the 3rd command,
+	   for the UIDs 701:800, fails with NO and the 6th, for 401:500, with BAD */
+	ms.no_uid = 750;
+	ms.bad_uid = 450;
+
+	push ("connecting");
+	service = create_store (session, "pipeline-failure", &ms, 1);
+	folder = camel_store_get_folder_sync (CAMEL_STORE (service), "INBOX", 0, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check (CAMEL_IS_FOLDER (folder));
+	pull ();
+
+	push ("refreshing");
+	check (!camel_folder_refresh_info_sync (folder, NULL, &error));
+	check (error != NULL);
+	/* The error is of the first failed command */
+	check_msg (strstr (error->message, "Mock failure of UIDs 701:800") != NULL, "%s", error->message);
+	g_clear_error (&error);
+
+	/* The failures do not affect the other commands of the window */
+	check_msg (camel_folder_summary_count (camel_folder_get_folder_summary (folder)) == 600,
+		"%u messages in the summary", camel_folder_summary_count (camel_folder_get_folder_summary (folder)));
+	check_summary_uids (folder, 801, 1000, TRUE);
+	check_summary_uids (folder, 701, 800, FALSE);
+	check_summary_uids (folder, 501, 700, TRUE);
+	check_summary_uids (folder, 401, 500, FALSE);
+	check_summary_uids (folder, 201, 400, TRUE);
+	/* The commands after the failed window are not sent */
+	check_summary_uids (folder, 1, 200, FALSE);
+	pull ();
+
+	g_object_unref (folder);
+	remove_store (session, service);
+
+	mock_server_stop (&ms);
+
+	push ("checking the server side");
+	check_msg (ms.error_text == NULL, "%s", ms.error_text);
+	check_msg (mock_server_count_summary_fetches (&ms, 0) == PIPELINE_WINDOW,
+		"%u summary fetches", mock_server_count_summary_fetches (&ms, 0));
+	check (mock_server_count_summary_fetches (&ms, 200) == 0);
+	check (mock_server_count_summary_fetches (&ms, 1) == 0);
+	check (ms.n_reordered > 0);
+	pull ();
+
+	mock_server_clear (&ms);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelSession *session;
+
+	camel_test_init (argc, argv);
+	camel_test_provider_init (1, imapx_drivers);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf " TEST_DIR);
+	g_mkdir_with_parents (TEST_DIR, 0700);
+
+	session = camel_test_session_new (TEST_DIR);
+
+	camel_test_start ("IMAP fetch of the new messages");
+
+	push ("pipelined summary fetch");
+	test_pipelined_fetch (session);
+	pull ();
+
+	push ("pipelined summary fetch with failed commands");
+	test_pipelined_fetch_failure (session);
+	pull ();
+
+	push ("parallel fetch on more connections");
+	test_parallel_fetch (session);
+	pull ();
+
+	push ("parallel fetch with a connection closed in the middle");
+	test_parallel_fetch_dropped (session);
+	pull ();
+
+	push ("cancelled parallel fetch");
+	test_parallel_fetch_cancelled (session);
+	pull ();
+
+	g_object_unref (session);
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The tokens sliced from the IMAPX input stream and the FETCH flags parser,
+   with the server data arriving in chunks of 1 to 3 bytes */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "providers/imapx/camel-imapx-input-stream.h"
+#include "providers/imapx/camel-imapx-utils.h"
+
+#include "camel-test.h"
+
+/* Longer than the initial buffer of the input stream, thus it grows */
+#define LONG_ATOM_LENGTH (10000)
+
+/* A memory stream, which returns at most 1, 2 or 3 bytes from each read */
+typedef struct _ChunkedInputStream {
+	GMemoryInputStream parent;
+	guint n_reads;
+} ChunkedInputStream;
+
+typedef struct _ChunkedInputStreamClass {
+	GMemoryInputStreamClass parent_class;
+} ChunkedInputStreamClass;
+
+GType chunked_input_stream_get_type (void);
+
+G_DEFINE_TYPE (ChunkedInputStream, chunked_input_stream, G_TYPE_MEMORY_INPUT_STREAM)
+
+static gssize
+chunked_input_stream_read (GInputStream *stream,
+			   gpointer buffer,
+			   gsize count,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	ChunkedInputStream *chunked = (ChunkedInputStream *) stream;
+	gsize chunk;
+
+	chunk = 1 + (chunked->n_reads % 3);
+	chunked->n_reads++;
+
+	return G_INPUT_STREAM_CLASS (chunked_input_stream_parent_class)->read_fn (stream, buffer, MIN (count, chunk), cancellable, error);
+}
+
+static void
+chunked_input_stream_class_init (ChunkedInputStreamClass *class)
+{
+	GInputStreamClass *input_stream_class;
+
+	input_stream_class = G_INPUT_STREAM_CLASS (class);
+	input_stream_class->read_fn = chunked_input_stream_read;
+}
+
+static void
+chunked_input_stream_init (ChunkedInputStream *chunked)
+{
+}
+
+static CamelIMAPXInputStream *
+create_stream (const gchar *data)
+{
+	GInputStream *base_stream;
+	GInputStream *stream;
+
+	base_stream = g_object_new (chunked_input_stream_get_type (), NULL);
+	g_memory_input_stream_add_data (G_MEMORY_INPUT_STREAM (base_stream), g_strdup (data), -1, g_free);
+
+	stream = camel_imapx_input_stream_new (base_stream);
+	g_object_unref (base_stream);
+
+	return CAMEL_IMAPX_INPUT_STREAM (stream);
+}
+
+static void
+check_token (CamelIMAPXInputStream *stream,
+	     gint expected_tok,
+	     const gchar *expected_data)
+{
+	GError *error = NULL;
+	guchar *token = NULL;
+	guint len = 0;
+	gint tok;
+
+	tok = camel_imapx_input_stream_token_slice (stream, &token, &len, NULL, &error);
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (tok == expected_tok, "expected token %d, got %d", expected_tok, tok);
+
+	if (expected_data) {
+		check_msg (len == strlen (expected_data) && strncmp ((const gchar *) token, expected_data, len) == 0,
+			"expected '%s', got '%.*s'", expected_data, (gint) MIN (len, 64), (const gchar *) token);
+	}
+}
+
+static void
+test_token_slices (void)
+{
+	CamelIMAPXInputStream *stream;
+	GString *data;
+	gchar *long_atom;
+	gchar *astring = NULL;
+	GError *error = NULL;
+
+	long_atom = g_strnfill (LONG_ATOM_LENGTH, 'x');
+	long_atom[0] = 'A';
+	long_atom[LONG_ATOM_LENGTH - 1] = 'Z';
+
+	data = g_string_new ("");
+	g_string_append (data, "* 123 FETCH (UID 4567 FLAGS (\\Seen Junk custom-flag))\r\n");
+	g_string_append_printf (data, "* OK %s 89 \"quoted string\" ATOM\r\n", long_atom);
+	g_string_append (data, "* 1234567890123 astring-atom \"astring quoted\"\r\n");
+
+	stream = create_stream (data->str);
+
+	push ("atoms, numbers and the flag list");
+	check_token (stream, '*', NULL);
+	check_token (stream, IMAPX_TOK_INT, "123");
+	check_token (stream, IMAPX_TOK_TOKEN, "FETCH");
+	check_token (stream, '(', NULL);
+	check_token (stream, IMAPX_TOK_TOKEN, "UID");
+	check_token (stream, IMAPX_TOK_INT, "4567");
+	check_token (stream, IMAPX_TOK_TOKEN, "FLAGS");
+	check_token (stream, '(', NULL);
+	check_token (stream, IMAPX_TOK_TOKEN, "\\Seen");
+	check_token (stream, IMAPX_TOK_TOKEN, "Junk");
+	check_token (stream, IMAPX_TOK_TOKEN, "custom-flag");
+	check_token (stream, ')', NULL);
+	check_token (stream, ')', NULL);
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	push ("atom longer than the buffer, quoted string");
+	check_token (stream, '*', NULL);
+	check_token (stream, IMAPX_TOK_TOKEN, "OK");
+	check_token (stream, IMAPX_TOK_TOKEN, long_atom);
+	check_token (stream, IMAPX_TOK_INT, "89");
+	/* not sliced, but copied by camel_imapx_input_stream_token() */
+	check_token (stream, IMAPX_TOK_STRING, "quoted string");
+	check_token (stream, IMAPX_TOK_TOKEN, "ATOM");
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	push ("slices mixed with the copied astrings");
+	check_token (stream, '*', NULL);
+	check_token (stream, IMAPX_TOK_INT, "1234567890123");
+	check (camel_imapx_input_stream_astring (stream, (guchar **) &astring, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (g_strcmp0 (astring, "astring-atom") == 0, "got '%s'", astring);
+	check (camel_imapx_input_stream_astring (stream, (guchar **) &astring, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check_msg (g_strcmp0 (astring, "astring quoted") == 0, "got '%s'", astring);
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	check_unref (stream, 1);
+	g_string_free (data, TRUE);
+	g_free (long_atom);
+}
+
+static void
+test_fetch_uid_flags (void)
+{
+	CamelIMAPXInputStream *stream;
+	struct _fetch_uid_flags ufinfo;
+	struct _fetch_info *finfo = NULL;
+	GError *error = NULL;
+
+	stream = create_stream (
+		"(UID 42 FLAGS (\\Seen \\Flagged Junk custom-flag) MODSEQ (12345))\r\n"
+		"(FLAGS () UID 1234567890)\r\n"
+		"(UID 43 FLAGS (\\Answered) RFC822.SIZE 1234)\r\n"
+		"(UID 44 FLAGS (\\Seen)\r\n");
+
+	push ("UID, FLAGS and MODSEQ");
+	check (imapx_parse_fetch_uid_flags (stream, &ufinfo, &finfo, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check (finfo == NULL);
+	check (ufinfo.got == (FETCH_UID | FETCH_FLAGS | FETCH_MODSEQ));
+	check_msg (strcmp (ufinfo.uid, "42") == 0, "got uid '%s'", ufinfo.uid);
+	check_msg (ufinfo.flags == (CAMEL_MESSAGE_SEEN | CAMEL_MESSAGE_FLAGGED | CAMEL_MESSAGE_JUNK), "got flags 0x%x", ufinfo.flags);
+	check (ufinfo.modseq == 12345);
+	check (ufinfo.user_flags != NULL);
+	check (camel_named_flags_get_length (ufinfo.user_flags) == 1);
+	check (camel_named_flags_contains (ufinfo.user_flags, "custom-flag"));
+	camel_named_flags_free (ufinfo.user_flags);
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	push ("empty flags before the UID");
+	check (imapx_parse_fetch_uid_flags (stream, &ufinfo, &finfo, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check (finfo == NULL);
+	check (ufinfo.got == (FETCH_UID | FETCH_FLAGS));
+	check_msg (strcmp (ufinfo.uid, "1234567890") == 0, "got uid '%s'", ufinfo.uid);
+	check (ufinfo.flags == 0);
+	check (ufinfo.user_flags == NULL);
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	push ("other items continue with the full fetch info");
+	check (imapx_parse_fetch_uid_flags (stream, &ufinfo, &finfo, NULL, &error));
+	check_msg (error == NULL, "%s", error->message);
+	check (finfo != NULL);
+	check (finfo->got == (FETCH_UID | FETCH_FLAGS | FETCH_SIZE));
+	check_msg (g_strcmp0 (finfo->uid, "43") == 0, "got uid '%s'", finfo->uid);
+	check (finfo->flags == CAMEL_MESSAGE_ANSWERED);
+	check (finfo->size == 1234);
+	check (ufinfo.user_flags == NULL);
+	imapx_free_fetch (finfo);
+	finfo = NULL;
+	check_token (stream, '\n', NULL);
+	pull ();
+
+	push ("missing closing parenthesis");
+	check (!imapx_parse_fetch_uid_flags (stream, &ufinfo, &finfo, NULL, &error));
+	check (error != NULL);
+	check (finfo == NULL);
+	g_clear_error (&error);
+	pull ();
+
+	check_unref (stream, 1);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	camel_test_init (argc, argv);
+	imapx_utils_init ();
+
+	camel_test_start ("IMAPX tokens and FETCH flags in small chunks");
+
+	push ("token slices");
+	test_token_slices ();
+	pull ();
+
+	push ("FETCH UID and FLAGS");
+	test_fetch_uid_flags ();
+	pull ();
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-data-server-config.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+#define TEST_DIR "/tmp/camel-test"
+
+static const struct {
+	const gchar *name;
+	const gchar *body;
+} messages[] = {
+	{ "1", "Hello, the meeting is on Tuesday." },
+	{ "2", "Please find the attached Invoice number 42." },
+	{ "3", "Příliš žluťoučký kůň úpěl ďábelské ódy" },
+	{ "4", "" }
+};
+
+/* A substring of any word of the message must never be rejected */
+static void
+check_words_match (CamelIndex *idx)
+{
+	gint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (messages); ii++) {
+		gchar **words;
+		gint jj;
+
+		words = g_strsplit_set (messages[ii].body, " ,.", -1);
+
+		for (jj = 0; words[jj]; jj++) {
+			const gchar *word = words[jj];
+			glong len = g_utf8_strlen (word, -1), from, to;
+
+			for (from = 0; from < len; from++) {
+				for (to = from + 1; to <= len; to++) {
+					gchar *sub, *upper;
+
+					sub = g_utf8_substring (word, from, to);
+					upper = g_utf8_strup (sub, -1);
+
+					check_msg (camel_index_may_match (idx, messages[ii].name, sub),
+						"'%s' of message %s", sub, messages[ii].name);
+					check_msg (camel_index_may_match (idx, messages[ii].name, upper),
+						"'%s' of message %s", upper, messages[ii].name);
+
+					g_free (upper);
+					g_free (sub);
+				}
+			}
+		}
+
+		g_strfreev (words);
+	}
+}
+
+static void
+check_filter (CamelIndex *idx)
+{
+	push ("substrings of the words");
+	check_words_match (idx);
+	pull ();
+
+	push ("absent words");
+	check (!camel_index_may_match (idx, "1", "invoice"));
+	check (!camel_index_may_match (idx, "2", "meeting"));
+	check (!camel_index_may_match (idx, "3", "zlutoucky"));
+	check (!camel_index_may_match (idx, "4", "hello"));
+	/* words are split at non-alphanumeric characters */
+	check (!camel_index_may_match (idx, "1", "the meeting"));
+	pull ();
+
+	push ("unknown names and short strings");
+	check (camel_index_may_match (idx, "5", "anything"));
+	check (camel_index_may_match (idx, "1", "zz"));
+	check (camel_index_may_match (idx, "1", ""));
+	pull ();
+}
+
+static void
+test_index (CamelIndex * (*index_new) (const gchar *path, gint flags),
+	    const gchar *path)
+{
+	CamelIndex *idx;
+	gint ii;
+
+	push ("creating");
+	idx = index_new (path, O_RDWR | O_CREAT | O_TRUNC);
+	check (idx != NULL);
+
+	for (ii = 0; ii < G_N_ELEMENTS (messages); ii++) {
+		CamelIndexName *idn;
+
+		idn = camel_index_add_name (idx, messages[ii].name);
+		check (idn != NULL);
+		camel_index_name_add_buffer (idn, messages[ii].body, strlen (messages[ii].body));
+		check (camel_index_write_name (idx, idn) == 0);
+		g_object_unref (idn);
+	}
+
+	check_filter (idx);
+	check (camel_index_sync (idx) == 0);
+	check_unref (idx, 1);
+	pull ();
+
+	push ("reopening");
+	idx = index_new (path, O_RDWR);
+	check (idx != NULL);
+	check_filter (idx);
+	pull ();
+
+	push ("deleting a name");
+	camel_index_delete_name (idx, "2");
+	check (camel_index_may_match (idx, "2", "meeting"));
+	check (camel_index_sync (idx) == 0);
+	check_unref (idx, 1);
+	pull ();
+
+	push ("rewriting a name");
+	idx = index_new (path, O_RDWR);
+	check (idx != NULL);
+	check (camel_index_may_match (idx, "2", "meeting"));
+	check (!camel_index_may_match (idx, "1", "invoice"));
+
+	for (ii = 0; ii < 3; ii++) {
+		CamelIndexName *idn;
+		const gchar *body = "Your invoice is ready.";
+
+		camel_index_delete_name (idx, "1");
+		idn = camel_index_add_name (idx, "1");
+		check (idn != NULL);
+		camel_index_name_add_buffer (idn, body, strlen (body));
+		check (camel_index_write_name (idx, idn) == 0);
+		g_object_unref (idn);
+		check (camel_index_sync (idx) == 0);
+	}
+
+	check (camel_index_may_match (idx, "1", "invoice"));
+	check (!camel_index_may_match (idx, "1", "meeting"));
+	check_unref (idx, 1);
+
+	/* only the last record of the name is used */
+	idx = index_new (path, O_RDWR);
+	check (idx != NULL);
+	check (camel_index_may_match (idx, "1", "invoice"));
+	check (!camel_index_may_match (idx, "1", "meeting"));
+	check (camel_index_may_match (idx, "2", "meeting"));
+	check (!camel_index_may_match (idx, "3", "invoice"));
+	check_unref (idx, 1);
+	pull ();
+
+	push ("truncating");
+	idx = index_new (path, O_RDWR | O_CREAT | O_TRUNC);
+	check (idx != NULL);
+	check (camel_index_may_match (idx, "1", "invoice"));
+	check_unref (idx, 1);
+	pull ();
+}
+
+static CamelIndex *
+text_index_new (const gchar *path,
+		gint flags)
+{
+	return (CamelIndex *) camel_text_index_new (path, flags);
+}
+
+static CamelIndex *
+posting_index_new (const gchar *path,
+		   gint flags)
+{
+	return (CamelIndex *) camel_posting_index_new (path, flags);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	camel_test_init (argc, argv);
+
+	/* clear out any camel-test data */
+	system ("/bin/rm -rf " TEST_DIR);
+	g_mkdir_with_parents (TEST_DIR, 0700);
+
+	camel_test_start ("Bloom filters of the indexed names");
+
+	push ("text index");
+	test_index (text_index_new, TEST_DIR "/text");
+	pull ();
+
+	push ("posting index");
+	test_index (posting_index_new, TEST_DIR "/posting");
+	pull ();
+
+	camel_test_end ();
+
+	return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* the message ID, references, user flags and user tags of the summary record,
+   which CamelMessageInfoBase decodes on the first use, compared with the
+   generic CamelMessageInfo load(), which decodes them immediately */
+
+#include "evolution-data-server-config.h"
+
+#include <string.h>
+#include <camel/camel.h>
+
+#include "camel-test.h"
+
+typedef enum {
+	READ_MESSAGE_ID,
+	READ_REFERENCES,
+	READ_USER_FLAG,
+	READ_USER_TAG
+} ReadFirst;
+
+static CamelMIRecord *
+save_record (CamelMessageInfo *mi)
+{
+	CamelMIRecord *record;
+	GString *bdata;
+
+	record = g_new0 (CamelMIRecord, 1);
+	bdata = g_string_new ("");
+
+	check (camel_message_info_save (mi, record, bdata));
+
+	record->bdata = g_string_free (bdata, FALSE);
+
+	return record;
+}
+
+static CamelMIRecord *
+create_record (guint64 message_id,
+	       const gchar *label,
+	       const gchar *follow_up)
+{
+	CamelMessageInfo *mi;
+	CamelMIRecord *record;
+	GArray *references;
+	guint64 reference;
+
+	mi = camel_message_info_new (NULL);
+	camel_message_info_set_uid (mi, "123");
+	camel_message_info_set_flags (mi, ~0, CAMEL_MESSAGE_SEEN | CAMEL_MESSAGE_FLAGGED);
+	camel_message_info_set_subject (mi, "Message subject");
+	camel_message_info_set_from (mi, "sender@example.com");
+	camel_message_info_set_size (mi, 4567);
+	camel_message_info_set_message_id (mi, message_id);
+
+	/* with both halves of the IDs used */
+	references = g_array_new (FALSE, FALSE, sizeof (guint64));
+	reference = G_GUINT64_CONSTANT (0x1234567890abcdef);
+	g_array_append_val (references, reference);
+	reference = message_id + 1;
+	g_array_append_val (references, reference);
+	camel_message_info_take_references (mi, references);
+
+	camel_message_info_set_user_flag (mi, "$Label1", TRUE);
+	camel_message_info_set_user_flag (mi, label, TRUE);
+	camel_message_info_set_user_tag (mi, "follow-up", follow_up);
+	camel_message_info_set_user_tag (mi, "label", "with spaces and 5-digits");
+
+	record = save_record (mi);
+
+	g_object_unref (mi);
+
+	return record;
+}
+
+static CamelMessageInfo *
+load_lazy (CamelMIRecord *record)
+{
+	CamelMessageInfo *mi;
+	gchar *bdata = record->bdata;
+
+	mi = camel_message_info_new (NULL);
+	check (CAMEL_IS_MESSAGE_INFO_BASE (mi));
+	check (camel_message_info_load (mi, record, &bdata));
+
+	return mi;
+}
+
+/* Loads the 'record' with the load() of the CamelMessageInfo, which does not postpone anything */
+static CamelMessageInfo *
+load_eager (CamelMIRecord *record)
+{
+	CamelMessageInfoClass *klass;
+	CamelMessageInfo *mi;
+	gchar *bdata = record->bdata;
+
+	klass = g_type_class_ref (CAMEL_TYPE_MESSAGE_INFO);
+
+	mi = camel_message_info_new (NULL);
+	check (klass->load (mi, record, &bdata));
+
+	g_type_class_unref (klass);
+
+	return mi;
+}
+
+static void
+check_decoded (CamelMessageInfo *lazy,
+	       CamelMessageInfo *eager,
+	       ReadFirst read_first)
+{
+	const GArray *lazy_references, *eager_references;
+	guint ii;
+
+	/* the first read decodes all the postponed values */
+	switch (read_first) {
+	case READ_MESSAGE_ID:
+		check (camel_message_info_get_message_id (lazy) == camel_message_info_get_message_id (eager));
+		break;
+	case READ_REFERENCES:
+		check (camel_message_info_get_references (lazy) != NULL);
+		break;
+	case READ_USER_FLAG:
+		check (camel_message_info_get_user_flag (lazy, "$Label1"));
+		break;
+	case READ_USER_TAG:
+		check (g_strcmp0 (camel_message_info_get_user_tag (lazy, "follow-up"), camel_message_info_get_user_tag (eager, "follow-up")) == 0);
+		break;
+	}
+
+	check (camel_message_info_get_message_id (lazy) == camel_message_info_get_message_id (eager));
+
+	lazy_references = camel_message_info_get_references (lazy);
+	eager_references = camel_message_info_get_references (eager);
+	check (lazy_references != NULL && eager_references != NULL);
+	check_msg (lazy_references->len == eager_references->len, "%u references, expected %u", lazy_references->len, eager_references->len);
+	for (ii = 0; ii < lazy_references->len; ii++) {
+		check_msg (g_array_index (lazy_references, guint64, ii) == g_array_index (eager_references, guint64, ii), "reference %u differs", ii);
+	}
+
+	check (camel_named_flags_equal (camel_message_info_get_user_flags (lazy), camel_message_info_get_user_flags (eager)));
+	check (camel_name_value_array_equal (camel_message_info_get_user_tags (lazy), camel_message_info_get_user_tags (eager), CAMEL_COMPARE_CASE_SENSITIVE));
+
+	/* the values loaded right away are not affected */
+	check (camel_message_info_get_flags (lazy) == camel_message_info_get_flags (eager));
+	check (camel_message_info_get_size (lazy) == camel_message_info_get_size (eager));
+	check (g_strcmp0 (camel_message_info_get_subject (lazy), camel_message_info_get_subject (eager)) == 0);
+}
+
+static void
+check_record_column (const gchar *name,
+		     const gchar *value,
+		     const gchar *expected)
+{
+	check_msg (g_strcmp0 (value, expected) == 0, "%s is '%s', expected '%s'", name, value, expected);
+}
+
+static void
+check_records_equal (CamelMIRecord *record,
+		     CamelMIRecord *expected)
+{
+	check_record_column ("uid", record->uid, expected->uid);
+	check (record->flags == expected->flags);
+	check (record->size == expected->size);
+	check_record_column ("subject", record->subject, expected->subject);
+	check_record_column ("from", record->from, expected->from);
+	check_record_column ("part", record->part, expected->part);
+	check_record_column ("labels", record->labels, expected->labels);
+	check_record_column ("usertags", record->usertags, expected->usertags);
+	check_record_column ("followup_flag", record->followup_flag, expected->followup_flag);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelMessageInfo *lazy, *eager;
+	CamelMIRecord *record, *other_record, *saved;
+	gchar *bdata;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Message info values decoded on the first use");
+
+	record = create_record (G_GUINT64_CONSTANT (0xfedcba0987654321), "important", "Follow-up");
+	other_record = create_record (G_GUINT64_CONSTANT (0x42), "other", "Reply");
+
+	push ("read after load");
+	eager = load_eager (record);
+
+	for (ii = READ_MESSAGE_ID; ii <= READ_USER_TAG; ii++) {
+		lazy = load_lazy (record);
+		check_decoded (lazy, eager, ii);
+		check_unref (lazy, 1);
+	}
+	pull ();
+
+	push ("load over the decoded values");
+	lazy = load_lazy (other_record);
+	check (camel_message_info_get_user_flag (lazy, "other"));
+	bdata = record->bdata;
+	check (camel_message_info_load (lazy, record, &bdata));
+	check (!camel_message_info_get_user_flag (lazy, "other"));
+	check_decoded (lazy, eager, READ_USER_TAG);
+	check_unref (lazy, 1);
+	check_unref (eager, 1);
+	pull ();
+
+	push ("save without reading");
+	lazy = load_lazy (record);
+	saved = save_record (lazy);
+	check_records_equal (saved, record);
+	camel_db_camel_mir_free (saved);
+
+	/* the saved record is decoded the same way */
+	saved = save_record (lazy);
+	eager = load_eager (saved);
+	check_unref (lazy, 1);
+	lazy = load_lazy (saved);
+	check_decoded (lazy, eager, READ_REFERENCES);
+	check_unref (lazy, 1);
+	check_unref (eager, 1);
+	camel_db_camel_mir_free (saved);
+	pull ();
+
+	push ("change after load");
+	lazy = load_lazy (record);
+	check (camel_message_info_set_user_tag (lazy, "follow-up", "Changed"));
+	saved = save_record (lazy);
+	check_record_column ("followup_flag", saved->followup_flag, "Changed");
+	check_record_column ("part", saved->part, record->part);
+	check_record_column ("labels", saved->labels, record->labels);
+	camel_db_camel_mir_free (saved);
+	check_unref (lazy, 1);
+	pull ();
+
+	push ("record without the values");
+	{
+		CamelMIRecord empty_record;
+
+		memset (&empty_record, 0, sizeof (CamelMIRecord));
+		empty_record.uid = "1";
+		bdata = NULL;
+
+		eager = load_eager (&empty_record);
+		lazy = camel_message_info_new (NULL);
+		check (camel_message_info_load (lazy, &empty_record, &bdata));
+
+		check (camel_message_info_get_message_id (lazy) == 0);
+		check (camel_message_info_get_message_id (lazy) == camel_message_info_get_message_id (eager));
+		check (camel_message_info_get_references (lazy) == NULL);
+		check (camel_message_info_get_user_flags (lazy) == NULL);
+		check (camel_message_info_get_user_tags (lazy) == NULL);
+
+		check_unref (lazy, 1);
+		check_unref (eager, 1);
+	}
+	pull ();
+
+	camel_db_camel_mir_free (other_record);
+	camel_db_camel_mir_free (record);
+
+	camel_test_end ();
+
+	return 0;
+}
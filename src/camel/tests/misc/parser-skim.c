@@ -0,0 +1,654 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "camel-test.h"
+
+static const gchar *messages[] = {
+	/* an attachment, with lines looking like the boundaries */
+	"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+	"From: Sender <sender@example.com>\n"
+	"Subject: mixed\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"=-mixed\"\n"
+	"\n"
+	"This is a multi-part message in MIME format.\n"
+	"--=-mixed\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"-- \n"
+	"--=-mixe\n"
+	"--=-mixedandmore\n"
+	"From the text\n"
+	"Fr\n"
+	"-\n"
+	"--=-mixed\n"
+	"Content-Type: application/octet-stream; name=\"data.bin\"\n"
+	"Content-Transfer-Encoding: base64\n"
+	"\n"
+	"QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5\n"
+	"LS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0tLS0t\n"
+	"--=-mixed--\n"
+	"postface\n"
+	"\n",
+
+	/* a nested message */
+	"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+	"From: Sender <sender@example.com>\n"
+	"Subject: forward\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"outer\"\n"
+	"\n"
+	"--outer\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"See the forwarded message.\n"
+	"--outer\n"
+	"Content-Type: message/rfc822\n"
+	"\n"
+	"From: Other <other@example.com>\n"
+	"Subject: inner\n"
+	"Content-Type: multipart/alternative; boundary=\"inner\"\n"
+	"\n"
+	"--inner\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"--oute\n"
+	"text\n"
+	"--inner\n"
+	"Content-Type: text/html\n"
+	"\n"
+	"<p>text</p>\n"
+	"--inner--\n"
+	"--outer--\n"
+	"\n",
+
+	/* a signed message */
+	"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+	"From: Sender <sender@example.com>\n"
+	"Subject: signed\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/signed; protocol=\"application/pgp-signature\"; boundary=\"sig\"\n"
+	"\n"
+	"--sig\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"Signed text\n"
+	"--sig\n"
+	"Content-Type: application/pgp-signature\n"
+	"\n"
+	"-----BEGIN PGP SIGNATURE-----\n"
+	"-----END PGP SIGNATURE-----\n"
+	"--sig--\n"
+	"\n",
+
+	/* a calendar */
+	"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+	"From: Sender <sender@example.com>\n"
+	"Subject: invitation\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: text/calendar; method=REQUEST\n"
+	"\n"
+	"BEGIN:VCALENDAR\n"
+	"END:VCALENDAR\n"
+	"\n",
+
+	/* a plain message, without the trailing new line */
+	"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+	"From: Sender <sender@example.com>\n"
+	"Subject: plain\n"
+	"\n"
+	">From the quoted line\n"
+	"-- \n"
+	"Sender"
+};
+
+/* Describes the states, except of the body content, with the offsets */
+static gchar *
+trace_parser (GBytes *bytes,
+	      gboolean skim_content,
+	      gsize read_window)
+{
+	CamelMimeParser *mp;
+	CamelMimeParserState state;
+	GString *trace;
+	gchar *buffer;
+	gsize len;
+
+	trace = g_string_new ("");
+
+	mp = camel_mime_parser_new ();
+	if (read_window)
+		camel_mime_parser_set_read_window (mp, read_window, read_window);
+	camel_mime_parser_init_with_bytes (mp, bytes);
+	camel_mime_parser_scan_from (mp, TRUE);
+	camel_mime_parser_skim_content (mp, skim_content);
+
+	while ((state = camel_mime_parser_step (mp, &buffer, &len)) != CAMEL_MIME_PARSER_STATE_EOF) {
+		CamelContentType *ct;
+
+		if (state == CAMEL_MIME_PARSER_STATE_BODY)
+			continue;
+
+		g_string_append_printf (trace, "%d at %" G_GINT64_FORMAT, state, (gint64) camel_mime_parser_tell (mp));
+
+		ct = camel_mime_parser_content_type (mp);
+		if (ct && (state == CAMEL_MIME_PARSER_STATE_HEADER ||
+			   state == CAMEL_MIME_PARSER_STATE_MULTIPART ||
+			   state == CAMEL_MIME_PARSER_STATE_MESSAGE))
+			g_string_append_printf (trace, " %s/%s from %" G_GINT64_FORMAT, ct->type, ct->subtype,
+				(gint64) camel_mime_parser_tell_start_headers (mp));
+
+		g_string_append_c (trace, '\n');
+	}
+
+	check_unref (mp, 1);
+
+	return g_string_free (trace, FALSE);
+}
+
+static GBytes *
+create_mbox (gint n_copies)
+{
+	GString *mbox;
+	gsize len;
+	gint ii, jj;
+
+	mbox = g_string_new ("");
+
+	for (ii = 0; ii < n_copies; ii++) {
+		/* the last message has no trailing new line */
+		for (jj = 0; jj < G_N_ELEMENTS (messages) - 1; jj++) {
+			g_string_append (mbox, messages[jj]);
+		}
+	}
+
+	g_string_append (mbox, messages[G_N_ELEMENTS (messages) - 1]);
+
+	len = mbox->len;
+
+	return g_bytes_new_take (g_string_free (mbox, FALSE), len);
+}
+
+static GBytes *
+create_large_mbox (void)
+{
+	GString *mbox;
+	gsize len;
+	gint ii, jj;
+
+	mbox = g_string_new ("");
+
+	for (ii = 0; ii < 500; ii++) {
+		g_string_append_printf (mbox,
+			"From sender@example.com Mon Jan  1 00:00:00 2020\n"
+			"From: Sender <sender@example.com>\n"
+			"Subject: Message %d\n"
+			"MIME-Version: 1.0\n"
+			"Content-Type: multipart/mixed; boundary=\"=-boundary\"\n"
+			"\n"
+			"--=-boundary\n"
+			"Content-Type: text/plain\n"
+			"\n"
+			"The attachment.\n"
+			"--=-boundary\n"
+			"Content-Type: application/octet-stream; name=\"data.bin\"\n"
+			"Content-Transfer-Encoding: base64\n"
+			"\n", ii);
+
+		for (jj = 0; jj < 2000; jj++) {
+			g_string_append (mbox, "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5\n");
+		}
+
+		g_string_append (mbox, "--=-boundary--\n\n");
+	}
+
+	len = mbox->len;
+
+	return g_bytes_new_take (g_string_free (mbox, FALSE), len);
+}
+
+static void
+check_traces (GBytes *bytes)
+{
+	gchar *full, *skim;
+	gsize windows[] = { 0, 4096, 1024 * 1024 };
+	gint ii;
+
+	full = trace_parser (bytes, FALSE, 0);
+
+	for (ii = 0; ii < G_N_ELEMENTS (windows); ii++) {
+		skim = trace_parser (bytes, TRUE, windows[ii]);
+		check_msg (strcmp (full, skim) == 0, "read window %d: full trace:\n%s\nskimmed trace:\n%s",
+			(gint) windows[ii], full, skim);
+		g_free (skim);
+
+		skim = trace_parser (bytes, FALSE, windows[ii]);
+		check_msg (strcmp (full, skim) == 0, "read window %d: full trace:\n%s\nother trace:\n%s",
+			(gint) windows[ii], full, skim);
+		g_free (skim);
+	}
+
+	g_free (full);
+}
+
+/* The summary without an index skims the content, the flags are from the part headers */
+static void
+check_summary_flags (void)
+{
+	CamelFolderSummary *summary;
+	CamelMimeParser *mp;
+	GBytes *bytes;
+	guint32 expected_flags[] = {
+		CAMEL_MESSAGE_ATTACHMENTS,
+		CAMEL_MESSAGE_ATTACHMENTS,
+		CAMEL_MESSAGE_SECURE,
+		0,
+		0
+	};
+	gint ii = 0;
+
+	summary = camel_folder_summary_new (NULL);
+	bytes = create_mbox (1);
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_init_with_bytes (mp, bytes);
+	camel_mime_parser_scan_from (mp, TRUE);
+
+	while (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM) {
+		CamelMessageInfo *info;
+
+		info = camel_folder_summary_info_new_from_parser (summary, mp);
+		check (info != NULL);
+		check (ii < G_N_ELEMENTS (expected_flags));
+
+		check_msg ((camel_message_info_get_flags (info) & (CAMEL_MESSAGE_ATTACHMENTS | CAMEL_MESSAGE_SECURE)) == expected_flags[ii],
+			"message %d has flags 0x%x", ii, camel_message_info_get_flags (info));
+		check_msg (camel_message_info_get_user_flag (info, "$has_cal") == (ii == 3),
+			"message %d has wrong $has_cal", ii);
+
+		g_object_unref (info);
+
+		check (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM_END);
+		ii++;
+	}
+
+	check_msg (ii == G_N_ELEMENTS (expected_flags), "expected %d messages, got %d", (gint) G_N_ELEMENTS (expected_flags), ii);
+
+	check_unref (mp, 1);
+	check_unref (summary, 1);
+	g_bytes_unref (bytes);
+}
+
+typedef struct _RefPart {
+	goffset headers_start;
+	GString *body;
+} RefPart;
+
+static void
+ref_part_free (gpointer ptr)
+{
+	RefPart *part = ptr;
+
+	if (part) {
+		if (part->body)
+			g_string_free (part->body, TRUE);
+		g_free (part);
+	}
+}
+
+static gboolean
+line_has_prefix (const gchar *line,
+		 gsize line_len,
+		 const gchar *prefix)
+{
+	gsize prefix_len = strlen (prefix);
+
+	return line_len >= prefix_len && strncmp (line, prefix, prefix_len) == 0;
+}
+
+/* The leaf parts of the messages made by create_generated_mbox(), found by
+   a plain line-by-line scan. The body of each part is without the new line
+   before the next boundary, the same as the parser returns it. */
+static GPtrArray *
+reference_scan (GBytes *bytes,
+		gboolean scan_from)
+{
+	enum {
+		STATE_TOP_HEADERS,
+		STATE_PREFACE,
+		STATE_PART_HEADERS,
+		STATE_PART_BODY,
+		STATE_POSTFACE
+	} state = STATE_TOP_HEADERS;
+	GPtrArray *parts;
+	RefPart *part = NULL;
+	gchar *boundary = NULL, *boundary_end = NULL;
+	const gchar *data;
+	gsize len, offset, line_len;
+
+	parts = g_ptr_array_new_with_free_func (ref_part_free);
+	data = g_bytes_get_data (bytes, &len);
+
+	for (offset = 0; offset < len; offset += line_len) {
+		const gchar *line = data + offset, *eol;
+
+		eol = memchr (line, '\n', len - offset);
+		line_len = eol ? eol - line + 1 : len - offset;
+
+		if (scan_from && line_has_prefix (line, line_len, "From ")) {
+			state = STATE_TOP_HEADERS;
+			part = NULL;
+			continue;
+		}
+
+		if (boundary && (state == STATE_PREFACE || state == STATE_PART_BODY) &&
+		    line_has_prefix (line, line_len, boundary)) {
+			/* the new line before the boundary belongs to it */
+			if (part && part->body->len > 0 && part->body->str[part->body->len - 1] == '\n')
+				g_string_truncate (part->body, part->body->len - 1);
+
+			part = NULL;
+
+			if (line_has_prefix (line, line_len, boundary_end)) {
+				state = STATE_POSTFACE;
+			} else {
+				part = g_new0 (RefPart, 1);
+				part->headers_start = offset + line_len;
+				g_ptr_array_add (parts, part);
+				state = STATE_PART_HEADERS;
+			}
+
+			continue;
+		}
+
+		switch (state) {
+		case STATE_TOP_HEADERS:
+			if (line_has_prefix (line, line_len, "Content-Type: multipart/mixed; boundary=\"")) {
+				const gchar *value = line + strlen ("Content-Type: multipart/mixed; boundary=\"");
+
+				g_free (boundary);
+				g_free (boundary_end);
+				boundary = g_strdup_printf ("--%.*s", (gint) (strchr (value, '"') - value), value);
+				boundary_end = g_strconcat (boundary, "--", NULL);
+			} else if (line_has_prefix (line, line_len, "\n") || line_has_prefix (line, line_len, "\r\n")) {
+				state = STATE_PREFACE;
+			}
+			break;
+		case STATE_PART_HEADERS:
+			if (line_has_prefix (line, line_len, "\n") || line_has_prefix (line, line_len, "\r\n")) {
+				part->body = g_string_new ("");
+				state = STATE_PART_BODY;
+			}
+			break;
+		case STATE_PART_BODY:
+			g_string_append_len (part->body, line, line_len);
+			break;
+		case STATE_PREFACE:
+		case STATE_POSTFACE:
+			break;
+		}
+	}
+
+	g_free (boundary);
+	g_free (boundary_end);
+
+	return parts;
+}
+
+static const gchar *body_lines[] = {
+	"Plain text.",
+	"-- ",
+	"-",
+	"--",
+	"--=-",
+	"--=-part",
+	"--=-par",
+	"F",
+	"Fro",
+	"From",
+	">From the quoted line",
+	"\tFrom the indented line",
+	"QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVphYmNkZWZnaGlqa2xtbm9wcXJzdHV2d3h5",
+	""
+};
+
+/* Messages with random bodies, with the lines looking like the boundaries
+   and the boundaries at various offsets, thus some of them straddle
+   the parser's buffer refills */
+static GBytes *
+create_generated_mbox (GRand *rand,
+		       gboolean crlf)
+{
+	const gchar *eol = crlf ? "\r\n" : "\n";
+	GString *mbox;
+	gsize len;
+	gint ii, jj, kk;
+
+	mbox = g_string_new ("");
+
+	for (ii = 0; ii < 200; ii++) {
+		gint n_parts = g_rand_int_range (rand, 1, 4);
+
+		g_string_append_printf (mbox,
+			"From sender@example.com Mon Jan  1 00:00:00 2020%s"
+			"From: Sender <sender@example.com>%s"
+			"Subject: Message %d%s"
+			"MIME-Version: 1.0%s"
+			"Content-Type: multipart/mixed; boundary=\"=-part%d\"%s"
+			"%s"
+			"preface%s",
+			eol, eol, ii, eol, eol, ii, eol, eol, eol);
+
+		for (jj = 0; jj < n_parts; jj++) {
+			gint n_lines = g_rand_int_range (rand, 0, 60);
+
+			g_string_append_printf (mbox, "--=-part%d%sContent-Type: text/plain%s%s", ii, eol, eol, eol);
+
+			for (kk = 0; kk < n_lines; kk++) {
+				const gchar *line = body_lines[g_rand_int_range (rand, 0, G_N_ELEMENTS (body_lines))];
+
+				/* vary the line lengths */
+				g_string_append_len (mbox, line, g_rand_int_range (rand, 0, strlen (line) + 1));
+				if (g_rand_boolean (rand))
+					g_string_append (mbox, line);
+				g_string_append (mbox, eol);
+			}
+		}
+
+		g_string_append_printf (mbox, "--=-part%d--%s", ii, eol);
+
+		if (g_rand_boolean (rand))
+			g_string_append_printf (mbox, "postface%s", eol);
+		g_string_append (mbox, eol);
+	}
+
+	len = mbox->len;
+
+	return g_bytes_new_take (g_string_free (mbox, FALSE), len);
+}
+
+/* The body content and the part offsets match the line-by-line scan */
+static void
+check_bodies (GBytes *bytes,
+	      gboolean skim_content,
+	      gsize read_window)
+{
+	CamelMimeParser *mp;
+	CamelMimeParserState state;
+	GPtrArray *expected;
+	GString *body = NULL;
+	gchar *buffer;
+	gsize len;
+	guint n_parts = 0;
+
+	expected = reference_scan (bytes, TRUE);
+	check (expected->len > 0);
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_set_read_window (mp, read_window, read_window);
+	camel_mime_parser_init_with_bytes (mp, bytes);
+	camel_mime_parser_scan_from (mp, TRUE);
+	camel_mime_parser_skim_content (mp, skim_content);
+
+	while ((state = camel_mime_parser_step (mp, &buffer, &len)) != CAMEL_MIME_PARSER_STATE_EOF) {
+		RefPart *part;
+
+		switch (state) {
+		case CAMEL_MIME_PARSER_STATE_HEADER:
+			check_msg (n_parts < expected->len, "more parts than the %u expected", expected->len);
+			part = g_ptr_array_index (expected, n_parts);
+
+			check_msg (camel_mime_parser_tell_start_headers (mp) == part->headers_start,
+				"part %u headers at %" G_GINT64_FORMAT ", expected at %" G_GINT64_FORMAT,
+				n_parts, (gint64) camel_mime_parser_tell_start_headers (mp), (gint64) part->headers_start);
+
+			body = g_string_new ("");
+			break;
+		case CAMEL_MIME_PARSER_STATE_BODY:
+			check (!skim_content);
+			check (body != NULL);
+			g_string_append_len (body, buffer, len);
+			break;
+		case CAMEL_MIME_PARSER_STATE_BODY_END:
+			check (body != NULL);
+			part = g_ptr_array_index (expected, n_parts);
+
+			if (!skim_content) {
+				check_msg (body->len == part->body->len && memcmp (body->str, part->body->str, body->len) == 0,
+					"part %u body differs:\n'%s'\nexpected:\n'%s'", n_parts, body->str, part->body->str);
+			}
+
+			g_string_free (body, TRUE);
+			body = NULL;
+			n_parts++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	check_msg (n_parts == expected->len, "found %u parts, expected %u", n_parts, expected->len);
+	check (body == NULL);
+
+	check_unref (mp, 1);
+	g_ptr_array_unref (expected);
+}
+
+static void
+check_generated (GRand *rand,
+		 gboolean crlf)
+{
+	GBytes *bytes;
+	gsize windows[] = { 4096, 4096 + 1021, 65536 };
+	gint ii;
+
+	bytes = create_generated_mbox (rand, crlf);
+
+	for (ii = 0; ii < G_N_ELEMENTS (windows); ii++) {
+		push ("read window %d", (gint) windows[ii]);
+		check_bodies (bytes, FALSE, windows[ii]);
+		check_bodies (bytes, TRUE, windows[ii]);
+		pull ();
+	}
+
+	check_traces (bytes);
+	g_bytes_unref (bytes);
+}
+
+static gdouble
+time_parser (GBytes *bytes,
+	     gboolean skim_content)
+{
+	GTimer *timer;
+	gdouble elapsed;
+
+	timer = g_timer_new ();
+	g_free (trace_parser (bytes, skim_content, 0));
+	g_timer_stop (timer);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return elapsed;
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GBytes *bytes;
+	GRand *rand;
+	gint ii;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Skimming the body content in CamelMimeParser");
+
+	push ("single messages");
+	for (ii = 0; ii < G_N_ELEMENTS (messages); ii++) {
+		bytes = g_bytes_new_static (messages[ii], strlen (messages[ii]));
+		check_traces (bytes);
+		g_bytes_unref (bytes);
+	}
+	pull ();
+
+	push ("mbox");
+	bytes = create_mbox (20);
+	check_traces (bytes);
+	g_bytes_unref (bytes);
+	pull ();
+
+	rand = g_rand_new_with_seed (17);
+
+	push ("generated mbox, LF");
+	check_generated (rand, FALSE);
+	pull ();
+
+	push ("generated mbox, CRLF");
+	check_generated (rand, TRUE);
+	pull ();
+
+	g_rand_free (rand);
+
+	push ("summary flags");
+	check_summary_flags ();
+	pull ();
+
+	push ("large mbox");
+	bytes = create_large_mbox ();
+	check_traces (bytes);
+	pull ();
+
+	camel_test_end ();
+
+	if (g_getenv ("CAMEL_TEST_BENCHMARK")) {
+		gdouble elapsed_full, elapsed_skim;
+
+		elapsed_full = time_parser (bytes, FALSE);
+		elapsed_skim = time_parser (bytes, TRUE);
+
+		printf ("Parsing %" G_GSIZE_FORMAT " bytes: full content %.3fs, skimmed content %.3fs\n",
+			g_bytes_get_size (bytes), elapsed_full, elapsed_skim);
+	}
+
+	g_bytes_unref (bytes);
+
+	return 0;
+}
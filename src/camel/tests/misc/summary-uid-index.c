@@ -0,0 +1,246 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* the sorted index of the numeric message UIDs in the folder summary */
+
+#include "evolution-data-server-config.h"
+
+#include <string.h>
+#include <camel/camel.h>
+
+#include "camel-test.h"
+
+static void
+add_uid (CamelFolderSummary *summary,
+	 const gchar *uid)
+{
+	CamelMessageInfo *info;
+
+	info = camel_message_info_new (summary);
+	camel_message_info_set_uid (info, uid);
+	camel_folder_summary_add (summary, info, TRUE);
+	g_object_unref (info);
+}
+
+static gboolean
+collect_uid_cb (CamelFolderSummary *summary,
+		const gchar *uid,
+		gpointer user_data)
+{
+	GString *collected = user_data;
+
+	if (collected->len)
+		g_string_append_c (collected, ' ');
+	g_string_append (collected, uid);
+
+	return TRUE;
+}
+
+static gboolean
+collect_two_uids_cb (CamelFolderSummary *summary,
+		     const gchar *uid,
+		     gpointer user_data)
+{
+	GString *collected = user_data;
+
+	collect_uid_cb (summary, uid, collected);
+
+	/* stop after the second UID */
+	return strchr (collected->str, ' ') == NULL;
+}
+
+static void
+check_foreach (CamelFolderSummary *summary,
+	       const gchar *expected)
+{
+	GString *collected = g_string_new ("");
+
+	check (camel_folder_summary_foreach_uid (summary, collect_uid_cb, collected));
+	check_msg (strcmp (collected->str, expected) == 0, "got '%s', expected '%s'", collected->str, expected);
+
+	g_string_free (collected, TRUE);
+}
+
+static void
+check_range (CamelFolderSummary *summary,
+	     guint32 first_uid,
+	     guint32 last_uid,
+	     const gchar *expected)
+{
+	GString *collected = g_string_new ("");
+
+	check (camel_folder_summary_foreach_uid_range (summary, first_uid, last_uid, collect_uid_cb, collected));
+	check_msg (strcmp (collected->str, expected) == 0, "range %u:%u got '%s', expected '%s'",
+		first_uid, last_uid, collected->str, expected);
+
+	g_string_free (collected, TRUE);
+}
+
+static void
+check_array (GArray *array,
+	     const guint32 *expected,
+	     guint n_expected)
+{
+	guint ii;
+
+	check (array != NULL);
+	check_msg (array->len == n_expected, "got %u UIDs, expected %u", array->len, n_expected);
+
+	for (ii = 0; ii < n_expected; ii++) {
+		check_msg (g_array_index (array, guint32, ii) == expected[ii], "at %u got %u, expected %u",
+			ii, g_array_index (array, guint32, ii), expected[ii]);
+	}
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	CamelFolderSummary *summary;
+	GString *collected;
+	GArray *only_in_summary = NULL, *only_in_uids = NULL;
+	guint32 uid = 0;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Numeric UID index of the folder summary");
+
+	summary = camel_folder_summary_new (NULL);
+	camel_folder_summary_set_flags (summary, camel_folder_summary_get_flags (summary) | CAMEL_FOLDER_SUMMARY_IN_MEMORY_ONLY);
+
+	push ("empty summary");
+	check (camel_folder_summary_has_numeric_uids (summary));
+	check (!camel_folder_summary_get_nth_numeric_uid (summary, 0, &uid));
+	check (!camel_folder_summary_check_numeric_uid (summary, 1));
+	check_foreach (summary, "");
+	pull ();
+
+	push ("insert");
+	/* out of order and with numbers of a different length, which strcmp() sorts differently */
+	add_uid (summary, "30");
+	add_uid (summary, "4");
+	add_uid (summary, "100");
+	add_uid (summary, "7");
+	add_uid (summary, "12");
+	check (camel_folder_summary_has_numeric_uids (summary));
+	check (camel_folder_summary_get_nth_numeric_uid (summary, 0, &uid) && uid == 4);
+	check (camel_folder_summary_get_nth_numeric_uid (summary, 2, &uid) && uid == 12);
+	check (camel_folder_summary_get_nth_numeric_uid (summary, 4, &uid) && uid == 100);
+	check (!camel_folder_summary_get_nth_numeric_uid (summary, 5, &uid));
+	check (camel_folder_summary_check_numeric_uid (summary, 7));
+	check (!camel_folder_summary_check_numeric_uid (summary, 8));
+	check_foreach (summary, "4 7 12 30 100");
+	pull ();
+
+	push ("remove");
+	check (camel_folder_summary_remove_uid (summary, "12"));
+	check (!camel_folder_summary_check_numeric_uid (summary, 12));
+	check (camel_folder_summary_get_nth_numeric_uid (summary, 2, &uid) && uid == 30);
+	check_foreach (summary, "4 7 30 100");
+	add_uid (summary, "12");
+	add_uid (summary, "50");
+	check_foreach (summary, "4 7 12 30 50 100");
+	pull ();
+
+	push ("ranges");
+	check_range (summary, 0, G_MAXUINT32, "4 7 12 30 50 100");
+	check_range (summary, 7, 30, "7 12 30");
+	check_range (summary, 8, 29, "12");
+	check_range (summary, 13, 29, "");
+	check_range (summary, 101, G_MAXUINT32, "");
+	check_range (summary, 50, 50, "50");
+
+	collected = g_string_new ("");
+	check (!camel_folder_summary_foreach_uid_range (summary, 5, 100, collect_two_uids_cb, collected));
+	check_msg (strcmp (collected->str, "7 12") == 0, "got '%s'", collected->str);
+	g_string_truncate (collected, 0);
+	check (!camel_folder_summary_foreach_uid (summary, collect_two_uids_cb, collected));
+	check_msg (strcmp (collected->str, "4 7") == 0, "got '%s'", collected->str);
+	g_string_free (collected, TRUE);
+	pull ();
+
+	push ("diff");
+	{
+		const guint32 server_uids[] = { 1, 4, 4, 12, 30, 31, 31, 100, 200 };
+		const guint32 expect_only_in_summary[] = { 7, 50 };
+		const guint32 expect_only_in_uids[] = { 1, 31, 200 };
+
+		check (camel_folder_summary_diff_numeric_uids (summary, server_uids, G_N_ELEMENTS (server_uids), &only_in_summary, &only_in_uids));
+		check_array (only_in_summary, expect_only_in_summary, G_N_ELEMENTS (expect_only_in_summary));
+		check_array (only_in_uids, expect_only_in_uids, G_N_ELEMENTS (expect_only_in_uids));
+		g_array_unref (only_in_summary);
+		g_array_unref (only_in_uids);
+		only_in_summary = NULL;
+		only_in_uids = NULL;
+	}
+
+	{
+		const guint32 expect_all[] = { 4, 7, 12, 30, 50, 100 };
+
+		check (camel_folder_summary_diff_numeric_uids (summary, NULL, 0, &only_in_summary, NULL));
+		check_array (only_in_summary, expect_all, G_N_ELEMENTS (expect_all));
+		g_array_unref (only_in_summary);
+		only_in_summary = NULL;
+	}
+	pull ();
+
+	push ("non-numeric fallback");
+	add_uid (summary, "x1");
+	check (!camel_folder_summary_has_numeric_uids (summary));
+	check (!camel_folder_summary_get_nth_numeric_uid (summary, 0, &uid));
+	check (camel_folder_summary_check_numeric_uid (summary, 30));
+	check (!camel_folder_summary_check_numeric_uid (summary, 31));
+	check_foreach (summary, "100 12 30 4 50 7 x1");
+
+	collected = g_string_new ("");
+	check (!camel_folder_summary_foreach_uid_range (summary, 0, G_MAXUINT32, collect_uid_cb, collected));
+	check (collected->len == 0);
+	g_string_free (collected, TRUE);
+
+	check (!camel_folder_summary_diff_numeric_uids (summary, &uid, 1, &only_in_summary, &only_in_uids));
+	check (only_in_summary == NULL);
+	check (only_in_uids == NULL);
+
+	add_uid (summary, "5");
+	check_foreach (summary, "100 12 30 4 5 50 7 x1");
+	check (camel_folder_summary_remove_uid (summary, "x1"));
+	check (camel_folder_summary_has_numeric_uids (summary));
+	check_foreach (summary, "4 5 7 12 30 50 100");
+	check (camel_folder_summary_get_nth_numeric_uid (summary, 1, &uid) && uid == 5);
+	pull ();
+
+	push ("remove all");
+	{
+		GPtrArray *uids;
+		guint ii;
+
+		uids = camel_folder_summary_get_array (summary);
+		check (uids != NULL && uids->len == 7);
+		for (ii = 0; ii < uids->len; ii++)
+			check (camel_folder_summary_remove_uid (summary, g_ptr_array_index (uids, ii)));
+		camel_folder_summary_free_array (uids);
+	}
+	check (camel_folder_summary_count (summary) == 0);
+	check (camel_folder_summary_has_numeric_uids (summary));
+	check (!camel_folder_summary_check_numeric_uid (summary, 4));
+	check_foreach (summary, "");
+	pull ();
+
+	check_unref (summary, 1);
+
+	camel_test_end ();
+
+	return 0;
+}
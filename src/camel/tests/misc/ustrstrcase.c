@@ -0,0 +1,233 @@
+/*
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-data-server-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <camel/camel-search-private.h>
+
+#include "camel-test.h"
+
+#define BENCHMARK_ROUNDS 200
+
+static struct {
+	const gchar *haystack;
+	const gchar *needle;
+	gint match_at; /* byte offset of the match, or -1 */
+} find_tests[] = {
+	{ "Hello, the meeting is on Tuesday.", "MEETING", 11 },
+	{ "Hello, the meeting is on Tuesday.", "tuesday.", 25 },
+	{ "Hello, the meeting is on Tuesday.", "meetings", -1 },
+	{ "Hello", "", 0 },
+	{ "", "a", -1 },
+	{ "Příliš žluťoučký kůň úpěl ďábelské ódy", "ŽLUŤOUČKÝ", 10 },
+	{ "Příliš žluťoučký kůň úpěl ďábelské ódy", "ÓDY", 49 },
+	{ "Příliš žluťoučký kůň úpěl ďábelské ódy", "kun", -1 },
+	{ "Temperature in \xe2\x84\xaa", "in k", 12 },
+	{ "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", "AAB", 47 },
+	{ "Re: [evolution-list] Calendar does not refresh the ICS file", "ics file", 51 },
+	{ "Re: [evolution-list] Calendar does not refresh the ICS file", "ics filex", -1 },
+	{ "éééééééééééééééééééééééééééééééééééééééééÉ", "ÉÉ", 0 },
+	{ "0123456789abcdef0123456789ABCDEF", "fABC", -1 },
+	{ "0123456789abcdef0123456789ABCDEF", "F012", 15 }
+};
+
+static const gchar *subject_words[] = {
+	"Re:", "Fwd:", "[list]", "meeting", "notes", "Tuesday", "Invoice", "number", "calendar",
+	"Příliš", "žluťoučký", "kůň", "Grüße", "aus", "München", "report", "quarterly", "ÚČET"
+};
+
+static const gchar *address_parts[] = {
+	"John Doe <john.doe@example.com>", "Jana Nováková <jana@example.cz>",
+	"\"Müller, Jürgen\" <juergen.mueller@example.de>", "list@lists.example.org",
+	"Support Team <support@example.net>"
+};
+
+static const gchar *needles[] = {
+	"meeting", "EXAMPLE.ORG", "nováková", "grüsse", "münchen", "xyz", "úč"
+};
+
+/* The former per-character implementation, as a reference */
+static const gchar *
+reference_ustrstrcase (const gchar *haystack,
+		       const gchar *needle)
+{
+	gunichar *nuni, *puni;
+	gunichar u;
+	const guchar *p;
+
+	if (!*needle)
+		return haystack;
+
+	puni = nuni = g_alloca (sizeof (gunichar) * (strlen (needle) + 1));
+
+	p = (const guchar *) needle;
+	while ((u = camel_utf8_getc (&p)))
+		*puni++ = g_unichar_tolower (u);
+
+	p = (const guchar *) haystack;
+	while ((u = camel_utf8_getc (&p))) {
+		if (g_unichar_tolower (u) == nuni[0]) {
+			const guchar *q = p;
+			gint npos = 1;
+
+			while (nuni + npos < puni) {
+				u = camel_utf8_getc (&q);
+				if (!u || g_unichar_tolower (u) != nuni[npos])
+					break;
+				npos++;
+			}
+
+			if (nuni + npos == puni)
+				return (const gchar *) p;
+		}
+	}
+
+	return NULL;
+}
+
+static GPtrArray *
+build_corpus (void)
+{
+	GPtrArray *corpus;
+	gint ii, jj;
+
+	corpus = g_ptr_array_new_with_free_func (g_free);
+
+	for (ii = 0; ii < 2000; ii++) {
+		GString *str = g_string_new ("");
+
+		for (jj = 0; jj < 4 + ii % 7; jj++) {
+			if (jj)
+				g_string_append_c (str, ' ');
+			g_string_append (str, subject_words[(ii * 7 + jj * 3) % G_N_ELEMENTS (subject_words)]);
+		}
+
+		g_ptr_array_add (corpus, g_string_free (str, FALSE));
+		g_ptr_array_add (corpus, g_strdup (address_parts[ii % G_N_ELEMENTS (address_parts)]));
+	}
+
+	return corpus;
+}
+
+static void
+run_benchmark (GPtrArray *corpus)
+{
+	GTimer *timer;
+	gdouble elapsed_reference, elapsed_needle;
+	gint ii, jj, kk, n_reference = 0, n_needle = 0;
+
+	timer = g_timer_new ();
+
+	for (kk = 0; kk < BENCHMARK_ROUNDS; kk++) {
+		for (ii = 0; ii < G_N_ELEMENTS (needles); ii++) {
+			for (jj = 0; jj < corpus->len; jj++) {
+				if (reference_ustrstrcase (g_ptr_array_index (corpus, jj), needles[ii]))
+					n_reference++;
+			}
+		}
+	}
+
+	elapsed_reference = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (kk = 0; kk < BENCHMARK_ROUNDS; kk++) {
+		for (ii = 0; ii < G_N_ELEMENTS (needles); ii++) {
+			CamelSearchNeedle *needle = camel_search_needle_new (needles[ii]);
+
+			for (jj = 0; jj < corpus->len; jj++) {
+				if (camel_search_needle_find (needle, g_ptr_array_index (corpus, jj), NULL))
+					n_needle++;
+			}
+
+			camel_search_needle_free (needle);
+		}
+	}
+
+	elapsed_needle = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	printf ("Searching %d needles in %d values %d times: per-character %.3fs, compiled needle %.3fs, %s results\n",
+		(gint) G_N_ELEMENTS (needles), corpus->len, BENCHMARK_ROUNDS, elapsed_reference, elapsed_needle,
+		n_reference == n_needle ? "same" : "different");
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GPtrArray *corpus;
+	gint ii, jj;
+
+	camel_test_init (argc, argv);
+
+	camel_test_start ("Case-insensitive substring search");
+
+	for (ii = 0; ii < G_N_ELEMENTS (find_tests); ii++) {
+		CamelSearchNeedle *needle;
+		const gchar *found, *found_end = NULL;
+
+		camel_test_push ("find %d '%s' in '%s'", ii, find_tests[ii].needle, find_tests[ii].haystack);
+
+		needle = camel_search_needle_new (find_tests[ii].needle);
+		found = camel_search_needle_find (needle, find_tests[ii].haystack, &found_end);
+
+		if (find_tests[ii].match_at < 0) {
+			check_msg (found == NULL, "found at %d", (gint) (found - find_tests[ii].haystack));
+		} else {
+			check_msg (found != NULL, "not found");
+			check_msg (found - find_tests[ii].haystack == find_tests[ii].match_at,
+				"found at %d, expected %d", (gint) (found - find_tests[ii].haystack), find_tests[ii].match_at);
+			check (found_end != NULL && found_end >= found);
+		}
+
+		check ((camel_ustrstrcase (find_tests[ii].haystack, find_tests[ii].needle) != NULL) == (find_tests[ii].match_at >= 0));
+
+		camel_search_needle_free (needle);
+		camel_test_pull ();
+	}
+
+	camel_test_end ();
+
+	camel_test_start ("Case-insensitive substring search of subjects and addresses");
+
+	corpus = build_corpus ();
+
+	camel_test_push ("results match the reference implementation");
+	for (ii = 0; ii < G_N_ELEMENTS (needles); ii++) {
+		CamelSearchNeedle *needle = camel_search_needle_new (needles[ii]);
+
+		for (jj = 0; jj < corpus->len; jj++) {
+			const gchar *value = g_ptr_array_index (corpus, jj);
+
+			check_msg ((reference_ustrstrcase (value, needles[ii]) != NULL) == (camel_search_needle_find (needle, value, NULL) != NULL),
+				"'%s' in '%s'", needles[ii], value);
+		}
+
+		camel_search_needle_free (needle);
+	}
+	camel_test_pull ();
+
+	camel_test_end ();
+
+	if (g_getenv ("CAMEL_TEST_BENCHMARK"))
+		run_benchmark (corpus);
+
+	g_ptr_array_unref (corpus);
+
+	return 0;
+}